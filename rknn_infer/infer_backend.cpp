@@ -0,0 +1,97 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 模拟推理后端实现
+ */
+#include <cstring>
+#include <cstdlib>
+#include "infer_backend.h"
+#include "utils_log.h"
+
+MockInferBackend::MockInferBackend(uint32_t context_num, uint32_t model_batch, uint32_t input_size,
+                                   uint32_t output_size, uint32_t base_us, uint32_t item_us,
+                                   rknn_tensor_type input_type) {
+    m_context_num = context_num == 0 ? 1 : context_num;
+    m_model_batch = model_batch == 0 ? 1 : model_batch;
+    m_base_us = base_us;
+    m_item_us = item_us;
+    // 输出至少能放下校验和
+    output_size = output_size < sizeof(uint64_t) ? sizeof(uint64_t) : output_size;
+
+    // 与 RKNN 的 tensor 信息一致：size 为整个 batch 的字节数
+    m_input_attr.index = 0;
+    m_input_attr.n_dims = 2;
+    m_input_attr.dims[0] = m_model_batch;
+    m_input_attr.dims[1] = input_size;
+    m_input_attr.n_elems = m_model_batch * input_size;
+    m_input_attr.size = m_model_batch * input_size * (input_type == RKNN_TENSOR_FLOAT16 ? 2 : 1);
+    m_input_attr.fmt = RKNN_TENSOR_NHWC;
+    m_input_attr.type = input_type;
+    strncpy(m_input_attr.name, "mock_input", sizeof(m_input_attr.name) - 1);
+
+    m_output_attr.index = 0;
+    m_output_attr.n_dims = 2;
+    m_output_attr.dims[0] = m_model_batch;
+    m_output_attr.dims[1] = output_size;
+    m_output_attr.n_elems = m_model_batch * output_size;
+    m_output_attr.size = m_model_batch * output_size;
+    m_output_attr.fmt = RKNN_TENSOR_NHWC;
+    m_output_attr.type = RKNN_TENSOR_UINT8;
+    strncpy(m_output_attr.name, "mock_output", sizeof(m_output_attr.name) - 1);
+
+    m_config.io_num.n_input = 1;
+    m_config.io_num.n_output = 1;
+    m_config.input_attr = &m_input_attr;
+    m_config.output_attr = &m_output_attr;
+    d_rknn_infer_info("mock backend: %d contexts, batch %d, input %d bytes, output %d bytes, cost %d + %d us",
+                      (int)m_context_num, (int)m_model_batch, (int)input_size, (int)output_size, (int)base_us,
+                      (int)item_us)
+}
+
+MockInferBackend::~MockInferBackend() = default;
+
+uint64_t MockInferBackend::checksum(const uint8_t *data, uint32_t size) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+RetStatus MockInferBackend::infer(uint32_t ctx, uint32_t n_inputs, rknn_input *inputs, uint32_t n_outputs,
+                                  rknn_output *outputs) {
+    // 与 rknn_inputs_set 一致：uint8 输入的大小为元素个数
+    CHECK_VAL(ctx >= m_context_num || n_inputs != 1 || n_outputs != 1 || inputs[0].type != RKNN_TENSOR_UINT8 ||
+              inputs[0].size != m_input_attr.n_elems,
+              return RET_STATUS_FAILED;)
+    time_unit t_start = getTimeOfNs();
+    uint32_t item_in = m_input_attr.n_elems / m_model_batch;
+    uint32_t item_out = m_output_attr.size / m_model_batch;
+    auto *out = (uint8_t *)malloc(m_output_attr.size);
+    CHECK_VAL(out == nullptr, return RET_STATUS_FAILED;)
+    memset(out, 0, m_output_attr.size);
+    for (uint32_t b = 0; b < m_model_batch; b++) {
+        uint64_t sum = checksum((const uint8_t *)inputs[0].buf + (size_t)b * item_in, item_in);
+        memcpy(out + (size_t)b * item_out, &sum, sizeof(sum));
+    }
+    outputs[0].buf = out;
+    outputs[0].size = m_output_attr.size;
+    outputs[0].index = 0;
+
+    // 模拟 NPU 耗时（扣除上面计算校验和的时间）
+    time_unit cost_us = (getTimeOfNs() - t_start) / 1000;
+    time_unit total_us = m_base_us + (time_unit)m_item_us * m_model_batch;
+    if (cost_us < total_us) {
+        sleepUS(total_us - cost_us);
+    }
+    return RET_STATUS_SUCCESS;
+}
+
+RetStatus MockInferBackend::release(uint32_t ctx, uint32_t n_outputs, rknn_output *outputs) {
+    for (uint32_t i = 0; i < n_outputs; i++) {
+        free(outputs[i].buf);
+        outputs[i].buf = nullptr;
+    }
+    return RET_STATUS_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 推理服务的推理后端：一组可以并发推理的上下文（RKNN 模型上下文池或模拟后端），
+ *         每个上下文同一时间只由一个服务线程使用
+ */
+#ifndef RKNN_INFER_INFER_BACKEND_H
+#define RKNN_INFER_INFER_BACKEND_H
+
+#include <vector>
+#include "rknn_api.h"
+#include "utils.h"
+#include "rknn_infer_api.h"
+
+class InferBackend {
+public:
+    virtual ~InferBackend() = default;
+
+    [[nodiscard]] virtual bool is_init() const = 0;
+    // 上下文个数
+    [[nodiscard]] virtual uint32_t context_num() const = 0;
+    // 模型输入的 batch（输入第一维），大于 1 时服务端把一批请求拼接后一次推理
+    [[nodiscard]] virtual uint32_t model_batch() const { return 1; };
+    // 输入输出 tensor 信息
+    [[nodiscard]] virtual const PluginConfigSet &model_config() const = 0;
+
+    // 在上下文 ctx 上推理，输出由后端分配，用完后调用 release
+    virtual RetStatus infer(uint32_t ctx, uint32_t n_inputs, rknn_input *inputs, uint32_t n_outputs,
+                            rknn_output *outputs) = 0;
+    virtual RetStatus release(uint32_t ctx, uint32_t n_outputs, rknn_output *outputs) = 0;
+};
+
+// 模拟后端：不依赖 NPU，用于开发机上压测服务本身。
+// 单输入单输出，每次推理耗时 base_us + item_us * model_batch，
+// 每个 batch 项的输出开头 8 字节为对应输入的字节和，便于客户端校验；
+// input_type 只影响 tensor 信息中的 size（模拟非量化模型），送入的数据总是 uint8
+class MockInferBackend : public InferBackend {
+public:
+    MockInferBackend(uint32_t context_num, uint32_t model_batch, uint32_t input_size, uint32_t output_size,
+                     uint32_t base_us, uint32_t item_us, rknn_tensor_type input_type = RKNN_TENSOR_UINT8);
+    ~MockInferBackend() override;
+
+    [[nodiscard]] bool is_init() const override { return true; };
+    [[nodiscard]] uint32_t context_num() const override { return m_context_num; };
+    [[nodiscard]] uint32_t model_batch() const override { return m_model_batch; };
+    [[nodiscard]] const PluginConfigSet &model_config() const override { return m_config; };
+
+    RetStatus infer(uint32_t ctx, uint32_t n_inputs, rknn_input *inputs, uint32_t n_outputs,
+                    rknn_output *outputs) override;
+    RetStatus release(uint32_t ctx, uint32_t n_outputs, rknn_output *outputs) override;
+
+    // 客户端校验输出用
+    static uint64_t checksum(const uint8_t *data, uint32_t size);
+
+private:
+    uint32_t m_context_num;
+    uint32_t m_model_batch;
+    uint32_t m_base_us;
+    uint32_t m_item_us;
+    PluginConfigSet m_config{};
+    rknn_tensor_attr m_input_attr{};
+    rknn_tensor_attr m_output_attr{};
+};
+
+#endif //RKNN_INFER_INFER_BACKEND_H
@@ -0,0 +1,283 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务客户端实现
+ */
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "infer_client.h"
+#include "utils_log.h"
+
+static int recv_full(int fd, void *buf, size_t len) {
+    auto *ptr = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, ptr, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 发送全部数据，data_fd >= 0 时随第一段数据传递
+static int send_iov(int fd, struct iovec *iov, int iov_cnt, int data_fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control{};
+    while (iov_cnt > 0) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_cnt;
+        if (data_fd >= 0) {
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &data_fd, sizeof(int));
+        }
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        data_fd = -1;
+        while (iov_cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iov_cnt--;
+        }
+        if (iov_cnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+InferClient::InferClient(const std::string &socket_path, uint32_t fd_threshold) {
+    m_fd_threshold = fd_threshold;
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    CHECK_VAL(socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path),
+              d_rknn_infer_error("invalid socket path %s", socket_path.c_str()); return;)
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK_VAL(fd < 0, d_rknn_infer_error("socket failed: %s", strerror(errno)); return;)
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        d_rknn_infer_error("connect %s failed: %s", socket_path.c_str(), strerror(errno))
+        ::close(fd);
+        return;
+    }
+    m_fd = fd;
+    m_recv_thread = std::thread([this] { recv_thread(); });
+}
+
+InferClient::~InferClient() {
+    close();
+}
+
+void InferClient::close() {
+    if (m_fd < 0) {
+        return;
+    }
+    shutdown(m_fd, SHUT_RDWR);
+    if (m_recv_thread.joinable()) {
+        m_recv_thread.join();
+    }
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+uint32_t InferClient::pending() const {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    return (uint32_t)m_pending.size();
+}
+
+int InferClient::send_request(InferRequestHeader &header, const InferClientInput *inputs, int data_fd,
+                              Callback callback, uint64_t *request_id) {
+    CHECK_VAL(m_fd < 0, return -1;)
+    header.magic = INFER_SERVER_MAGIC;
+    header.version = INFER_SERVER_VERSION;
+    header.request_id = m_next_id++;
+    header.flags = data_fd >= 0 ? INFER_REQUEST_DATA_FD : 0;
+
+    struct iovec iov[INFER_MAX_INPUTS + 1];
+    iov[0] = {&header, sizeof(header)};
+    int iov_cnt = 1;
+    for (uint32_t i = 0; data_fd < 0 && i < header.n_inputs; i++) {
+        iov[iov_cnt++] = {(void *)inputs[i].data, inputs[i].size};
+    }
+    // 先登记再发送，响应可能在 sendmsg 返回前到达
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending[header.request_id] = {std::move(callback), getTimeOfNs()};
+    }
+    int ret = -1;
+    // 接收线程已退出时不会再有回调
+    if (!m_disconnected) {
+        std::lock_guard<std::mutex> lock(m_send_mutex);
+        ret = send_iov(m_fd, iov, iov_cnt, data_fd);
+    }
+    if (ret != 0) {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending.erase(header.request_id);
+        return -1;
+    }
+    CHECK_VAL(request_id != nullptr, *request_id = header.request_id;)
+    return 0;
+}
+
+int InferClient::submit(const InferClientInput *inputs, uint32_t n_inputs, Callback callback, uint64_t *request_id) {
+    CHECK_VAL(n_inputs == 0 || n_inputs > INFER_MAX_INPUTS, return -1;)
+    InferRequestHeader header{};
+    header.n_inputs = n_inputs;
+    size_t total = 0;
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        header.input_size[i] = inputs[i].size;
+        total += inputs[i].size;
+    }
+    if (total <= m_fd_threshold) {
+        return send_request(header, inputs, -1, std::move(callback), request_id);
+    }
+
+    // 大输入写入 memfd，服务端直接映射
+    int data_fd = memfd_create("infer_input", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    CHECK_VAL(data_fd < 0, d_rknn_infer_error("memfd_create failed: %s", strerror(errno)); return -1;)
+    void *addr = MAP_FAILED;
+    if (ftruncate(data_fd, (off_t)total) == 0) {
+        addr = mmap(nullptr, total, PROT_WRITE, MAP_SHARED, data_fd, 0);
+    }
+    if (addr == MAP_FAILED) {
+        d_rknn_infer_error("map input buffer of %lu bytes failed", (unsigned long)total)
+        ::close(data_fd);
+        return -1;
+    }
+    size_t offset = 0;
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        memcpy((uint8_t *)addr + offset, inputs[i].data, inputs[i].size);
+        offset += inputs[i].size;
+    }
+    munmap(addr, total);
+    // 服务端只接受不能再改变大小的 fd
+    if (fcntl(data_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        d_rknn_infer_error("seal input buffer failed: %s", strerror(errno))
+        ::close(data_fd);
+        return -1;
+    }
+    int ret = send_request(header, nullptr, data_fd, std::move(callback), request_id);
+    ::close(data_fd);
+    return ret;
+}
+
+int InferClient::submit_fd(int data_fd, const uint32_t *input_size, uint32_t n_inputs, Callback callback,
+                           uint64_t *request_id) {
+    CHECK_VAL(data_fd < 0 || n_inputs == 0 || n_inputs > INFER_MAX_INPUTS, return -1;)
+    InferRequestHeader header{};
+    header.n_inputs = n_inputs;
+    for (uint32_t i = 0; i < n_inputs; i++) {
+        header.input_size[i] = input_size[i];
+    }
+    return send_request(header, nullptr, data_fd, std::move(callback), request_id);
+}
+
+int InferClient::infer(const InferClientInput *inputs, uint32_t n_inputs, InferResult &result, int timeout_ms) {
+    struct SyncState {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        InferResult result;
+    };
+    // 超时返回后回调仍可能执行，状态由回调共同持有
+    auto state = std::make_shared<SyncState>();
+    int ret = submit(inputs, n_inputs, [state](InferResult &r) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->result = std::move(r);
+        state->done = true;
+        state->cond.notify_one();
+    });
+    CHECK_VAL(ret != 0, return -1;)
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (timeout_ms < 0) {
+        state->cond.wait(lock, [&state] { return state->done; });
+    } else if (!state->cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&state] { return state->done; })) {
+        return 1;
+    }
+    result = std::move(state->result);
+    return result.status == INFER_STATUS_DISCONNECTED ? -1 : 0;
+}
+
+void InferClient::recv_thread() {
+    while (true) {
+        InferResponseHeader header{};
+        if (recv_full(m_fd, &header, sizeof(header)) != 0) {
+            break;
+        }
+        if (header.magic != INFER_SERVER_MAGIC || header.version != INFER_SERVER_VERSION ||
+            header.n_outputs > INFER_MAX_OUTPUTS) {
+            d_rknn_infer_error("invalid response from server")
+            break;
+        }
+        InferResult result;
+        result.request_id = header.request_id;
+        result.status = header.status;
+        result.batch_size = header.batch_size;
+        result.queue_us = header.queue_us;
+        result.infer_us = header.infer_us;
+        result.server_us = header.server_us;
+        result.outputs.resize(header.n_outputs);
+        bool failed = false;
+        for (uint32_t i = 0; i < header.n_outputs && !failed; i++) {
+            result.outputs[i].resize(header.output_size[i]);
+            failed = header.output_size[i] > 0 &&
+                     recv_full(m_fd, result.outputs[i].data(), header.output_size[i]) != 0;
+        }
+        if (failed) {
+            break;
+        }
+
+        Pending pending;
+        {
+            std::lock_guard<std::mutex> lock(m_pending_mutex);
+            auto it = m_pending.find(header.request_id);
+            if (it == m_pending.end()) {
+                continue;
+            }
+            pending = std::move(it->second);
+            m_pending.erase(it);
+        }
+        result.rtt_us = (uint32_t)((getTimeOfNs() - pending.send_ns) / 1000);
+        CHECK_VAL(pending.callback, pending.callback(result);)
+    }
+
+    // 连接断开，通知所有未返回的请求
+    m_disconnected = true;
+    shutdown(m_fd, SHUT_RDWR);
+    std::unordered_map<uint64_t, Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        pending.swap(m_pending);
+    }
+    for (auto &it : pending) {
+        InferResult result;
+        result.request_id = it.first;
+        CHECK_VAL(it.second.callback, it.second.callback(result);)
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务客户端：异步提交请求，接收线程按 request_id 回调结果；
+ *         超过阈值的输入写入 memfd 后传递 fd，不经过套接字拷贝。不依赖 RKNN 库
+ */
+#ifndef RKNN_INFER_INFER_CLIENT_H
+#define RKNN_INFER_INFER_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include "utils.h"
+#include "infer_server_protocol.h"
+
+// 输入总大小超过该值时使用 fd 传递
+#define INFER_CLIENT_FD_THRESHOLD (64 * 1024)
+
+// 连接断开时回调的状态
+#define INFER_STATUS_DISCONNECTED (-1)
+
+struct InferClientInput {
+    const void *data;
+    uint32_t size;
+};
+
+struct InferResult {
+    uint64_t request_id = 0;
+    int status = INFER_STATUS_DISCONNECTED;
+    std::vector<std::vector<uint8_t>> outputs;
+    // 服务端返回的耗时信息
+    uint32_t batch_size = 0;
+    uint32_t queue_us = 0;
+    uint32_t infer_us = 0;
+    uint32_t server_us = 0;
+    // 提交到收到响应的时间
+    uint32_t rtt_us = 0;
+};
+
+class InferClient {
+public:
+    // 回调在接收线程中执行，不要在回调中阻塞
+    using Callback = std::function<void(InferResult &result)>;
+
+    explicit InferClient(const std::string &socket_path, uint32_t fd_threshold = INFER_CLIENT_FD_THRESHOLD);
+    ~InferClient();
+
+    InferClient(const InferClient &) = delete;
+    InferClient &operator=(const InferClient &) = delete;
+
+    [[nodiscard]] bool is_init() const { return m_fd >= 0; };
+
+    // 异步提交，可以多线程调用；返回 0 成功，-1 连接已断开
+    int submit(const InferClientInput *inputs, uint32_t n_inputs, Callback callback, uint64_t *request_id = nullptr);
+    // 输入已经在 fd 中时直接传递，各输入从偏移 0 依次排列，fd 由调用者关闭；
+    // fd 需要是已加 F_SEAL_SHRINK 的 memfd（memfd_create 时带 MFD_ALLOW_SEALING），否则服务端返回 BAD_REQUEST
+    int submit_fd(int data_fd, const uint32_t *input_size, uint32_t n_inputs, Callback callback,
+                  uint64_t *request_id = nullptr);
+
+    // 同步推理，返回 0 收到响应（检查 result.status），1 超时，-1 连接已断开
+    int infer(const InferClientInput *inputs, uint32_t n_inputs, InferResult &result, int timeout_ms = -1);
+
+    // 已提交未返回的请求个数
+    [[nodiscard]] uint32_t pending() const;
+
+    // 断开连接，未返回的请求以 INFER_STATUS_DISCONNECTED 回调
+    void close();
+
+private:
+    struct Pending {
+        Callback callback;
+        time_unit send_ns;
+    };
+
+    int send_request(InferRequestHeader &header, const InferClientInput *inputs, int data_fd, Callback callback,
+                     uint64_t *request_id);
+    void recv_thread();
+
+private:
+    int m_fd = -1;
+    uint32_t m_fd_threshold;
+    std::atomic<uint64_t> m_next_id{1};
+    std::atomic<bool> m_disconnected{false};
+    std::mutex m_send_mutex;
+    mutable std::mutex m_pending_mutex;
+    std::unordered_map<uint64_t, Pending> m_pending;
+    std::thread m_recv_thread;
+};
+
+#endif //RKNN_INFER_INFER_CLIENT_H
@@ -0,0 +1,165 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.28
+ * @brief: 推理结果缓存实现
+ */
+#include <cstring>
+#include "infer_result_cache.h"
+#include "utils_log.h"
+
+// 分块均值隔行隔列采样
+#define INFER_CACHE_SAMPLE_STEP (2)
+
+InferResultCache::InferResultCache(const InferCacheConfig &config, const PluginConfigSet &model_config) {
+    m_config = config;
+    m_config.max_entries = m_config.max_entries == 0 ? 1 : m_config.max_entries;
+    if (!m_config.enable || model_config.io_num.n_input == 0 || model_config.input_attr == nullptr) {
+        m_config.enable = false;
+        return;
+    }
+    // 插件按 NHWC 传入数据，模型输入为 NCHW 时维度顺序不同
+    const rknn_tensor_attr &attr = model_config.input_attr[0];
+    if (attr.n_dims == 4 && attr.fmt == RKNN_TENSOR_NCHW) {
+        m_channel = attr.dims[1];
+        m_height = attr.dims[2];
+        m_width = attr.dims[3];
+    } else if (attr.n_dims == 4) {
+        m_height = attr.dims[1];
+        m_width = attr.dims[2];
+        m_channel = attr.dims[3];
+    }
+    if (m_height < INFER_CACHE_GRID || m_width < INFER_CACHE_GRID || m_channel == 0) {
+        d_rknn_infer_warn("infer cache disabled: model input is not an image")
+        m_config.enable = false;
+        return;
+    }
+    d_rknn_infer_info("infer cache: input %dx%dx%d, max distance %d, max age %d ms, %d entries", (int)m_width,
+                      (int)m_height, (int)m_channel, (int)m_config.max_distance, (int)m_config.max_age_ms,
+                      (int)m_config.max_entries)
+}
+
+void InferResultCache::compute_hash(const InputUnit &input, InferCacheHash &hash) const {
+    hash.valid = false;
+    if (!m_config.enable || input.n_inputs == 0 || input.inputs == nullptr) {
+        return;
+    }
+    const rknn_input &in = input.inputs[0];
+    size_t row_size = (size_t)m_width * m_channel;
+    if (in.pass_through || in.type != RKNN_TENSOR_UINT8 || in.fmt != RKNN_TENSOR_NHWC || in.buf == nullptr ||
+        in.size != row_size * m_height) {
+        return;
+    }
+    const auto *data = (const uint8_t *)in.buf;
+    for (uint32_t gy = 0; gy < INFER_CACHE_GRID; gy++) {
+        uint32_t y_begin = gy * m_height / INFER_CACHE_GRID;
+        uint32_t y_end = (gy + 1) * m_height / INFER_CACHE_GRID;
+        uint32_t sums[INFER_CACHE_GRID] = {};
+        uint32_t counts[INFER_CACHE_GRID] = {};
+        for (uint32_t y = y_begin; y < y_end; y += INFER_CACHE_SAMPLE_STEP) {
+            const uint8_t *row = data + y * row_size;
+            for (uint32_t gx = 0; gx < INFER_CACHE_GRID; gx++) {
+                uint32_t x_begin = gx * m_width / INFER_CACHE_GRID;
+                uint32_t x_end = (gx + 1) * m_width / INFER_CACHE_GRID;
+                uint32_t sum = 0;
+                for (uint32_t x = x_begin; x < x_end; x += INFER_CACHE_SAMPLE_STEP) {
+                    const uint8_t *pixel = row + (size_t)x * m_channel;
+                    for (uint32_t c = 0; c < m_channel; c++) {
+                        sum += pixel[c];
+                    }
+                }
+                sums[gx] += sum;
+                counts[gx] += (x_end - x_begin + INFER_CACHE_SAMPLE_STEP - 1) / INFER_CACHE_SAMPLE_STEP * m_channel;
+            }
+        }
+        for (uint32_t gx = 0; gx < INFER_CACHE_GRID; gx++) {
+            hash.cells[gy * INFER_CACHE_GRID + gx] = (uint8_t)(counts[gx] == 0 ? 0 : sums[gx] / counts[gx]);
+        }
+    }
+    hash.valid = true;
+}
+
+uint32_t InferResultCache::distance(const InferCacheHash &a, const InferCacheHash &b) {
+    // 取最大值而不是平均值，画面局部的小目标变化不会被整体平均掉
+    uint32_t max_diff = 0;
+    for (uint32_t i = 0; i < INFER_CACHE_HASH_SIZE; i++) {
+        uint32_t diff = a.cells[i] > b.cells[i] ? a.cells[i] - b.cells[i] : b.cells[i] - a.cells[i];
+        max_diff = diff > max_diff ? diff : max_diff;
+    }
+    return max_diff;
+}
+
+std::shared_ptr<const InferCacheEntry> InferResultCache::lookup(const InferCacheHash &hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.lookups++;
+    if (!hash.valid) {
+        m_stats.uncacheable++;
+        return nullptr;
+    }
+    time_unit now = get_time_of_ms();
+    // 清理过期的缓存项
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (now > (*it)->time_ms && now - (*it)->time_ms > m_config.max_age_ms) {
+            it = m_entries.erase(it);
+            m_stats.expired++;
+        } else {
+            ++it;
+        }
+    }
+    for (auto &entry : m_entries) {
+        if (distance(entry->hash, hash) <= m_config.max_distance) {
+            m_stats.hits++;
+            return entry;
+        }
+    }
+    m_stats.misses++;
+    return nullptr;
+}
+
+void InferResultCache::insert(const InferCacheHash &hash, const OutputUnit &output) {
+    if (!hash.valid) {
+        return;
+    }
+    auto entry = std::make_shared<InferCacheEntry>();
+    entry->hash = hash;
+    entry->time_ms = get_time_of_ms();
+    entry->outputs.resize(output.n_outputs);
+    entry->data.resize(output.n_outputs);
+    for (uint32_t i = 0; i < output.n_outputs; i++) {
+        const rknn_output &out = output.outputs[i];
+        entry->data[i].assign((const uint8_t *)out.buf, (const uint8_t *)out.buf + out.size);
+        entry->outputs[i] = out;
+        entry->outputs[i].buf = entry->data[i].data();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.push_front(entry);
+    while (m_entries.size() > m_config.max_entries) {
+        m_entries.pop_back();
+    }
+    m_stats.inserts++;
+}
+
+void InferResultCache::fill_output(const InferCacheEntry &entry, OutputUnit &output,
+                                   std::vector<std::vector<uint8_t>> &buffers) {
+    uint32_t n_outputs = output.n_outputs < entry.outputs.size() ? output.n_outputs : (uint32_t)entry.outputs.size();
+    buffers.resize(n_outputs);
+    for (uint32_t i = 0; i < n_outputs; i++) {
+        buffers[i] = entry.data[i];
+        output.outputs[i] = entry.outputs[i];
+        output.outputs[i].buf = buffers[i].data();
+    }
+}
+
+InferCacheStats InferResultCache::get_stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void InferResultCache::print_stats() const {
+    InferCacheStats stats = get_stats();
+    d_rknn_infer_info("infer cache lookups: %lu, hits: %lu (%.1f%%), misses: %lu, uncacheable: %lu, inserts: %lu, expired: %lu",
+                      (unsigned long)stats.lookups, (unsigned long)stats.hits,
+                      stats.lookups == 0 ? 0.0 : 100.0 * (double)stats.hits / (double)stats.lookups,
+                      (unsigned long)stats.misses, (unsigned long)stats.uncacheable, (unsigned long)stats.inserts,
+                      (unsigned long)stats.expired)
+}
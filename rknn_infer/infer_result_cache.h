@@ -0,0 +1,96 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.28
+ * @brief: 推理结果缓存：对插件预处理后的输入计算 16x16 分块亮度均值作为感知哈希，
+ *         与最近的缓存项逐块比较，最大差值不超过阈值且缓存项未过期时直接回放缓存的输出，不再推理。
+ *         固定机位的静止画面可以省掉大部分 NPU 推理
+ */
+#ifndef RKNN_INFER_INFER_RESULT_CACHE_H
+#define RKNN_INFER_INFER_RESULT_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "rknn_api.h"
+#include "utils.h"
+#include "rknn_infer_api.h"
+
+#define INFER_CACHE_GRID (16)
+#define INFER_CACHE_HASH_SIZE (INFER_CACHE_GRID * INFER_CACHE_GRID)
+
+struct InferCacheConfig {
+    // 是否启用
+    bool enable = false;
+    // 两帧对应分块亮度均值的最大差值（0 ~ 255），不超过时认为是同一画面
+    uint32_t max_distance = 3;
+    // 缓存结果的最长回放时间，超过后重新推理
+    uint32_t max_age_ms = 1000;
+    // 保留的最近缓存项个数
+    uint32_t max_entries = 4;
+};
+
+struct InferCacheStats {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // 输入格式不支持（非 uint8 NHWC 或透传）
+    uint64_t uncacheable = 0;
+    uint64_t inserts = 0;
+    uint64_t expired = 0;
+};
+
+// 输入的感知哈希：每块的亮度均值
+struct InferCacheHash {
+    bool valid = false;
+    uint8_t cells[INFER_CACHE_HASH_SIZE] = {};
+};
+
+// 一次推理的输出拷贝
+struct InferCacheEntry {
+    InferCacheHash hash;
+    time_unit time_ms = 0;
+    std::vector<rknn_output> outputs;
+    std::vector<std::vector<uint8_t>> data;
+};
+
+class InferResultCache {
+public:
+    InferResultCache(const InferCacheConfig &config, const PluginConfigSet &model_config);
+
+    [[nodiscard]] bool enable() const { return m_config.enable; };
+
+    // 计算输入的感知哈希，输入格式不支持时 hash.valid 为 false
+    void compute_hash(const InputUnit &input, InferCacheHash &hash) const;
+
+    // 查找匹配的缓存项，未命中返回空
+    std::shared_ptr<const InferCacheEntry> lookup(const InferCacheHash &hash);
+
+    // 保存一次推理的输出（拷贝），替换最旧的缓存项
+    void insert(const InferCacheHash &hash, const OutputUnit &output);
+
+    // 按缓存项填充输出单元，输出数据拷贝到 buffers（插件可能原地修改输出，不能直接指向缓存项）
+    static void fill_output(const InferCacheEntry &entry, OutputUnit &output, std::vector<std::vector<uint8_t>> &buffers);
+
+    // 两个哈希逐块差值的最大值
+    static uint32_t distance(const InferCacheHash &a, const InferCacheHash &b);
+
+    [[nodiscard]] InferCacheStats get_stats() const;
+    void print_stats() const;
+
+private:
+    InferCacheConfig m_config;
+    // 输入 0 的尺寸（NHWC）
+    uint32_t m_height = 0;
+    uint32_t m_width = 0;
+    uint32_t m_channel = 0;
+
+    mutable std::mutex m_mutex;
+    // 最新的在前
+    std::list<std::shared_ptr<const InferCacheEntry>> m_entries;
+    InferCacheStats m_stats;
+};
+
+#endif //RKNN_INFER_INFER_RESULT_CACHE_H
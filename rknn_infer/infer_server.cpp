@@ -0,0 +1,548 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务实现
+ */
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "infer_server.h"
+#include "utils_log.h"
+
+// 单个请求的输入上限，防止错误的请求头导致大量分配
+#define INFER_SERVER_MAX_REQUEST_SIZE (256u * 1024 * 1024)
+
+struct InferServer::Client {
+    int fd = -1;
+    // 多个服务线程会向同一个客户端发送响应
+    std::mutex send_mutex;
+    bool closed = false;
+    std::atomic<bool> finished{false};
+    std::thread thread;
+
+    // 排队中的请求也持有客户端，最后一个引用释放时才关闭套接字，避免 fd 被复用后发错
+    ~Client() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+struct InferServer::Request {
+    std::shared_ptr<Client> client;
+    InferRequestHeader header{};
+    // 内联输入数据
+    std::vector<uint8_t> data;
+    // fd 传递的输入数据映射，fd 无效（不够大、没有禁止缩小或映射失败）时不处理
+    void *map_addr = nullptr;
+    size_t map_size = 0;
+    bool bad_data_fd = false;
+    const uint8_t *inputs[INFER_MAX_INPUTS] = {};
+    time_unit recv_ns = 0;
+
+    ~Request() {
+        if (map_addr != nullptr) {
+            munmap(map_addr, map_size);
+        }
+    }
+};
+
+// 读满 len 字节，passed_fd 不为空时接收随数据传递的 fd；返回 0 成功，-1 连接断开
+static int recv_full(int fd, void *buf, size_t len, int *passed_fd) {
+    auto *ptr = (uint8_t *)buf;
+    while (len > 0) {
+        struct iovec iov = {ptr, len};
+        union {
+            char buf[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control{};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (passed_fd != nullptr) {
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+        }
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        if (passed_fd != nullptr) {
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                    int received = -1;
+                    memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+                    // 一个请求只接受一个 fd
+                    if (*passed_fd >= 0) {
+                        close(received);
+                    } else {
+                        *passed_fd = received;
+                    }
+                }
+            }
+        }
+        ptr += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 发送全部数据（处理部分发送），整个响应最多等待 timeout_ms；返回 0 成功，-1 连接断开或超时（errno 为 ETIMEDOUT）
+static int send_iov(int fd, struct iovec *iov, int iov_cnt, uint32_t timeout_ms) {
+    time_unit deadline = getTimeOfNs() + (time_unit)timeout_ms * 1000000;
+    while (iov_cnt > 0) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_cnt;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // 客户端接收缓冲已满，等待它读取
+            time_unit now = getTimeOfNs();
+            if (now >= deadline) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            int wait_ms = (int)((deadline - now + 999999) / 1000000);
+            if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+                return -1;
+            }
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        while (iov_cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iov_cnt--;
+        }
+        if (iov_cnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+InferServer::InferServer(const InferServerConfig &config, InferBackend *backend) {
+    m_config = config;
+    m_backend = backend;
+    CHECK_VAL(backend == nullptr || !backend->is_init(), d_rknn_infer_error("infer backend not ready"); return;)
+    const PluginConfigSet &model = backend->model_config();
+    CHECK_VAL(model.io_num.n_input == 0 || model.io_num.n_input > INFER_MAX_INPUTS ||
+              model.io_num.n_output > INFER_MAX_OUTPUTS,
+              d_rknn_infer_error("model with %d inputs %d outputs not supported", (int)model.io_num.n_input,
+                                 (int)model.io_num.n_output); return;)
+    uint32_t model_batch = backend->model_batch();
+    m_max_batch = model_batch > 1 ? model_batch : std::max(config.max_batch, 1u);
+    // 输入按 RKNN_TENSOR_UINT8 送入（由 RKNN 转换为模型的输入类型），每个元素 1 字节；
+    // 非量化模型的 size 是 float16 的字节数，不能用来计算请求大小
+    for (uint32_t i = 0; i < model.io_num.n_input; i++) {
+        m_item_size.push_back(model.input_attr[i].n_elems / model_batch);
+    }
+    m_batch_buffers.resize(backend->context_num());
+
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    CHECK_VAL(config.socket_path.empty() || config.socket_path.size() >= sizeof(addr.sun_path),
+              d_rknn_infer_error("invalid socket path %s", config.socket_path.c_str()); return;)
+    strncpy(addr.sun_path, config.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK_VAL(m_listen_fd < 0, d_rknn_infer_error("socket failed: %s", strerror(errno)); return;)
+    // 上次异常退出可能留下套接字文件
+    unlink(config.socket_path.c_str());
+    if (bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_listen_fd, 128) != 0) {
+        d_rknn_infer_error("listen on %s failed: %s", config.socket_path.c_str(), strerror(errno))
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return;
+    }
+
+    m_running = true;
+    for (uint32_t ctx = 0; ctx < backend->context_num(); ctx++) {
+        m_workers.emplace_back([this, ctx] { worker_thread(ctx); });
+    }
+    m_accept_thread = std::thread([this] { accept_thread(); });
+    d_rknn_infer_info("infer server listening on %s: %d contexts, max batch %d, batch wait %d us",
+                      config.socket_path.c_str(), (int)backend->context_num(), (int)m_max_batch,
+                      (int)config.batch_wait_us)
+    m_init = true;
+}
+
+InferServer::~InferServer() {
+    stop();
+}
+
+void InferServer::stop() {
+    if (!m_running.exchange(false)) {
+        if (m_listen_fd >= 0) {
+            close(m_listen_fd);
+            m_listen_fd = -1;
+        }
+        return;
+    }
+    if (m_accept_thread.joinable()) {
+        m_accept_thread.join();
+    }
+    close(m_listen_fd);
+    m_listen_fd = -1;
+    unlink(m_config.socket_path.c_str());
+
+    // 关闭连接唤醒接收线程
+    {
+        std::lock_guard<std::mutex> lock(m_client_mutex);
+        for (auto &client : m_clients) {
+            shutdown(client->fd, SHUT_RDWR);
+        }
+        for (auto &client : m_clients) {
+            client->thread.join();
+        }
+        m_clients.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_queue_cond.notify_all();
+    }
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_queue.clear();
+}
+
+InferServerStats InferServer::get_stats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
+}
+
+void InferServer::print_stats() const {
+    InferServerStats stats = get_stats();
+    d_rknn_infer_info("server clients: %lu, requests: %lu, responses: %lu, rejected: %lu",
+                      (unsigned long)stats.clients, (unsigned long)stats.requests, (unsigned long)stats.responses,
+                      (unsigned long)stats.rejected)
+    if (stats.batches > 0 && stats.responses > 0) {
+        d_rknn_infer_info("server batches: %lu, avg batch: %.2f, avg queue: %.3f ms, avg infer: %.3f ms",
+                          (unsigned long)stats.batches, (double)stats.responses / (double)stats.batches,
+                          (double)stats.queue_us / (double)stats.responses / 1000.0,
+                          (double)stats.infer_us / (double)stats.responses / 1000.0)
+    }
+}
+
+void InferServer::accept_thread() {
+    while (m_running) {
+        struct pollfd pfd = {m_listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(m_client_mutex);
+        // 回收已断开的客户端
+        for (auto it = m_clients.begin(); it != m_clients.end();) {
+            if ((*it)->finished) {
+                (*it)->thread.join();
+                it = m_clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (m_clients.size() >= m_config.max_clients) {
+            d_rknn_infer_warn("too many clients (%d), reject", (int)m_clients.size())
+            close(fd);
+            continue;
+        }
+        auto client = std::make_shared<Client>();
+        client->fd = fd;
+        client->thread = std::thread([this, client] { client_thread(client); });
+        m_clients.push_back(client);
+        std::lock_guard<std::mutex> stats_lock(m_stats_mutex);
+        m_stats.clients++;
+    }
+}
+
+int InferServer::read_request(const std::shared_ptr<Client> &client, std::unique_ptr<Request> &request) {
+    request = std::make_unique<Request>();
+    int passed_fd = -1;
+    if (recv_full(client->fd, &request->header, sizeof(request->header), &passed_fd) != 0) {
+        CHECK_VAL(passed_fd >= 0, close(passed_fd);)
+        return -1;
+    }
+    request->client = client;
+    request->recv_ns = getTimeOfNs();
+    InferRequestHeader &header = request->header;
+    size_t total = 0;
+    for (uint32_t i = 0; i < header.n_inputs && i < INFER_MAX_INPUTS; i++) {
+        total += header.input_size[i];
+    }
+    if (header.magic != INFER_SERVER_MAGIC || header.version != INFER_SERVER_VERSION ||
+        header.n_inputs > INFER_MAX_INPUTS || total > INFER_SERVER_MAX_REQUEST_SIZE ||
+        (passed_fd >= 0) != ((header.flags & INFER_REQUEST_DATA_FD) != 0)) {
+        // 数据流已经无法对齐，断开连接
+        d_rknn_infer_warn("invalid request header from client fd %d", client->fd)
+        CHECK_VAL(passed_fd >= 0, close(passed_fd);)
+        return -1;
+    }
+
+    const uint8_t *data = nullptr;
+    if (passed_fd >= 0) {
+        // 直接映射客户端的缓冲，不拷贝；映射前检查大小，并要求已禁止缩小，
+        // 否则客户端截断 fd 后服务线程访问映射会收到 SIGBUS，整个服务退出
+        if (total > 0) {
+            struct stat st{};
+            int seals = fcntl(passed_fd, F_GET_SEALS);
+            if (fstat(passed_fd, &st) != 0 || (size_t)st.st_size < total || seals < 0 || !(seals & F_SEAL_SHRINK)) {
+                d_rknn_infer_warn("client fd %d passed data fd of %ld bytes (seals %d), need %lu bytes sealed",
+                                  client->fd, (long)st.st_size, seals, (unsigned long)total)
+                request->bad_data_fd = true;
+            } else {
+                request->map_addr = mmap(nullptr, total, PROT_READ, MAP_SHARED, passed_fd, 0);
+            }
+            if (request->bad_data_fd || request->map_addr == MAP_FAILED) {
+                request->map_addr = nullptr;
+                request->bad_data_fd = true;
+            } else {
+                request->map_size = total;
+                data = (const uint8_t *)request->map_addr;
+            }
+        }
+        close(passed_fd);
+    } else {
+        request->data.resize(total);
+        if (total > 0 && recv_full(client->fd, request->data.data(), total, nullptr) != 0) {
+            return -1;
+        }
+        data = request->data.data();
+    }
+    for (uint32_t i = 0; data != nullptr && i < header.n_inputs; i++) {
+        request->inputs[i] = data;
+        data += header.input_size[i];
+    }
+    return 0;
+}
+
+bool InferServer::check_request(const Request &request) const {
+    if (request.bad_data_fd || request.header.n_inputs != m_item_size.size()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < request.header.n_inputs; i++) {
+        if (request.header.input_size[i] != m_item_size[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void InferServer::client_thread(const std::shared_ptr<Client> &client) {
+    while (m_running) {
+        std::unique_ptr<Request> request;
+        if (read_request(client, request) != 0) {
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.requests++;
+        }
+        if (!check_request(*request)) {
+            send_response(*request, INFER_STATUS_BAD_REQUEST, 0, nullptr, nullptr, 0, 0, 0);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        if (m_queue.size() >= m_config.max_queue) {
+            lock.unlock();
+            send_response(*request, INFER_STATUS_BUSY, 0, nullptr, nullptr, 0, 0, 0);
+            continue;
+        }
+        m_queue.push_back(std::move(request));
+        m_queue_cond.notify_one();
+    }
+    client->finished = true;
+}
+
+bool InferServer::take_batch(std::vector<std::unique_ptr<Request>> &batch) {
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    while (true) {
+        m_queue_cond.wait(lock, [this] { return !m_running || !m_queue.empty(); });
+        // 凑批：不足一批时等到队首请求超过 batch_wait_us
+        while (m_running && !m_queue.empty() && m_queue.size() < m_max_batch) {
+            time_unit deadline = m_queue.front()->recv_ns + (time_unit)m_config.batch_wait_us * 1000;
+            time_unit now = getTimeOfNs();
+            if (now >= deadline) {
+                break;
+            }
+            m_queue_cond.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+        }
+        if (!m_running) {
+            return false;
+        }
+        // 被其他服务线程取走了
+        if (m_queue.empty()) {
+            continue;
+        }
+        size_t n = std::min<size_t>(m_queue.size(), m_max_batch);
+        for (size_t i = 0; i < n; i++) {
+            batch.push_back(std::move(m_queue.front()));
+            m_queue.pop_front();
+        }
+        // 剩余请求交给其他空闲的服务线程
+        if (!m_queue.empty()) {
+            m_queue_cond.notify_one();
+        }
+        return true;
+    }
+}
+
+void InferServer::worker_thread(uint32_t ctx) {
+    std::vector<std::unique_ptr<Request>> batch;
+    while (take_batch(batch)) {
+        run_batch(ctx, batch);
+        batch.clear();
+    }
+}
+
+void InferServer::run_batch(uint32_t ctx, std::vector<std::unique_ptr<Request>> &batch) {
+    const PluginConfigSet &model = m_backend->model_config();
+    uint32_t n_inputs = model.io_num.n_input;
+    uint32_t n_outputs = model.io_num.n_output;
+    uint32_t model_batch = m_backend->model_batch();
+    auto batch_size = (uint32_t)batch.size();
+    rknn_input inputs[INFER_MAX_INPUTS];
+    rknn_output outputs[INFER_MAX_OUTPUTS];
+    const uint8_t *output_data[INFER_MAX_OUTPUTS] = {};
+    uint32_t output_size[INFER_MAX_OUTPUTS] = {};
+
+    auto prepare = [&]() {
+        memset(inputs, 0, sizeof(inputs));
+        memset(outputs, 0, sizeof(outputs));
+        for (uint32_t i = 0; i < n_inputs; i++) {
+            inputs[i].index = i;
+            inputs[i].type = RKNN_TENSOR_UINT8;
+            inputs[i].fmt = RKNN_TENSOR_NHWC;
+        }
+        for (uint32_t i = 0; i < n_outputs; i++) {
+            outputs[i].want_float = m_config.output_want_float ? 1 : 0;
+        }
+    };
+
+    if (model_batch > 1) {
+        // batch 模型：拼接到该上下文的缓冲，不足一批补 0，一次推理后按 batch 项拆分输出
+        time_unit dispatch_ns = getTimeOfNs();
+        prepare();
+        auto &buffers = m_batch_buffers[ctx];
+        buffers.resize(n_inputs);
+        for (uint32_t i = 0; i < n_inputs; i++) {
+            buffers[i].resize((size_t)model_batch * m_item_size[i]);
+            for (uint32_t b = 0; b < batch_size; b++) {
+                memcpy(buffers[i].data() + (size_t)b * m_item_size[i], batch[b]->inputs[i], m_item_size[i]);
+            }
+            memset(buffers[i].data() + (size_t)batch_size * m_item_size[i], 0,
+                   (size_t)(model_batch - batch_size) * m_item_size[i]);
+            inputs[i].buf = buffers[i].data();
+            inputs[i].size = model_batch * m_item_size[i];
+        }
+        time_unit t_infer = getTimeOfNs();
+        RetStatus ret = m_backend->infer(ctx, n_inputs, inputs, n_outputs, outputs);
+        auto infer_us = (uint32_t)((getTimeOfNs() - t_infer) / 1000);
+        for (uint32_t b = 0; b < batch_size; b++) {
+            if (ret != RET_STATUS_SUCCESS) {
+                send_response(*batch[b], INFER_STATUS_INFER_FAILED, 0, nullptr, nullptr, batch_size, dispatch_ns,
+                              infer_us);
+                continue;
+            }
+            for (uint32_t i = 0; i < n_outputs; i++) {
+                output_size[i] = outputs[i].size / model_batch;
+                output_data[i] = (const uint8_t *)outputs[i].buf + (size_t)b * output_size[i];
+            }
+            send_response(*batch[b], INFER_STATUS_OK, n_outputs, output_data, output_size, batch_size, dispatch_ns,
+                          infer_us);
+        }
+        CHECK_VAL(ret == RET_STATUS_SUCCESS, m_backend->release(ctx, n_outputs, outputs);)
+    } else {
+        // 单 batch 模型：同一批请求在该上下文上依次推理，输入直接使用请求的缓冲
+        for (auto &request : batch) {
+            time_unit dispatch_ns = getTimeOfNs();
+            prepare();
+            for (uint32_t i = 0; i < n_inputs; i++) {
+                inputs[i].buf = (void *)request->inputs[i];
+                inputs[i].size = m_item_size[i];
+            }
+            RetStatus ret = m_backend->infer(ctx, n_inputs, inputs, n_outputs, outputs);
+            auto infer_us = (uint32_t)((getTimeOfNs() - dispatch_ns) / 1000);
+            if (ret != RET_STATUS_SUCCESS) {
+                send_response(*request, INFER_STATUS_INFER_FAILED, 0, nullptr, nullptr, batch_size, dispatch_ns,
+                              infer_us);
+                continue;
+            }
+            for (uint32_t i = 0; i < n_outputs; i++) {
+                output_data[i] = (const uint8_t *)outputs[i].buf;
+                output_size[i] = outputs[i].size;
+            }
+            send_response(*request, INFER_STATUS_OK, n_outputs, output_data, output_size, batch_size, dispatch_ns,
+                          infer_us);
+            m_backend->release(ctx, n_outputs, outputs);
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.batches++;
+}
+
+void InferServer::send_response(Request &request, int status, uint32_t n_outputs, const uint8_t *const *outputs,
+                                const uint32_t *output_size, uint32_t batch_size, time_unit dispatch_ns,
+                                uint32_t infer_us) {
+    InferResponseHeader header{};
+    header.magic = INFER_SERVER_MAGIC;
+    header.version = INFER_SERVER_VERSION;
+    header.request_id = request.header.request_id;
+    header.status = status;
+    header.n_outputs = n_outputs;
+    header.batch_size = batch_size;
+    header.queue_us = dispatch_ns > request.recv_ns ? (uint32_t)((dispatch_ns - request.recv_ns) / 1000) : 0;
+    header.infer_us = infer_us;
+    header.server_us = (uint32_t)((getTimeOfNs() - request.recv_ns) / 1000);
+
+    struct iovec iov[INFER_MAX_OUTPUTS + 1];
+    iov[0] = {&header, sizeof(header)};
+    for (uint32_t i = 0; i < n_outputs; i++) {
+        header.output_size[i] = output_size[i];
+        iov[i + 1] = {(void *)outputs[i], output_size[i]};
+    }
+    {
+        Client &client = *request.client;
+        std::lock_guard<std::mutex> lock(client.send_mutex);
+        if (!client.closed && send_iov(client.fd, iov, (int)n_outputs + 1, m_config.send_timeout_ms) != 0) {
+            // 客户端已断开或不再读取响应，断开连接并唤醒它的接收线程退出，该客户端剩余的响应直接丢弃
+            if (errno == ETIMEDOUT) {
+                d_rknn_infer_warn("client fd %d not reading responses for %d ms, disconnect", client.fd,
+                                  (int)m_config.send_timeout_ms)
+            }
+            client.closed = true;
+            shutdown(client.fd, SHUT_RDWR);
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    if (status == INFER_STATUS_OK) {
+        m_stats.responses++;
+        m_stats.queue_us += header.queue_us;
+        m_stats.infer_us += infer_us;
+    } else {
+        m_stats.rejected++;
+    }
+}
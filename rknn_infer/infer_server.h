@@ -0,0 +1,113 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务：监听 Unix 域套接字，每个客户端一个接收线程，
+ *         所有客户端的请求进入同一个队列，每个推理上下文一个服务线程从队列攒批推理，
+ *         推理完成后直接从服务线程把结果发回对应客户端（响应顺序与请求顺序无关）
+ */
+#ifndef RKNN_INFER_INFER_SERVER_H
+#define RKNN_INFER_INFER_SERVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include "infer_backend.h"
+#include "infer_server_protocol.h"
+
+struct InferServerConfig {
+    // 套接字路径，已存在时先删除
+    std::string socket_path = "/tmp/rknn_infer.sock";
+    // 模型 batch 为 1 时一批最多取的请求个数（batch 模型固定按模型 batch 攒批）
+    uint32_t max_batch = 4;
+    // 队首请求最多等待多久来凑批
+    uint32_t batch_wait_us = 1000;
+    // 排队请求上限，超过后直接返回 INFER_STATUS_BUSY
+    uint32_t max_queue = 256;
+    // 客户端连接上限
+    uint32_t max_clients = 64;
+    // 发送一个响应最多等待的时间，客户端不读取响应时超时断开该客户端，避免阻塞服务线程
+    uint32_t send_timeout_ms = 1000;
+    // 输出是否转换为 float
+    bool output_want_float = false;
+};
+
+struct InferServerStats {
+    uint64_t clients = 0;
+    uint64_t requests = 0;
+    uint64_t responses = 0;
+    uint64_t rejected = 0;
+    uint64_t batches = 0;
+    uint64_t queue_us = 0;
+    uint64_t infer_us = 0;
+};
+
+class InferServer {
+public:
+    // backend 由调用者持有，需比服务活得久
+    InferServer(const InferServerConfig &config, InferBackend *backend);
+    ~InferServer();
+
+    InferServer(const InferServer &) = delete;
+    InferServer &operator=(const InferServer &) = delete;
+
+    // 开始监听
+    [[nodiscard]] bool is_init() const { return m_init; };
+
+    // 停止监听，断开所有客户端，丢弃未处理的请求
+    void stop();
+
+    [[nodiscard]] InferServerStats get_stats() const;
+    void print_stats() const;
+
+private:
+    struct Client;
+    struct Request;
+
+    void accept_thread();
+    void client_thread(const std::shared_ptr<Client> &client);
+    void worker_thread(uint32_t ctx);
+
+    // 读取一个请求，返回 0 成功，-1 连接断开或协议错误
+    int read_request(const std::shared_ptr<Client> &client, std::unique_ptr<Request> &request);
+    // 检查请求的输入是否与模型一致
+    bool check_request(const Request &request) const;
+    // 取一批请求：队首请求最多等待 batch_wait_us，返回 false 表示服务停止
+    bool take_batch(std::vector<std::unique_ptr<Request>> &batch);
+    void run_batch(uint32_t ctx, std::vector<std::unique_ptr<Request>> &batch);
+    void send_response(Request &request, int status, uint32_t n_outputs, const uint8_t *const *outputs,
+                       const uint32_t *output_size, uint32_t batch_size, time_unit dispatch_ns, uint32_t infer_us);
+
+private:
+    bool m_init = false;
+    std::atomic<bool> m_running{false};
+    InferServerConfig m_config;
+    InferBackend *m_backend;
+    uint32_t m_max_batch = 1;
+    // 每个输入 batch 项的字节数（uint8 输入，等于元素个数）
+    std::vector<uint32_t> m_item_size;
+    // batch 模型每个上下文的输入拼接缓冲
+    std::vector<std::vector<std::vector<uint8_t>>> m_batch_buffers;
+
+    int m_listen_fd = -1;
+    std::thread m_accept_thread;
+    std::mutex m_client_mutex;
+    std::list<std::shared_ptr<Client>> m_clients;
+
+    // 请求队列
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cond;
+    std::deque<std::unique_ptr<Request>> m_queue;
+    std::vector<std::thread> m_workers;
+
+    mutable std::mutex m_stats_mutex;
+    InferServerStats m_stats;
+};
+
+#endif //RKNN_INFER_INFER_SERVER_H
@@ -5,7 +5,10 @@
  * @brief: 推理模板主文件
  */
 #include <string>
+#include <memory>
 #include "rknn_infer.h"
+#include "infer_server.h"
+#include "rknn_infer_backend.h"
 #include "utils_log.h"
 
 bool g_system_running;
@@ -28,23 +31,97 @@ void quit_handler(int sig_num){
 }
 #endif
 
+/**
+ * @brief 服务模式：不加载插件，客户端通过 Unix 域套接字提交输入，推理结果异步返回
+ */
+static int run_server(const std::string &model_path, const InferServerConfig &config, uint32_t contexts,
+                      bool mock) {
+#ifdef __linux__
+    signal(SIGINT, quit_handler);
+#endif
+    std::unique_ptr<InferBackend> backend;
+    if (mock) {
+        // 模拟后端：640x640x3 输入，每次推理约 10ms
+        backend.reset(new MockInferBackend(contexts, 1, 640 * 640 * 3, 1024, 8000, 2000));
+    } else {
+        backend.reset(new RknnInferBackend(model_path, contexts));
+    }
+    if (!backend->is_init()) {
+        d_rknn_infer_error("infer backend init fail!")
+        return -1;
+    }
+    g_system_running = true;
+    InferServer server(config, backend.get());
+    if (!server.is_init()) {
+        d_rknn_infer_error("infer server init fail!")
+        return -1;
+    }
+    while (g_system_running) {
+        sleepUS(100000);
+    }
+    server.stop();
+    d_rknn_infer_info("infer server stop!")
+    server.print_stats();
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
 #ifdef __linux__
     // 注册信号处理函数
     signal(SIGQUIT, quit_handler);
 #endif
     // 读取配置
-    const std::string usage = "Usage: ./rknn_infer -m <model_path> -p <plugin_name>";
+    const std::string usage = "Usage: ./rknn_infer -m <model_path> -p <plugin_name> [--cache <max_distance>] "
+                              "[--cache-age-ms <ms>] [--cache-entries <n>]\n"
+                              "       ./rknn_infer -m <model_path> -s <socket_path> [-c <contexts>] [-b <max_batch>] "
+                              "[-w <batch_wait_us>] [--mock]";
     std::string model_path = "./model/RK3566_RK3568/mobilenet_v1.rknn";
     std::string plugin_name = "rknn_mobilenet";
+    // 服务模式配置
+    InferServerConfig server_config;
+    std::string socket_path;
+    uint32_t contexts = 3;
+    bool mock = false;
+    // 推理结果缓存配置
+    InferCacheConfig cache_config;
     for(int idx = 0; idx < argc; idx++){
         std::string args = argv[idx];
-        if (args == "-m" || args == "--model"){
+        if (idx + 1 < argc && (args == "-m" || args == "--model")){
             model_path = argv[++idx];
         }
-        if (args == "-p" || args == "--plugin"){
+        if (idx + 1 < argc && (args == "-p" || args == "--plugin")){
             plugin_name = argv[++idx];
         }
+        if (idx + 1 < argc && (args == "-s" || args == "--server")){
+            socket_path = argv[++idx];
+        }
+        if (idx + 1 < argc && (args == "-c" || args == "--contexts")){
+            contexts = std::stoul(argv[++idx]);
+        }
+        if (idx + 1 < argc && (args == "-b" || args == "--batch")){
+            server_config.max_batch = std::stoul(argv[++idx]);
+        }
+        if (idx + 1 < argc && (args == "-w" || args == "--batch-wait-us")){
+            server_config.batch_wait_us = std::stoul(argv[++idx]);
+        }
+        if (args == "--mock"){
+            mock = true;
+        }
+        if (idx + 1 < argc && args == "--cache"){
+            cache_config.enable = true;
+            cache_config.max_distance = std::stoul(argv[++idx]);
+        }
+        if (idx + 1 < argc && args == "--cache-age-ms"){
+            cache_config.max_age_ms = std::stoul(argv[++idx]);
+        }
+        if (idx + 1 < argc && args == "--cache-entries"){
+            cache_config.max_entries = std::stoul(argv[++idx]);
+        }
+    }
+    if (!socket_path.empty()){
+        d_rknn_infer_info("server mode: %s, model path: %s", socket_path.c_str(), mock ? "mock" : model_path.c_str())
+        server_config.socket_path = socket_path;
+        return run_server(model_path, server_config, contexts, mock);
     }
     if (model_path.empty()){
         d_rknn_infer_error("model path is empty!")
@@ -62,13 +139,14 @@ int main(int argc, char *argv[]) {
 
     // 启动推理
     g_system_running = true;
-    RknnInfer rknn_infer(model_path, plugin_name);
+    RknnInfer rknn_infer(model_path, plugin_name, cache_config);
     if (!rknn_infer.check_init()){
         d_rknn_infer_error("rknn infer init fail!")
         return -1;
     }
     rknn_infer.stop();
     d_rknn_infer_info("rknn infer stop!")
+    rknn_infer.print_cache_statistic();
 
     // 输出时间统计
 #ifdef PERFORMANCE_STATISTIC
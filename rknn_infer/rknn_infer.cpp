@@ -10,7 +10,8 @@
 
 extern bool g_system_running;
 
-RknnInfer::RknnInfer(const std::string &model_name, const std::string &plugin_name) {
+RknnInfer::RknnInfer(const std::string &model_name, const std::string &plugin_name,
+                     const InferCacheConfig &cache_config) {
     // 初始化变量
     m_init = false;
     // 加载插件
@@ -54,6 +55,14 @@ RknnInfer::RknnInfer(const std::string &model_name, const std::string &plugin_na
         }
     }
 
+    // 推理结果缓存，按模型输入尺寸计算哈希
+    if (cache_config.enable) {
+        m_result_cache.reset(new InferResultCache(cache_config, m_plugin_set_config));
+        if (!m_result_cache->enable()) {
+            m_result_cache.reset();
+        }
+    }
+
     // 调度之前给插件传递配置信息
     if (0 != plugin->set_config(&m_plugin_set_config)) {
         d_rknn_infer_error("set_config failed")
@@ -100,6 +109,12 @@ bool RknnInfer::check_init() const {
     return m_init;
 }
 
+void RknnInfer::print_cache_statistic() const {
+    if (m_result_cache != nullptr) {
+        m_result_cache->print_stats();
+    }
+}
+
 RetStatus RknnInfer::get_input_unit(QueuePack &pack) {
     std::unique_lock<std::mutex> proc_queue_lock(m_infer_queue_mutex);
     while (m_infer_queue.empty()) {
@@ -147,8 +162,8 @@ void RknnInfer::input_data_thread(uint32_t idx) {
 
     while(g_system_running){
         // 限制队列长度，降低任务处理延时
+        uint32_t queue_size = get_queue_size();
         if(m_plugin_get_config.task_queue_limit !=0){
-            uint32_t queue_size = get_queue_size();
             if(queue_size >= uint32_t(m_plugin_get_config.task_queue_limit / 1.5)){
                 sleepUS(100000);
                 continue;
@@ -160,6 +175,10 @@ void RknnInfer::input_data_thread(uint32_t idx) {
                 continue;
             }
         }
+        // 队列压力反馈给插件，由插件决定跳帧
+        td_data.task_queue_size = queue_size;
+        td_data.task_queue_limit = m_plugin_get_config.task_queue_limit;
+
         // 收集数据
 #ifdef PERFORMANCE_STATISTIC
         time_unit t_plugin_input_ms = get_time_of_ms();
@@ -184,6 +203,11 @@ void RknnInfer::input_data_thread(uint32_t idx) {
 #endif
         pack.input_unit = input_unit;
         pack.plugin_sync_data = td_data.plugin_sync_data;
+        // 与最近推理过的画面相同时，输出线程直接回放缓存结果
+        if (m_result_cache != nullptr) {
+            m_result_cache->compute_hash(*input_unit, pack.cache_hash);
+            pack.cache_entry = m_result_cache->lookup(pack.cache_hash);
+        }
         put_input_unit(pack);
     }
 
@@ -221,6 +245,8 @@ void RknnInfer::infer_proc_thread(uint32_t idx) {
         m_statistic.s_plugin_init_ms += get_time_of_ms() - t_plugin_init;
     }
 #endif
+    // 缓存命中时回放的输出数据
+    std::vector<std::vector<uint8_t>> cache_buffers;
     while(g_system_running){
         // 获取数据
         QueuePack pack{};
@@ -245,26 +271,36 @@ void RknnInfer::infer_proc_thread(uint32_t idx) {
             output_unit->outputs[i].want_float = m_plugin_get_config.output_want_float ? 1 : 0;
         }
 
-        // 推理
+        // 推理（缓存命中时回放缓存的输出）
+        bool cache_hit = pack.cache_entry != nullptr;
+        if (cache_hit) {
+            InferResultCache::fill_output(*pack.cache_entry, *output_unit, cache_buffers);
+            pack.cache_entry.reset();
+        } else {
 #ifdef PERFORMANCE_STATISTIC
-        time_unit t_model_infer = get_time_of_ms();
+            time_unit t_model_infer = get_time_of_ms();
 #endif
-        ret = m_rknn_models[idx]->model_infer_sync(
-                pack.input_unit->n_inputs,
-                pack.input_unit->inputs,
-                output_unit->n_outputs,
-                output_unit->outputs);
-        if (ret != RetStatus::RET_STATUS_SUCCESS){
-            d_rknn_infer_error("model_infer_sync failed")
-            continue;
-        }
+            ret = m_rknn_models[idx]->model_infer_sync(
+                    pack.input_unit->n_inputs,
+                    pack.input_unit->inputs,
+                    output_unit->n_outputs,
+                    output_unit->outputs);
+            if (ret != RetStatus::RET_STATUS_SUCCESS){
+                d_rknn_infer_error("model_infer_sync failed")
+                continue;
+            }
 #ifdef PERFORMANCE_STATISTIC
-        {
-            std::lock_guard<std::mutex> proc_queue_lock(m_statistic.s_model_infer_mutex);
-            m_statistic.s_model_infer_count++;
-            m_statistic.s_model_infer_ms += get_time_of_ms() - t_model_infer;
-        }
+            {
+                std::lock_guard<std::mutex> proc_queue_lock(m_statistic.s_model_infer_mutex);
+                m_statistic.s_model_infer_count++;
+                m_statistic.s_model_infer_ms += get_time_of_ms() - t_model_infer;
+            }
 #endif
+            // 插件可能原地修改输出，先保存到缓存
+            if (m_result_cache != nullptr) {
+                m_result_cache->insert(pack.cache_hash, *output_unit);
+            }
+        }
 
         // 输出结果
         // 转移同步数据
@@ -300,22 +336,24 @@ void RknnInfer::infer_proc_thread(uint32_t idx) {
         }
 #endif
 
-        // 释放资源
+        // 释放资源（回放的输出不属于模型）
+        if (!cache_hit) {
 #ifdef PERFORMANCE_STATISTIC
-        time_unit t_model_infer_release = get_time_of_ms();
+            time_unit t_model_infer_release = get_time_of_ms();
 #endif
-        ret = m_rknn_models[idx]->model_infer_release(output_unit->n_outputs, output_unit->outputs);
-        if (ret != RetStatus::RET_STATUS_SUCCESS){
-            d_rknn_infer_error("model_infer_release failed")
-            continue;
-        }
+            ret = m_rknn_models[idx]->model_infer_release(output_unit->n_outputs, output_unit->outputs);
+            if (ret != RetStatus::RET_STATUS_SUCCESS){
+                d_rknn_infer_error("model_infer_release failed")
+                continue;
+            }
 #ifdef PERFORMANCE_STATISTIC
-        {
-            std::lock_guard<std::mutex> proc_queue_lock(m_statistic.s_model_release_mutex);
-            m_statistic.s_model_release_count++;
-            m_statistic.s_model_release_ms += get_time_of_ms() - t_model_infer_release;
-        }
+            {
+                std::lock_guard<std::mutex> proc_queue_lock(m_statistic.s_model_release_mutex);
+                m_statistic.s_model_release_count++;
+                m_statistic.s_model_release_ms += get_time_of_ms() - t_model_infer_release;
+            }
 #endif
+        }
 
         // 释放输出
         free(output_unit->outputs);
@@ -10,10 +10,12 @@
 #include <mutex>
 #include <list>
 #include <vector>
+#include <memory>
 #include <condition_variable>
 #include "rknn_model.h"
 #include "rknn_infer_api.h"
 #include "plugin_ctrl.h"
+#include "infer_result_cache.h"
 
 struct QueuePack{
 #ifdef PERFORMANCE_STATISTIC
@@ -21,6 +23,9 @@ struct QueuePack{
 #endif
     InputUnit* input_unit;
     void *plugin_sync_data;
+    // 推理结果缓存：输入的感知哈希，命中时回放的缓存项（不再推理）
+    InferCacheHash cache_hash;
+    std::shared_ptr<const InferCacheEntry> cache_entry;
 };
 #ifdef PERFORMANCE_STATISTIC
 struct StaticStruct{
@@ -92,11 +97,14 @@ struct StaticStruct{
 #endif
 class RknnInfer {
 public:
-    explicit RknnInfer(const std::string &model_name, const std::string &plugin_name);
+    explicit RknnInfer(const std::string &model_name, const std::string &plugin_name,
+                       const InferCacheConfig &cache_config = InferCacheConfig());
     RetStatus stop();
 
     // 检查初始化
     [[nodiscard]] bool check_init() const;
+    // 推理结果缓存命中统计
+    void print_cache_statistic() const;
 #ifdef PERFORMANCE_STATISTIC
     void print_statistic() const;
 #endif
@@ -126,6 +134,8 @@ private:
     std::vector<ThreadData> m_infer_proc_meta;
     // 输入调度
     std::vector<RknnModel*> m_rknn_models;
+    // 推理结果缓存（未启用时为空）
+    std::unique_ptr<InferResultCache> m_result_cache;
 
     std::vector<std::thread> m_input_data_ctrl;
     std::vector<ThreadData> m_input_data_meta;
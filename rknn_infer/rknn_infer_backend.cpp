@@ -0,0 +1,52 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: RKNN 模型上下文池推理后端实现
+ */
+#include "rknn_infer_backend.h"
+#include "infer_server_protocol.h"
+#include "utils_log.h"
+
+RknnInferBackend::RknnInferBackend(const std::string &model_path, uint32_t context_num) {
+    context_num = context_num == 0 ? 1 : context_num;
+    for (uint32_t idx = 0; idx < context_num; ++idx) {
+        if (idx == 0) {
+            m_rknn_models.emplace_back(new RknnModel(model_path, m_config, true));
+        } else {
+            m_rknn_models.emplace_back(m_rknn_models[0]->model_infer_dup());
+        }
+        if (!m_rknn_models[idx]->check_init()) {
+            d_rknn_infer_error("rknn model %d init failed", (int)idx)
+            return;
+        }
+    }
+    CHECK_VAL(m_config.io_num.n_input == 0 || m_config.io_num.n_input > INFER_MAX_INPUTS ||
+              m_config.io_num.n_output > INFER_MAX_OUTPUTS,
+              d_rknn_infer_error("model with %d inputs %d outputs not supported by server",
+                                 (int)m_config.io_num.n_input, (int)m_config.io_num.n_output); return;)
+    // 输入第一维大于 1 的模型按 batch 推理
+    m_model_batch = m_config.input_attr[0].n_dims == 4 && m_config.input_attr[0].dims[0] > 1 ?
+                    m_config.input_attr[0].dims[0] : 1;
+    d_rknn_infer_info("rknn backend: %d contexts, model batch %d", (int)context_num, (int)m_model_batch)
+    m_init = true;
+}
+
+RknnInferBackend::~RknnInferBackend() {
+    // 复用权重的上下文先释放
+    for (size_t idx = m_rknn_models.size(); idx > 0; --idx) {
+        delete m_rknn_models[idx - 1];
+    }
+    m_rknn_models.clear();
+}
+
+RetStatus RknnInferBackend::infer(uint32_t ctx, uint32_t n_inputs, rknn_input *inputs, uint32_t n_outputs,
+                                  rknn_output *outputs) {
+    CHECK_VAL(ctx >= m_rknn_models.size(), return RET_STATUS_FAILED;)
+    return m_rknn_models[ctx]->model_infer_sync(n_inputs, inputs, n_outputs, outputs);
+}
+
+RetStatus RknnInferBackend::release(uint32_t ctx, uint32_t n_outputs, rknn_output *outputs) {
+    CHECK_VAL(ctx >= m_rknn_models.size(), return RET_STATUS_FAILED;)
+    return m_rknn_models[ctx]->model_infer_release(n_outputs, outputs);
+}
@@ -0,0 +1,37 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: RKNN 模型上下文池推理后端：第一个上下文加载模型，其余上下文复用权重
+ */
+#ifndef RKNN_INFER_RKNN_INFER_BACKEND_H
+#define RKNN_INFER_RKNN_INFER_BACKEND_H
+
+#include <string>
+#include <vector>
+#include "infer_backend.h"
+#include "rknn_model.h"
+
+class RknnInferBackend : public InferBackend {
+public:
+    RknnInferBackend(const std::string &model_path, uint32_t context_num);
+    ~RknnInferBackend() override;
+
+    [[nodiscard]] bool is_init() const override { return m_init; };
+    [[nodiscard]] uint32_t context_num() const override { return (uint32_t)m_rknn_models.size(); };
+    [[nodiscard]] uint32_t model_batch() const override { return m_model_batch; };
+    [[nodiscard]] const PluginConfigSet &model_config() const override { return m_config; };
+
+    RetStatus infer(uint32_t ctx, uint32_t n_inputs, rknn_input *inputs, uint32_t n_outputs,
+                    rknn_output *outputs) override;
+    RetStatus release(uint32_t ctx, uint32_t n_outputs, rknn_output *outputs) override;
+
+private:
+    bool m_init = false;
+    uint32_t m_model_batch = 1;
+    // 模型上下文引用该配置，需要比上下文活得久
+    PluginConfigSet m_config{};
+    std::vector<RknnModel *> m_rknn_models;
+};
+
+#endif //RKNN_INFER_RKNN_INFER_BACKEND_H
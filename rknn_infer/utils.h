@@ -7,6 +7,7 @@
 #ifndef PLUGIN_RKNN_IMAGE_UTILS_H
 #define PLUGIN_RKNN_IMAGE_UTILS_H
 #include <ctime>
+#include <cerrno>
 #ifdef __linux__
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -0,0 +1,62 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务的 Unix 域套接字协议（客户端和服务端共用）：
+ *         请求 = 请求头 + 输入数据（直接跟在请求头后，或放在随请求头一起传递的 memfd 中），
+ *         响应 = 响应头 + 各输出数据，响应按完成顺序返回，用 request_id 对应请求
+ */
+#ifndef RKNN_INFER_INFER_SERVER_PROTOCOL_H
+#define RKNN_INFER_INFER_SERVER_PROTOCOL_H
+
+#include <cstdint>
+
+#define INFER_SERVER_MAGIC (0x464e4952)  // "RINF"
+#define INFER_SERVER_VERSION (1)
+#define INFER_MAX_INPUTS (4)
+#define INFER_MAX_OUTPUTS (8)
+
+// 请求标志
+enum InferRequestFlag {
+    // 输入数据在随请求头传递的 memfd 中（各输入依次排列），大输入不经过套接字拷贝
+    INFER_REQUEST_DATA_FD = 1 << 0,
+};
+
+// 响应状态
+enum InferResponseStatus {
+    INFER_STATUS_OK = 0,
+    // 输入个数或大小与模型不符
+    INFER_STATUS_BAD_REQUEST = 1,
+    // 服务端请求队列已满
+    INFER_STATUS_BUSY = 2,
+    // 推理失败
+    INFER_STATUS_INFER_FAILED = 3,
+};
+
+// 请求头，输入为模型输入格式的 uint8 数据（与插件的 rknn_input 相同，不做预处理）
+struct InferRequestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t request_id;
+    uint32_t flags;
+    uint32_t n_inputs;
+    uint32_t input_size[INFER_MAX_INPUTS];
+};
+
+// 响应头，附带该请求在服务端的耗时
+struct InferResponseHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t request_id;
+    int32_t status;
+    uint32_t n_outputs;
+    uint32_t output_size[INFER_MAX_OUTPUTS];
+    // 所在批次的请求个数
+    uint32_t batch_size;
+    // 收到请求到开始推理的排队时间、批次推理时间、收到请求到开始发送响应的总时间
+    uint32_t queue_us;
+    uint32_t infer_us;
+    uint32_t server_us;
+};
+
+#endif //RKNN_INFER_INFER_SERVER_PROTOCOL_H
@@ -52,6 +52,10 @@ struct ThreadData {
 
     // 共享接口
     PluginStruct *plugin;
+
+    // 推理任务队列状态，输入线程每次采集前由调度程序更新，插件可据此降低采集/解码帧率
+    uint32_t task_queue_size;
+    uint32_t task_queue_limit;
 };
 
 // 插件程序给调度程序的配置
@@ -64,7 +68,7 @@ struct PluginConfigGet{
     // 任务队列个数限制(0代表无限制)，降低任务处理延时
     uint32_t task_queue_limit;
 
-    // 是否需要输出 float 类型的输出结果
+    // 是否需要输出 float 类型的输出结果（false 时输出为模型原始数据类型，配合 output_attr 的 zp/scale 使用）
     bool output_want_float;
 
     // 默认配置
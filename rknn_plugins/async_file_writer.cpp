@@ -0,0 +1,205 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.18
+ * @brief: 后台线程写文件实现
+ */
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "async_file_writer.h"
+#include "utils_log.h"
+
+// O_DIRECT 要求的地址、长度和文件偏移对齐
+#define ASYNC_WRITER_ALIGN 4096
+#define ASYNC_WRITER_ALIGN_UP(x) (((x) + ASYNC_WRITER_ALIGN - 1) & ~((size_t)ASYNC_WRITER_ALIGN - 1))
+#define ASYNC_WRITER_ALIGN_DOWN(x) ((x) & ~((size_t)ASYNC_WRITER_ALIGN - 1))
+
+AsyncFileWriter::AsyncFileWriter(const std::string &path, const AsyncFileWriterConfig &config) {
+    m_config = config;
+    m_config.chunk_size = ASYNC_WRITER_ALIGN_UP(std::max<size_t>(m_config.chunk_size, ASYNC_WRITER_ALIGN));
+    m_config.buffer_size = std::max(m_config.buffer_size, m_config.chunk_size * 2);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (m_config.direct_io) {
+        m_fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (m_fd < 0) {
+            d_mpp_module_warn("open %s with O_DIRECT failed: %s, use buffered io", path.c_str(), strerror(errno))
+        } else {
+            m_direct_io = true;
+        }
+    }
+    if (m_fd < 0) {
+        m_fd = open(path.c_str(), flags, 0644);
+    }
+    CHECK_VAL(m_fd < 0, d_mpp_module_error("failed to open output file %s: %s", path.c_str(), strerror(errno)); return;)
+
+    m_staging_size = m_config.chunk_size;
+    CHECK_VAL(posix_memalign((void **)&m_staging, ASYNC_WRITER_ALIGN, m_staging_size) != 0,
+              d_mpp_module_error("alloc writer staging buffer failed"); return;)
+    m_ring.resize(m_config.buffer_size);
+
+    m_writer_thread = std::thread(&AsyncFileWriter::writer_loop, this);
+    m_init_flag = true;
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_ring_mutex);
+        m_stop_flag = true;
+    }
+    m_data_cond.notify_all();
+    if (m_writer_thread.joinable()) {
+        m_writer_thread.join();
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    free(m_staging);
+    m_staging = nullptr;
+    d_mpp_module_info("async writer closed, bytes written: %llu, stall count: %llu",
+                      (unsigned long long)m_bytes_written.load(), (unsigned long long)m_stall_count.load())
+}
+
+int AsyncFileWriter::write(const void *data, size_t size) {
+    struct iovec iov = {const_cast<void *>(data), size};
+    return writev(&iov, 1);
+}
+
+int AsyncFileWriter::writev(const struct iovec *iov, int iov_count) {
+    CHECK_VAL(!m_init_flag, d_mpp_module_error("async writer not init"); return -1;)
+    std::unique_lock<std::mutex> lock(m_ring_mutex);
+    for (int i = 0; i < iov_count; i++) {
+        if (copy_in(lock, (const uint8_t *)iov[i].iov_base, iov[i].iov_len) != 0) {
+            return -1;
+        }
+    }
+    if (m_pending >= m_config.chunk_size) {
+        m_data_cond.notify_one();
+    }
+    return 0;
+}
+
+int AsyncFileWriter::copy_in(std::unique_lock<std::mutex> &lock, const uint8_t *src, size_t size) {
+    while (size > 0) {
+        if (m_pending == m_ring.size()) {
+            // 写线程跟不上，等待空间
+            m_stall_count++;
+            m_data_cond.notify_one();
+            m_space_cond.wait(lock, [this] { return m_pending < m_ring.size() || m_stop_flag; });
+            if (m_stop_flag) {
+                return -1;
+            }
+        }
+        size_t write_pos = (m_read_pos + m_pending) % m_ring.size();
+        size_t n = std::min(size, m_ring.size() - m_pending);
+        n = std::min(n, m_ring.size() - write_pos);
+        memcpy(m_ring.data() + write_pos, src, n);
+        m_pending += n;
+        src += n;
+        size -= n;
+    }
+    return 0;
+}
+
+void AsyncFileWriter::flush() {
+    {
+        std::lock_guard<std::mutex> lock(m_ring_mutex);
+        m_flush_flag = true;
+    }
+    m_data_cond.notify_one();
+}
+
+size_t AsyncFileWriter::pending_bytes() const {
+    std::lock_guard<std::mutex> lock(m_ring_mutex);
+    return m_pending;
+}
+
+void AsyncFileWriter::writer_loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_ring_mutex);
+        auto ready = [this] { return m_pending >= m_config.chunk_size || m_flush_flag || m_stop_flag; };
+        if (m_config.flush_interval_ms == 0) {
+            m_data_cond.wait(lock, ready);
+        } else {
+            m_data_cond.wait_for(lock, std::chrono::milliseconds(m_config.flush_interval_ms), ready);
+        }
+
+        size_t n = std::min(m_pending, m_staging_size);
+        // 关闭前最后一次写出，长度可以不对齐
+        bool last_write = m_stop_flag && n == m_pending;
+        if (m_direct_io && !last_write) {
+            n = ASYNC_WRITER_ALIGN_DOWN(n);
+        }
+        if (n == 0) {
+            m_flush_flag = false;
+            if (m_stop_flag) {
+                break;
+            }
+            continue;
+        }
+        // [m_read_pos, m_read_pos + n) 在 m_pending 减少前不会被调用方覆盖，拷贝时不持锁
+        size_t read_pos = m_read_pos;
+        lock.unlock();
+        size_t first = std::min(n, m_ring.size() - read_pos);
+        memcpy(m_staging, m_ring.data() + read_pos, first);
+        memcpy(m_staging + first, m_ring.data(), n - first);
+        lock.lock();
+        m_read_pos = (m_read_pos + n) % m_ring.size();
+        m_pending -= n;
+        if (m_pending == 0) {
+            m_flush_flag = false;
+        }
+        lock.unlock();
+        m_space_cond.notify_all();
+
+        if (last_write && m_direct_io && n % ASYNC_WRITER_ALIGN != 0) {
+            // 对齐部分仍走 O_DIRECT，剩余不足一页的尾部关闭 O_DIRECT 后写出
+            size_t aligned = ASYNC_WRITER_ALIGN_DOWN(n);
+            if (aligned > 0) {
+                write_out(m_staging, aligned);
+            }
+            fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+            m_direct_io = false;
+            write_out(m_staging + aligned, n - aligned);
+        } else {
+            write_out(m_staging, n);
+        }
+        if (m_config.sync_on_flush) {
+            fdatasync(m_fd);
+        }
+        if (last_write) {
+            break;
+        }
+    }
+}
+
+int AsyncFileWriter::write_out(const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t ret = ::write(m_fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && m_direct_io) {
+                // 部分文件系统可以用 O_DIRECT 打开但不支持写入
+                d_mpp_module_warn("O_DIRECT write not supported, use buffered io")
+                fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+                m_direct_io = false;
+                continue;
+            }
+            d_mpp_module_error("async writer write failed: %s", strerror(errno))
+            return -1;
+        }
+        data += ret;
+        size -= ret;
+        m_bytes_written += ret;
+    }
+    return 0;
+}
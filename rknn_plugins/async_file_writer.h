@@ -0,0 +1,89 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.18
+ * @brief: 后台线程写文件：调用方只把数据拷贝到环形缓冲区，写线程攒够一块后一次写出，
+ *         磁盘（SD 卡）写入的卡顿不会传递到调用线程，可选 O_DIRECT 绕过页缓存
+ */
+#ifndef RKNN_INFER_PLUGIN_ASYNC_FILE_WRITER_H
+#define RKNN_INFER_PLUGIN_ASYNC_FILE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <sys/uio.h>
+
+struct AsyncFileWriterConfig {
+    // 环形缓冲区大小，写线程跟不上时调用方在 write 中等待
+    size_t buffer_size = 8 << 20;
+    // 攒够一块后写出一次（O_DIRECT 时向上对齐到 4096）
+    size_t chunk_size = 1 << 20;
+    // 使用 O_DIRECT 打开文件，文件系统不支持时退回普通写入
+    bool direct_io = false;
+    // 数据不足一块时最长等待多久写出，0 代表只按块写出（关闭时写出剩余数据）
+    uint32_t flush_interval_ms = 1000;
+    // 每次写出后 fdatasync
+    bool sync_on_flush = false;
+};
+
+class AsyncFileWriter {
+public:
+    explicit AsyncFileWriter(const std::string &path, const AsyncFileWriterConfig &config = {});
+    // 写出剩余数据并关闭文件
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    [[nodiscard]] bool is_init() const { return m_init_flag; };
+
+    // 数据拷贝到缓冲区后返回，缓冲区满时等待写线程
+    int write(const void *data, size_t size);
+    // 多段数据一次加锁写入缓冲区，各段按顺序连续排列
+    int writev(const struct iovec *iov, int iov_count);
+    // 请求立即写出缓冲区中的数据（不等待写完）
+    void flush();
+
+    // 已写入文件的字节数
+    [[nodiscard]] uint64_t bytes_written() const { return m_bytes_written.load(); };
+    // 缓冲区中等待写出的字节数
+    [[nodiscard]] size_t pending_bytes() const;
+    // 调用方因缓冲区满而等待的次数
+    [[nodiscard]] uint64_t stall_count() const { return m_stall_count.load(); };
+
+private:
+    // 持锁时拷贝到缓冲区，缓冲区满时等待写线程
+    int copy_in(std::unique_lock<std::mutex> &lock, const uint8_t *src, size_t size);
+    void writer_loop();
+    // 写出 staging 中的 size 字节，处理部分写入
+    int write_out(const uint8_t *data, size_t size);
+
+private:
+    bool m_init_flag = false;
+    AsyncFileWriterConfig m_config;
+    int m_fd = -1;
+    bool m_direct_io = false;
+
+    // 环形缓冲区
+    std::vector<uint8_t> m_ring;
+    size_t m_read_pos = 0;
+    size_t m_pending = 0;
+    bool m_flush_flag = false;
+    bool m_stop_flag = false;
+    mutable std::mutex m_ring_mutex;
+    std::condition_variable m_data_cond;
+    std::condition_variable m_space_cond;
+
+    // 写线程使用的对齐内存（O_DIRECT 要求地址和长度对齐）
+    uint8_t *m_staging = nullptr;
+    size_t m_staging_size = 0;
+
+    std::atomic<uint64_t> m_bytes_written{0};
+    std::atomic<uint64_t> m_stall_count{0};
+    std::thread m_writer_thread;
+};
+
+#endif //RKNN_INFER_PLUGIN_ASYNC_FILE_WRITER_H
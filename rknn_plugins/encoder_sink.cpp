@@ -0,0 +1,554 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.19
+ * @brief: 编码码流输出实现
+ */
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "encoder_sink.h"
+#include "utils_log.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// 阻塞写出全部 iov，处理部分写入，iov 会被修改
+static int write_iov_all(int fd, struct iovec *iov, int iov_count) {
+    while (iov_count > 0) {
+        ssize_t ret = ::writev(fd, iov, std::min(iov_count, IOV_MAX));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        auto n = (size_t)ret;
+        while (iov_count > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int EncoderSink::write_header(const uint8_t *data, size_t size) {
+    m_header.assign(data, data + size);
+    return 0;
+}
+
+/*************************** 分段文件 ***************************/
+FileSegmentSink::FileSegmentSink(const std::string &path, const FileSegmentConfig &config) {
+    m_path = path;
+    m_config = config;
+}
+
+FileSegmentSink::~FileSegmentSink() {
+    close_segment();
+}
+
+int FileSegmentSink::set_config(const FileSegmentConfig &config) {
+    CHECK_VAL(m_segment_index != 0, d_mpp_module_error("file sink config must be set before the first packet"); return -1;)
+    m_config = config;
+    return 0;
+}
+
+std::string FileSegmentSink::make_segment_path(uint32_t index) const {
+    if (m_config.segment_ms == 0 && m_config.segment_bytes == 0) {
+        return m_path;
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%05u", index);
+    // 序号插在扩展名之前
+    size_t dot = m_path.find_last_of('.');
+    size_t slash = m_path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return m_path + suffix;
+    }
+    return m_path.substr(0, dot) + suffix + m_path.substr(dot);
+}
+
+std::string FileSegmentSink::segment_path() const {
+    return m_segment_paths.empty() ? std::string() : m_segment_paths.back();
+}
+
+uint64_t FileSegmentSink::stall_count() const {
+    std::lock_guard<std::mutex> lock(m_writer_mutex);
+    return m_closed_stall_count + (m_writer != nullptr ? m_writer->stall_count() : 0);
+}
+
+bool FileSegmentSink::need_rotate(const EncoderPacket &packet) const {
+    if (!packet.key_frame) {
+        return false;
+    }
+    if (m_config.segment_ms != 0 && packet.pts_ms - m_segment_start_pts >= m_config.segment_ms) {
+        return true;
+    }
+    return m_config.segment_bytes != 0 && m_segment_bytes >= m_config.segment_bytes;
+}
+
+int FileSegmentSink::open_segment(int64_t pts_ms) {
+    std::string path = make_segment_path(m_segment_index);
+    if (m_config.async_writer) {
+        auto writer = std::make_unique<AsyncFileWriter>(path, m_config.writer_config);
+        CHECK_VAL(!writer->is_init(), d_mpp_module_error("open segment %s failed", path.c_str()); return -1;)
+        std::lock_guard<std::mutex> lock(m_writer_mutex);
+        m_writer = std::move(writer);
+    } else {
+        m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        CHECK_VAL(m_fd < 0, d_mpp_module_error("open segment %s failed: %s", path.c_str(), strerror(errno)); return -1;)
+        m_batch.reserve(m_config.batch_bytes);
+    }
+    m_segment_open = true;
+    m_segment_index++;
+    m_segment_start_pts = pts_ms;
+    m_segment_bytes = 0;
+    m_segment_paths.push_back(path);
+    while (m_config.max_segments != 0 && m_segment_paths.size() > m_config.max_segments) {
+        unlink(m_segment_paths.front().c_str());
+        m_segment_paths.pop_front();
+    }
+    d_mpp_module_debug("open segment %s", path.c_str())
+
+    // 每个分段以码流头开始
+    if (!m_header.empty()) {
+        return emit(m_header.data(), m_header.size());
+    }
+    return 0;
+}
+
+void FileSegmentSink::close_segment() {
+    if (!m_segment_open) {
+        return;
+    }
+    flush_batch();
+    if (m_writer != nullptr) {
+        std::unique_ptr<AsyncFileWriter> writer;
+        {
+            std::lock_guard<std::mutex> lock(m_writer_mutex);
+            m_closed_stall_count += m_writer->stall_count();
+            writer.swap(m_writer);
+        }
+        // 析构时写出剩余数据并关闭文件
+        writer.reset();
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_segment_open = false;
+}
+
+int FileSegmentSink::emit(const uint8_t *data, size_t size) {
+    m_segment_bytes += size;
+    m_bytes_written += size;
+    if (m_writer != nullptr) {
+        return m_writer->write(data, size);
+    }
+    if (m_batch.size() + size <= m_config.batch_bytes) {
+        m_batch.insert(m_batch.end(), data, data + size);
+        return 0;
+    }
+    // 攒下的小包和当前包一次写出，大包不再拷贝
+    struct iovec iov[2] = {{m_batch.data(), m_batch.size()},
+                           {const_cast<uint8_t *>(data), size}};
+    int ret = write_iov_all(m_fd, iov, 2);
+    m_batch.clear();
+    CHECK_VAL(ret != 0, d_mpp_module_error("write segment failed: %s", strerror(errno)); return -1;)
+    return 0;
+}
+
+int FileSegmentSink::flush_batch() {
+    if (m_fd < 0 || m_batch.empty()) {
+        return 0;
+    }
+    struct iovec iov = {m_batch.data(), m_batch.size()};
+    int ret = write_iov_all(m_fd, &iov, 1);
+    m_batch.clear();
+    CHECK_VAL(ret != 0, d_mpp_module_error("write segment failed: %s", strerror(errno)); return -1;)
+    return 0;
+}
+
+int FileSegmentSink::write_header(const uint8_t *data, size_t size) {
+    bool changed = m_header.size() != size || (size != 0 && memcmp(m_header.data(), data, size) != 0);
+    EncoderSink::write_header(data, size);
+    if (!m_segment_open || !changed) {
+        return 0;
+    }
+    if (m_config.segment_ms != 0 || m_config.segment_bytes != 0) {
+        close_segment();
+        return 0;
+    }
+    return emit(data, size);
+}
+
+int FileSegmentSink::write_packet(const EncoderPacket &packet) {
+    if (m_segment_open && need_rotate(packet)) {
+        close_segment();
+    }
+    if (!m_segment_open && open_segment(packet.pts_ms) != 0) {
+        m_dropped_packets++;
+        return -1;
+    }
+    return emit(packet.data, packet.size);
+}
+
+void FileSegmentSink::flush() {
+    flush_batch();
+    if (m_writer != nullptr) {
+        m_writer->flush();
+    }
+}
+
+/*************************** 命名管道 / Unix socket ***************************/
+StreamSink::StreamSink(const std::string &path, const StreamSinkConfig &config) {
+    m_path = path;
+    m_config = config;
+}
+
+StreamSink::~StreamSink() {
+    disconnect();
+}
+
+int StreamSink::try_connect() {
+    auto now = std::chrono::steady_clock::now();
+    if (m_connect_tried && now - m_last_connect < std::chrono::milliseconds(m_config.reconnect_interval_ms)) {
+        return -1;
+    }
+    m_connect_tried = true;
+    m_last_connect = now;
+
+    if (m_config.type == STREAM_SINK_FIFO) {
+        struct stat st{};
+        if (stat(m_path.c_str(), &st) != 0) {
+            CHECK_VAL(mkfifo(m_path.c_str(), 0666) != 0,
+                      d_mpp_module_error("mkfifo %s failed: %s", m_path.c_str(), strerror(errno)); return -1;)
+        } else {
+            CHECK_VAL(!S_ISFIFO(st.st_mode), d_mpp_module_error("%s is not a fifo", m_path.c_str()); return -1;)
+        }
+        // 没有读端时返回 ENXIO
+        m_fd = open(m_path.c_str(), O_WRONLY | O_NONBLOCK);
+        if (m_fd < 0) {
+            return -1;
+        }
+    } else {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        CHECK_VAL(m_path.size() >= sizeof(addr.sun_path), d_mpp_module_error("socket path too long: %s", m_path.c_str()); return -1;)
+        strncpy(addr.sun_path, m_path.c_str(), sizeof(addr.sun_path) - 1);
+        m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        CHECK_VAL(m_fd < 0, d_mpp_module_error("create socket failed: %s", strerror(errno)); return -1;)
+        if (connect(m_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(m_fd);
+            m_fd = -1;
+            return -1;
+        }
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    }
+    m_wait_key_frame = true;
+    m_pending.clear();
+    d_mpp_module_info("stream sink %s connected", m_path.c_str())
+    return 0;
+}
+
+void StreamSink::disconnect() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+        d_mpp_module_info("stream sink %s disconnected", m_path.c_str())
+    }
+    m_pending.clear();
+    m_wait_key_frame = true;
+}
+
+ssize_t StreamSink::send_iov(struct iovec *iov, int iov_count) {
+    iov_count = std::min(iov_count, IOV_MAX);
+    if (m_config.type == STREAM_SINK_UNIX_SOCKET) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        ssize_t ret;
+        do {
+            ret = sendmsg(m_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (ret < 0 && errno == EINTR);
+        return ret;
+    }
+    // 管道没有 MSG_NOSIGNAL：写入时屏蔽 SIGPIPE，读端关闭时取走产生的信号
+    sigset_t pipe_set, old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    ssize_t ret;
+    do {
+        ret = ::writev(m_fd, iov, iov_count);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 && errno == EPIPE) {
+        int err = errno;
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe_set, nullptr, &zero);
+        errno = err;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    return ret;
+}
+
+int StreamSink::send_or_keep(struct iovec *iov, int iov_count) {
+    size_t total = 0;
+    for (int i = 0; i < iov_count; i++) {
+        total += iov[i].iov_len;
+    }
+    ssize_t ret = send_iov(iov, iov_count);
+    if (ret < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            // 接收方断开，下次写入时重连
+            disconnect();
+            return -1;
+        }
+        ret = 0;
+    }
+    m_bytes_written += ret;
+    if ((size_t)ret == total) {
+        m_pending.clear();
+        return 0;
+    }
+    // 未写完的部分按顺序保存（iov 可能引用 m_pending 本身，先拼到新的缓冲区）
+    std::vector<uint8_t> rest;
+    rest.reserve(total - ret);
+    auto skip = (size_t)ret;
+    for (int i = 0; i < iov_count; i++) {
+        auto *base = (const uint8_t *)iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        rest.insert(rest.end(), base + skip, base + len);
+        skip = 0;
+    }
+    m_pending.swap(rest);
+    return 0;
+}
+
+int StreamSink::write_header(const uint8_t *data, size_t size) {
+    bool changed = m_header.size() != size || (size != 0 && memcmp(m_header.data(), data, size) != 0);
+    EncoderSink::write_header(data, size);
+    if (changed) {
+        m_wait_key_frame = true;
+    }
+    return 0;
+}
+
+int StreamSink::write_packet(const EncoderPacket &packet) {
+    if (m_fd < 0 && try_connect() != 0) {
+        m_dropped_packets++;
+        return 0;
+    }
+    // 先尝试写完上次剩余的数据
+    if (!m_pending.empty()) {
+        struct iovec iov = {m_pending.data(), m_pending.size()};
+        if (send_or_keep(&iov, 1) != 0) {
+            m_dropped_packets++;
+            return 0;
+        }
+    }
+    if (m_wait_key_frame && !packet.key_frame) {
+        m_dropped_packets++;
+        return 0;
+    }
+    size_t header_size = m_wait_key_frame ? m_header.size() : 0;
+    if (m_pending.size() + header_size + packet.size > m_config.max_pending_bytes) {
+        // 接收方太慢，丢弃到下一个关键帧
+        m_wait_key_frame = true;
+        m_dropped_packets++;
+        return 0;
+    }
+    struct iovec iov[3];
+    int iov_count = 0;
+    if (!m_pending.empty()) {
+        iov[iov_count++] = {m_pending.data(), m_pending.size()};
+    }
+    if (header_size != 0) {
+        iov[iov_count++] = {m_header.data(), header_size};
+    }
+    iov[iov_count++] = {const_cast<uint8_t *>(packet.data), packet.size};
+    m_wait_key_frame = false;
+    if (send_or_keep(iov, iov_count) != 0) {
+        m_dropped_packets++;
+    }
+    return 0;
+}
+
+void StreamSink::flush() {
+    if (m_fd >= 0 && !m_pending.empty()) {
+        struct iovec iov = {m_pending.data(), m_pending.size()};
+        send_or_keep(&iov, 1);
+    }
+}
+
+/*************************** 内存环形缓冲 ***************************/
+MemoryRingSink::MemoryRingSink(const MemoryRingConfig &config) {
+    m_config = config;
+}
+
+int MemoryRingSink::write_header(const uint8_t *data, size_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_header.size() != size || (size != 0 && memcmp(m_header.data(), data, size) != 0)) {
+        pop_front_gop(m_packets.size());
+    }
+    return EncoderSink::write_header(data, size);
+}
+
+int MemoryRingSink::write_packet(const EncoderPacket &packet) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_packets.empty() && !packet.key_frame) {
+        // 缓冲区总是从关键帧开始
+        m_dropped_packets++;
+        return 0;
+    }
+    std::shared_ptr<std::vector<uint8_t>> buffer;
+    if (!m_free_buffers.empty()) {
+        buffer = std::move(m_free_buffers.back());
+        m_free_buffers.pop_back();
+    } else {
+        buffer = std::make_shared<std::vector<uint8_t>>();
+    }
+    buffer->assign(packet.data, packet.data + packet.size);
+    m_packets.push_back({std::move(buffer), packet.pts_ms, packet.key_frame});
+    m_bytes += packet.size;
+    m_bytes_written += packet.size;
+    evict();
+    return 0;
+}
+
+void MemoryRingSink::pop_front_gop(size_t next_key) {
+    for (size_t i = 0; i < next_key; i++) {
+        auto &front = m_packets.front();
+        m_bytes -= front.data->size();
+        // 正在被导出的包不复用
+        if (front.data.use_count() == 1 && m_free_buffers.size() < 64) {
+            m_free_buffers.push_back(std::move(front.data));
+        }
+        m_packets.pop_front();
+    }
+}
+
+void MemoryRingSink::evict() {
+    while (!m_packets.empty()) {
+        // 下一个 GOP 的起点
+        size_t next_key = 1;
+        while (next_key < m_packets.size() && !m_packets[next_key].key_frame) {
+            next_key++;
+        }
+        if (next_key == m_packets.size()) {
+            if (m_bytes > m_config.max_bytes) {
+                // 一个 GOP 就超出内存上限，清空后等待下一个关键帧
+                pop_front_gop(next_key);
+                continue;
+            }
+            break;
+        }
+        // 第二个 GOP 已经覆盖了保留时长，第一个 GOP 可以淘汰
+        int64_t newest = m_packets.back().pts_ms;
+        bool expired = newest - m_packets[next_key].pts_ms >= (int64_t)m_config.duration_ms;
+        if (!expired && m_bytes <= m_config.max_bytes) {
+            break;
+        }
+        pop_front_gop(next_key);
+    }
+}
+
+void MemoryRingSink::snapshot(uint32_t duration_ms,
+                              std::vector<uint8_t> &header,
+                              std::vector<RingPacket> &packets) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    header = m_header;
+    packets.clear();
+    if (m_packets.empty()) {
+        return;
+    }
+    // 从不晚于起点的最后一个关键帧开始
+    size_t start = 0;
+    if (duration_ms != 0) {
+        int64_t start_pts = m_packets.back().pts_ms - duration_ms;
+        for (size_t i = 0; i < m_packets.size() && m_packets[i].pts_ms <= start_pts; i++) {
+            if (m_packets[i].key_frame) {
+                start = i;
+            }
+        }
+    }
+    packets.assign(m_packets.begin() + (long)start, m_packets.end());
+}
+
+int MemoryRingSink::save_clip(const std::string &path, uint32_t duration_ms) const {
+    std::vector<uint8_t> header;
+    std::vector<RingPacket> packets;
+    snapshot(duration_ms, header, packets);
+    CHECK_VAL(packets.empty(), d_mpp_module_warn("memory ring is empty, no clip saved"); return -1;)
+
+    std::vector<struct iovec> iov;
+    iov.reserve(packets.size() + 1);
+    if (!header.empty()) {
+        iov.push_back({header.data(), header.size()});
+    }
+    for (auto &packet : packets) {
+        iov.push_back({packet.data->data(), packet.data->size()});
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK_VAL(fd < 0, d_mpp_module_error("open clip %s failed: %s", path.c_str(), strerror(errno)); return -1;)
+    int ret = write_iov_all(fd, iov.data(), (int)iov.size());
+    close(fd);
+    CHECK_VAL(ret != 0, d_mpp_module_error("write clip %s failed: %s", path.c_str(), strerror(errno)); return -1;)
+    d_mpp_module_info("save clip %s, %d packets", path.c_str(), (int)packets.size())
+    return 0;
+}
+
+int MemoryRingSink::get_clip(std::vector<uint8_t> &data, uint32_t duration_ms) const {
+    std::vector<uint8_t> header;
+    std::vector<RingPacket> packets;
+    snapshot(duration_ms, header, packets);
+    if (packets.empty()) {
+        data.clear();
+        return -1;
+    }
+    size_t total = header.size();
+    for (auto &packet : packets) {
+        total += packet.data->size();
+    }
+    data.clear();
+    data.reserve(total);
+    data.insert(data.end(), header.begin(), header.end());
+    for (auto &packet : packets) {
+        data.insert(data.end(), packet.data->begin(), packet.data->end());
+    }
+    return 0;
+}
+
+size_t MemoryRingSink::packet_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_packets.size();
+}
+
+size_t MemoryRingSink::buffered_bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+int64_t MemoryRingSink::buffered_ms() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_packets.empty() ? 0 : m_packets.back().pts_ms - m_packets.front().pts_ms;
+}
@@ -0,0 +1,218 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.19
+ * @brief: 编码码流输出：按时间/大小切分的文件、交给本地打包程序的命名管道/Unix socket、
+ *         保留最近 N 秒码流用于导出事件片段的内存环形缓冲，写入时用 writev 合并多段数据
+ */
+#ifndef RKNN_INFER_PLUGIN_ENCODER_SINK_H
+#define RKNN_INFER_PLUGIN_ENCODER_SINK_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <sys/uio.h>
+
+#include "async_file_writer.h"
+
+// 编码输出的一个包（一帧的码流）
+struct EncoderPacket {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    // 显示时间（毫秒）
+    int64_t pts_ms = 0;
+    bool key_frame = false;
+};
+
+class EncoderSink {
+public:
+    virtual ~EncoderSink() = default;
+
+    // 码流头（H.264 的 SPS/PPS），新的分段、新连接的接收方和导出的片段都以它开头
+    virtual int write_header(const uint8_t *data, size_t size);
+    virtual int write_packet(const EncoderPacket &packet) = 0;
+    // 写出缓存中的数据
+    virtual void flush() {};
+
+    // 已写出（或交给后台写线程）的字节数
+    [[nodiscard]] uint64_t bytes_written() const { return m_bytes_written.load(); };
+    // 因接收方跟不上或等待关键帧而丢弃的包数
+    [[nodiscard]] uint64_t dropped_packets() const { return m_dropped_packets.load(); };
+
+protected:
+    std::vector<uint8_t> m_header;
+    std::atomic<uint64_t> m_bytes_written{0};
+    std::atomic<uint64_t> m_dropped_packets{0};
+};
+
+/*************************** 分段文件 ***************************/
+struct FileSegmentConfig {
+    // 分段时长（毫秒），0 代表不按时间切分
+    uint32_t segment_ms = 0;
+    // 分段大小（字节），0 代表不按大小切分
+    uint64_t segment_bytes = 0;
+    // 最多保留的分段个数，超出后删除最早的分段，0 代表全部保留
+    uint32_t max_segments = 0;
+    // 小包先攒在内存中，攒够后和当前包一起用一次 writev 写出
+    size_t batch_bytes = 256 << 10;
+    // 使用后台写线程写文件（此时不再额外攒包）
+    bool async_writer = false;
+    AsyncFileWriterConfig writer_config;
+};
+
+// 不切分时直接写入 path；切分时写入 path 加序号，例如 out.h264 -> out_00000.h264
+// 只在关键帧处切分，每个分段都以码流头开始，可以单独播放
+class FileSegmentSink : public EncoderSink {
+public:
+    explicit FileSegmentSink(const std::string &path, const FileSegmentConfig &config = {});
+    ~FileSegmentSink() override;
+
+    FileSegmentSink(const FileSegmentSink &) = delete;
+    FileSegmentSink &operator=(const FileSegmentSink &) = delete;
+
+    // 修改配置，只能在写入第一个包之前调用
+    int set_config(const FileSegmentConfig &config);
+    [[nodiscard]] const FileSegmentConfig &get_config() const { return m_config; };
+
+    // 编码器重建后码流头变化：切分时从下一个包开始新的分段，不切分时写入当前文件
+    int write_header(const uint8_t *data, size_t size) override;
+    int write_packet(const EncoderPacket &packet) override;
+    void flush() override;
+
+    // 已经打开过的分段个数
+    [[nodiscard]] uint32_t segment_count() const { return m_segment_index; };
+    // 当前分段的文件路径
+    [[nodiscard]] std::string segment_path() const;
+    // 后台写线程缓冲区满导致等待的次数
+    [[nodiscard]] uint64_t stall_count() const;
+
+private:
+    [[nodiscard]] std::string make_segment_path(uint32_t index) const;
+    [[nodiscard]] bool need_rotate(const EncoderPacket &packet) const;
+    int open_segment(int64_t pts_ms);
+    void close_segment();
+    // 写入当前分段：攒包或直接交给后台写线程
+    int emit(const uint8_t *data, size_t size);
+    int flush_batch();
+
+private:
+    std::string m_path;
+    FileSegmentConfig m_config;
+
+    int m_fd = -1;
+    std::unique_ptr<AsyncFileWriter> m_writer;
+    bool m_segment_open = false;
+    uint32_t m_segment_index = 0;
+    int64_t m_segment_start_pts = 0;
+    uint64_t m_segment_bytes = 0;
+    std::deque<std::string> m_segment_paths;
+    std::vector<uint8_t> m_batch;
+    // 已关闭分段的写线程等待次数
+    uint64_t m_closed_stall_count = 0;
+    // 切换分段时替换 m_writer，和读取统计的线程互斥
+    mutable std::mutex m_writer_mutex;
+};
+
+/*************************** 命名管道 / Unix socket ***************************/
+enum StreamSinkType {
+    // 命名管道（不存在时创建），没有读端时丢包
+    STREAM_SINK_FIFO = 0,
+    // 连接到打包程序监听的 SOCK_STREAM Unix socket
+    STREAM_SINK_UNIX_SOCKET = 1,
+};
+
+struct StreamSinkConfig {
+    StreamSinkType type = STREAM_SINK_FIFO;
+    // 未连接时重试间隔（毫秒）
+    uint32_t reconnect_interval_ms = 1000;
+    // 接收方读取过慢时最多缓存的字节数，超出后丢包，直到下一个关键帧重新同步
+    size_t max_pending_bytes = 4 << 20;
+};
+
+// 非阻塞写入，接收方断开或过慢不会阻塞编码；每次（重新）同步都从码流头和关键帧开始
+class StreamSink : public EncoderSink {
+public:
+    explicit StreamSink(const std::string &path, const StreamSinkConfig &config = {});
+    ~StreamSink() override;
+
+    StreamSink(const StreamSink &) = delete;
+    StreamSink &operator=(const StreamSink &) = delete;
+
+    // 码流头变化时在下一个关键帧前重新发送
+    int write_header(const uint8_t *data, size_t size) override;
+    int write_packet(const EncoderPacket &packet) override;
+    void flush() override;
+
+    [[nodiscard]] bool is_connected() const { return m_fd >= 0; };
+
+private:
+    int try_connect();
+    void disconnect();
+    // 非阻塞写出 iov，返回写出的字节数，出错返回 -1
+    ssize_t send_iov(struct iovec *iov, int iov_count);
+    // 写出 iov，剩余部分追加到 m_pending
+    int send_or_keep(struct iovec *iov, int iov_count);
+
+private:
+    std::string m_path;
+    StreamSinkConfig m_config;
+    int m_fd = -1;
+    std::chrono::steady_clock::time_point m_last_connect;
+    bool m_connect_tried = false;
+    // 等待关键帧重新同步
+    bool m_wait_key_frame = true;
+    // 上一次没有写完的数据
+    std::vector<uint8_t> m_pending;
+};
+
+/*************************** 内存环形缓冲 ***************************/
+struct MemoryRingConfig {
+    // 保留最近多少毫秒的码流
+    uint32_t duration_ms = 10000;
+    // 最多占用的内存，超出后提前淘汰最早的 GOP
+    size_t max_bytes = 32 << 20;
+};
+
+// 按 GOP 淘汰，缓冲区总是从关键帧开始；导出片段时持锁只复制包的引用，写文件不阻塞编码线程
+class MemoryRingSink : public EncoderSink {
+public:
+    explicit MemoryRingSink(const MemoryRingConfig &config = {});
+
+    // 码流头变化时缓冲区中的包无法再和新的码流头一起播放，清空缓冲区
+    int write_header(const uint8_t *data, size_t size) override;
+    int write_packet(const EncoderPacket &packet) override;
+
+    // 导出最近 duration_ms 的片段（0 代表全部），从不晚于起点的关键帧开始，不重新编码
+    int save_clip(const std::string &path, uint32_t duration_ms = 0) const;
+    int get_clip(std::vector<uint8_t> &data, uint32_t duration_ms = 0) const;
+
+    [[nodiscard]] size_t packet_count() const;
+    [[nodiscard]] size_t buffered_bytes() const;
+    // 缓冲区中第一个包到最后一个包的时长
+    [[nodiscard]] int64_t buffered_ms() const;
+
+private:
+    struct RingPacket {
+        std::shared_ptr<std::vector<uint8_t>> data;
+        int64_t pts_ms;
+        bool key_frame;
+    };
+    // 淘汰最早的 GOP，持锁调用
+    void evict();
+    void pop_front_gop(size_t next_key);
+    void snapshot(uint32_t duration_ms, std::vector<uint8_t> &header, std::vector<RingPacket> &packets) const;
+
+private:
+    MemoryRingConfig m_config;
+    std::deque<RingPacket> m_packets;
+    size_t m_bytes = 0;
+    // 淘汰后没有被导出片段引用的包内存，留给后续的包复用
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> m_free_buffers;
+    mutable std::mutex m_mutex;
+};
+
+#endif //RKNN_INFER_PLUGIN_ENCODER_SINK_H
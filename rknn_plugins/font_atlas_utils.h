@@ -0,0 +1,282 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.17
+ * @brief: 点阵字体文字绘制，直接写入 NV12 / I420 帧，标注和编码全程不需要转换到 RGB
+ *         字形来源于公有领域的 font8x8_basic（ASCII 0x20 ~ 0x7E），构造时按缩放倍数预先展开为每行的连续像素段，
+ *         绘制时只做整段填充，Y 平面按原分辨率，UV 平面按 2x2 下采样（2x2 内任一像素有笔画即填充）
+ */
+#ifndef RKNN_INFER_PLUGIN_FONT_ATLAS_UTILS_H
+#define RKNN_INFER_PLUGIN_FONT_ATLAS_UTILS_H
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "image_op_utils.h"
+#include "yuv_convert_utils.h"
+
+#define FONT_GLYPH_FIRST 0x20
+#define FONT_GLYPH_LAST 0x7E
+#define FONT_GLYPH_NUM (FONT_GLYPH_LAST - FONT_GLYPH_FIRST + 1)
+// 原始字形大小，每行一个字节，bit 0 为最左侧像素
+#define FONT_GLYPH_SIZE 8
+// 标签背景框内边距（偶数，保证色度对齐）
+#define FONT_LABEL_PADDING 2
+
+static const uint8_t g_font8x8_basic[FONT_GLYPH_NUM][FONT_GLYPH_SIZE] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // ' '
+        {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00},   // !
+        {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // "
+        {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00},   // #
+        {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00},   // $
+        {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00},   // %
+        {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00},   // &
+        {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00},   // '
+        {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00},   // (
+        {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00},   // )
+        {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00},   // *
+        {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00},   // +
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06},   // ,
+        {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00},   // -
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00},   // .
+        {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00},   // /
+        {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00},   // 0
+        {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00},   // 1
+        {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00},   // 2
+        {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00},   // 3
+        {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00},   // 4
+        {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00},   // 5
+        {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00},   // 6
+        {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00},   // 7
+        {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00},   // 8
+        {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00},   // 9
+        {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00},   // :
+        {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06},   // ;
+        {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00},   // <
+        {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00},   // =
+        {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00},   // >
+        {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00},   // ?
+        {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00},   // @
+        {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00},   // A
+        {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00},   // B
+        {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00},   // C
+        {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00},   // D
+        {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00},   // E
+        {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00},   // F
+        {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00},   // G
+        {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00},   // H
+        {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // I
+        {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00},   // J
+        {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00},   // K
+        {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00},   // L
+        {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00},   // M
+        {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00},   // N
+        {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00},   // O
+        {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00},   // P
+        {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00},   // Q
+        {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00},   // R
+        {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00},   // S
+        {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // T
+        {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00},   // U
+        {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   // V
+        {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00},   // W
+        {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00},   // X
+        {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00},   // Y
+        {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00},   // Z
+        {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00},   // [
+        {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00},   // '\'
+        {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00},   // ]
+        {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00},   // ^
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF},   // _
+        {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00},   // `
+        {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00},   // a
+        {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00},   // b
+        {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00},   // c
+        {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00},   // d
+        {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00},   // e
+        {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00},   // f
+        {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F},   // g
+        {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00},   // h
+        {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // i
+        {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E},   // j
+        {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00},   // k
+        {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00},   // l
+        {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00},   // m
+        {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00},   // n
+        {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00},   // o
+        {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F},   // p
+        {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78},   // q
+        {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00},   // r
+        {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00},   // s
+        {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00},   // t
+        {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00},   // u
+        {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00},   // v
+        {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00},   // w
+        {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00},   // x
+        {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F},   // y
+        {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00},   // z
+        {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00},   // {
+        {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00},   // |
+        {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00},   // }
+        {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // ~
+};
+
+// 字形一行中的连续像素段
+struct FontGlyphRun {
+    uint16_t x;
+    uint16_t len;
+};
+
+/**
+ * @brief 预先展开的点阵字体，构造后只读，可以在多个线程中共享
+ */
+class FontAtlas {
+public:
+    // scale: 字形放大倍数，字符大小为 (8 * scale) x (8 * scale)
+    explicit FontAtlas(int scale = 2) {
+        m_scale = std::max(scale, 1);
+        m_glyph_w = FONT_GLYPH_SIZE * m_scale;
+        m_glyph_h = FONT_GLYPH_SIZE * m_scale;
+        std::vector<uint8_t> luma_mask(m_glyph_w * m_glyph_h);
+        std::vector<uint8_t> chroma_mask(m_glyph_w / 2 * m_glyph_h / 2);
+        for (int g = 0; g < FONT_GLYPH_NUM; g++) {
+            for (int y = 0; y < m_glyph_h; y++) {
+                const uint8_t bits = g_font8x8_basic[g][y / m_scale];
+                for (int x = 0; x < m_glyph_w; x++) {
+                    luma_mask[y * m_glyph_w + x] = (bits >> (x / m_scale)) & 1;
+                }
+            }
+            for (int y = 0; y < m_glyph_h / 2; y++) {
+                for (int x = 0; x < m_glyph_w / 2; x++) {
+                    const uint8_t *p = luma_mask.data() + y * 2 * m_glyph_w + x * 2;
+                    chroma_mask[y * m_glyph_w / 2 + x] = p[0] | p[1] | p[m_glyph_w] | p[m_glyph_w + 1];
+                }
+            }
+            append_runs(luma_mask.data(), m_glyph_w, m_glyph_h, m_luma_rows, m_luma_runs);
+            append_runs(chroma_mask.data(), m_glyph_w / 2, m_glyph_h / 2, m_chroma_rows, m_chroma_runs);
+        }
+        m_luma_rows.push_back((uint32_t)m_luma_runs.size());
+        m_chroma_rows.push_back((uint32_t)m_chroma_runs.size());
+    }
+
+    int glyph_width() const { return m_glyph_w; }
+    int glyph_height() const { return m_glyph_h; }
+    int text_width(const char *text) const { return (int)strlen(text) * m_glyph_w; }
+    // 标签背景框大小
+    int label_width(const char *text) const { return text_width(text) + 2 * FONT_LABEL_PADDING; }
+    int label_height() const { return m_glyph_h + 2 * FONT_LABEL_PADDING; }
+
+    /**
+     * @brief 在 YUV420 帧上绘制文字，超出图像的部分被裁剪
+     * @param x, y 文字左上角（向下取偶数，保证色度对齐）
+     * @param color 文字颜色，按字节依次为 Y、U、V（见 draw_rgb_to_yuv_color）
+     */
+    void draw_text(uint8_t *yuv, int w, int h, int hor_stride, int ver_stride, YuvPlaneLayout layout,
+                   int x, int y, const char *text, unsigned int color) const {
+        x &= ~1;
+        y &= ~1;
+        const uint8_t *pen_color = (const uint8_t *)&color;
+        uint8_t *u_plane = yuv + (size_t)hor_stride * ver_stride;
+        uint8_t *v_plane = u_plane + (size_t)hor_stride * ver_stride / 4;
+        for (const char *c = text; *c != '\0'; c++, x += m_glyph_w) {
+            if (x >= w) {
+                break;
+            }
+            if (x + m_glyph_w <= 0) {
+                continue;
+            }
+            int glyph = (uint8_t)*c;
+            glyph = (glyph < FONT_GLYPH_FIRST || glyph > FONT_GLYPH_LAST) ? '?' - FONT_GLYPH_FIRST
+                                                                           : glyph - FONT_GLYPH_FIRST;
+            blit_glyph(m_luma_rows, m_luma_runs, m_glyph_h, glyph,
+                       yuv, hor_stride, 1, w, h, x, y, pen_color);
+            if (layout == YUV_LAYOUT_NV12) {
+                blit_glyph(m_chroma_rows, m_chroma_runs, m_glyph_h / 2, glyph,
+                           u_plane, hor_stride, 2, w / 2, h / 2, x / 2, y / 2, pen_color + 1);
+            } else {
+                blit_glyph(m_chroma_rows, m_chroma_runs, m_glyph_h / 2, glyph,
+                           u_plane, hor_stride / 2, 1, w / 2, h / 2, x / 2, y / 2, pen_color + 1);
+                blit_glyph(m_chroma_rows, m_chroma_runs, m_glyph_h / 2, glyph,
+                           v_plane, hor_stride / 2, 1, w / 2, h / 2, x / 2, y / 2, pen_color + 2);
+            }
+        }
+    }
+
+    /**
+     * @brief 绘制带背景框的标签，标签贴在 (x, y) 上方，上方空间不足时放到 (x, y) 下方
+     */
+    void draw_label(uint8_t *yuv, int w, int h, int hor_stride, int ver_stride, YuvPlaneLayout layout,
+                    int x, int y, const char *text, unsigned int text_color, unsigned int bg_color) const {
+        x &= ~1;
+        y &= ~1;
+        const int label_w = label_width(text);
+        const int label_h = label_height();
+        if (y - label_h >= 0) {
+            y -= label_h;
+        }
+        DrawRect rect{x, y, label_w, label_h, bg_color, -1};
+        if (layout == YUV_LAYOUT_NV12) {
+            draw_rectangles_nv12(yuv, w, h, hor_stride, ver_stride, &rect, 1);
+        } else {
+            draw_rectangles_i420(yuv, w, h, hor_stride, ver_stride, &rect, 1);
+        }
+        draw_text(yuv, w, h, hor_stride, ver_stride, layout,
+                  x + FONT_LABEL_PADDING, y + FONT_LABEL_PADDING, text, text_color);
+    }
+
+private:
+    // 把每行的掩码转换为连续像素段，rows 记录每行第一个像素段的下标
+    static void append_runs(const uint8_t *mask, int mask_w, int mask_h,
+                            std::vector<uint32_t> &rows, std::vector<FontGlyphRun> &runs) {
+        for (int y = 0; y < mask_h; y++) {
+            rows.push_back((uint32_t)runs.size());
+            const uint8_t *p = mask + y * mask_w;
+            int x = 0;
+            while (x < mask_w) {
+                if (p[x] == 0) {
+                    x++;
+                    continue;
+                }
+                int x_end = x;
+                while (x_end < mask_w && p[x_end] != 0) {
+                    x_end++;
+                }
+                runs.push_back({(uint16_t)x, (uint16_t)(x_end - x)});
+                x = x_end;
+            }
+        }
+    }
+
+    // 把一个字形的像素段填充到一个平面，(gx, gy) 为平面坐标
+    static void blit_glyph(const std::vector<uint32_t> &rows, const std::vector<FontGlyphRun> &runs,
+                           int glyph_h, int glyph,
+                           uint8_t *plane, int stride, int channels, int plane_w, int plane_h,
+                           int gx, int gy, const uint8_t *color) {
+        const int row_begin = std::max(0, -gy);
+        const int row_end = std::min(glyph_h, plane_h - gy);
+        const uint32_t *row_index = rows.data() + glyph * glyph_h;
+        for (int r = row_begin; r < row_end; r++) {
+            uint8_t *line = plane + (size_t)stride * (gy + r);
+            for (uint32_t k = row_index[r]; k < row_index[r + 1]; k++) {
+                const int x0 = std::max(gx + runs[k].x, 0);
+                const int x1 = std::min(gx + runs[k].x + runs[k].len, plane_w);
+                if (x0 < x1) {
+                    draw_fill_span(line + x0 * channels, x1 - x0, channels, color);
+                }
+            }
+        }
+    }
+
+    int m_scale = 1;
+    int m_glyph_w = FONT_GLYPH_SIZE;
+    int m_glyph_h = FONT_GLYPH_SIZE;
+    // 所有字形按 [字形][行] 排列的像素段起始下标，末尾多一个结束下标
+    std::vector<uint32_t> m_luma_rows;
+    std::vector<FontGlyphRun> m_luma_runs;
+    std::vector<uint32_t> m_chroma_rows;
+    std::vector<FontGlyphRun> m_chroma_runs;
+};
+
+#endif //RKNN_INFER_PLUGIN_FONT_ATLAS_UTILS_H
@@ -0,0 +1,69 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.25
+ * @brief: 按 uri 创建帧来源
+ */
+#include <cstdio>
+
+#include "frame_source.h"
+#include "raw_frame_source.h"
+#include "shm_frame_source.h"
+#include "utils_log.h"
+#ifndef ENABLE_LOCAL_TEST
+#include "mpp_video_decoder.h"
+#endif
+
+// 本地测试不链接 MPP，只支持原始文件和图案
+static std::unique_ptr<FrameSource> create_decoder_source(const std::string &uri, const FrameSourceOptions &options) {
+#ifdef ENABLE_LOCAL_TEST
+    d_mpp_module_error("stream %s needs mpp decoder, not available in local test", uri.c_str())
+    return nullptr;
+#else
+    std::string path = uri;
+    if (path.compare(0, 5, "file:") == 0) {
+        path = path.substr(5);
+    } else if (path.find("://") != std::string::npos) {
+        d_mpp_module_error("stream %s not supported yet", uri.c_str())
+        return nullptr;
+    }
+    auto decoder = std::make_unique<MppVideoDecoder>(path, options.use_mmap, options.fps);
+    if (!decoder->is_init()) {
+        return nullptr;
+    }
+    decoder->set_loop_decode(options.loop);
+    if (options.adaptive_skip) {
+        decoder->set_adaptive_skip(options.skip_config);
+    }
+    if (options.buffer_group_provider) {
+        decoder->set_buffer_group_provider(options.buffer_group_provider);
+    }
+    return decoder;
+#endif
+}
+
+std::unique_ptr<FrameSource> create_frame_source(const std::string &uri, const FrameSourceOptions &options) {
+    std::unique_ptr<FrameSource> source;
+    if (uri.compare(0, 4, "yuv:") == 0) {
+        source = std::make_unique<RawFrameSource>(uri.substr(4), options, false);
+    } else if (uri.compare(0, 4, "y4m:") == 0) {
+        source = std::make_unique<RawFrameSource>(uri.substr(4), options, true);
+    } else if (uri.compare(0, 4, "shm:") == 0) {
+        // POSIX 共享内存名以 / 开头
+        std::string name = uri.substr(4);
+        source = std::make_unique<ShmFrameSource>(name[0] == '/' ? name : "/" + name, options);
+    } else if (uri.compare(0, 8, "pattern:") == 0) {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        CHECK_VAL(sscanf(uri.c_str() + 8, "%ux%u", &width, &height) != 2,
+                  d_mpp_module_error("invalid pattern size: %s", uri.c_str()); return nullptr;)
+        source = std::make_unique<PatternFrameSource>(width, height, options);
+    } else {
+        source = create_decoder_source(uri, options);
+    }
+    if (source == nullptr || !source->is_init()) {
+        d_mpp_module_error("create frame source failed: %s", uri.c_str())
+        return nullptr;
+    }
+    return source;
+}
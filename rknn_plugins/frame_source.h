@@ -0,0 +1,116 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.25
+ * @brief: 帧来源接口：MPP 解码器、原始 NV12/I420/Y4M 文件和合成图案都输出 DecoderMppFrame，
+ *         插件按接口取帧，没有 MPP 硬件时也能跑完整的 输入 -> 预处理 -> 推理 -> 后处理 流程
+ */
+#ifndef RKNN_INFER_PLUGIN_FRAME_SOURCE_H
+#define RKNN_INFER_PLUGIN_FRAME_SOURCE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+// 只使用 MPP 的类型定义，原始文件和图案来源不需要链接 MPP
+#include "rk_mpi.h"
+#include "h264_nal_splitter.h"
+
+struct DecoderMppFrame{
+    uint32_t hor_stride;
+    uint32_t ver_stride;
+
+    uint32_t hor_width;
+    uint32_t ver_height;
+
+    int data_fd;
+    void *data_buf;
+    uint32_t data_size;
+
+    // MPP 解码器为 MppFrame，其他来源为各自的帧句柄，release_frame 时使用
+    MppFrame mpp_frame;
+    MppFrameFormat mpp_frame_format;
+
+    // 按帧送包时有效：码流顺序的帧序号、时间戳和从送包到取出的解码延迟
+    uint64_t frame_index;
+    int64_t pts_ms;
+    uint32_t decode_latency_us;
+};
+
+// 预解码统计
+struct MppDecoderStats {
+    uint64_t decoded_frames = 0;        // 已解码帧数
+    int queue_capacity = 0;             // 预解码队列容量，0 表示同步解码
+    int queue_size = 0;                 // 当前队列中已就绪的帧数
+    double avg_queue_size = 0;          // 取帧时队列中平均就绪帧数
+    double decoder_stall_ms = 0;        // 队列满导致解码线程停顿的总时间
+    double consumer_wait_ms = 0;        // 队列空导致取帧等待的总时间
+    double avg_decode_latency_ms = 0;   // 按帧送包时，送包到取出的平均解码延迟
+    uint64_t skipped_frames = 0;        // 跳帧模式下没有送解码器的帧
+    uint64_t dropped_frames = 0;        // 跳帧模式下解码但没有输出的帧
+    H264SkipMode skip_mode = H264_SKIP_NONE;
+};
+
+// 创建帧来源的参数，各来源只使用其中相关的部分
+struct FrameSourceOptions {
+    // 解码：计算时间戳；原始文件和图案：输出帧率（y4m 优先使用文件头中的帧率）
+    double fps = 25;
+    // 不按帧率限速，尽快输出（原始文件和图案）
+    bool free_run = false;
+    // 读到末尾后从头继续
+    bool loop = false;
+
+    // MPP 解码
+    bool use_mmap = true;
+    bool adaptive_skip = false;
+    H264SkipConfig skip_config;
+    // 帧内存池由外部按帧大小提供，为空时解码器自己创建
+    std::function<MppBufferGroup(uint32_t buf_size)> buffer_group_provider;
+
+    // 原始 yuv 文件的尺寸和格式（y4m 从文件头读取），共享内存帧槽的最大尺寸，图案的尺寸写在 uri 中
+    uint32_t width = 0;
+    uint32_t height = 0;
+    MppFrameFormat format = MPP_FMT_YUV420SP;
+    // 原始文件和图案：输出帧的行步长对齐，同时未释放的帧数上限
+    uint32_t stride_align = 16;
+    int max_frames = 8;
+    // 图案输出的帧数，0 不限
+    uint64_t pattern_frames = 0;
+    // 共享内存帧环的访问权限（默认只允许同一用户的采集进程连接）
+    uint32_t shm_mode = 0600;
+};
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    [[nodiscard]] virtual bool is_init() const = 0;
+
+    // 获取下一帧，返回 0 成功，1 超时（timeout_ms < 0 一直等），-1 结束或出错
+    virtual int get_next_frame(DecoderMppFrame &frame, int timeout_ms = -1) = 0;
+
+    // 不等待：返回 0 取到帧，1 暂时没有帧，-1 结束或出错（多个流轮流取帧）
+    virtual int poll_frame(DecoderMppFrame &frame) { return get_next_frame(frame, 0); };
+
+    // 释放取到的帧，可以在其他线程调用
+    virtual void release_frame(DecoderMppFrame &frame) = 0;
+
+    // 调度队列压力，支持跳帧的来源按压力减少输出
+    virtual void set_queue_pressure(uint32_t queue_size, uint32_t queue_limit) {};
+
+    [[nodiscard]] virtual MppDecoderStats get_stats() const { return {}; };
+};
+
+/**
+ * @brief 按 uri 创建帧来源，失败返回 nullptr
+ *        file:xxx.h264 或直接写路径   MPP 解码（定义 ENABLE_LOCAL_TEST 时不可用）
+ *        yuv:xxx.yuv                  原始 NV12/I420 帧，尺寸和格式见 options
+ *        y4m:xxx.y4m                  YUV4MPEG2 文件（4:2:0）
+ *        pattern:1920x1080            合成的运动图案，格式见 options
+ *        shm:/rknn_frames             创建共享内存帧环，由外部采集进程（ShmFrameProducer）写入，
+ *                                     每槽最大尺寸为 options.width x options.height，槽数为 options.max_frames
+ */
+std::unique_ptr<FrameSource> create_frame_source(const std::string &uri, const FrameSourceOptions &options);
+
+#endif //RKNN_INFER_PLUGIN_FRAME_SOURCE_H
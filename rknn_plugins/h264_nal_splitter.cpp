@@ -0,0 +1,153 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.23
+ * @brief: H.264 Annex-B 访问单元切分实现
+ */
+#include <cstring>
+
+#include "h264_nal_splitter.h"
+
+H264NalSplitter::H264NalSplitter(const uint8_t *data, size_t size, double fps) {
+    m_begin = data;
+    m_end = data + size;
+    m_fps = fps > 0 ? fps : 25;
+    int sc_len;
+    // 跳过第一个起始码之前的无效数据
+    m_pos = find_start_code(m_begin, m_end, sc_len);
+}
+
+const uint8_t *H264NalSplitter::find_start_code(const uint8_t *begin, const uint8_t *end, int &sc_len) {
+    if (end - begin < 3) {
+        return end;
+    }
+    // memchr 按字长/向量查找 0x01，再回看前两个字节是否为 0
+    const uint8_t *p = begin + 2;
+    while (p < end) {
+        p = (const uint8_t *)memchr(p, 0x01, end - p);
+        if (p == nullptr) {
+            return end;
+        }
+        if (p[-1] == 0 && p[-2] == 0) {
+            const uint8_t *sc = p - 2;
+            if (sc > begin && sc[-1] == 0) {
+                sc--;
+            }
+            sc_len = (int)(p + 1 - sc);
+            return sc;
+        }
+        p++;
+    }
+    return end;
+}
+
+bool H264NalSplitter::next(H264AccessUnit &au) {
+    if (at_end()) {
+        return false;
+    }
+    au = H264AccessUnit();
+    au.data = m_pos;
+    bool has_vcl = false;
+    const uint8_t *sc = m_pos;
+    while (sc < m_end) {
+        int sc_len = 0;
+        sc = find_start_code(sc, m_end, sc_len);
+        const uint8_t *nal = sc + sc_len;
+        if (sc >= m_end || nal >= m_end) {
+            sc = m_end;
+            break;
+        }
+        int nal_type = nal[0] & 0x1f;
+        bool vcl = nal_type == H264_NAL_SLICE || nal_type == H264_NAL_IDR;
+        if (has_vcl) {
+            // 新访问单元的开始：AUD/SEI/SPS/PPS 以及 14~18 类型，或者 first_mb_in_slice == 0 的 slice
+            // （ue(v) 编码的 0 只有一个比特 1）
+            bool new_au = (nal_type >= H264_NAL_SEI && nal_type <= H264_NAL_AUD) ||
+                          (nal_type >= 14 && nal_type <= 18) ||
+                          (vcl && nal + 1 < m_end && (nal[1] & 0x80));
+            if (new_au) {
+                break;
+            }
+        }
+        if (vcl) {
+            has_vcl = true;
+            au.key_frame |= nal_type == H264_NAL_IDR;
+            au.reference |= (nal[0] & 0x60) != 0;
+        }
+        sc = nal;
+    }
+    au.size = sc - au.data;
+    au.index = m_frame_index++;
+    au.pts_ms = (int64_t)((double)au.index * 1000 / m_fps);
+    m_pos = sc;
+    return true;
+}
+
+void H264NalSplitter::reset() {
+    int sc_len;
+    m_pos = find_start_code(m_begin, m_end, sc_len);
+    m_base_index = m_frame_index;
+}
+
+int64_t H264NalSplitter::seek_key_frame(uint64_t frame_index) {
+    uint64_t base_index = m_base_index;
+    reset();
+    m_frame_index = base_index;
+    m_base_index = base_index;
+
+    const uint8_t *key_pos = nullptr;
+    uint64_t key_index = 0;
+    H264AccessUnit au;
+    const uint8_t *pos = m_pos;
+    while (next(au) && au.index <= frame_index) {
+        if (au.key_frame) {
+            key_pos = pos;
+            key_index = au.index;
+        }
+        pos = m_pos;
+    }
+    if (key_pos == nullptr) {
+        reset();
+        m_frame_index = base_index;
+        m_base_index = base_index;
+        return -1;
+    }
+    m_pos = key_pos;
+    m_frame_index = key_index;
+    return (int64_t)key_index;
+}
+
+H264SkipAction H264SkipFilter::filter(const H264AccessUnit &au, H264SkipMode mode, int nth, bool last) {
+    H264SkipAction action = H264_ACTION_DECODE;
+    if (au.key_frame) {
+        m_wait_key_frame = false;
+    } else if (m_wait_key_frame) {
+        // 参考帧已经缺失，直到下一个关键帧都不送解码
+        action = H264_ACTION_SKIP;
+    } else if (mode == H264_SKIP_NON_REFERENCE) {
+        action = au.reference ? H264_ACTION_DECODE : H264_ACTION_SKIP;
+    } else if (mode == H264_SKIP_EVERY_NTH && nth > 1 && au.index % nth != 0) {
+        action = au.reference ? H264_ACTION_DECODE_DROP : H264_ACTION_SKIP;
+    } else if (mode == H264_SKIP_KEY_FRAME_ONLY) {
+        m_wait_key_frame = au.reference;
+        action = H264_ACTION_SKIP;
+    }
+    if (last && action == H264_ACTION_SKIP) {
+        // 最后一帧带结束标志，送解码但不输出
+        action = H264_ACTION_DECODE_DROP;
+    }
+    return action;
+}
+
+H264SkipMode H264SkipFilter::mode_for_pressure(float pressure, const H264SkipConfig &config) {
+    if (pressure >= config.key_frame_only_pressure) {
+        return H264_SKIP_KEY_FRAME_ONLY;
+    }
+    if (pressure >= config.every_nth_pressure) {
+        return H264_SKIP_EVERY_NTH;
+    }
+    if (pressure >= config.non_reference_pressure) {
+        return H264_SKIP_NON_REFERENCE;
+    }
+    return H264_SKIP_NONE;
+}
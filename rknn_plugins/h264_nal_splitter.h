@@ -0,0 +1,107 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.23
+ * @brief: H.264 Annex-B 码流按访问单元（一帧）切分，不依赖 MPP，
+ *         切分后整帧送解码器（关闭 MPP 的 split 模式），每帧带序号和时间戳；
+ *         按帧类型和参考关系决定负载高时跳过哪些帧
+ */
+#ifndef RKNN_INFER_PLUGIN_H264_NAL_SPLITTER_H
+#define RKNN_INFER_PLUGIN_H264_NAL_SPLITTER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// NAL 单元类型
+enum H264NalType {
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+};
+
+// 一个访问单元，data 指向原始码流（含起始码），不拷贝
+struct H264AccessUnit {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint64_t index = 0;         // 码流顺序的帧序号，循环读取时继续递增
+    int64_t pts_ms = 0;         // index * 1000 / fps
+    bool key_frame = false;     // 包含 IDR
+    bool reference = false;     // 有 nal_ref_idc != 0 的 slice，为 false 时可以丢弃不影响后续解码
+};
+
+class H264NalSplitter {
+public:
+    // data 在切分期间必须有效（例如 mmap 的输入文件）
+    H264NalSplitter(const uint8_t *data, size_t size, double fps = 25);
+
+    // 取下一个访问单元，没有数据时返回 false
+    bool next(H264AccessUnit &au);
+
+    // 已经取完最后一个访问单元
+    [[nodiscard]] bool at_end() const { return m_pos >= m_end; };
+
+    // 回到码流开头，帧序号继续递增（循环读取）
+    void reset();
+
+    // 定位到 frame_index 及之前最近的关键帧，下一次 next 从该帧开始，返回关键帧序号，没有关键帧返回 -1
+    int64_t seek_key_frame(uint64_t frame_index);
+
+    [[nodiscard]] uint64_t frame_index() const { return m_frame_index; };
+
+    // 下一个访问单元在码流中的偏移
+    [[nodiscard]] size_t offset() const { return m_pos - m_begin; };
+
+    // 查找 [begin, end) 中的下一个起始码，返回起始码首字节（4 字节起始码指向第一个 0），没有时返回 end
+    static const uint8_t *find_start_code(const uint8_t *begin, const uint8_t *end, int &sc_len);
+
+private:
+    const uint8_t *m_begin;
+    const uint8_t *m_end;
+    const uint8_t *m_pos;
+    double m_fps;
+    uint64_t m_frame_index = 0;
+    // reset 时的帧序号，seek 按相对位置计算
+    uint64_t m_base_index = 0;
+};
+
+// 跳帧模式，负载高时减少解码
+enum H264SkipMode {
+    H264_SKIP_NONE,             // 解码全部帧
+    H264_SKIP_NON_REFERENCE,    // 跳过非参考帧
+    H264_SKIP_EVERY_NTH,        // 每 N 帧输出一帧：其余非参考帧不解码，参考帧解码但不输出
+    H264_SKIP_KEY_FRAME_ONLY,   // 只解码关键帧
+};
+
+// 每个访问单元的处理方式
+enum H264SkipAction {
+    H264_ACTION_DECODE,         // 解码并输出
+    H264_ACTION_DECODE_DROP,    // 解码（后续帧需要参考）但不输出
+    H264_ACTION_SKIP,           // 不送解码器
+};
+
+// 按队列压力（队列长度 / 队列限制）选择跳帧模式
+struct H264SkipConfig {
+    float non_reference_pressure = 0.3f;
+    float every_nth_pressure = 0.45f;
+    float key_frame_only_pressure = 0.6f;
+    int nth = 3;
+};
+
+class H264SkipFilter {
+public:
+    // 决定访问单元的处理方式；last 为码流最后一帧，需要送解码器带出结束标志
+    H264SkipAction filter(const H264AccessUnit &au, H264SkipMode mode, int nth, bool last);
+
+    // 跳过了参考帧，后续帧在下一个关键帧之前无法正确解码
+    [[nodiscard]] bool waiting_key_frame() const { return m_wait_key_frame; };
+
+    static H264SkipMode mode_for_pressure(float pressure, const H264SkipConfig &config);
+
+private:
+    bool m_wait_key_frame = false;
+};
+
+#endif //RKNN_INFER_PLUGIN_H264_NAL_SPLITTER_H
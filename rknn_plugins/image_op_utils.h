@@ -2,572 +2,265 @@
  * @author: bo.liu
  * @mail: geniusrabbit@qq.com
  * @date: 2023.08.10
- * @brief: 图像处理函数，来源于官方的 drawing.cpp
+ * @brief: 图像处理函数，接口来源于官方的 drawing.cpp
+ *         矩形先整体裁剪到图像范围内，再按行填充连续的像素段（memset / memcpy），内层循环不再做边界判断
+ *         叠加图预先转换为 YUVA，按行做逐像素 alpha 混合（NEON / SSE2）
  */
 #ifndef RKNN_INFER_PLUGIN_IMAGE_OP_UTILS_H
 #define RKNN_INFER_PLUGIN_IMAGE_OP_UTILS_H
 
-#include "string.h"
-
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) < (b)) ? (a) : (b))
-
-static void draw_rectangle_c1(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
-{
-    const unsigned char* pen_color = (const unsigned char*)&color;
-
-    if (thickness == -1)
-    {
-        // filled
-        for (int y = ry; y < ry + rh; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx; x < rx + rw; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x] = pen_color[0];
-            }
-        }
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMAGE_OP_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_OP_USE_SSE2
+#endif
+
+// 待填充的矩形区域 [x0, x1) x [y0, y1)，已裁剪到图像范围内
+struct DrawSpanBand {
+    int x0;
+    int x1;
+    int y0;
+    int y1;
+    // 像素值（按字节存放，前 channels 个有效）
+    uint8_t color[4];
+    // 绘制顺序，重叠时后绘制的覆盖先绘制的
+    int order;
+};
+
+// 批量绘制的矩形框
+struct DrawRect {
+    int x;
+    int y;
+    int w;
+    int h;
+    // 颜色，按字节依次为各通道的值（NV12 时依次为 Y、U、V）
+    unsigned int color;
+    // 线宽，-1 代表填充
+    int thickness;
+};
 
+/**
+ * @brief 填充一行中连续的 count 个像素：第一个像素写入后按倍增方式 memcpy
+ */
+static inline void draw_fill_span(uint8_t *p, int count, int channels, const uint8_t *color) {
+    if (count <= 0) {
         return;
     }
-
-    const int t0 = thickness / 2;
-    const int t1 = thickness - t0;
-
-    // draw top
-    {
-        for (int y = ry - t0; y < ry + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x] = pen_color[0];
-            }
-        }
+    if (channels == 1) {
+        memset(p, color[0], count);
+        return;
     }
-
-    // draw bottom
-    {
-        for (int y = ry + rh - t0; y < ry + rh + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x] = pen_color[0];
-            }
-        }
+    memcpy(p, color, channels);
+    int filled = channels;
+    const int total = count * channels;
+    while (filled < total) {
+        int n = std::min(filled, total - filled);
+        memcpy(p + filled, p, n);
+        filled += n;
     }
+}
 
-    // draw left
-    for (int x = rx - t0; x < rx + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x] = pen_color[0];
-        }
+/**
+ * @brief 填充裁剪后的矩形区域：先填充第一行，其余行直接拷贝第一行
+ */
+static inline void draw_fill_band(uint8_t *pixels, int stride, int channels, const DrawSpanBand &band) {
+    if (band.x0 >= band.x1 || band.y0 >= band.y1) {
+        return;
     }
-
-    // draw right
-    for (int x = rx + rw - t0; x < rx + rw + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x] = pen_color[0];
-        }
+    uint8_t *first = pixels + (size_t)stride * band.y0 + band.x0 * channels;
+    const int span = band.x1 - band.x0;
+    draw_fill_span(first, span, channels, band.color);
+    for (int y = band.y0 + 1; y < band.y1; y++) {
+        memcpy(pixels + (size_t)stride * y + band.x0 * channels, first, span * channels);
     }
 }
 
-static void draw_rectangle_c2(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
-{
-    const unsigned char* pen_color = (const unsigned char*)&color;
-
-    if (thickness == -1)
-    {
-        // filled
-        for (int y = ry; y < ry + rh; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx; x < rx + rw; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
+/**
+ * @brief 将 [x0, x1) x [y0, y1) 裁剪到 w x h 内，完全在外面时返回 false
+ */
+static inline bool draw_clip_band(int x0, int y0, int x1, int y1, int w, int h, DrawSpanBand &band) {
+    band.x0 = std::max(x0, 0);
+    band.y0 = std::max(y0, 0);
+    band.x1 = std::min(x1, w);
+    band.y1 = std::min(y1, h);
+    return band.x0 < band.x1 && band.y0 < band.y1;
+}
 
-                p[x * 2 + 0] = pen_color[0];
-                p[x * 2 + 1] = pen_color[1];
-            }
+/**
+ * @brief 把矩形框拆成最多 4 个已裁剪的填充区域（上、下、左、右），几何关系与官方实现一致
+ */
+static inline int draw_rect_bands(int w, int h, int rx, int ry, int rw, int rh, unsigned int color, int thickness,
+                                  int order, std::vector<DrawSpanBand> &bands) {
+    DrawSpanBand band{};
+    memcpy(band.color, &color, sizeof(band.color));
+    band.order = order;
+    int band_num = 0;
+    if (thickness == -1) {
+        if (draw_clip_band(rx, ry, rx + rw, ry + rh, w, h, band)) {
+            bands.push_back(band);
+            band_num++;
         }
-
-        return;
+        return band_num;
     }
 
     const int t0 = thickness / 2;
     const int t1 = thickness - t0;
-
-    // draw top
-    {
-        for (int y = ry - t0; y < ry + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 2 + 0] = pen_color[0];
-                p[x * 2 + 1] = pen_color[1];
-            }
-        }
-    }
-
-    // draw bottom
-    {
-        for (int y = ry + rh - t0; y < ry + rh + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 2 + 0] = pen_color[0];
-                p[x * 2 + 1] = pen_color[1];
-            }
-        }
-    }
-
-    // draw left
-    for (int x = rx - t0; x < rx + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x * 2 + 0] = pen_color[0];
-            p[x * 2 + 1] = pen_color[1];
-        }
-    }
-
-    // draw right
-    for (int x = rx + rw - t0; x < rx + rw + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x * 2 + 0] = pen_color[0];
-            p[x * 2 + 1] = pen_color[1];
+    const int edges[4][4] = {
+            // top
+            {rx - t0, ry - t0, rx + rw + t1, ry + t1},
+            // bottom
+            {rx - t0, ry + rh - t0, rx + rw + t1, ry + rh + t1},
+            // left
+            {rx - t0, ry + t1, rx + t1, ry + rh - t0},
+            // right
+            {rx + rw - t0, ry + t1, rx + rw + t1, ry + rh - t0},
+    };
+    for (const auto &edge : edges) {
+        if (draw_clip_band(edge[0], edge[1], edge[2], edge[3], w, h, band)) {
+            bands.push_back(band);
+            band_num++;
         }
     }
+    return band_num;
 }
 
-static void draw_rectangle_c3(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
-{
-    const unsigned char* pen_color = (const unsigned char*)&color;
-
-    if (thickness == -1)
-    {
-        // filled
-        for (int y = ry; y < ry + rh; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx; x < rx + rw; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 3 + 0] = pen_color[0];
-                p[x * 3 + 1] = pen_color[1];
-                p[x * 3 + 2] = pen_color[2];
-            }
-        }
-
+/**
+ * @brief 按行从上到下一次扫描绘制所有区域，每行只访问一次，重叠时按 order 覆盖
+ */
+static void draw_bands(uint8_t *pixels, int stride, int channels, std::vector<DrawSpanBand> &bands) {
+    if (bands.empty()) {
         return;
     }
-
-    const int t0 = thickness / 2;
-    const int t1 = thickness - t0;
-
-    // draw top
-    {
-        for (int y = ry - t0; y < ry + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 3 + 0] = pen_color[0];
-                p[x * 3 + 1] = pen_color[1];
-                p[x * 3 + 2] = pen_color[2];
-            }
+    std::stable_sort(bands.begin(), bands.end(), [](const DrawSpanBand &a, const DrawSpanBand &b) {
+        return a.y0 < b.y0;
+    });
+    thread_local std::vector<const DrawSpanBand *> active;
+    active.clear();
+    size_t next = 0;
+    int y = bands[0].y0;
+    while (next < bands.size() || !active.empty()) {
+        if (active.empty() && bands[next].y0 > y) {
+            y = bands[next].y0;
         }
-    }
-
-    // draw bottom
-    {
-        for (int y = ry + rh - t0; y < ry + rh + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 3 + 0] = pen_color[0];
-                p[x * 3 + 1] = pen_color[1];
-                p[x * 3 + 2] = pen_color[2];
-            }
+        bool added = false;
+        while (next < bands.size() && bands[next].y0 == y) {
+            active.push_back(&bands[next++]);
+            added = true;
         }
-    }
-
-    // draw left
-    for (int x = rx - t0; x < rx + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x * 3 + 0] = pen_color[0];
-            p[x * 3 + 1] = pen_color[1];
-            p[x * 3 + 2] = pen_color[2];
+        if (added) {
+            std::stable_sort(active.begin(), active.end(), [](const DrawSpanBand *a, const DrawSpanBand *b) {
+                return a->order < b->order;
+            });
         }
-    }
-
-    // draw right
-    for (int x = rx + rw - t0; x < rx + rw + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x * 3 + 0] = pen_color[0];
-            p[x * 3 + 1] = pen_color[1];
-            p[x * 3 + 2] = pen_color[2];
+        uint8_t *row = pixels + (size_t)stride * y;
+        for (const DrawSpanBand *band : active) {
+            draw_fill_span(row + band->x0 * channels, band->x1 - band->x0, channels, band->color);
         }
+        y++;
+        active.erase(std::remove_if(active.begin(), active.end(), [y](const DrawSpanBand *band) {
+            return band->y1 <= y;
+        }), active.end());
     }
 }
 
-static void draw_rectangle_c4(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
+static void draw_rectangle_cn(unsigned char* pixels, int w, int h, int stride, int channels,
+                              int rx, int ry, int rw, int rh, unsigned int color, int thickness)
 {
-    const unsigned char* pen_color = (const unsigned char*)&color;
-
-    if (thickness == -1)
-    {
-        // filled
-        for (int y = ry; y < ry + rh; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx; x < rx + rw; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 4 + 0] = pen_color[0];
-                p[x * 4 + 1] = pen_color[1];
-                p[x * 4 + 2] = pen_color[2];
-                p[x * 4 + 3] = pen_color[3];
-            }
-        }
-
-        return;
-    }
-
-    const int t0 = thickness / 2;
-    const int t1 = thickness - t0;
-
-    // draw top
-    {
-        for (int y = ry - t0; y < ry + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 4 + 0] = pen_color[0];
-                p[x * 4 + 1] = pen_color[1];
-                p[x * 4 + 2] = pen_color[2];
-                p[x * 4 + 3] = pen_color[3];
-            }
-        }
-    }
-
-    // draw bottom
-    {
-        for (int y = ry + rh - t0; y < ry + rh + t1; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            for (int x = rx - t0; x < rx + rw + t1; x++)
-            {
-                if (x < 0)
-                    continue;
-
-                if (x >= w)
-                    break;
-
-                p[x * 4 + 0] = pen_color[0];
-                p[x * 4 + 1] = pen_color[1];
-                p[x * 4 + 2] = pen_color[2];
-                p[x * 4 + 3] = pen_color[3];
-            }
-        }
+    thread_local std::vector<DrawSpanBand> bands;
+    bands.clear();
+    draw_rect_bands(w, h, rx, ry, rw, rh, color, thickness, 0, bands);
+    for (const DrawSpanBand &band : bands) {
+        draw_fill_band(pixels, stride, channels, band);
     }
+}
 
-    // draw left
-    for (int x = rx - t0; x < rx + t1; x++)
-    {
-        if (x < 0)
-            continue;
+static void draw_rectangle_c1(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
+{
+    draw_rectangle_cn(pixels, w, h, stride, 1, rx, ry, rw, rh, color, thickness);
+}
 
-        if (x >= w)
-            break;
+static void draw_rectangle_c2(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
+{
+    draw_rectangle_cn(pixels, w, h, stride, 2, rx, ry, rw, rh, color, thickness);
+}
 
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
+static void draw_rectangle_c3(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
+{
+    draw_rectangle_cn(pixels, w, h, stride, 3, rx, ry, rw, rh, color, thickness);
+}
 
-            if (y >= h)
-                break;
+static void draw_rectangle_c4(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
+{
+    draw_rectangle_cn(pixels, w, h, stride, 4, rx, ry, rw, rh, color, thickness);
+}
 
-            unsigned char* p = pixels + stride * y;
+/**
+ * @brief RGB 颜色转换为 NV12 绘制用的颜色（BT.601 limited range），按字节依次为 Y、U、V
+ */
+static inline unsigned int draw_rgb_to_yuv_color(uint8_t r, uint8_t g, uint8_t b) {
+    int y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    return (unsigned int)y | ((unsigned int)u << 8) | ((unsigned int)v << 16);
+}
 
-            p[x * 4 + 0] = pen_color[0];
-            p[x * 4 + 1] = pen_color[1];
-            p[x * 4 + 2] = pen_color[2];
-            p[x * 4 + 3] = pen_color[3];
-        }
+/**
+ * @brief 在带步长的 NV12 帧上批量绘制矩形框，Y 平面和 UV 平面各按行扫描一次
+ * @param hor_stride, ver_stride 行步长和高度步长（UV 平面起始于 hor_stride * ver_stride）
+ */
+static void draw_rectangles_nv12(unsigned char* nv12, int w, int h, int hor_stride, int ver_stride,
+                                 const DrawRect* rects, int rect_num)
+{
+    thread_local std::vector<DrawSpanBand> y_bands;
+    thread_local std::vector<DrawSpanBand> uv_bands;
+    y_bands.clear();
+    uv_bands.clear();
+    for (int i = 0; i < rect_num; i++) {
+        const DrawRect &rect = rects[i];
+        const unsigned char* pen_color = (const unsigned char*)&rect.color;
+        unsigned int color_uv = (unsigned int)pen_color[1] | ((unsigned int)pen_color[2] << 8);
+        int thickness_uv = rect.thickness == -1 ? rect.thickness : std::max(rect.thickness / 2, 1);
+        draw_rect_bands(w, h, rect.x, rect.y, rect.w, rect.h, pen_color[0], rect.thickness, i, y_bands);
+        draw_rect_bands(w / 2, h / 2, rect.x / 2, rect.y / 2, rect.w / 2, rect.h / 2, color_uv, thickness_uv, i,
+                        uv_bands);
     }
+    draw_bands(nv12, hor_stride, 1, y_bands);
+    draw_bands(nv12 + (size_t)hor_stride * ver_stride, hor_stride, 2, uv_bands);
+}
 
-    // draw right
-    for (int x = rx + rw - t0; x < rx + rw + t1; x++)
-    {
-        if (x < 0)
-            continue;
-
-        if (x >= w)
-            break;
-
-        for (int y = ry + t1; y < ry + rh - t0; y++)
-        {
-            if (y < 0)
-                continue;
-
-            if (y >= h)
-                break;
-
-            unsigned char* p = pixels + stride * y;
-
-            p[x * 4 + 0] = pen_color[0];
-            p[x * 4 + 1] = pen_color[1];
-            p[x * 4 + 2] = pen_color[2];
-            p[x * 4 + 3] = pen_color[3];
-        }
+/**
+ * @brief 在带步长的 I420 帧上批量绘制矩形框（U、V 平面行步长为 hor_stride / 2）
+ */
+static void draw_rectangles_i420(unsigned char* i420, int w, int h, int hor_stride, int ver_stride,
+                                 const DrawRect* rects, int rect_num)
+{
+    thread_local std::vector<DrawSpanBand> y_bands;
+    thread_local std::vector<DrawSpanBand> u_bands;
+    thread_local std::vector<DrawSpanBand> v_bands;
+    y_bands.clear();
+    u_bands.clear();
+    v_bands.clear();
+    for (int i = 0; i < rect_num; i++) {
+        const DrawRect &rect = rects[i];
+        const unsigned char* pen_color = (const unsigned char*)&rect.color;
+        int thickness_uv = rect.thickness == -1 ? rect.thickness : std::max(rect.thickness / 2, 1);
+        draw_rect_bands(w, h, rect.x, rect.y, rect.w, rect.h, pen_color[0], rect.thickness, i, y_bands);
+        draw_rect_bands(w / 2, h / 2, rect.x / 2, rect.y / 2, rect.w / 2, rect.h / 2, pen_color[1], thickness_uv, i,
+                        u_bands);
+        draw_rect_bands(w / 2, h / 2, rect.x / 2, rect.y / 2, rect.w / 2, rect.h / 2, pen_color[2], thickness_uv, i,
+                        v_bands);
     }
+    unsigned char* u_plane = i420 + (size_t)hor_stride * ver_stride;
+    draw_bands(i420, hor_stride, 1, y_bands);
+    draw_bands(u_plane, hor_stride / 2, 1, u_bands);
+    draw_bands(u_plane + (size_t)hor_stride * ver_stride / 4, hor_stride / 2, 1, v_bands);
 }
 
 static void draw_rectangle_yuv420sp(unsigned char* yuv420sp, int w, int h, int rx, int ry, int rw, int rh, unsigned int color, int thickness)
@@ -579,23 +272,8 @@ static void draw_rectangle_yuv420sp(unsigned char* yuv420sp, int w, int h, int r
     // assert rw % 2 == 0
     // assert rh % 2 == 0
     // assert thickness % 2 == 0
-
-    const unsigned char* pen_color = (const unsigned char*)&color;
-
-    unsigned int v_y;
-    unsigned int v_uv;
-    unsigned char* pen_color_y = (unsigned char*)&v_y;
-    unsigned char* pen_color_uv = (unsigned char*)&v_uv;
-    pen_color_y[0] = pen_color[0];
-    pen_color_uv[0] = pen_color[1];
-    pen_color_uv[1] = pen_color[2];
-
-    unsigned char* Y = yuv420sp;
-    draw_rectangle_c1(Y, w, h, w, rx, ry, rw, rh, v_y, thickness);
-
-    unsigned char* UV = yuv420sp + w * h;
-    int thickness_uv = thickness == -1 ? thickness : max(thickness / 2, 1);
-    draw_rectangle_c2(UV, w / 2, h / 2, w, rx / 2, ry / 2, rw / 2, rh / 2, v_uv, thickness_uv);
+    DrawRect rect{rx, ry, rw, rh, color, thickness};
+    draw_rectangles_nv12(yuv420sp, w, h, w, h, &rect, 1);
 }
 
 static void draw_image_yuv420sp(unsigned char* yuv420sp, int w, int h, unsigned char* draw_img, int rx, int ry, int rw, int rh) {
@@ -607,4 +285,161 @@ static void draw_image_yuv420sp(unsigned char* yuv420sp, int w, int h, unsigned
     }
 }
 
+// 预先转换好的 YUVA 叠加图（宽高为偶数），每张叠加图只转换一次，之后每帧直接混合
+struct YuvaOverlay {
+    int width = 0;
+    int height = 0;
+    // Y 平面和对应的 alpha，width x height
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> y_alpha;
+    // UV 交织平面和对应的 alpha（每个色度像素的 alpha 重复两次，与 UV 一一对应），width x height / 2
+    std::vector<uint8_t> uv;
+    std::vector<uint8_t> uv_alpha;
+};
+
+/**
+ * @brief RGBA 叠加图转换为 YUVA，奇数宽高的最后一行 / 列被丢弃
+ *        色度取 2x2 内按 alpha 加权的平均颜色，alpha 取 2x2 平均值
+ * @param stride RGBA 图像的行步长（字节）
+ */
+static int yuva_overlay_from_rgba(const uint8_t *rgba, int width, int height, int stride, YuvaOverlay &overlay) {
+    if (rgba == nullptr || width < 2 || height < 2) {
+        return -1;
+    }
+    overlay.width = width & ~1;
+    overlay.height = height & ~1;
+    const int w = overlay.width;
+    const int h = overlay.height;
+    overlay.y.resize(w * h);
+    overlay.y_alpha.resize(w * h);
+    overlay.uv.resize(w * h / 2);
+    overlay.uv_alpha.resize(w * h / 2);
+    for (int row = 0; row < h; row++) {
+        const uint8_t *p = rgba + (size_t)stride * row;
+        for (int col = 0; col < w; col++, p += 4) {
+            overlay.y[row * w + col] = (uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+            overlay.y_alpha[row * w + col] = p[3];
+        }
+    }
+    for (int row = 0; row < h / 2; row++) {
+        const uint8_t *p0 = rgba + (size_t)stride * row * 2;
+        const uint8_t *p1 = p0 + stride;
+        for (int col = 0; col < w / 2; col++, p0 += 8, p1 += 8) {
+            const uint8_t *px[4] = {p0, p0 + 4, p1, p1 + 4};
+            int sum_a = 0;
+            int sum_rgb[3] = {0, 0, 0};
+            for (auto q : px) {
+                sum_a += q[3];
+                for (int c = 0; c < 3; c++) {
+                    sum_rgb[c] += q[c] * q[3];
+                }
+            }
+            int rgb[3] = {0, 0, 0};
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = sum_a == 0 ? 0 : (sum_rgb[c] + sum_a / 2) / sum_a;
+            }
+            uint8_t *uv = overlay.uv.data() + row * w + col * 2;
+            uint8_t *uv_alpha = overlay.uv_alpha.data() + row * w + col * 2;
+            uv[0] = (uint8_t)(((-38 * rgb[0] - 74 * rgb[1] + 112 * rgb[2] + 128) >> 8) + 128);
+            uv[1] = (uint8_t)(((112 * rgb[0] - 94 * rgb[1] - 18 * rgb[2] + 128) >> 8) + 128);
+            uv_alpha[0] = uv_alpha[1] = (uint8_t)((sum_a + 2) / 4);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 一行 alpha 混合（标量实现）：dst = round((src * a + dst * (255 - a)) / 255)
+ */
+static inline void overlay_blend_row_c(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned int v = src[i] * alpha[i] + dst[i] * (255 - alpha[i]) + 128;
+        dst[i] = (uint8_t)((v + (v >> 8)) >> 8);
+    }
+}
+
+/**
+ * @brief 一行 alpha 混合，NEON / SSE2 每次处理 16 个像素，结果与标量实现逐位一致
+ */
+static inline void overlay_blend_row(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int count) {
+    int i = 0;
+#if defined(IMAGE_OP_USE_NEON)
+    const uint8x16_t c255 = vdupq_n_u8(255);
+    const uint16x8_t c128 = vdupq_n_u16(128);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t d = vld1q_u8(dst + i);
+        uint8x16_t a = vld1q_u8(alpha + i);
+        uint8x16_t na = vsubq_u8(c255, a);
+        uint16x8_t lo = vmlal_u8(vmlal_u8(c128, vget_low_u8(s), vget_low_u8(a)), vget_low_u8(d), vget_low_u8(na));
+        uint16x8_t hi = vmlal_u8(vmlal_u8(c128, vget_high_u8(s), vget_high_u8(a)), vget_high_u8(d), vget_high_u8(na));
+        lo = vsraq_n_u16(lo, lo, 8);
+        hi = vsraq_n_u16(hi, hi, 8);
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#elif defined(IMAGE_OP_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+    for (; i + 16 <= count; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+        __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+        __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), a_lo),
+                                                 _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(c255, a_lo))),
+                                   c128);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), a_hi),
+                                                 _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(c255, a_hi))),
+                                   c128);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    overlay_blend_row_c(dst + i, src + i, alpha + i, count - i);
+}
+
+/**
+ * @brief 把 YUVA 叠加图的一部分混合到带步长的 NV12 帧上，超出帧的部分被裁剪
+ * @param x, y 叠加区域在帧上的左上角（向下取偶数，保证色度对齐）
+ * @param crop_x, crop_y, crop_w, crop_h 使用叠加图的哪一部分，crop_w / crop_h 为 -1 时使用到叠加图边缘
+ */
+static void draw_overlay_nv12(unsigned char* nv12, int w, int h, int hor_stride, int ver_stride,
+                              const YuvaOverlay &overlay, int x, int y,
+                              int crop_x = 0, int crop_y = 0, int crop_w = -1, int crop_h = -1)
+{
+    x &= ~1;
+    y &= ~1;
+    crop_x = std::max(crop_x, 0) & ~1;
+    crop_y = std::max(crop_y, 0) & ~1;
+    int crop_x1 = crop_w < 0 ? overlay.width : std::min(crop_x + crop_w, overlay.width);
+    int crop_y1 = crop_h < 0 ? overlay.height : std::min(crop_y + crop_h, overlay.height);
+    // 裁剪到帧内
+    int src_x0 = crop_x + std::max(0, -x);
+    int src_y0 = crop_y + std::max(0, -y);
+    int src_x1 = std::min(crop_x1, crop_x + (w & ~1) - x);
+    int src_y1 = std::min(crop_y1, crop_y + (h & ~1) - y);
+    // 宽高取偶数，Y 与 UV 一一对应
+    const int span = (src_x1 - src_x0) & ~1;
+    src_y1 = src_y0 + ((src_y1 - src_y0) & ~1);
+    if (span <= 0 || src_y0 >= src_y1) {
+        return;
+    }
+    const int dst_x0 = x + src_x0 - crop_x;
+    const int dst_y0 = y + src_y0 - crop_y;
+    for (int row = src_y0; row < src_y1; row++) {
+        overlay_blend_row(nv12 + (size_t)hor_stride * (dst_y0 + row - src_y0) + dst_x0,
+                          overlay.y.data() + row * overlay.width + src_x0,
+                          overlay.y_alpha.data() + row * overlay.width + src_x0, span);
+    }
+    uint8_t *uv_plane = nv12 + (size_t)hor_stride * ver_stride;
+    for (int row = src_y0 / 2; row < src_y1 / 2; row++) {
+        overlay_blend_row(uv_plane + (size_t)hor_stride * (dst_y0 / 2 + row - src_y0 / 2) + dst_x0,
+                          overlay.uv.data() + row * overlay.width + src_x0,
+                          overlay.uv_alpha.data() + row * overlay.width + src_x0, span);
+    }
+}
+
 #endif //RKNN_INFER_PLUGIN_IMAGE_OP_UTILS_H
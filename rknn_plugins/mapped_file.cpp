@@ -0,0 +1,85 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.21
+ * @brief: 只读内存映射文件实现
+ */
+#include <map>
+#include <mutex>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+#include "utils_log.h"
+
+MappedFile::MappedFile(const std::string &path) {
+    m_path = path;
+    // 先检查文件类型，以只读方式打开没有写端的管道会阻塞
+    struct stat st{};
+    CHECK_VAL(stat(path.c_str(), &st) != 0,
+              d_mpp_module_warn("stat %s failed: %s", path.c_str(), strerror(errno)); return;)
+    CHECK_VAL(!S_ISREG(st.st_mode) || st.st_size == 0,
+              d_mpp_module_warn("%s is not a regular non-empty file, can not mmap", path.c_str()); return;)
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    CHECK_VAL(fd < 0, d_mpp_module_error("open %s failed: %s", path.c_str(), strerror(errno)); return;)
+    void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // 映射建立后可以关闭文件
+    close(fd);
+    CHECK_VAL(addr == MAP_FAILED, d_mpp_module_error("mmap %s failed: %s", path.c_str(), strerror(errno)); return;)
+
+    m_data = (uint8_t *)addr;
+    m_size = (size_t)st.st_size;
+    // 顺序读取：内核加大预读窗口，读过的页面优先回收
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+    d_mpp_module_info("mmap %s, size: %d", path.c_str(), (int)m_size)
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open_shared(const std::string &path) {
+    static std::mutex s_mutex;
+    static std::map<std::string, std::weak_ptr<MappedFile>> s_files;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_files.find(path);
+    if (it != s_files.end()) {
+        std::shared_ptr<MappedFile> file = it->second.lock();
+        if (file != nullptr) {
+            return file;
+        }
+    }
+    auto file = std::make_shared<MappedFile>(path);
+    if (!file->is_init()) {
+        s_files.erase(path);
+        return nullptr;
+    }
+    // 顺带清理已经释放的映射
+    for (auto iter = s_files.begin(); iter != s_files.end();) {
+        iter = iter->second.expired() ? s_files.erase(iter) : std::next(iter);
+    }
+    s_files[path] = file;
+    return file;
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+    if (m_data == nullptr || offset >= m_size) {
+        return;
+    }
+    size = std::min(size, m_size - offset);
+    // madvise 要求起始地址按页对齐
+    auto page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page_size * page_size;
+    madvise(m_data + begin, size + (offset - begin), MADV_WILLNEED);
+}
@@ -0,0 +1,42 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.21
+ * @brief: 只读内存映射文件：按路径共享同一个映射（多个解码器读同一个文件时只占一份页缓存），
+ *         顺序读取时给内核预读提示
+ */
+#ifndef RKNN_INFER_PLUGIN_MAPPED_FILE_H
+#define RKNN_INFER_PLUGIN_MAPPED_FILE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class MappedFile {
+public:
+    // 映射整个文件，失败时 is_init() 为 false（例如空文件、管道等不支持 mmap 的输入）
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // 同一路径返回同一个映射，最后一个使用者释放后解除映射
+    static std::shared_ptr<MappedFile> open_shared(const std::string &path);
+
+    [[nodiscard]] bool is_init() const { return m_data != nullptr; };
+    [[nodiscard]] const uint8_t *data() const { return m_data; };
+    [[nodiscard]] size_t size() const { return m_size; };
+    [[nodiscard]] const std::string &path() const { return m_path; };
+
+    // 提示内核预读 [offset, offset + size)，顺序读取时在使用前调用
+    void prefetch(size_t offset, size_t size) const;
+
+private:
+    std::string m_path;
+    uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif //RKNN_INFER_PLUGIN_MAPPED_FILE_H
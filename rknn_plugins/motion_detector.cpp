@@ -0,0 +1,229 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.29
+ * @brief: 运动检测实现
+ */
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "motion_detector.h"
+#include "properties_reader.h"
+#include "utils.h"
+#include "utils_log.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MOTION_DETECT_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MOTION_DETECT_USE_SSE2
+#endif
+
+// ROI 最小为整帧宽高的 1 / MOTION_ROI_MIN_DIV，避免小区域放大过多
+#define MOTION_ROI_MIN_DIV (4)
+
+// 设置一项配置，name 不带 motion. 和流序号前缀，未知配置返回 false
+static bool set_motion_config(const std::string &name, const std::string &value, MotionDetectConfig &config) {
+    if (name == "mode") {
+        config.mode = value == "roi" ? MOTION_GATE_ROI : (value == "skip" ? MOTION_GATE_SKIP : MOTION_GATE_OFF);
+    } else if (name == "downsample") {
+        config.downsample = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "pixel_threshold") {
+        config.pixel_threshold = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "tile_threshold") {
+        config.tile_threshold = strtof(value.c_str(), nullptr);
+    } else if (name == "learn_shift") {
+        config.learn_shift = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "refresh_frames") {
+        config.refresh_frames = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "roi_margin") {
+        config.roi_margin = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "roi_max_ratio") {
+        config.roi_max_ratio = strtof(value.c_str(), nullptr);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int load_motion_detect_config(const std::string &path, MotionDetectConfigSet &config_set) {
+    if (load_stream_properties(path, "motion", config_set.defaults, config_set.streams, set_motion_config) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+MotionDetector::MotionDetector(const MotionDetectConfig &config) {
+    m_config = config;
+    m_config.downsample = std::max(1u, m_config.downsample);
+    m_config.pixel_threshold = std::min(255u, m_config.pixel_threshold);
+    m_config.learn_shift = std::min(7u, m_config.learn_shift);
+}
+
+void MotionDetector::reset(uint32_t width, uint32_t height) {
+    m_width = width;
+    m_height = height;
+    m_ds_width = (width + m_config.downsample - 1) / m_config.downsample;
+    m_ds_height = (height + m_config.downsample - 1) / m_config.downsample;
+    m_tiles_x = (m_ds_width + MOTION_TILE_SIZE - 1) / MOTION_TILE_SIZE;
+    m_tiles_y = (m_ds_height + MOTION_TILE_SIZE - 1) / MOTION_TILE_SIZE;
+    m_background.assign((size_t)m_ds_width * m_ds_height, 0);
+    m_row.assign(m_ds_width, 0);
+    m_tile_counts.assign((size_t)m_tiles_x * m_tiles_y, 0);
+}
+
+void MotionDetector::diff_row(const uint8_t *cur, uint8_t *bg, uint32_t count, uint8_t threshold,
+                              uint32_t learn_shift, uint16_t *tile_counts) {
+    uint32_t i = 0;
+#if defined(MOTION_DETECT_USE_NEON)
+    const uint8x16_t thr = vdupq_n_u8(threshold);
+    // 有符号数左移负数位即算术右移
+    const int16x8_t shift = vdupq_n_s16((int16_t)-(int)learn_shift);
+    for (; i + MOTION_TILE_SIZE <= count; i += MOTION_TILE_SIZE) {
+        uint8x16_t c = vld1q_u8(cur + i);
+        uint8x16_t b = vld1q_u8(bg + i);
+        uint8x16_t changed = vshrq_n_u8(vcgtq_u8(vabdq_u8(c, b), thr), 7);
+        uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(changed)));
+        tile_counts[i / MOTION_TILE_SIZE] += (uint16_t)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+
+        int16x8_t d_lo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(c), vget_low_u8(b)));
+        int16x8_t d_hi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(c), vget_high_u8(b)));
+        int16x8_t b_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b)));
+        int16x8_t b_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b)));
+        b_lo = vaddq_s16(b_lo, vshlq_s16(d_lo, shift));
+        b_hi = vaddq_s16(b_hi, vshlq_s16(d_hi, shift));
+        vst1q_u8(bg + i, vcombine_u8(vqmovun_s16(b_lo), vqmovun_s16(b_hi)));
+    }
+#elif defined(MOTION_DETECT_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i thr = _mm_set1_epi8((char)threshold);
+    const __m128i shift = _mm_cvtsi32_si128((int)learn_shift);
+    for (; i + MOTION_TILE_SIZE <= count; i += MOTION_TILE_SIZE) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(cur + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(bg + i));
+        // 无符号饱和减法求差的绝对值，差值减去阈值后不为 0 即超过阈值
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(c, b), _mm_subs_epu8(b, c));
+        int same = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(diff, thr), zero));
+        tile_counts[i / MOTION_TILE_SIZE] += (uint16_t)(MOTION_TILE_SIZE - __builtin_popcount((unsigned)same));
+
+        __m128i c_lo = _mm_unpacklo_epi8(c, zero);
+        __m128i c_hi = _mm_unpackhi_epi8(c, zero);
+        __m128i b_lo = _mm_unpacklo_epi8(b, zero);
+        __m128i b_hi = _mm_unpackhi_epi8(b, zero);
+        b_lo = _mm_add_epi16(b_lo, _mm_sra_epi16(_mm_sub_epi16(c_lo, b_lo), shift));
+        b_hi = _mm_add_epi16(b_hi, _mm_sra_epi16(_mm_sub_epi16(c_hi, b_hi), shift));
+        _mm_storeu_si128((__m128i *)(bg + i), _mm_packus_epi16(b_lo, b_hi));
+    }
+#endif
+    for (; i < count; i++) {
+        int diff = (int)cur[i] - (int)bg[i];
+        tile_counts[i / MOTION_TILE_SIZE] += (diff > threshold || -diff > threshold) ? 1 : 0;
+        bg[i] = (uint8_t)((int)bg[i] + (diff >> learn_shift));
+    }
+}
+
+int MotionDetector::detect(const uint8_t *luma, uint32_t width, uint32_t height, uint32_t stride,
+                           MotionResult &result) {
+    result = MotionResult();
+    result.roi = {0, 0, (int)(width & ~1u), (int)(height & ~1u)};
+    if (luma == nullptr || width < 2 || height < 2 || stride < width) {
+        return -1;
+    }
+    time_unit t_start = getTimeOfNs();
+    m_stats.frames++;
+
+    // 第一帧和尺寸变化时用当前帧初始化背景
+    bool first = width != m_width || height != m_height;
+    if (first) {
+        reset(width, height);
+    }
+    std::fill(m_tile_counts.begin(), m_tile_counts.end(), 0);
+    const uint32_t step = m_config.downsample;
+    for (uint32_t y = 0; y < m_ds_height; y++) {
+        const uint8_t *src = luma + (size_t)y * step * stride;
+        uint8_t *bg = m_background.data() + (size_t)y * m_ds_width;
+        uint8_t *row = first ? bg : m_row.data();
+        for (uint32_t x = 0; x < m_ds_width; x++) {
+            row[x] = src[x * step];
+        }
+        if (!first) {
+            diff_row(row, bg, m_ds_width, (uint8_t)m_config.pixel_threshold, m_config.learn_shift,
+                     m_tile_counts.data() + (size_t)(y / MOTION_TILE_SIZE) * m_tiles_x);
+        }
+    }
+
+    // 统计有变化的分块和范围
+    uint32_t changed = 0;
+    uint32_t tx0 = m_tiles_x, ty0 = m_tiles_y, tx1 = 0, ty1 = 0;
+    for (uint32_t ty = 0; ty < m_tiles_y; ty++) {
+        uint32_t tile_h = std::min((uint32_t)MOTION_TILE_SIZE, m_ds_height - ty * MOTION_TILE_SIZE);
+        for (uint32_t tx = 0; tx < m_tiles_x; tx++) {
+            uint32_t count = m_tile_counts[ty * m_tiles_x + tx];
+            uint32_t tile_w = std::min((uint32_t)MOTION_TILE_SIZE, m_ds_width - tx * MOTION_TILE_SIZE);
+            changed += count;
+            if (count == 0 || (float)count < m_config.tile_threshold * (float)(tile_w * tile_h)) {
+                continue;
+            }
+            result.dirty_tiles++;
+            tx0 = std::min(tx0, tx);
+            ty0 = std::min(ty0, ty);
+            tx1 = std::max(tx1, tx);
+            ty1 = std::max(ty1, ty);
+        }
+    }
+    result.total_tiles = m_tiles_x * m_tiles_y;
+    result.changed_ratio = (float)changed / (float)(m_ds_width * m_ds_height);
+
+    m_frames_since_full++;
+    bool refresh = m_config.refresh_frames > 0 && m_frames_since_full >= m_config.refresh_frames;
+    if (first || m_request_full || refresh || m_config.mode == MOTION_GATE_OFF) {
+        result.decision = MOTION_DECISION_FULL;
+    } else if (result.dirty_tiles == 0) {
+        result.decision = MOTION_DECISION_SKIP;
+    } else if (m_config.mode == MOTION_GATE_ROI) {
+        // 变化分块外扩后换算到原图
+        const int tile_px = (int)(MOTION_TILE_SIZE * step);
+        const int margin = (int)m_config.roi_margin;
+        int x0 = std::max(0, (int)tx0 - margin) * tile_px;
+        int y0 = std::max(0, (int)ty0 - margin) * tile_px;
+        int x1 = std::min((int)width, ((int)tx1 + 1 + margin) * tile_px);
+        int y1 = std::min((int)height, ((int)ty1 + 1 + margin) * tile_px);
+        int roi_w = std::max(x1 - x0, (int)width / MOTION_ROI_MIN_DIV);
+        int roi_h = std::max(y1 - y0, (int)height / MOTION_ROI_MIN_DIV);
+        // 扩展到与整帧相同的宽高比，模型看到的目标形变与整帧推理一致
+        if ((int64_t)roi_w * height < (int64_t)roi_h * width) {
+            roi_w = (int)std::min((int64_t)width, (int64_t)roi_h * width / height);
+        } else {
+            roi_h = (int)std::min((int64_t)height, (int64_t)roi_w * height / width);
+        }
+        // 以变化区域为中心，超出画面时平移回画面内，坐标和尺寸对齐到偶数
+        int cx = (x0 + x1) / 2;
+        int cy = (y0 + y1) / 2;
+        int rx = std::min(std::max(0, cx - roi_w / 2), (int)width - roi_w) & ~1;
+        int ry = std::min(std::max(0, cy - roi_h / 2), (int)height - roi_h) & ~1;
+        roi_w &= ~1;
+        roi_h &= ~1;
+        if ((float)roi_w * (float)roi_h <= m_config.roi_max_ratio * (float)width * (float)height) {
+            result.decision = MOTION_DECISION_ROI;
+            result.roi = {rx, ry, roi_w, roi_h};
+        } else {
+            result.decision = MOTION_DECISION_FULL;
+        }
+    } else {
+        result.decision = MOTION_DECISION_FULL;
+    }
+
+    if (result.decision == MOTION_DECISION_FULL) {
+        m_frames_since_full = 0;
+        m_request_full = false;
+        m_stats.full_frames++;
+    } else if (result.decision == MOTION_DECISION_ROI) {
+        m_stats.roi_frames++;
+    } else {
+        m_stats.skipped_frames++;
+    }
+    m_stats.detect_us += (getTimeOfNs() - t_start) / 1000;
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.29
+ * @brief: 运动检测：解码帧的亮度平面降采样后与背景逐像素比较（NEON / SSE2），按 16x16 分块统计变化像素，
+ *         画面静止时跳过推理，变化集中在局部时只把变化区域裁剪送入模型。不依赖 MPP，输入为带步长的亮度平面
+ */
+#ifndef RKNN_INFER_PLUGIN_MOTION_DETECTOR_H
+#define RKNN_INFER_PLUGIN_MOTION_DETECTOR_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 分块边长（降采样后的像素），正好是一个 128 位向量
+#define MOTION_TILE_SIZE (16)
+
+enum MotionGateMode {
+    // 不做运动检测，每帧整帧推理
+    MOTION_GATE_OFF,
+    // 静止时跳过推理
+    MOTION_GATE_SKIP,
+    // 静止时跳过推理，变化区域较小时只推理变化区域
+    MOTION_GATE_ROI,
+};
+
+// 本帧的推理方式
+enum MotionDecision {
+    MOTION_DECISION_FULL,
+    MOTION_DECISION_ROI,
+    MOTION_DECISION_SKIP,
+};
+
+struct MotionDetectConfig {
+    MotionGateMode mode = MOTION_GATE_OFF;
+    // 亮度平面每隔 downsample 行、列取一个像素
+    uint32_t downsample = 4;
+    // 与背景的亮度差超过该值的像素认为有变化
+    uint32_t pixel_threshold = 25;
+    // 分块内变化像素的占比超过该值时认为分块有变化，过滤零散的噪声
+    float tile_threshold = 0.05f;
+    // 背景更新速度：bg += (cur - bg) >> learn_shift
+    uint32_t learn_shift = 3;
+    // 距离上次整帧推理超过该帧数时强制整帧推理，刷新静止目标的结果
+    uint32_t refresh_frames = 50;
+    // ROI 在变化分块外扩的分块数
+    uint32_t roi_margin = 1;
+    // ROI 面积超过整帧的该比例时整帧推理
+    float roi_max_ratio = 0.5f;
+};
+
+// 各流的配置：motion.xxx 为默认值，motion.N.xxx 覆盖流 N 的配置
+struct MotionDetectConfigSet {
+    MotionDetectConfig defaults;
+    std::map<int, MotionDetectConfig> streams;
+
+    [[nodiscard]] const MotionDetectConfig &get(int stream_id) const {
+        auto it = streams.find(stream_id);
+        return it == streams.end() ? defaults : it->second;
+    }
+};
+
+/**
+ * @brief 从 properties 文件读取 motion.xxx 和 motion.N.xxx，忽略其他配置，文件不存在返回 -1
+ */
+int load_motion_detect_config(const std::string &path, MotionDetectConfigSet &config_set);
+
+// 原图中的矩形，坐标和尺寸为偶数（YUV420 裁剪要求）
+struct MotionRect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct MotionResult {
+    MotionDecision decision = MOTION_DECISION_FULL;
+    // 有变化的分块个数和总分块个数
+    uint32_t dirty_tiles = 0;
+    uint32_t total_tiles = 0;
+    // 降采样后变化像素的占比
+    float changed_ratio = 0;
+    // 送入模型的区域：ROI 时为变化区域，其他时候为整帧
+    MotionRect roi = {};
+};
+
+struct MotionDetectStats {
+    uint64_t frames = 0;
+    uint64_t full_frames = 0;
+    uint64_t roi_frames = 0;
+    uint64_t skipped_frames = 0;
+    // 检测耗时
+    uint64_t detect_us = 0;
+};
+
+/**
+ * @brief 一路流的运动检测，非线程安全（多个输入线程取同一路流时由调用者加锁）
+ */
+class MotionDetector {
+public:
+    explicit MotionDetector(const MotionDetectConfig &config);
+
+    [[nodiscard]] const MotionDetectConfig &config() const { return m_config; };
+
+    /**
+     * @brief 检测一帧并决定推理方式，第一帧和尺寸变化后整帧推理
+     * @param luma 亮度平面，行步长为 stride
+     * @return 0 成功，-1 参数错误
+     */
+    int detect(const uint8_t *luma, uint32_t width, uint32_t height, uint32_t stride, MotionResult &result);
+
+    // 下一帧强制整帧推理（例如还没有可以复用的检测结果）
+    void request_full() { m_request_full = true; };
+
+    [[nodiscard]] MotionDetectStats get_stats() const { return m_stats; };
+
+    // 降采样后的一行与背景比较：差值超过 threshold 的像素按 MOTION_TILE_SIZE 分块累加到 tile_counts，
+    // 同时更新背景；NEON / SSE2 与标量实现逐位一致
+    static void diff_row(const uint8_t *cur, uint8_t *bg, uint32_t count, uint8_t threshold, uint32_t learn_shift,
+                         uint16_t *tile_counts);
+
+private:
+    void reset(uint32_t width, uint32_t height);
+
+private:
+    MotionDetectConfig m_config;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    // 降采样后的尺寸和分块个数
+    uint32_t m_ds_width = 0;
+    uint32_t m_ds_height = 0;
+    uint32_t m_tiles_x = 0;
+    uint32_t m_tiles_y = 0;
+    std::vector<uint8_t> m_background;
+    std::vector<uint8_t> m_row;
+    std::vector<uint16_t> m_tile_counts;
+    // 距离上次整帧推理的帧数
+    uint32_t m_frames_since_full = 0;
+    bool m_request_full = false;
+    MotionDetectStats m_stats;
+};
+
+#endif //RKNN_INFER_PLUGIN_MOTION_DETECTOR_H
@@ -0,0 +1,288 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.24
+ * @brief: 多路解码管理实现
+ */
+#include <cstdlib>
+#include <algorithm>
+
+#include "mpp_decoder_manager.h"
+#include "properties_reader.h"
+#include "utils.h"
+#include "utils_log.h"
+
+int load_decoder_manager_config(const std::string &path, MppDecoderManagerConfig &config) {
+    std::vector<PropertyItem> items;
+    if (read_properties(path, items) != 0) {
+        d_mpp_module_warn("decoder config %s not exist", path.c_str())
+        return -1;
+    }
+
+    // stream.N 按 N 排序，流序号依次为 1, 2, ...
+    std::map<int, std::string> streams;
+    for (auto &item : items) {
+        const std::string &key = item.key;
+        const std::string &value = item.value;
+        if (key.compare(0, 7, "stream.") == 0) {
+            streams[(int)strtol(key.c_str() + 7, nullptr, 10)] = value;
+        } else if (key == "decoder.input_threads") {
+            config.input_threads = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "decoder.max_frame_memory_mb") {
+            config.max_frame_memory_mb = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        } else if (key == "decoder.min_frames_per_stream") {
+            config.min_frames_per_stream = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        } else if (key == "decoder.fps") {
+            config.fps = strtod(value.c_str(), nullptr);
+        } else if (key == "decoder.loop") {
+            config.loop = parse_bool_property(value);
+        } else if (key == "decoder.use_mmap") {
+            config.use_mmap = parse_bool_property(value);
+        } else if (key == "decoder.free_run") {
+            config.free_run = parse_bool_property(value);
+        } else if (key == "decoder.raw_width") {
+            config.raw_width = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        } else if (key == "decoder.raw_height") {
+            config.raw_height = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        } else if (key == "decoder.raw_format") {
+            config.raw_format = value == "i420" ? MPP_FMT_YUV420P : MPP_FMT_YUV420SP;
+        } else if (key == "decoder.shm_mode") {
+            config.shm_mode = (uint32_t)strtoul(value.c_str(), nullptr, 8);
+        } else if (key == "decoder.adaptive_skip") {
+            config.adaptive_skip = parse_bool_property(value);
+        } else if (key.compare(0, 7, "motion.") == 0) {
+            // 运动检测配置，由 load_motion_detect_config 读取
+        } else if (key.compare(0, 8, "tracker.") == 0) {
+            // 跟踪配置，由 load_object_tracker_config 读取
+        } else {
+            d_mpp_module_warn("unknown decoder config: %s", key.c_str())
+        }
+    }
+    config.streams.clear();
+    for (auto &it : streams) {
+        config.streams.push_back(it.second);
+    }
+    d_mpp_module_info("load decoder config %s, streams: %d, input threads: %d",
+                      path.c_str(), (int)config.streams.size(), config.input_threads)
+    return 0;
+}
+
+MppDecoderManager::MppDecoderManager(const MppDecoderManagerConfig &config) {
+    m_config = config;
+    m_config.input_threads = std::max(1, m_config.input_threads);
+
+    for (size_t i = 0; i < m_config.streams.size(); i++) {
+        auto stream = std::make_unique<DecodeStream>();
+        stream->stream_id = (int)i + 1;
+        stream->uri = m_config.streams[i];
+
+        FrameSourceOptions options;
+        options.fps = m_config.fps;
+        options.free_run = m_config.free_run;
+        options.loop = m_config.loop;
+        options.use_mmap = m_config.use_mmap;
+        options.adaptive_skip = m_config.adaptive_skip;
+        options.skip_config = m_config.skip_config;
+        options.width = m_config.raw_width;
+        options.height = m_config.raw_height;
+        options.format = m_config.raw_format;
+        options.shm_mode = m_config.shm_mode;
+        // 原始文件和图案的帧池与 MPP 内存池一样保留参考帧 + 推理中的帧
+        options.max_frames = (int)m_config.min_frames_per_stream;
+        DecodeStream *stream_ptr = stream.get();
+        options.buffer_group_provider = [this, stream_ptr](uint32_t buf_size) {
+            return get_pool(*stream_ptr, buf_size);
+        };
+        stream->source = create_frame_source(stream->uri, options);
+        if (stream->source == nullptr) {
+            d_mpp_module_error("stream %d init failed: %s", stream->stream_id, stream->uri.c_str())
+            continue;
+        }
+        m_streams.push_back(std::move(stream));
+    }
+
+    // 流按序号分给输入线程，空闲线程再从其他线程的流窃取
+    m_thread_streams.resize(m_config.input_threads);
+    m_thread_cursor = std::make_unique<std::atomic<size_t>[]>(m_config.input_threads);
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        int owner = (int)i % m_config.input_threads;
+        m_streams[i]->owner_thread = owner;
+        m_thread_streams[owner].push_back((int)i);
+    }
+    d_mpp_module_info("decoder manager: %d streams on %d input threads",
+                      (int)m_streams.size(), m_config.input_threads)
+}
+
+MppDecoderManager::~MppDecoderManager() {
+    // 先销毁帧来源，再释放共享的内存池
+    m_streams.clear();
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    for (auto &it : m_pools) {
+        if (it.second.group != nullptr) {
+            mpp_buffer_group_put(it.second.group);
+            it.second.group = nullptr;
+        }
+    }
+    m_pools.clear();
+}
+
+MppBufferGroup MppDecoderManager::get_pool(DecodeStream &stream, uint32_t buf_size) {
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    if (stream.pool_size == buf_size) {
+        return m_pools[buf_size].group;
+    }
+    auto &pool = m_pools[buf_size];
+    if (pool.group == nullptr) {
+        MPP_RET ret = mpp_buffer_group_get_internal(&pool.group, MPP_BUFFER_TYPE_DRM);
+        CHECK_VAL(ret != MPP_OK, d_mpp_module_error("get mpp buffer group failed ret %d", ret); pool.group = nullptr; return nullptr;)
+    }
+    // 尺寸变化：原内存池保留（可能还有未释放的帧），只减少其流数
+    if (stream.pool_size != 0) {
+        m_pools[stream.pool_size].streams--;
+    }
+    pool.streams++;
+    stream.pool_size = buf_size;
+    d_mpp_module_info("stream %d use buffer pool %d bytes, streams in pool: %d",
+                      stream.stream_id, (int)buf_size, pool.streams)
+    update_pool_limits();
+    return pool.group;
+}
+
+void MppDecoderManager::update_pool_limits() {
+    int total_streams = 0;
+    for (auto &it : m_pools) {
+        total_streams += it.second.streams;
+    }
+    if (total_streams == 0) {
+        return;
+    }
+    uint64_t budget = (uint64_t)m_config.max_frame_memory_mb << 20;
+    uint64_t total_bytes = 0;
+    for (auto &it : m_pools) {
+        BufferPool &pool = it.second;
+        if (pool.streams <= 0 || pool.group == nullptr) {
+            continue;
+        }
+        // 按流数分配预算，每路流不少于 min_frames_per_stream 帧
+        uint64_t share = budget * pool.streams / total_streams;
+        auto count = (uint32_t)std::max<uint64_t>(share / it.first,
+                                                  (uint64_t)pool.streams * m_config.min_frames_per_stream);
+        total_bytes += (uint64_t)count * it.first;
+        if (count != pool.limit_count) {
+            MPP_RET ret = mpp_buffer_group_limit_config(pool.group, it.first, (RK_S32)count);
+            CHECK_VAL(ret != MPP_OK, d_mpp_module_error("limit buffer group failed ret %d", ret); continue;)
+            pool.limit_count = count;
+        }
+    }
+    if (total_bytes > budget) {
+        d_mpp_module_warn("frame memory %d MB exceeds budget %d MB (min %d frames per stream)",
+                          (int)(total_bytes >> 20), (int)m_config.max_frame_memory_mb,
+                          (int)m_config.min_frames_per_stream)
+    }
+}
+
+int MppDecoderManager::poll_stream(DecodeStream &stream, DecoderMppFrame &frame) {
+    if (stream.finished) {
+        return -1;
+    }
+    std::unique_lock<std::mutex> lock(stream.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return 1;
+    }
+    int ret = stream.source->poll_frame(frame);
+    if (ret < 0) {
+        stream.finished = true;
+        d_mpp_module_info("stream %d finished, frames: %d", stream.stream_id, (int)stream.frames.load())
+    }
+    return ret;
+}
+
+int MppDecoderManager::get_next_frame(int thread_id, DecoderMppFrame &frame, int &stream_id, int timeout_ms) {
+    int thread_num = m_config.input_threads;
+    int self = thread_id % thread_num;
+    time_unit t_start = get_time_of_ms();
+    while (true) {
+        bool alive = false;
+        // 依次检查自己的流和其他线程的流（窃取）
+        for (int t = 0; t < thread_num; t++) {
+            int owner = (self + t) % thread_num;
+            const std::vector<int> &indexes = m_thread_streams[owner];
+            if (indexes.empty()) {
+                continue;
+            }
+            // 从上次取帧的下一路开始，流之间轮流
+            size_t cursor = m_thread_cursor[owner].load(std::memory_order_relaxed);
+            for (size_t k = 0; k < indexes.size(); k++) {
+                size_t pos = (cursor + k) % indexes.size();
+                DecodeStream &stream = *m_streams[indexes[pos]];
+                int ret = poll_stream(stream, frame);
+                if (ret < 0) {
+                    continue;
+                }
+                alive = true;
+                if (ret == 0) {
+                    m_thread_cursor[owner].store(pos + 1, std::memory_order_relaxed);
+                    stream.frames++;
+                    if (owner != self) {
+                        stream.stolen_frames++;
+                    }
+                    stream_id = stream.stream_id;
+                    return 0;
+                }
+            }
+        }
+        if (!alive) {
+            d_mpp_module_info("all streams finished")
+            return -1;
+        }
+        if (timeout_ms >= 0 && get_time_of_ms() - t_start >= (time_unit)timeout_ms) {
+            return 1;
+        }
+        // 所有流都没有解码好的帧，等待一个解码周期
+        sleepUS(1000);
+    }
+}
+
+void MppDecoderManager::release_frame(int stream_id, DecoderMppFrame &frame) {
+    for (auto &stream : m_streams) {
+        if (stream->stream_id == stream_id) {
+            stream->source->release_frame(frame);
+            return;
+        }
+    }
+    d_mpp_module_error("invalid stream id: %d", stream_id)
+}
+
+void MppDecoderManager::set_queue_pressure(uint32_t queue_size, uint32_t queue_limit) {
+    if (!m_config.adaptive_skip) {
+        return;
+    }
+    for (auto &stream : m_streams) {
+        stream->source->set_queue_pressure(queue_size, queue_limit);
+    }
+}
+
+std::vector<MppDecodeStreamStats> MppDecoderManager::get_stats() const {
+    std::vector<MppDecodeStreamStats> stats_list;
+    for (auto &stream : m_streams) {
+        MppDecodeStreamStats stats;
+        stats.stream_id = stream->stream_id;
+        stats.uri = stream->uri;
+        stats.owner_thread = stream->owner_thread;
+        stats.finished = stream->finished;
+        stats.frames = stream->frames;
+        stats.stolen_frames = stream->stolen_frames;
+        stats.decoder = stream->source->get_stats();
+        stats_list.push_back(stats);
+    }
+    return stats_list;
+}
+
+std::vector<MppDecodePoolStats> MppDecoderManager::get_pool_stats() const {
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    std::vector<MppDecodePoolStats> stats_list;
+    for (auto &it : m_pools) {
+        stats_list.push_back({it.first, it.second.streams, it.second.limit_count});
+    }
+    return stats_list;
+}
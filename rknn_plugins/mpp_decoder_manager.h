@@ -0,0 +1,131 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.24
+ * @brief: 多路解码管理：按配置列表创建 M 路帧来源（MPP 解码、原始文件或图案），由 K 个输入线程轮询取帧（先取分给自己的流，
+ *         空闲时从其他线程的流窃取），同尺寸的流共享 MPP 帧内存池，所有内存池按总预算限制帧数
+ */
+#ifndef RKNN_INFER_PLUGIN_MPP_DECODER_MANAGER_H
+#define RKNN_INFER_PLUGIN_MPP_DECODER_MANAGER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include "frame_source.h"
+
+struct MppDecoderManagerConfig {
+    // 输入流，file:路径 或直接写路径，以及 yuv: / y4m: / pattern: 等不需要解码的来源（见 create_frame_source）
+    std::vector<std::string> streams;
+    // 取帧的输入线程个数，流按 序号 % 线程数 分配
+    int input_threads = 2;
+    // 所有流的帧内存总预算，按各尺寸内存池的流数分配
+    uint32_t max_frame_memory_mb = 512;
+    // 每路流至少保留的帧数（参考帧 + 推理中的帧），预算不足时以此为准
+    uint32_t min_frames_per_stream = 16;
+    double fps = 25;
+    bool loop = false;
+    bool use_mmap = true;
+    // 原始文件和图案不限速
+    bool free_run = false;
+    // 原始 yuv 文件的尺寸和格式
+    uint32_t raw_width = 0;
+    uint32_t raw_height = 0;
+    MppFrameFormat raw_format = MPP_FMT_YUV420SP;
+    // 共享内存帧环的访问权限（八进制）
+    uint32_t shm_mode = 0600;
+    // 按调度队列压力跳帧
+    bool adaptive_skip = false;
+    H264SkipConfig skip_config;
+};
+
+// 从 properties 文件读取配置（stream.N = file:xxx.h264，decoder.xxx = 值），文件不存在返回 -1
+int load_decoder_manager_config(const std::string &path, MppDecoderManagerConfig &config);
+
+// 单路流的统计
+struct MppDecodeStreamStats {
+    int stream_id;
+    std::string uri;
+    int owner_thread;
+    bool finished;
+    uint64_t frames;
+    // 被其他线程取走的帧数
+    uint64_t stolen_frames;
+    MppDecoderStats decoder;
+};
+
+// 按尺寸共享的内存池统计
+struct MppDecodePoolStats {
+    uint32_t buf_size;
+    int streams;
+    uint32_t limit_count;
+};
+
+class MppDecoderManager {
+public:
+    explicit MppDecoderManager(const MppDecoderManagerConfig &config);
+    ~MppDecoderManager();
+
+    MppDecoderManager(const MppDecoderManager &) = delete;
+    MppDecoderManager &operator=(const MppDecoderManager &) = delete;
+
+    // 至少有一路流创建成功
+    [[nodiscard]] bool is_init() const { return !m_streams.empty(); };
+
+    // 输入线程 thread_id 取下一帧，stream_id 为流序号（从 1 开始）；
+    // 返回 0 成功，1 超时（timeout_ms < 0 一直等），-1 所有流都已结束
+    int get_next_frame(int thread_id, DecoderMppFrame &frame, int &stream_id, int timeout_ms = -1);
+
+    // 释放 get_next_frame 取到的帧
+    void release_frame(int stream_id, DecoderMppFrame &frame);
+
+    // 调度队列压力，转发给开启跳帧的解码器
+    void set_queue_pressure(uint32_t queue_size, uint32_t queue_limit);
+
+    [[nodiscard]] std::vector<MppDecodeStreamStats> get_stats() const;
+    [[nodiscard]] std::vector<MppDecodePoolStats> get_pool_stats() const;
+    [[nodiscard]] size_t stream_count() const { return m_streams.size(); };
+
+private:
+    struct DecodeStream {
+        int stream_id = 0;
+        std::string uri;
+        int owner_thread = 0;
+        // 同一时间只有一个线程从该流取帧
+        std::mutex mutex;
+        std::unique_ptr<FrameSource> source;
+        std::atomic<bool> finished{false};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> stolen_frames{0};
+        // 当前使用的内存池帧大小
+        uint32_t pool_size = 0;
+    };
+
+    struct BufferPool {
+        MppBufferGroup group = nullptr;
+        int streams = 0;
+        uint32_t limit_count = 0;
+    };
+
+    // 流 stream 需要 buf_size 大小的帧内存池（MPP 解码器信息变化时调用）
+    MppBufferGroup get_pool(DecodeStream &stream, uint32_t buf_size);
+    // 按预算重新分配各内存池的帧数，持 m_pool_mutex 调用
+    void update_pool_limits();
+    // 从 stream 取一帧，0 成功，1 暂时没有（或正被其他线程使用），-1 已结束
+    int poll_stream(DecodeStream &stream, DecoderMppFrame &frame);
+
+private:
+    MppDecoderManagerConfig m_config;
+    std::vector<std::unique_ptr<DecodeStream>> m_streams;
+    // 每个输入线程自己的流和轮询位置
+    std::vector<std::vector<int>> m_thread_streams;
+    std::unique_ptr<std::atomic<size_t>[]> m_thread_cursor;
+
+    std::map<uint32_t, BufferPool> m_pools;
+    mutable std::mutex m_pool_mutex;
+};
+
+#endif //RKNN_INFER_PLUGIN_MPP_DECODER_MANAGER_H
@@ -0,0 +1,267 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.20
+ * @brief: 按输入流管理编码器实现
+ */
+#include <cstdio>
+
+#include "mpp_encoder_manager.h"
+#include "utils_log.h"
+
+MppEncoderManager::MppEncoderManager(const MppEncoderManagerConfig &config) {
+    m_config = config;
+    m_last_idle_check = Clock::now();
+}
+
+MppEncoderManager::~MppEncoderManager() {
+    std::map<int, std::shared_ptr<StreamEncoder>> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streams_mutex);
+        streams.swap(m_streams);
+    }
+    for (auto &it : streams) {
+        std::lock_guard<std::mutex> lock(it.second->mutex);
+        release_encoder(*it.second);
+    }
+    streams.clear();
+    if (m_buf_grp != nullptr) {
+        mpp_buffer_group_put(m_buf_grp);
+        m_buf_grp = nullptr;
+    }
+}
+
+MppBufferGroup MppEncoderManager::get_buffer_group() {
+    std::lock_guard<std::mutex> lock(m_group_mutex);
+    if (m_buf_grp == nullptr) {
+        MPP_RET ret = mpp_buffer_group_get_internal(&m_buf_grp, MPP_BUFFER_TYPE_DRM);
+        CHECK_VAL(ret != MPP_OK, d_mpp_module_error("failed to get mpp buffer group ret %d", ret); m_buf_grp = nullptr;)
+    }
+    return m_buf_grp;
+}
+
+std::shared_ptr<MppEncoderManager::StreamEncoder> MppEncoderManager::get_stream(int stream_id) {
+    std::lock_guard<std::mutex> lock(m_streams_mutex);
+    auto &stream = m_streams[stream_id];
+    if (stream == nullptr) {
+        stream = std::make_shared<StreamEncoder>();
+        stream->stream_id = stream_id;
+        stream->last_frame = Clock::now();
+        if (!m_config.path_pattern.empty()) {
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer), m_config.path_pattern.c_str(), stream_id);
+            std::string path = buffer;
+            uint32_t session = m_stream_sessions[stream_id]++;
+            if (session != 0) {
+                // out_1.h264 -> out_1_s1.h264
+                snprintf(buffer, sizeof(buffer), "_s%u", session);
+                size_t dot = path.find_last_of('.');
+                size_t slash = path.find_last_of('/');
+                if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+                    path += buffer;
+                } else {
+                    path.insert(dot, buffer);
+                }
+            }
+            FileSegmentConfig file_config = m_config.file_config;
+            if (m_config.async) {
+                file_config.async_writer = true;
+                file_config.writer_config = m_config.async_config.writer_config;
+            }
+            stream->file_sink = std::make_shared<FileSegmentSink>(path, file_config);
+            stream->sinks.push_back(stream->file_sink);
+        }
+    }
+    return stream;
+}
+
+int MppEncoderManager::create_encoder(StreamEncoder &stream, const DecoderMppFrame &frame) {
+    if (stream.encoder != nullptr) {
+        // 尺寸或格式变化，重建编码器，输出继续使用
+        d_mpp_module_info("stream %d geometry %dx%d fmt %d -> %dx%d fmt %d, reinit encoder",
+                          stream.stream_id, stream.width, stream.height, stream.fmt,
+                          frame.hor_width, frame.ver_height, frame.mpp_frame_format)
+        release_encoder(stream);
+        stream.reinit_count++;
+    }
+    MppBufferGroup group = get_buffer_group();
+    CHECK_VAL(group == nullptr, return -1;)
+
+    // 编码器本身不写文件，码流交给流的输出
+    auto encoder = std::make_unique<MppVideoEncoder>("");
+    CHECK_VAL(!encoder->is_init(), d_mpp_module_error("stream %d create encoder failed", stream.stream_id); return -1;)
+    encoder->set_buffer_group(group);
+    for (auto &sink : stream.sinks) {
+        encoder->add_sink(sink);
+    }
+    if (m_config.async) {
+        CHECK_VAL(encoder->start_async(m_config.async_config) != 0,
+                  d_mpp_module_error("stream %d start async encoder failed", stream.stream_id); return -1;)
+    }
+    stream.encoder = std::move(encoder);
+    stream.width = (int32_t)frame.hor_width;
+    stream.height = (int32_t)frame.ver_height;
+    stream.fmt = frame.mpp_frame_format;
+    d_mpp_module_info("stream %d encoder created, %dx%d fmt %d",
+                      stream.stream_id, stream.width, stream.height, stream.fmt)
+    return 0;
+}
+
+void MppEncoderManager::release_encoder(StreamEncoder &stream) {
+    if (stream.encoder == nullptr) {
+        return;
+    }
+    MppEncoderStats stats = stream.encoder->get_stats();
+    // 析构时编码完队列中的帧，帧内存归还到共享内存池
+    stream.encoder.reset();
+    stream.history.pushed_frames += stats.pushed_frames;
+    stream.history.encoded_frames += stats.encoded_frames;
+    stream.history.dropped_frames += stats.dropped_frames;
+    stream.history.stream_bytes += stats.stream_bytes;
+    for (auto &sink : stream.sinks) {
+        sink->flush();
+    }
+}
+
+bool MppEncoderManager::encode_frame(int stream_id, const DecoderMppFrame &frame, const EncoderFrameOverlay &overlay) {
+    bool ret;
+    {
+        std::shared_ptr<StreamEncoder> stream;
+        std::unique_lock<std::mutex> lock;
+        do {
+            // 流可能刚好因空闲被移除
+            stream = get_stream(stream_id);
+            lock = std::unique_lock<std::mutex>(stream->mutex);
+        } while (stream->removed);
+        stream->last_frame = Clock::now();
+        if (stream->encoder == nullptr ||
+            stream->width != (int32_t)frame.hor_width || stream->height != (int32_t)frame.ver_height ||
+            stream->fmt != frame.mpp_frame_format) {
+            if (create_encoder(*stream, frame) != 0) {
+                return false;
+            }
+        }
+        ret = m_config.async ?
+              stream->encoder->push_frame(frame, m_config.type, m_config.fps, m_config.gop, overlay) :
+              stream->encoder->process_frame(frame, m_config.type, m_config.fps, m_config.gop, overlay);
+    }
+
+    if (m_config.idle_timeout_ms != 0) {
+        bool check = false;
+        {
+            std::lock_guard<std::mutex> lock(m_streams_mutex);
+            if (Clock::now() - m_last_idle_check >= std::chrono::seconds(1)) {
+                m_last_idle_check = Clock::now();
+                check = true;
+            }
+        }
+        if (check) {
+            remove_idle();
+        }
+    }
+    return ret;
+}
+
+void MppEncoderManager::add_stream_sink(int stream_id, const std::shared_ptr<EncoderSink> &sink) {
+    CHECK_VAL(sink == nullptr, return;)
+    std::shared_ptr<StreamEncoder> stream;
+    std::unique_lock<std::mutex> lock;
+    do {
+        stream = get_stream(stream_id);
+        lock = std::unique_lock<std::mutex>(stream->mutex);
+    } while (stream->removed);
+    stream->sinks.push_back(sink);
+    if (stream->encoder != nullptr) {
+        stream->encoder->add_sink(sink);
+    }
+}
+
+int MppEncoderManager::remove_stream(int stream_id) {
+    std::shared_ptr<StreamEncoder> stream;
+    {
+        std::lock_guard<std::mutex> lock(m_streams_mutex);
+        auto it = m_streams.find(stream_id);
+        CHECK_VAL(it == m_streams.end(), return -1;)
+        stream = it->second;
+        m_streams.erase(it);
+    }
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        stream->removed = true;
+        release_encoder(*stream);
+    }
+    d_mpp_module_info("stream %d encoder removed, encoded frames: %llu",
+                      stream_id, (unsigned long long)stream->history.encoded_frames)
+
+    // 没有编码器时释放内存池中的帧内存
+    std::lock_guard<std::mutex> lock(m_streams_mutex);
+    if (m_streams.empty()) {
+        std::lock_guard<std::mutex> group_lock(m_group_mutex);
+        if (m_buf_grp != nullptr) {
+            mpp_buffer_group_put(m_buf_grp);
+            m_buf_grp = nullptr;
+        }
+    }
+    return 0;
+}
+
+int MppEncoderManager::remove_idle() {
+    std::vector<int> idle_streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streams_mutex);
+        auto now = Clock::now();
+        for (auto &it : m_streams) {
+            std::lock_guard<std::mutex> stream_lock(it.second->mutex);
+            if (now - it.second->last_frame >= std::chrono::milliseconds(m_config.idle_timeout_ms)) {
+                idle_streams.push_back(it.first);
+            }
+        }
+    }
+    for (int stream_id : idle_streams) {
+        d_mpp_module_info("stream %d idle for %d ms, release encoder", stream_id, m_config.idle_timeout_ms)
+        remove_stream(stream_id);
+    }
+    return (int)idle_streams.size();
+}
+
+std::vector<MppStreamEncodeStats> MppEncoderManager::get_stats() const {
+    std::vector<std::shared_ptr<StreamEncoder>> streams;
+    {
+        std::lock_guard<std::mutex> lock(m_streams_mutex);
+        for (auto &it : m_streams) {
+            streams.push_back(it.second);
+        }
+    }
+    std::vector<MppStreamEncodeStats> stats_list;
+    auto now = Clock::now();
+    for (auto &stream : streams) {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        MppStreamEncodeStats stats{};
+        stats.stream_id = stream->stream_id;
+        stats.width = stream->width;
+        stats.height = stream->height;
+        stats.fmt = stream->fmt;
+        stats.reinit_count = stream->reinit_count;
+        stats.idle_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - stream->last_frame).count();
+        stats.encoder = stream->history;
+        if (stream->encoder != nullptr) {
+            MppEncoderStats current = stream->encoder->get_stats();
+            stats.encoder.queue_size = current.queue_size;
+            stats.encoder.pushed_frames += current.pushed_frames;
+            stats.encoder.encoded_frames += current.encoded_frames;
+            stats.encoder.dropped_frames += current.dropped_frames;
+            stats.encoder.stream_bytes += current.stream_bytes;
+        }
+        if (stream->file_sink != nullptr) {
+            stats.encoder.written_bytes = stream->file_sink->bytes_written();
+            stats.encoder.writer_stalls = stream->file_sink->stall_count();
+        }
+        stats_list.push_back(stats);
+    }
+    return stats_list;
+}
+
+size_t MppEncoderManager::stream_count() const {
+    std::lock_guard<std::mutex> lock(m_streams_mutex);
+    return m_streams.size();
+}
@@ -0,0 +1,109 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.20
+ * @brief: 按输入流管理编码器：第一帧到来时按帧的实际尺寸和格式创建编码器，尺寸变化时重建，
+ *         所有编码器共享一个 MPP 内存池（重建时复用帧内存），长时间没有帧的编码器自动销毁
+ */
+#ifndef RKNN_INFER_PLUGIN_MPP_ENCODER_MANAGER_H
+#define RKNN_INFER_PLUGIN_MPP_ENCODER_MANAGER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <chrono>
+
+#include "mpp_video_encoder.h"
+
+struct MppEncoderManagerConfig {
+    // 输出文件名，%d 替换为流 id，例如 out_%d.h264；为空时不写文件
+    std::string path_pattern = "out_%d.h264";
+    FileSegmentConfig file_config;
+    MppCodingType type = MPP_VIDEO_CodingAVC;
+    int32_t fps = 30;
+    int32_t gop = 60;
+    // 异步编码（编码和写文件在每个编码器的后台线程完成）
+    bool async = true;
+    MppEncoderAsyncConfig async_config;
+    // 超过该时间没有新帧的编码器被销毁（输出文件随之关闭），0 代表不销毁
+    uint32_t idle_timeout_ms = 30000;
+};
+
+// 单个流的编码统计，计数包含重建前的编码器
+struct MppStreamEncodeStats {
+    int stream_id;
+    int32_t width;
+    int32_t height;
+    MppFrameFormat fmt;
+    // 尺寸或格式变化导致重建编码器的次数
+    uint32_t reinit_count;
+    // 距离上一帧的时间
+    int64_t idle_ms;
+    MppEncoderStats encoder;
+};
+
+class MppEncoderManager {
+public:
+    explicit MppEncoderManager(const MppEncoderManagerConfig &config = {});
+    ~MppEncoderManager();
+
+    MppEncoderManager(const MppEncoderManager &) = delete;
+    MppEncoderManager &operator=(const MppEncoderManager &) = delete;
+
+    // 编码流的一帧，返回后即可释放该帧；overlay 在编码器的帧副本上绘制，不修改输入帧
+    bool encode_frame(int stream_id, const DecoderMppFrame &frame, const EncoderFrameOverlay &overlay = nullptr);
+
+    // 为流增加额外的码流输出（管道、内存环形缓冲等），编码器重建后继续使用
+    void add_stream_sink(int stream_id, const std::shared_ptr<EncoderSink> &sink);
+    // 销毁流的编码器，写出剩余数据并关闭输出
+    int remove_stream(int stream_id);
+    // 销毁空闲超时的编码器，返回销毁的个数（encode_frame 中每秒检查一次）
+    int remove_idle();
+
+    [[nodiscard]] std::vector<MppStreamEncodeStats> get_stats() const;
+    [[nodiscard]] size_t stream_count() const;
+
+private:
+    struct StreamEncoder {
+        int stream_id = -1;
+        std::mutex mutex;
+        // 已从 m_streams 中移除，持有该对象的线程需要重新获取
+        bool removed = false;
+        std::unique_ptr<MppVideoEncoder> encoder;
+        // 输出在编码器重建后保留，文件不会被新的编码器截断
+        std::shared_ptr<FileSegmentSink> file_sink;
+        std::vector<std::shared_ptr<EncoderSink>> sinks;
+
+        int32_t width = 0;
+        int32_t height = 0;
+        MppFrameFormat fmt = MPP_FMT_YUV420SP;
+        uint32_t reinit_count = 0;
+        std::chrono::steady_clock::time_point last_frame;
+        // 已销毁的编码器的累计统计
+        MppEncoderStats history{};
+    };
+    using Clock = std::chrono::steady_clock;
+
+    std::shared_ptr<StreamEncoder> get_stream(int stream_id);
+    // 按帧的尺寸创建（或重建）编码器，持 stream->mutex 调用
+    int create_encoder(StreamEncoder &stream, const DecoderMppFrame &frame);
+    // 销毁编码器并累计统计，持 stream->mutex 调用
+    void release_encoder(StreamEncoder &stream);
+    MppBufferGroup get_buffer_group();
+
+private:
+    MppEncoderManagerConfig m_config;
+    std::map<int, std::shared_ptr<StreamEncoder>> m_streams;
+    // 流被移除后再次出现的次数，新的输出文件名加上该序号，不覆盖之前的文件
+    std::map<int, uint32_t> m_stream_sessions;
+    mutable std::mutex m_streams_mutex;
+    Clock::time_point m_last_idle_check;
+
+    // 所有编码器共享的内存池，没有编码器时释放
+    MppBufferGroup m_buf_grp = nullptr;
+    std::mutex m_group_mutex;
+};
+
+#endif //RKNN_INFER_PLUGIN_MPP_ENCODER_MANAGER_H
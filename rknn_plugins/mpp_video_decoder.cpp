@@ -10,10 +10,20 @@
 #include "mpp_video_decoder.h"
 #include "utils_log.h"
 
-MppVideoDecoder::MppVideoDecoder(const std::string &video_path) {
+MppVideoDecoder::MppVideoDecoder(const std::string &video_path, bool use_mmap, double fps) {
+    m_fps = fps > 0 ? fps : 25;
     // 打开视频输入源
-    m_in_fp = fopen(video_path.c_str(), "rb");
-    CHECK_VAL(m_in_fp == nullptr, d_mpp_module_error("open %s failed!", video_path.c_str()); return;)
+    if (use_mmap) {
+        m_in_map = MappedFile::open_shared(video_path);
+    }
+    if (m_in_map != nullptr) {
+        // 映射的输入在用户态按帧切分
+        m_splitter = std::make_unique<H264NalSplitter>(m_in_map->data(), m_in_map->size(), m_fps);
+    }
+    if (m_in_map == nullptr) {
+        m_in_fp = fopen(video_path.c_str(), "rb");
+        CHECK_VAL(m_in_fp == nullptr, d_mpp_module_error("open %s failed!", video_path.c_str()); return;)
+    }
 
     // 初始化解码器
     int ret = init_decoder();
@@ -23,6 +33,8 @@ MppVideoDecoder::MppVideoDecoder(const std::string &video_path) {
 }
 
 MppVideoDecoder::~MppVideoDecoder() {
+    // 先停止预解码线程并归还队列中的帧，再销毁解码器
+    stop_decode_ahead();
     if(m_in_fp != nullptr){
         fclose(m_in_fp);
         m_in_buf = nullptr;
@@ -49,7 +61,7 @@ MppVideoDecoder::~MppVideoDecoder() {
     }
     d_mpp_module_info("MppVideoDecoder release success! buffer now total: %d, unreleased frame count :%d ",
                       mpp_buffer_total_now(),
-                      m_frame_count)
+                      m_frame_count.load())
 }
 
 int MppVideoDecoder::init_decoder() {
@@ -57,14 +69,23 @@ int MppVideoDecoder::init_decoder() {
     MPP_RET ret = mpp_create(&m_mpp_ctx, &m_mpp_mpi);
     CHECK_VAL(MPP_OK != ret, d_mpp_module_error("mpp_create error"); return -1;)
 
-    // 设置解码器参数
-    RK_U32 need_split = 1;
+    // 设置解码器参数：按帧送包时不需要 MPP 再切分
+    RK_U32 need_split = m_splitter != nullptr ? 0 : 1;
     ret = m_mpp_mpi->control(m_mpp_ctx, MPP_DEC_SET_PARSER_SPLIT_MODE, (MppParam*)&need_split);
     CHECK_VAL(MPP_OK != ret, d_mpp_module_error("m_mpp_mpi->control error MPP_DEC_SET_PARSER_SPLIT_MODE"); return -1;)
 
     ret = mpp_init(m_mpp_ctx, MPP_CTX_DEC, MPP_VIDEO_CodingAVC);  // 固定为H264
     CHECK_VAL(MPP_OK != ret, d_mpp_module_error("mpp_init error"); return -1;)
 
+    if (m_in_map != nullptr) {
+        // 包直接指向映射内存，不需要输入缓冲区
+        ret = mpp_packet_init(&m_pkt, (void *)m_in_map->data(), 0);
+        CHECK_VAL(MPP_OK != ret, d_mpp_module_error("mpp_packet_init error"); return -1;)
+        mpp_packet_set_length(m_pkt, 0);
+        m_in_map->prefetch(m_splitter->offset(), MMAP_PACKET_SIZE);
+        return 0;
+    }
+
     // 申请解码器输入缓冲区，初始化packet
     m_in_buf = (char*)malloc(MAX_READ_BUFFER_SIZE);
     CHECK_VAL(nullptr == m_in_buf, d_mpp_module_error("malloc m_in_buf error"); return -1;)
@@ -76,7 +97,107 @@ int MppVideoDecoder::init_decoder() {
     return 0;
 }
 
-int MppVideoDecoder::get_next_frame(DecoderMppFrame &decoder_frame) {
+int MppVideoDecoder::start_decode_ahead(int queue_size) {
+    CHECK_VAL(!m_init_flag, d_mpp_module_error("decoder not init"); return -1;)
+    CHECK_VAL(m_ahead_queue != nullptr, d_mpp_module_warn("decode ahead already started"); return 0;)
+    CHECK_VAL(queue_size <= 0 || queue_size >= MAX_DECODER_FRAME_NUM,
+              d_mpp_module_error("invalid decode ahead queue size: %d", queue_size); return -1;)
+    m_ahead_queue = std::make_unique<SpscQueue<DecoderMppFrame>>(queue_size);
+    m_ahead_thread = std::thread(&MppVideoDecoder::decode_ahead_loop, this);
+    d_mpp_module_info("decode ahead started, queue size: %d", (int)m_ahead_queue->capacity())
+    return 0;
+}
+
+void MppVideoDecoder::decode_ahead_loop() {
+    while (!m_ahead_stop) {
+        DecoderMppFrame frame = {};
+        if (decode_frame(frame) < 0) {
+            break;
+        }
+        // 队列满说明消费跟不上，解码线程停顿等待
+        time_unit t_start = getTimeOfNs();
+        bool pushed = m_ahead_queue->try_push(frame);
+        while (!pushed && !m_ahead_stop) {
+            pushed = m_ahead_queue->push(frame, 100);
+        }
+        if (!pushed) {
+            release_frame(frame);
+            break;
+        }
+        m_stall_ns += getTimeOfNs() - t_start;
+        if (m_video_eos) {
+            break;
+        }
+    }
+    // 已入队的帧仍可取出，取完后 get_next_frame 返回结束
+    m_ahead_queue->close();
+    d_mpp_module_info("decode ahead thread exit, decoded frames: %d", (int)m_decoded_frames.load())
+}
+
+void MppVideoDecoder::stop_decode_ahead() {
+    if (m_ahead_queue == nullptr) {
+        return;
+    }
+    m_ahead_stop = true;
+    m_ahead_queue->close();
+    if (m_ahead_thread.joinable()) {
+        m_ahead_thread.join();
+    }
+    DecoderMppFrame frame = {};
+    while (m_ahead_queue->try_pop(frame)) {
+        release_frame(frame);
+    }
+}
+
+MppDecoderStats MppVideoDecoder::get_stats() const {
+    MppDecoderStats stats;
+    stats.decoded_frames = m_decoded_frames;
+    if (m_ahead_queue != nullptr) {
+        stats.queue_capacity = (int)m_ahead_queue->capacity();
+        stats.queue_size = (int)m_ahead_queue->size();
+    }
+    uint64_t pop_count = m_pop_count;
+    stats.avg_queue_size = pop_count > 0 ? (double)m_pop_queue_sum / (double)pop_count : 0;
+    stats.decoder_stall_ms = (double)m_stall_ns / 1e6;
+    stats.consumer_wait_ms = (double)m_wait_ns / 1e6;
+    uint64_t latency_count = m_latency_count;
+    stats.avg_decode_latency_ms = latency_count > 0 ? (double)m_latency_us_sum / 1e3 / (double)latency_count : 0;
+    stats.skipped_frames = m_skipped_frames;
+    stats.dropped_frames = m_dropped_frames;
+    stats.skip_mode = (H264SkipMode)m_skip_mode.load();
+    return stats;
+}
+
+int MppVideoDecoder::get_next_frame(DecoderMppFrame &decoder_frame, int timeout_ms) {
+    if (m_ahead_queue == nullptr) {
+        return decode_frame(decoder_frame);
+    }
+    // 预解码模式：直接从队列取已解码的帧
+    m_pop_queue_sum += m_ahead_queue->size();
+    m_pop_count++;
+    if (m_ahead_queue->try_pop(decoder_frame)) {
+        return 0;
+    }
+    time_unit t_start = getTimeOfNs();
+    bool popped = m_ahead_queue->pop(decoder_frame, timeout_ms);
+    m_wait_ns += getTimeOfNs() - t_start;
+    if (popped) {
+        return 0;
+    }
+    if (m_ahead_queue->is_closed()) {
+        d_rknn_plugin_warn("video eos!")
+        return -1;
+    }
+    d_mpp_module_warn("wait decoded frame timeout: %d ms", timeout_ms)
+    return 1;
+}
+
+int MppVideoDecoder::poll_frame(DecoderMppFrame &frame) {
+    CHECK_VAL(m_ahead_queue != nullptr, d_mpp_module_error("poll_frame is not available in decode ahead mode"); return -1;)
+    return decode_frame(frame, false);
+}
+
+int MppVideoDecoder::decode_frame(DecoderMppFrame &decoder_frame, bool wait) {
     if(m_video_eos){
         // 已经读到最后一帧了
         d_rknn_plugin_warn("video eos!")
@@ -89,21 +210,37 @@ int MppVideoDecoder::get_next_frame(DecoderMppFrame &decoder_frame) {
     // 读取一个数据帧
     bool get_valid_frame = false;
     while (!get_valid_frame){
+        if (m_ahead_stop) {
+            return -1;
+        }
         MPP_RET ret = MPP_OK;
         // 读取数据包
-        get_one_packet();
+        if (m_in_map != nullptr) {
+            get_one_mapped_packet();
+        } else {
+            get_one_packet();
+        }
 
         // 设置数据包
         int pkt_len = (int)mpp_packet_get_length(m_pkt);
         if(pkt_len > 0){
             ret = m_mpp_mpi->decode_put_packet(m_mpp_ctx, m_pkt);
             d_mpp_module_info("pkt send ret:%d remain:%d", ret, (int)mpp_packet_get_length(m_pkt))
+            if (MPP_OK == ret && m_splitter != nullptr) {
+                // 整帧送包成功即全部送入，记录送包时间
+                mpp_packet_set_length(m_pkt, 0);
+                m_put_ns[(uint64_t)mpp_packet_get_pts(m_pkt) % DECODE_LATENCY_SLOTS] = getTimeOfNs();
+            }
         }
 
         // 解析帧
         ret = m_mpp_mpi->decode_get_frame(m_mpp_ctx, &decoder_frame.mpp_frame);
         if (MPP_OK != ret || !decoder_frame.mpp_frame) {
             d_mpp_module_debug("decode_get_frame failed ret:%d, frame:%p", ret, decoder_frame.mpp_frame);
+            if (!wait) {
+                // 轮询模式：还没有解码好的帧，调用方先去处理其他流
+                return 1;
+            }
             // 等待一下2ms，通常1080p解码时间2ms
             usleep(2000);
             continue;
@@ -121,6 +258,18 @@ int MppVideoDecoder::get_next_frame(DecoderMppFrame &decoder_frame) {
                            decoder_frame.ver_stride,
                            decoder_frame.data_size)
 
+        if (mpp_frame_get_info_change(decoder_frame.mpp_frame) && m_buffer_group_provider != nullptr){
+            // 使用外部按尺寸共享的内存池，数量限制由提供方统一配置，不能清空（其他解码器还在使用）
+            d_mpp_module_warn("decode_get_frame info changed, use shared buffer group")
+            MppBufferGroup group = m_buffer_group_provider(decoder_frame.data_size);
+            ret = group == nullptr ? MPP_NOK : m_mpp_mpi->control(m_mpp_ctx, MPP_DEC_SET_EXT_BUF_GROUP, group);
+            if (ret == MPP_OK) {
+                ret = m_mpp_mpi->control(m_mpp_ctx, MPP_DEC_SET_INFO_CHANGE_READY, nullptr);
+            }
+            mpp_frame_deinit(&decoder_frame.mpp_frame);
+            CHECK_VAL(ret != MPP_OK, d_mpp_module_error("%p set shared buffer group failed ret %d ", m_mpp_ctx, ret); return -1;)
+            continue;
+        }
         if (mpp_frame_get_info_change(decoder_frame.mpp_frame)){
             d_mpp_module_warn("decode_get_frame info changed")
             if(m_frame_buffer_group == nullptr){
@@ -176,8 +325,34 @@ int MppVideoDecoder::get_next_frame(DecoderMppFrame &decoder_frame) {
             decoder_frame.mpp_frame_format = mpp_frame_get_fmt(decoder_frame.mpp_frame);
             decoder_frame.data_buf = (char *) mpp_buffer_get_ptr(mpp_frame_get_buffer(decoder_frame.mpp_frame));
             decoder_frame.data_fd = mpp_buffer_get_fd(mpp_frame_get_buffer(decoder_frame.mpp_frame));
+            if (m_splitter != nullptr) {
+                // 包的 pts 为帧序号，随帧带出
+                auto index = (uint64_t)mpp_frame_get_pts(decoder_frame.mpp_frame);
+                if (m_drop_output[index % DECODE_LATENCY_SLOTS]) {
+                    // 只为后续帧参考而解码，不输出
+                    bool eos = mpp_frame_get_eos(decoder_frame.mpp_frame);
+                    mpp_frame_deinit(&decoder_frame.mpp_frame);
+                    m_dropped_frames++;
+                    if (eos) {
+                        d_mpp_module_info("mpp_frame_get_eos");
+                        m_video_eos = true;
+                        return -1;
+                    }
+                    continue;
+                }
+                auto latency_us = (uint64_t)(getTimeOfNs() - m_put_ns[index % DECODE_LATENCY_SLOTS]) / 1000;
+                decoder_frame.frame_index = index;
+                decoder_frame.decode_latency_us = (uint32_t)latency_us;
+                m_latency_us_sum += latency_us;
+                m_latency_count++;
+            } else {
+                decoder_frame.frame_index = m_decoded_frames;
+                decoder_frame.decode_latency_us = 0;
+            }
+            decoder_frame.pts_ms = (int64_t)((double)decoder_frame.frame_index * 1000 / m_fps);
             get_valid_frame = true;
             m_frame_count++;
+            m_decoded_frames++;
         }
 
         if (mpp_frame_get_eos(decoder_frame.mpp_frame)) {
@@ -201,6 +376,10 @@ int MppVideoDecoder::get_one_packet() {
         d_mpp_module_warn("pkt get before remain:%d", pkt_len)
         return 0;
     }
+    if (m_video_loop_decoder && feof(m_in_fp)) {
+        // 循环解码，从头读取
+        fseek(m_in_fp, 0, SEEK_SET);
+    }
     if (feof(m_in_fp)) {
         // 文件已经读完
         d_mpp_module_debug("file read end")
@@ -215,7 +394,7 @@ int MppVideoDecoder::get_one_packet() {
         mpp_packet_set_size(m_pkt, len);
         mpp_packet_set_pos(m_pkt, m_in_buf);
         mpp_packet_set_length(m_pkt, len);
-        if (feof(m_in_fp) || len < MAX_READ_BUFFER_SIZE) {
+        if (!m_video_loop_decoder && (feof(m_in_fp) || len < MAX_READ_BUFFER_SIZE)) {
             // 读到了最后一个包
             mpp_packet_set_eos(m_pkt);
             d_mpp_module_info("mpp_packet_set_eos")
@@ -223,3 +402,87 @@ int MppVideoDecoder::get_one_packet() {
     }
     return 0;
 }
+
+int64_t MppVideoDecoder::seek_key_frame(uint64_t frame_index) {
+    CHECK_VAL(m_splitter == nullptr, d_mpp_module_error("seek needs mmap input"); return -1;)
+    int64_t key_index = m_splitter->seek_key_frame(frame_index);
+    d_mpp_module_info("seek frame %d, key frame: %d", (int)frame_index, (int)key_index)
+    return key_index;
+}
+
+void MppVideoDecoder::set_skip_mode(H264SkipMode mode, int nth) {
+    if (m_splitter == nullptr && mode != H264_SKIP_NONE) {
+        d_mpp_module_warn("skip mode needs mmap input, ignored")
+        return;
+    }
+    m_adaptive_skip = false;
+    m_skip_nth = nth;
+    m_skip_mode = mode;
+}
+
+void MppVideoDecoder::set_adaptive_skip(const H264SkipConfig &config) {
+    if (m_splitter == nullptr) {
+        d_mpp_module_warn("skip mode needs mmap input, ignored")
+        return;
+    }
+    m_skip_config = config;
+    m_skip_nth = config.nth;
+    m_adaptive_skip = true;
+}
+
+void MppVideoDecoder::set_queue_pressure(uint32_t queue_size, uint32_t queue_limit) {
+    if (!m_adaptive_skip || queue_limit == 0) {
+        return;
+    }
+    float pressure = (float)queue_size / (float)queue_limit;
+    H264SkipMode mode = H264SkipFilter::mode_for_pressure(pressure, m_skip_config);
+    int old_mode = m_skip_mode.exchange(mode);
+    if (old_mode != mode) {
+        d_mpp_module_info("queue %d/%d, skip mode %d -> %d", queue_size, queue_limit, old_mode, mode)
+    }
+}
+
+int MppVideoDecoder::get_one_mapped_packet() {
+    if (mpp_packet_get_length(m_pkt) > 0) {
+        // 上一帧还没有送入解码器
+        return 0;
+    }
+    H264AccessUnit au;
+    H264SkipAction action;
+    while (true) {
+        if (!m_splitter->next(au)) {
+            if (!m_video_loop_decoder) {
+                // 文件已经读完
+                d_mpp_module_debug("file read end")
+                return -1;
+            }
+            // 循环解码直接回到映射起点，帧序号和时间戳继续递增
+            m_splitter->reset();
+            CHECK_VAL(m_splitter->at_end(), d_mpp_module_error("no start code in input"); return -1;)
+            continue;
+        }
+        action = m_skip_filter.filter(au, (H264SkipMode)m_skip_mode.load(), m_skip_nth, m_splitter->at_end());
+        if (action == H264_ACTION_SKIP) {
+            m_skipped_frames++;
+            continue;
+        }
+        break;
+    }
+    m_drop_output[au.index % DECODE_LATENCY_SLOTS] = action == H264_ACTION_DECODE_DROP;
+
+    // 包指向映射内存中的一整帧，解码器只读取不修改
+    auto *pos = (void *)au.data;
+    mpp_packet_set_data(m_pkt, pos);
+    mpp_packet_set_size(m_pkt, au.size);
+    mpp_packet_set_pos(m_pkt, pos);
+    mpp_packet_set_length(m_pkt, au.size);
+    mpp_packet_set_pts(m_pkt, (int64_t)au.index);
+    if (!m_video_loop_decoder && m_splitter->at_end()) {
+        // 最后一个包
+        mpp_packet_set_eos(m_pkt);
+        d_mpp_module_info("mpp_packet_set_eos")
+    }
+    // 提前预读后面的数据
+    m_in_map->prefetch(m_splitter->offset(), MMAP_PACKET_SIZE);
+    return 0;
+}
@@ -9,56 +9,105 @@
 #define RKNN_INFER_PLUGIN_MPP_VIDEO_DECODER_H
 
 #include <cstdio>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <functional>
 
 #include "rk_mpi.h"
+#include "utils.h"
 #include "plugin_common.h"
+#include "mapped_file.h"
+#include "spsc_queue.h"
+#include "h264_nal_splitter.h"
+#include "frame_source.h"
 
 #define MAX_READ_BUFFER_SIZE (5 * 1024 * 1024)
+// mmap 输入时每次预读的数据长度
+#define MMAP_PACKET_SIZE (512 * 1024)
+// 记录送包时间的帧数（按帧序号取模），用于统计解码延迟
+#define DECODE_LATENCY_SLOTS (64)
 #define MAX_DECODER_FRAME_NUM (200)
 
-struct DecoderMppFrame{
-    uint32_t hor_stride;
-    uint32_t ver_stride;
-
-    uint32_t hor_width;
-    uint32_t ver_height;
-
-    int data_fd;
-    void *data_buf;
-    uint32_t data_size;
-
-    MppFrame mpp_frame;
-    MppFrameFormat mpp_frame_format;
-};
-
-class MppVideoDecoder {
+class MppVideoDecoder : public FrameSource {
 public:
     // 初始化解码器
-    explicit MppVideoDecoder(const std::string &video_path);
+    // use_mmap: 映射输入文件，包直接指向映射内存（不再 fread 拷贝），同一文件的多个解码器共享映射，
+    // 并在用户态按帧切分后整帧送解码器；输入不能映射（例如管道）时退回 fread + MPP 内部切分
+    // fps: 按帧送包时计算时间戳
+    explicit MppVideoDecoder(const std::string &video_path, bool use_mmap = true, double fps = 25);
 
     // 释放解码器
     ~MppVideoDecoder();
 
-    [[nodiscard]] bool is_init() const { return m_init_flag; };
+    [[nodiscard]] bool is_init() const override { return m_init_flag; };
+
+    [[nodiscard]] MppDecoderStats get_stats() const override;
+
+    // 开启预解码：后台线程提前解码 queue_size 帧放入无锁队列，需在第一次取帧前调用
+    int start_decode_ahead(int queue_size = 4);
 
-    // 获取视频的下一帧数据
-    int get_next_frame(DecoderMppFrame &frame);
+    // 获取视频的下一帧数据，返回 0 成功，-1 结束或出错；
+    // 预解码模式下最多等待 timeout_ms（< 0 一直等），超时返回 1
+    int get_next_frame(DecoderMppFrame &frame, int timeout_ms = -1) override;
 
-    void release_frame(DecoderMppFrame &frame);
+    void release_frame(DecoderMppFrame &frame) override;
+
+    // 同步解码时不等待：返回 0 取到帧，1 暂时没有解码好的帧，-1 结束或出错（多个流轮流取帧）
+    int poll_frame(DecoderMppFrame &frame) override;
+
+    // 帧内存池由外部按帧大小提供（多个解码器共享、统一限制数量），需在第一次取帧前设置
+    using BufferGroupProvider = std::function<MppBufferGroup(uint32_t buf_size)>;
+    void set_buffer_group_provider(const BufferGroupProvider &provider) { m_buffer_group_provider = provider; };
+
+    // 读到文件末尾后从头继续解码（不产生结束帧）
+    void set_loop_decode(bool loop) { m_video_loop_decoder = loop; };
+
+    // 按帧送包时的跳帧模式（mmap 输入），可以在解码过程中随时切换；跳过参考帧后等到下一个关键帧才恢复
+    void set_skip_mode(H264SkipMode mode, int nth = 3);
+
+    // 按调度队列压力自动切换跳帧模式，每次取帧前调用 set_queue_pressure 更新
+    void set_adaptive_skip(const H264SkipConfig &config);
+    void set_queue_pressure(uint32_t queue_size, uint32_t queue_limit) override;
+
+    // 按帧送包时定位到 frame_index 及之前最近的关键帧，需在第一次取帧前调用，返回关键帧序号
+    int64_t seek_key_frame(uint64_t frame_index);
 private:
     // 初始化解码器
     int init_decoder();
 
+    // 同步解码一帧，wait 为 false 时没有解码好的帧直接返回 1
+    int decode_frame(DecoderMppFrame &frame, bool wait = true);
+    // 预解码线程
+    void decode_ahead_loop();
+    void stop_decode_ahead();
+
     // 封装一个包
     int get_one_packet();
+    // mmap 输入：包指向映射内存中的下一帧
+    int get_one_mapped_packet();
 
 private:
     bool m_init_flag = false;
-    uint64_t m_frame_count = 0;
+    // 输出线程释放帧，需要原子计数
+    std::atomic<int> m_frame_count{0};
     // 视频输入源
     FILE *m_in_fp = nullptr;
     char *m_in_buf = nullptr;
     MppPacket m_pkt = nullptr;
+    // mmap 输入源
+    std::shared_ptr<MappedFile> m_in_map;
+    // mmap 输入按帧切分
+    std::unique_ptr<H264NalSplitter> m_splitter;
+    double m_fps = 25;
+    time_unit m_put_ns[DECODE_LATENCY_SLOTS] = {};
+    // 跳帧：取帧线程切换模式，解码线程按模式过滤
+    H264SkipFilter m_skip_filter;
+    std::atomic<int> m_skip_mode{H264_SKIP_NONE};
+    std::atomic<int> m_skip_nth{3};
+    bool m_adaptive_skip = false;
+    H264SkipConfig m_skip_config;
+    bool m_drop_output[DECODE_LATENCY_SLOTS] = {};
 
     // Mpp视频解码器上下文
     MppCtx m_mpp_ctx = nullptr;
@@ -66,9 +115,24 @@ private:
 
     // 缓存
     MppBufferGroup  m_frame_buffer_group = nullptr;
+    BufferGroupProvider m_buffer_group_provider;
 
     // 视频解码信息
     bool m_video_eos = false; // 视频解码结束标志
-    bool m_video_loop_decoder = true; // 视频循环解码标志
+    bool m_video_loop_decoder = false; // 视频循环解码标志
+
+    // 预解码
+    std::unique_ptr<SpscQueue<DecoderMppFrame>> m_ahead_queue;
+    std::thread m_ahead_thread;
+    std::atomic<bool> m_ahead_stop{false};
+    std::atomic<uint64_t> m_decoded_frames{0};
+    std::atomic<uint64_t> m_stall_ns{0};
+    std::atomic<uint64_t> m_wait_ns{0};
+    std::atomic<uint64_t> m_pop_count{0};
+    std::atomic<uint64_t> m_pop_queue_sum{0};
+    std::atomic<uint64_t> m_latency_us_sum{0};
+    std::atomic<uint64_t> m_latency_count{0};
+    std::atomic<uint64_t> m_skipped_frames{0};
+    std::atomic<uint64_t> m_dropped_frames{0};
 };
 #endif //RKNN_INFER_PLUGIN_MPP_VIDEO_DECODER_H
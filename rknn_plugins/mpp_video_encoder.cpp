@@ -18,8 +18,12 @@ MppVideoEncoder::MppVideoEncoder(const std::string &video_path,
                                  int32_t fps, int32_t gop){
     memset(&m_enc_data, 0, sizeof(m_enc_data));
 
-    m_enc_data.fp_output = fopen(video_path.c_str(), "wb+");
-    CHECK_VAL(m_enc_data.fp_output == nullptr, d_mpp_module_error("failed to open output file %s", video_path.c_str()); return;)
+    m_video_path = video_path;
+    if (!video_path.empty()) {
+        // 文件在写入第一个包时打开
+        m_file_sink = std::make_shared<FileSegmentSink>(video_path);
+        m_sinks.push_back(m_file_sink);
+    }
 
     //使用输入的配置初始化编码器
     if(width != 0 && height != 0){
@@ -32,13 +36,17 @@ MppVideoEncoder::MppVideoEncoder(const std::string &video_path,
 }
 
 MppVideoEncoder::~MppVideoEncoder() {
+    stop_async();
     uninit_encoder();
 }
 
 int MppVideoEncoder::uninit_encoder(){
-    if(m_enc_data.fp_output != nullptr){
-        fclose(m_enc_data.fp_output);
+    for (auto &buffer : m_async_buffers) {
+        mpp_buffer_put(buffer);
     }
+    m_async_buffers.clear();
+    m_free_buffers.clear();
+    m_encode_queue.clear();
     if (m_enc_data.ctx) {
         m_enc_data.mpi->reset(m_enc_data.ctx);
         mpp_destroy(m_enc_data.ctx);
@@ -59,7 +67,7 @@ int MppVideoEncoder::uninit_encoder(){
         mpp_buffer_put(m_enc_data.md_info);
         m_enc_data.md_info = nullptr;
     }
-    if (m_enc_data.buf_grp) {
+    if (m_enc_data.buf_grp && !m_external_group) {
         mpp_buffer_group_put(m_enc_data.buf_grp);
         m_enc_data.buf_grp = nullptr;
     }
@@ -71,13 +79,14 @@ int MppVideoEncoder::uninit_encoder(){
 int MppVideoEncoder::init_encoder(int32_t width,int32_t height,
                                   MppFrameFormat fmt,
                                   MppCodingType type,
-                                  int32_t fps, int32_t gop) {
+                                  int32_t fps, int32_t gop,
+                                  int32_t hor_stride, int32_t ver_stride) {
     MPP_RET ret = MPP_OK;
 
     m_enc_data.width = width;
     m_enc_data.height = height;
-    m_enc_data.hor_stride = MPP_ALIGN(m_enc_data.width, 16);
-    m_enc_data.ver_stride = MPP_ALIGN(m_enc_data.height, 16);
+    m_enc_data.hor_stride = hor_stride != 0 ? hor_stride : MPP_ALIGN(m_enc_data.width, 16);
+    m_enc_data.ver_stride = ver_stride != 0 ? ver_stride : MPP_ALIGN(m_enc_data.height, 16);
     m_enc_data.fmt = fmt;
     m_enc_data.type = type;
     m_enc_data.fps = fps;
@@ -94,7 +103,10 @@ int MppVideoEncoder::init_encoder(int32_t width,int32_t height,
         m_enc_data.frame_size = m_enc_data.hor_stride * m_enc_data.ver_stride * 3/2;
 
     } else if (m_enc_data.fmt <= MPP_FMT_YUV422_UYVY) {
-        m_enc_data.hor_stride *= 2;
+        // 传入的步长已经是字节数
+        if (hor_stride == 0) {
+            m_enc_data.hor_stride *= 2;
+        }
         m_enc_data.frame_size = m_enc_data.hor_stride * m_enc_data.ver_stride;
     } else {
         m_enc_data.frame_size = m_enc_data.hor_stride * m_enc_data.ver_stride * 4;
@@ -102,10 +114,12 @@ int MppVideoEncoder::init_encoder(int32_t width,int32_t height,
     d_mpp_module_info("frame_size : %d", m_enc_data.frame_size)
 
     //开辟编码时需要的内存
-    ret = mpp_buffer_group_get_internal(&m_enc_data.buf_grp, MPP_BUFFER_TYPE_DRM);
-    if (ret) {
-        d_mpp_module_error("failed to get mpp buffer group ret %d", ret);
-        goto MPP_INIT_OUT;
+    if (m_enc_data.buf_grp == nullptr) {
+        ret = mpp_buffer_group_get_internal(&m_enc_data.buf_grp, MPP_BUFFER_TYPE_DRM);
+        if (ret) {
+            d_mpp_module_error("failed to get mpp buffer group ret %d", ret);
+            goto MPP_INIT_OUT;
+        }
     }
     ret = mpp_buffer_get(m_enc_data.buf_grp, &m_enc_data.frm_buf, m_enc_data.frame_size);
     if (ret) {
@@ -278,13 +292,10 @@ int MppVideoEncoder::init_encoder(int32_t width,int32_t height,
         if (packet) {
             void *ptr = mpp_packet_get_pos(packet);
             size_t len = mpp_packet_get_length(packet);
-            if (m_enc_data.fp_output) {
-                d_mpp_module_info("write extra data %d bytes", len)
-                uint32_t w_len = fwrite(ptr, 1, len, m_enc_data.fp_output);
-                if (w_len != len){
-                    d_mpp_module_error("failed to save extra data! w_len %d len %d", w_len, len);
-                    goto MPP_INIT_OUT;
-                }
+            d_mpp_module_info("write extra data %d bytes", len)
+            if (write_header(ptr, len) != 0) {
+                d_mpp_module_error("failed to save extra data! len %d", len);
+                goto MPP_INIT_OUT;
             }
             mpp_packet_deinit(&packet);
         }
@@ -309,34 +320,142 @@ MPI包含两套接口做编解码：
 一套是简易接口， 类似 decode_put_packet / decode_get_frame 这样put/get即可
 一套是高级接口， 类似 poll / enqueue/ dequeue 这样的对input output队列进行操作
 *****************************************************************************/
+int MppVideoEncoder::check_encoder(int32_t width,int32_t height,
+                                   MppFrameFormat fmt,
+                                   MppCodingType type,
+                                   int32_t fps, int32_t gop,
+                                   int32_t hor_stride, int32_t ver_stride) {
+    if (m_mpp_init_flag) {
+        return 0;
+    }
+    CHECK_VAL(width == 0 || height == 0, d_mpp_module_error("encoder not init and image size is 0"); return -1;)
+    int ret = init_encoder(width, height, fmt, type, fps, gop, hor_stride, ver_stride);
+    CHECK_VAL(ret != MPP_OK, d_mpp_module_error("init encoder failed!"); return -1;)
+
+    m_mpp_init_flag = true;
+    d_mpp_module_info("init encoder success! stride [%d:%d]", m_enc_data.hor_stride, m_enc_data.ver_stride)
+    return 0;
+}
+
 bool MppVideoEncoder::process_image(uint8_t *image_data,
                                     int32_t width,int32_t height,
                                     MppFrameFormat fmt,
                                     MppCodingType type,
                                     int32_t fps, int32_t gop) {
     // 初次处理图像时初始化编码器
-    if(!m_mpp_init_flag && width != 0) {
-        int ret = init_encoder(width, height, fmt, type, fps, gop);
-        CHECK_VAL(ret != MPP_OK, d_mpp_module_error("init encoder failed!"); return false;)
-
-        m_mpp_init_flag = true;
-        d_mpp_module_info("init encoder success!")
+    if (check_encoder(width, height, fmt, type, fps, gop) != 0) {
+        return false;
     }
-
-    MPP_RET ret = MPP_OK;
-    MppFrame frame = nullptr;
-    MppPacket packet = nullptr;
     //获得开辟的内存的首地址
     void *buf = mpp_buffer_get_ptr(m_enc_data.frm_buf);
 
-    // TODO: improve performance here?
     // 从输入图像的首地址开始读取图像数据，但是读取时会考虑16位对齐，即读取的长和宽都是16的整数倍。
     // 若图像一行或者一列不满16整数倍，则会用空数据补齐行和列
+    // 输入已经带步长时使用 process_frame / process_fd / process_buffer，避免先去 padding 再补 padding 的两次拷贝
     yuv_add_stride(image_data,
                     m_enc_data.width, m_enc_data.height,
                     m_enc_data.hor_stride, m_enc_data.ver_stride,
                     m_enc_data.fmt,
                     (uint8_t *)buf);
+    return encode_buffer(m_enc_data.frm_buf);
+}
+
+bool MppVideoEncoder::process_frame(const DecoderMppFrame &frame,
+                                    MppCodingType type,
+                                    int32_t fps, int32_t gop,
+                                    const EncoderFrameOverlay &overlay) {
+    if (check_encoder((int32_t)frame.hor_width, (int32_t)frame.ver_height, frame.mpp_frame_format, type, fps, gop,
+                      (int32_t)frame.hor_stride, (int32_t)frame.ver_stride) != 0) {
+        return false;
+    }
+    MppBuffer buffer = frame.mpp_frame != nullptr ? mpp_frame_get_buffer(frame.mpp_frame) : nullptr;
+    if (buffer != nullptr && overlay == nullptr && frame.mpp_frame_format == m_enc_data.fmt &&
+        same_stride((int32_t)frame.hor_stride, (int32_t)frame.ver_stride)) {
+        // 解码器的帧内存直接作为编码器输入（解码器还把它作为参考帧，不能在上面绘制）
+        return encode_buffer(buffer);
+    }
+    return process_buffer((const uint8_t *)frame.data_buf,
+                          (int32_t)frame.hor_width, (int32_t)frame.ver_height,
+                          (int32_t)frame.hor_stride, (int32_t)frame.ver_stride,
+                          frame.mpp_frame_format, type, fps, gop, overlay);
+}
+
+bool MppVideoEncoder::process_fd(int fd, size_t size,
+                                 int32_t width, int32_t height,
+                                 int32_t hor_stride, int32_t ver_stride,
+                                 MppFrameFormat fmt,
+                                 MppCodingType type,
+                                 int32_t fps, int32_t gop) {
+    if (check_encoder(width, height, fmt, type, fps, gop, hor_stride, ver_stride) != 0) {
+        return false;
+    }
+    // 导入外部 dma-buf，不拷贝数据
+    MppBufferInfo info;
+    memset(&info, 0, sizeof(info));
+    info.type = MPP_BUFFER_TYPE_DRM;
+    info.fd = fd;
+    info.size = size;
+    MppBuffer buffer = nullptr;
+    MPP_RET ret = mpp_buffer_import(&buffer, &info);
+    CHECK_VAL(ret != MPP_OK || buffer == nullptr, d_mpp_module_error("import fd %d failed ret %d", fd, ret); return false;)
+
+    bool encode_ret;
+    if (fmt == m_enc_data.fmt && same_stride(hor_stride, ver_stride)) {
+        encode_ret = encode_buffer(buffer);
+    } else {
+        encode_ret = process_buffer((const uint8_t *)mpp_buffer_get_ptr(buffer),
+                                    width, height, hor_stride, ver_stride, fmt, type, fps, gop);
+    }
+    mpp_buffer_put(buffer);
+    return encode_ret;
+}
+
+bool MppVideoEncoder::process_buffer(const uint8_t *data,
+                                     int32_t width, int32_t height,
+                                     int32_t hor_stride, int32_t ver_stride,
+                                     MppFrameFormat fmt,
+                                     MppCodingType type,
+                                     int32_t fps, int32_t gop,
+                                     const EncoderFrameOverlay &overlay) {
+    if (check_encoder(width, height, fmt, type, fps, gop, hor_stride, ver_stride) != 0) {
+        return false;
+    }
+    CHECK_VAL(data == nullptr, d_mpp_module_error("input buffer is null"); return false;)
+    CHECK_VAL(fmt != m_enc_data.fmt || width != m_enc_data.width || height != m_enc_data.height,
+              d_mpp_module_error("input %dx%d fmt %d mismatch encoder %dx%d fmt %d",
+                                 width, height, fmt, m_enc_data.width, m_enc_data.height, m_enc_data.fmt);
+              return false;)
+    // 按编码器步长一次拷贝
+    if (yuv_copy_stride(data, width, height, hor_stride, ver_stride, fmt,
+                        (uint8_t *)mpp_buffer_get_ptr(m_enc_data.frm_buf),
+                        m_enc_data.hor_stride, m_enc_data.ver_stride) != 0) {
+        return false;
+    }
+    apply_overlay(overlay, m_enc_data.frm_buf);
+    return encode_buffer(m_enc_data.frm_buf);
+}
+
+void MppVideoEncoder::apply_overlay(const EncoderFrameOverlay &overlay, MppBuffer buffer) const {
+    if (overlay == nullptr) {
+        return;
+    }
+    DecoderMppFrame copy = {};
+    copy.hor_width = (uint32_t)m_enc_data.width;
+    copy.ver_height = (uint32_t)m_enc_data.height;
+    copy.hor_stride = (uint32_t)m_enc_data.hor_stride;
+    copy.ver_stride = (uint32_t)m_enc_data.ver_stride;
+    copy.mpp_frame_format = m_enc_data.fmt;
+    copy.data_fd = -1;
+    copy.data_buf = mpp_buffer_get_ptr(buffer);
+    copy.data_size = (uint32_t)m_enc_data.frame_size;
+    overlay(copy);
+}
+
+bool MppVideoEncoder::encode_buffer(MppBuffer buffer) {
+    MPP_RET ret = MPP_OK;
+    MppFrame frame = nullptr;
+    MppPacket packet = nullptr;
+
     ret = mpp_frame_init(&frame);
     if (ret) {
         d_mpp_module_error("mpp_frame_init failed\n");
@@ -348,7 +467,7 @@ bool MppVideoEncoder::process_image(uint8_t *image_data,
     mpp_frame_set_hor_stride(frame, m_enc_data.hor_stride);
     mpp_frame_set_ver_stride(frame, m_enc_data.ver_stride);
     mpp_frame_set_fmt(frame, m_enc_data.fmt);
-    mpp_frame_set_buffer(frame, m_enc_data.frm_buf);
+    mpp_frame_set_buffer(frame, buffer);
 //    mpp_frame_set_buf_size(frame, m_enc_data.buf_size);
     mpp_frame_set_eos(frame, m_enc_data.frm_eos);
 
@@ -379,12 +498,20 @@ bool MppVideoEncoder::process_image(uint8_t *image_data,
         size_t len  = mpp_packet_get_length(packet);
         m_enc_data.pkt_eos = mpp_packet_get_eos(packet);
 
-        if (m_enc_data.fp_output) {
-            fwrite(ptr, 1, len, m_enc_data.fp_output);
+        EncoderPacket enc_packet;
+        enc_packet.data = (const uint8_t *)ptr;
+        enc_packet.size = len;
+        enc_packet.pts_ms = (int64_t)m_enc_data.frame_count * 1000 / (m_enc_data.fps > 0 ? m_enc_data.fps : 30);
+        if (mpp_packet_has_meta(packet)) {
+            RK_S32 intra = 0;
+            mpp_meta_get_s32(mpp_packet_get_meta(packet), KEY_OUTPUT_INTRA, &intra);
+            enc_packet.key_frame = intra != 0;
         }
+        write_packet(enc_packet);
         mpp_packet_deinit(&packet);
 
         m_enc_data.stream_size += len;
+        m_stream_bytes += len;
         m_enc_data.frame_count++;
 
         if (m_enc_data.pkt_eos) {
@@ -402,3 +529,208 @@ bool MppVideoEncoder::process_image(uint8_t *image_data,
     }
     return true;
 }
+
+int MppVideoEncoder::set_file_config(const FileSegmentConfig &config) {
+    CHECK_VAL(m_file_sink == nullptr, d_mpp_module_error("encoder has no output file"); return -1;)
+    CHECK_VAL(m_mpp_init_flag, d_mpp_module_error("file config must be set before the first frame"); return -1;)
+    // 异步模式下保留后台写线程的配置
+    FileSegmentConfig file_config = config;
+    if (m_async_flag) {
+        file_config.async_writer = true;
+        file_config.writer_config = m_async_config.writer_config;
+    }
+    return m_file_sink->set_config(file_config);
+}
+
+int MppVideoEncoder::set_buffer_group(MppBufferGroup group) {
+    CHECK_VAL(group == nullptr, d_mpp_module_error("buffer group is null"); return -1;)
+    CHECK_VAL(m_mpp_init_flag || m_enc_data.buf_grp != nullptr,
+              d_mpp_module_error("buffer group must be set before the first frame"); return -1;)
+    m_enc_data.buf_grp = group;
+    m_external_group = true;
+    return 0;
+}
+
+void MppVideoEncoder::add_sink(const std::shared_ptr<EncoderSink> &sink) {
+    CHECK_VAL(sink == nullptr, return;)
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+    if (!m_header.empty()) {
+        sink->write_header(m_header.data(), m_header.size());
+    }
+    m_sinks.push_back(sink);
+}
+
+int MppVideoEncoder::write_header(const void *data, size_t size) {
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+    m_header.assign((const uint8_t *)data, (const uint8_t *)data + size);
+    int ret = 0;
+    for (auto &sink : m_sinks) {
+        ret |= sink->write_header((const uint8_t *)data, size);
+    }
+    return ret;
+}
+
+int MppVideoEncoder::write_packet(const EncoderPacket &packet) {
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+    int ret = 0;
+    for (auto &sink : m_sinks) {
+        ret |= sink->write_packet(packet);
+    }
+    return ret;
+}
+
+int MppVideoEncoder::start_async(const MppEncoderAsyncConfig &config) {
+    CHECK_VAL(m_async_flag, d_mpp_module_warn("encoder already async"); return 0;)
+    CHECK_VAL(m_mpp_init_flag, d_mpp_module_error("start async must be called before the first frame"); return -1;)
+    CHECK_VAL(config.queue_depth == 0, d_mpp_module_error("async queue depth is 0"); return -1;)
+
+    // 输出文件改由后台写线程写出
+    if (m_file_sink != nullptr) {
+        FileSegmentConfig file_config = m_file_sink->get_config();
+        file_config.async_writer = true;
+        file_config.writer_config = config.writer_config;
+        CHECK_VAL(m_file_sink->set_config(file_config) != 0, return -1;)
+    }
+
+    m_async_config = config;
+    m_async_stop_flag = false;
+    m_async_flag = true;
+    m_encode_thread = std::thread(&MppVideoEncoder::encode_loop, this);
+    d_mpp_module_info("encoder async start, queue depth: %d", config.queue_depth)
+    return 0;
+}
+
+void MppVideoEncoder::stop_async() {
+    if (!m_async_flag) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        m_async_stop_flag = true;
+    }
+    m_encode_cond.notify_all();
+    m_free_cond.notify_all();
+    if (m_encode_thread.joinable()) {
+        m_encode_thread.join();
+    }
+    // 写出各输出缓存的数据
+    {
+        std::lock_guard<std::mutex> lock(m_sink_mutex);
+        for (auto &sink : m_sinks) {
+            sink->flush();
+        }
+    }
+    m_async_flag = false;
+    d_mpp_module_info("encoder async stop, pushed: %llu, encoded: %llu, dropped: %llu",
+                      (unsigned long long)m_pushed_frames.load(),
+                      (unsigned long long)m_encoded_frames.load(),
+                      (unsigned long long)m_dropped_frames.load())
+}
+
+bool MppVideoEncoder::push_frame(const DecoderMppFrame &frame,
+                                 MppCodingType type,
+                                 int32_t fps, int32_t gop,
+                                 const EncoderFrameOverlay &overlay) {
+    return push_buffer((const uint8_t *)frame.data_buf,
+                       (int32_t)frame.hor_width, (int32_t)frame.ver_height,
+                       (int32_t)frame.hor_stride, (int32_t)frame.ver_stride,
+                       frame.mpp_frame_format, type, fps, gop, overlay);
+}
+
+bool MppVideoEncoder::push_buffer(const uint8_t *data,
+                                  int32_t width, int32_t height,
+                                  int32_t hor_stride, int32_t ver_stride,
+                                  MppFrameFormat fmt,
+                                  MppCodingType type,
+                                  int32_t fps, int32_t gop,
+                                  const EncoderFrameOverlay &overlay) {
+    CHECK_VAL(!m_async_flag, d_mpp_module_error("encoder is not async, call start_async first"); return false;)
+    CHECK_VAL(data == nullptr, d_mpp_module_error("input buffer is null"); return false;)
+
+    std::unique_lock<std::mutex> lock(m_async_mutex);
+    if (m_async_stop_flag || check_encoder(width, height, fmt, type, fps, gop, hor_stride, ver_stride) != 0) {
+        return false;
+    }
+    CHECK_VAL(fmt != m_enc_data.fmt || width != m_enc_data.width || height != m_enc_data.height,
+              d_mpp_module_error("input %dx%d fmt %d mismatch encoder %dx%d fmt %d",
+                                 width, height, fmt, m_enc_data.width, m_enc_data.height, m_enc_data.fmt);
+              return false;)
+    if (m_async_buffers.empty()) {
+        // 编码器初始化后按帧大小申请队列使用的帧内存
+        for (uint32_t i = 0; i < m_async_config.queue_depth; i++) {
+            MppBuffer buffer = nullptr;
+            MPP_RET ret = mpp_buffer_get(m_enc_data.buf_grp, &buffer, m_enc_data.frame_size);
+            CHECK_VAL(ret != MPP_OK, d_mpp_module_error("failed to get async frame buffer ret %d", ret); break;)
+            m_async_buffers.push_back(buffer);
+            m_free_buffers.push_back(i);
+        }
+        CHECK_VAL(m_async_buffers.empty(), return false;)
+    }
+    m_pushed_frames++;
+    if (m_free_buffers.empty()) {
+        if (m_async_config.drop_when_full) {
+            m_dropped_frames++;
+            d_mpp_module_debug("encode queue full, drop frame")
+            return false;
+        }
+        m_free_cond.wait(lock, [this] { return !m_free_buffers.empty() || m_async_stop_flag; });
+        if (m_async_stop_flag) {
+            return false;
+        }
+    }
+    uint32_t index = m_free_buffers.front();
+    m_free_buffers.pop_front();
+    lock.unlock();
+
+    // 在调用线程上完成唯一的一次拷贝，返回后调用方即可释放帧
+    yuv_copy_stride(data, width, height, hor_stride, ver_stride, fmt,
+                    (uint8_t *)mpp_buffer_get_ptr(m_async_buffers[index]),
+                    m_enc_data.hor_stride, m_enc_data.ver_stride);
+    apply_overlay(overlay, m_async_buffers[index]);
+
+    lock.lock();
+    m_encode_queue.push_back(index);
+    lock.unlock();
+    m_encode_cond.notify_one();
+    return true;
+}
+
+void MppVideoEncoder::encode_loop() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_async_mutex);
+        m_encode_cond.wait(lock, [this] { return !m_encode_queue.empty() || m_async_stop_flag; });
+        if (m_encode_queue.empty()) {
+            // 停止时先编码完队列中的帧
+            break;
+        }
+        uint32_t index = m_encode_queue.front();
+        m_encode_queue.pop_front();
+        MppBuffer buffer = m_async_buffers[index];
+        lock.unlock();
+
+        encode_buffer(buffer);
+        m_encoded_frames++;
+
+        lock.lock();
+        m_free_buffers.push_back(index);
+        lock.unlock();
+        m_free_cond.notify_one();
+    }
+}
+
+MppEncoderStats MppVideoEncoder::get_stats() const {
+    MppEncoderStats stats{};
+    {
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        stats.queue_size = (uint32_t)m_encode_queue.size();
+    }
+    stats.pushed_frames = m_pushed_frames.load();
+    stats.encoded_frames = m_encoded_frames.load();
+    stats.dropped_frames = m_dropped_frames.load();
+    stats.stream_bytes = m_stream_bytes.load();
+    if (m_file_sink != nullptr) {
+        stats.written_bytes = m_file_sink->bytes_written();
+        stats.writer_stalls = m_file_sink->stall_count();
+    }
+    return stats;
+}
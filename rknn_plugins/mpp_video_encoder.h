@@ -9,8 +9,46 @@
 #define RKNN_INFER_PLUGIN_MPP_VIDEO_ENCODER_H
 
 #include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
 
 #include "rk_mpi.h"
+#include "mpp_video_decoder.h"
+#include "encoder_sink.h"
+
+// 在编码器内存中的帧副本上绘制（检测框、标签等），参数描述副本（编码器的步长），输入帧不会被修改
+using EncoderFrameOverlay = std::function<void(const DecoderMppFrame &frame)>;
+
+// 异步编码配置
+struct MppEncoderAsyncConfig {
+    // 待编码帧队列长度，编码器持有同样数量的帧内存
+    uint32_t queue_depth = 4;
+    // 队列满时丢弃新帧，否则等待编码线程
+    bool drop_when_full = true;
+    // 输出文件写入配置（开启后文件由后台写线程写出）
+    AsyncFileWriterConfig writer_config;
+};
+
+// 编码统计
+struct MppEncoderStats {
+    // 当前等待编码的帧数
+    uint32_t queue_size;
+    uint64_t pushed_frames;
+    uint64_t encoded_frames;
+    uint64_t dropped_frames;
+    // 编码输出的码流字节数
+    uint64_t stream_bytes;
+    // 已写入输出文件的字节数
+    uint64_t written_bytes;
+    // 写文件跟不上导致编码线程等待的次数
+    uint64_t writer_stalls;
+};
 
 class MppVideoEncoder {
 public:
@@ -22,22 +60,125 @@ public:
             int32_t fps = 30, int32_t gop = 60);
     ~MppVideoEncoder();
 
+    // 输出文件的分段配置（video_path 为空时没有输出文件），必须在编码第一帧之前调用
+    int set_file_config(const FileSegmentConfig &config);
+    // 增加码流输出（管道、内存环形缓冲等），码流头会补发给新的输出
+    void add_sink(const std::shared_ptr<EncoderSink> &sink);
+    // 使用外部的 MPP 内存池（多个编码器共享，重建编码器时复用已释放的帧内存），必须在编码第一帧之前调用
+    // 编码器不释放外部内存池
+    int set_buffer_group(MppBufferGroup group);
+
+    // 编码紧密排列（无 padding）的图像，拷贝到编码器内存时补齐步长
     bool process_image(uint8_t *image_data, int32_t width = 0, int32_t height = 0,
                        MppFrameFormat fmt = MPP_FMT_YUV422_YUYV,
                        MppCodingType type = MPP_VIDEO_CodingAVC,
                        int32_t fps = 30, int32_t gop = 60);
 
+    // 编码解码器输出的帧：编码器未初始化时按帧的步长初始化，步长一致时直接使用帧的 MppBuffer（零拷贝），否则拷贝一次
+    // 有 overlay 时总是拷贝，在副本上绘制。返回后即可释放该帧
+    bool process_frame(const DecoderMppFrame &frame,
+                       MppCodingType type = MPP_VIDEO_CodingAVC,
+                       int32_t fps = 30, int32_t gop = 60,
+                       const EncoderFrameOverlay &overlay = nullptr);
+
+    // 编码 dma-buf fd 中带步长的帧：步长一致时导入为 MppBuffer（零拷贝），否则映射后拷贝一次
+    bool process_fd(int fd, size_t size,
+                    int32_t width, int32_t height,
+                    int32_t hor_stride, int32_t ver_stride,
+                    MppFrameFormat fmt = MPP_FMT_YUV420SP,
+                    MppCodingType type = MPP_VIDEO_CodingAVC,
+                    int32_t fps = 30, int32_t gop = 60);
+
+    // 编码内存中带步长的帧，只拷贝一次到编码器内存，overlay 在拷贝后的数据上绘制
+    bool process_buffer(const uint8_t *data,
+                        int32_t width, int32_t height,
+                        int32_t hor_stride, int32_t ver_stride,
+                        MppFrameFormat fmt = MPP_FMT_YUV420SP,
+                        MppCodingType type = MPP_VIDEO_CodingAVC,
+                        int32_t fps = 30, int32_t gop = 60,
+                        const EncoderFrameOverlay &overlay = nullptr);
+
+    // 开启异步编码：调用线程只拷贝一次帧数据到编码器内存，编码和写文件在后台线程完成
+    // 必须在编码第一帧之前调用
+    int start_async(const MppEncoderAsyncConfig &config = {});
+
+    // 异步编码：帧数据拷贝到空闲的编码器内存后返回，返回后即可释放该帧；队列满且配置为丢帧时返回 false
+    // overlay 在调用线程上拷贝完成后绘制
+    bool push_frame(const DecoderMppFrame &frame,
+                    MppCodingType type = MPP_VIDEO_CodingAVC,
+                    int32_t fps = 30, int32_t gop = 60,
+                    const EncoderFrameOverlay &overlay = nullptr);
+    bool push_buffer(const uint8_t *data,
+                     int32_t width, int32_t height,
+                     int32_t hor_stride, int32_t ver_stride,
+                     MppFrameFormat fmt = MPP_FMT_YUV420SP,
+                     MppCodingType type = MPP_VIDEO_CodingAVC,
+                     int32_t fps = 30, int32_t gop = 60,
+                     const EncoderFrameOverlay &overlay = nullptr);
+
+    [[nodiscard]] MppEncoderStats get_stats() const;
+
     [[nodiscard]] bool is_init() const { return m_init_flag; };
 
 private:
+    // hor_stride / ver_stride 为 0 时按 16 对齐计算
     int init_encoder(int32_t width,int32_t height,
                      MppFrameFormat fmt,
                      MppCodingType type,
-                     int32_t fps, int32_t gop);
+                     int32_t fps, int32_t gop,
+                     int32_t hor_stride = 0, int32_t ver_stride = 0);
+    // 初次编码时初始化编码器
+    int check_encoder(int32_t width,int32_t height,
+                      MppFrameFormat fmt,
+                      MppCodingType type,
+                      int32_t fps, int32_t gop,
+                      int32_t hor_stride = 0, int32_t ver_stride = 0);
+    // 输入数据的步长是否和编码器一致（一致时可以零拷贝）
+    [[nodiscard]] bool same_stride(int32_t hor_stride, int32_t ver_stride) const {
+        return hor_stride == m_enc_data.hor_stride && ver_stride == m_enc_data.ver_stride;
+    };
+    // 编码一帧，buffer 中的数据已经按编码器的步长排列
+    bool encode_buffer(MppBuffer buffer);
+    // 在编码器内存中的帧副本上调用 overlay
+    void apply_overlay(const EncoderFrameOverlay &overlay, MppBuffer buffer) const;
+    // 码流头和编码后的包分发到所有输出
+    int write_header(const void *data, size_t size);
+    int write_packet(const EncoderPacket &packet);
+    // 异步编码线程
+    void encode_loop();
+    // 结束异步编码，编码完队列中的帧并写出所有数据
+    void stop_async();
     int uninit_encoder();
 private:
     bool m_init_flag = false;
     bool m_mpp_init_flag = false;
+    std::string m_video_path;
+    // buf_grp 由外部传入
+    bool m_external_group = false;
+
+    // 异步编码
+    bool m_async_flag = false;
+    bool m_async_stop_flag = false;
+    MppEncoderAsyncConfig m_async_config;
+    // 编码器持有的帧内存，空闲下标和待编码下标分别排队
+    std::vector<MppBuffer> m_async_buffers;
+    std::deque<uint32_t> m_free_buffers;
+    std::deque<uint32_t> m_encode_queue;
+    mutable std::mutex m_async_mutex;
+    std::condition_variable m_encode_cond;
+    std::condition_variable m_free_cond;
+    std::thread m_encode_thread;
+    std::atomic<uint64_t> m_pushed_frames{0};
+    std::atomic<uint64_t> m_encoded_frames{0};
+    std::atomic<uint64_t> m_dropped_frames{0};
+    std::atomic<uint64_t> m_stream_bytes{0};
+
+    // 码流输出，m_file_sink 为 video_path 对应的文件输出
+    std::shared_ptr<FileSegmentSink> m_file_sink;
+    std::vector<std::shared_ptr<EncoderSink>> m_sinks;
+    std::vector<uint8_t> m_header;
+    std::mutex m_sink_mutex;
+
     //编码所需要的数据
     struct MPP_ENC_DATA {
         // global flow control flag
@@ -75,8 +216,6 @@ private:
         int32_t gop = 60;
         int32_t fps = 30;
         int32_t bps;
-
-        FILE *fp_output;
     };
     MPP_ENC_DATA m_enc_data{};
 };
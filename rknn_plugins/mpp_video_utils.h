@@ -6,9 +6,11 @@
  */
 #ifndef RKNN_INFER_PLUGIN__MPP_VIDEO_UTILS_H
 #define RKNN_INFER_PLUGIN__MPP_VIDEO_UTILS_H
+#include <vector>
 #include "rk_mpi.h"
 #include "opencv2/opencv.hpp"
 #include "utils_log.h"
+#include "yuv_convert_utils.h"
 
 /**
  * @brief 将 MPP 帧数据中的 padding 部分去掉得到原始图像，参考 https://github.com/MUZLATAN/ffmpeg_rtsp_mpp/blob/master/MppDecode.cpp#L214
@@ -133,8 +135,72 @@ static int yuv_add_stride(
     return 0;
 }
 
+/**
+ * @brief 带步长的帧数据直接拷贝到另一种步长的帧内存中（一次拷贝，不经过去 padding 的中间图像）
+ *        步长的含义与 yuv_add_stride 相同，步长一致时整帧一次 memcpy
+ */
+static int yuv_copy_stride(
+        const uint8_t *src,
+        uint32_t width, uint32_t height,
+        uint32_t src_hor_stride, uint32_t src_ver_stride,
+        MppFrameFormat fmt,
+        uint8_t *dst,
+        uint32_t dst_hor_stride, uint32_t dst_ver_stride) {
+    switch (fmt) {
+        case MPP_FMT_YUV420SP : {
+            if (src_hor_stride == dst_hor_stride && src_ver_stride == dst_ver_stride) {
+                memcpy(dst, src, src_hor_stride * src_ver_stride * 3 / 2);
+                break;
+            }
+            const uint8_t *src_c = src + src_hor_stride * src_ver_stride;
+            uint8_t *dst_c = dst + dst_hor_stride * dst_ver_stride;
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(dst + row * dst_hor_stride, src + row * src_hor_stride, width);
+            }
+            for (uint32_t row = 0; row < height / 2; row++) {
+                memcpy(dst_c + row * dst_hor_stride, src_c + row * src_hor_stride, width);
+            }
+        } break;
+        case MPP_FMT_YUV420P : {
+            if (src_hor_stride == dst_hor_stride && src_ver_stride == dst_ver_stride) {
+                memcpy(dst, src, src_hor_stride * src_ver_stride * 3 / 2);
+                break;
+            }
+            const uint8_t *src_u = src + src_hor_stride * src_ver_stride;
+            const uint8_t *src_v = src_u + src_hor_stride * src_ver_stride / 4;
+            uint8_t *dst_u = dst + dst_hor_stride * dst_ver_stride;
+            uint8_t *dst_v = dst_u + dst_hor_stride * dst_ver_stride / 4;
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(dst + row * dst_hor_stride, src + row * src_hor_stride, width);
+            }
+            for (uint32_t row = 0; row < height / 2; row++) {
+                memcpy(dst_u + row * dst_hor_stride / 2, src_u + row * src_hor_stride / 2, width / 2);
+                memcpy(dst_v + row * dst_hor_stride / 2, src_v + row * src_hor_stride / 2, width / 2);
+            }
+        } break;
+        case MPP_FMT_ARGB8888 : {
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(dst + row * dst_hor_stride * 4, src + row * src_hor_stride * 4, width * 4);
+            }
+        } break;
+        case MPP_FMT_YUV422_YUYV :
+        case MPP_FMT_YUV422_UYVY : {
+            for (uint32_t row = 0; row < height; row++) {
+                memcpy(dst + row * dst_hor_stride, src + row * src_hor_stride, width * 2);
+            }
+        } break;
+        default : {
+            d_mpp_module_error("copy image do not support fmt %d", fmt)
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief 将 MPP 帧数据转换为 OpenCV Mat
+ *        直接用带行步长的 Mat 引用 MPP 帧数据，不再先拷贝去掉 padding；
+ *        rgb_img 尺寸和类型不变时复用其内存，调用方可跨帧复用同一个 Mat
  */
 static int frame_data_to_mat(
         const uint8_t *data_buf,
@@ -142,29 +208,34 @@ static int frame_data_to_mat(
         uint32_t hor_stride, uint32_t ver_stride,
         MppFrameFormat fmt,
         cv::Mat &rgb_img) {
-    cv::Mat yuv_img;
     switch (fmt) {
         case MPP_FMT_YUV420SP :{
-            yuv_img.create(height * 3 / 2, width, CV_8UC1);
-            yuv_del_stride(data_buf, width, height, hor_stride, ver_stride, fmt, yuv_img.data);
-            cv::cvtColor(yuv_img, rgb_img, cv::COLOR_YUV420sp2RGB);
+            // Y 平面和 UV 平面的行步长都是 hor_stride
+            cv::Mat y_plane((int)height, (int)width, CV_8UC1, (void *)data_buf, hor_stride);
+            cv::Mat uv_plane((int)height / 2, (int)width / 2, CV_8UC2,
+                             (void *)(data_buf + hor_stride * ver_stride), hor_stride);
+            cv::cvtColorTwoPlane(y_plane, uv_plane, rgb_img, cv::COLOR_YUV2RGB_NV12);
         } break;
         case MPP_FMT_YUV420P : {
-            yuv_img.create(height * 3 / 2, width, CV_8UC1);
-            yuv_del_stride(data_buf, width, height, hor_stride, ver_stride, fmt, yuv_img.data);
-            cv::cvtColor(yuv_img, rgb_img, cv::COLOR_YUV420p2RGB);
+            if (hor_stride == width && ver_stride == height) {
+                // 没有 padding 时直接引用（COLOR_YUV420p2RGB 是 YV12，V 在前，不能用于 I420）
+                cv::Mat yuv_img((int)height * 3 / 2, (int)width, CV_8UC1, (void *)data_buf);
+                cv::cvtColor(yuv_img, rgb_img, cv::COLOR_YUV2RGB_I420);
+                break;
+            }
+            // 有 padding 时只把 U、V 交织成行步长为 hor_stride 的 UV 平面（1/4 帧大小），再按 NV12 转换
+            const uint8_t *base_u = data_buf + hor_stride * ver_stride;
+            const uint8_t *base_v = base_u + hor_stride * ver_stride / 4;
+            cv::Mat u_plane((int)height / 2, (int)width / 2, CV_8UC1, (void *)base_u, hor_stride / 2);
+            cv::Mat v_plane((int)height / 2, (int)width / 2, CV_8UC1, (void *)base_v, hor_stride / 2);
+            thread_local std::vector<uint8_t> uv_buf;
+            uv_buf.resize(hor_stride * height / 2);
+            cv::Mat uv_plane((int)height / 2, (int)width / 2, CV_8UC2, uv_buf.data(), hor_stride);
+            cv::Mat uv_src[2] = {u_plane, v_plane};
+            cv::merge(uv_src, 2, uv_plane);
+            cv::Mat y_plane((int)height, (int)width, CV_8UC1, (void *)data_buf, hor_stride);
+            cv::cvtColorTwoPlane(y_plane, uv_plane, rgb_img, cv::COLOR_YUV2RGB_NV12);
         } break;
-//        case MPP_FMT_ARGB8888 : {
-//            yuv_img.create(height, width * 4, CV_8UC1);
-//            yuv_del_stride(data_buf, width, height, hor_stride, ver_stride, fmt, yuv_img.data);
-//            cv::cvtColor(yuv_img, rgb_img, cv::COLOR_YUV420p2RGB);
-//        } break;
-//        case MPP_FMT_YUV422_YUYV :
-//        case MPP_FMT_YUV422_UYVY : {
-//            yuv_img.create(height, width * 2, CV_8UC1);
-//            yuv_del_stride(data_buf, width, height, hor_stride, ver_stride, fmt, yuv_img.data);
-//            cv::cvtColor(yuv_img, rgb_img, cv::COLOR_YUV2RGBA_Y422);
-//        } break;
         default : {
             d_mpp_module_error("read image do not support fmt %d", fmt)
             return -1;
@@ -172,4 +243,33 @@ static int frame_data_to_mat(
     }
     return 0;
 }
+/**
+ * @brief 将 MPP 帧数据直接转换、缩放为模型输入（RGB888），不经过中间图像，参数含义见 yuv_to_rgb_resize
+ */
+static int frame_data_to_model_input(
+        const uint8_t *data_buf,
+        uint32_t width, uint32_t height,
+        uint32_t hor_stride, uint32_t ver_stride,
+        MppFrameFormat fmt,
+        uint8_t *dst, int dst_w, int dst_h,
+        rknn_tensor_format dst_layout,
+        bool keep_ratio,
+        uint8_t pad_value,
+        LetterboxInfo *info) {
+    YuvFrameView frame{data_buf, width, height, hor_stride, ver_stride, YUV_LAYOUT_NV12};
+    switch (fmt) {
+        case MPP_FMT_YUV420SP :
+            frame.layout = YUV_LAYOUT_NV12;
+            break;
+        case MPP_FMT_YUV420P :
+            frame.layout = YUV_LAYOUT_I420;
+            break;
+        default : {
+            d_mpp_module_error("model input do not support fmt %d", fmt)
+            return -1;
+        }
+    }
+    return yuv_to_rgb_resize(frame, dst, dst_w, dst_h, dst_layout, keep_ratio, pad_value, info);
+}
+
 #endif //RKNN_INFER_PLUGIN__MPP_VIDEO_UTILS_H
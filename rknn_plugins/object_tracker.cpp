@@ -0,0 +1,301 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.30
+ * @brief: 多目标跟踪实现
+ */
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "object_tracker.h"
+#include "properties_reader.h"
+#include "utils_log.h"
+
+// 过程噪声和观测噪声的标准差相对目标高度的比例（与 DeepSORT 相同）
+#define TRACKER_STD_POSITION (1.0f / 20)
+#define TRACKER_STD_VELOCITY (1.0f / 160)
+
+// 设置一项配置，name 不带 tracker. 和流序号前缀，未知配置返回 false
+static bool set_tracker_config(const std::string &name, const std::string &value, ObjectTrackerConfig &config) {
+    if (name == "enable") {
+        config.enable = parse_bool_property(value);
+    } else if (name == "min_interval") {
+        config.min_interval = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "max_interval") {
+        config.max_interval = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "target_shift") {
+        config.target_shift = strtof(value.c_str(), nullptr);
+    } else if (name == "iou_threshold") {
+        config.iou_threshold = strtof(value.c_str(), nullptr);
+    } else if (name == "max_misses") {
+        config.max_misses = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "min_hits") {
+        config.min_hits = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "max_uncertainty") {
+        config.max_uncertainty = strtof(value.c_str(), nullptr);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int load_object_tracker_config(const std::string &path, ObjectTrackerConfigSet &config_set) {
+    if (load_stream_properties(path, "tracker", config_set.defaults, config_set.streams, set_tracker_config) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+ObjectTracker::ObjectTracker(const ObjectTrackerConfig &config) {
+    m_config = config;
+    m_config.min_interval = std::max(1u, m_config.min_interval);
+    m_config.max_interval = std::max(m_config.min_interval, m_config.max_interval);
+    m_config.max_misses = std::max(1u, m_config.max_misses);
+    m_interval = m_config.min_interval;
+    m_stats.interval = m_interval;
+}
+
+float ObjectTracker::iou(const TrackBox &a, const TrackBox &b) {
+    float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+    float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+    if (w <= 0 || h <= 0) {
+        return 0;
+    }
+    float inter = w * h;
+    float area_a = (a.right - a.left) * (a.bottom - a.top);
+    float area_b = (b.right - b.left) * (b.bottom - b.top);
+    return inter / (area_a + area_b - inter);
+}
+
+bool ObjectTracker::should_detect(uint64_t frame) {
+    bool detect = !m_config.enable || !m_detect_scheduled || frame < m_detect_frame ||
+                  frame - m_detect_frame >= m_interval;
+    // 上次调度的检测已经返回时才按不确定度提前检测，避免检测结果返回前每帧都调度
+    if (!detect && m_updated && m_update_frame >= m_detect_frame && uncertainty(frame) > m_config.max_uncertainty) {
+        detect = true;
+        m_stats.early_detects++;
+    }
+    if (detect) {
+        m_detect_frame = frame;
+        m_detect_scheduled = true;
+        m_stats.detect_frames++;
+    } else {
+        m_stats.track_frames++;
+    }
+    return detect;
+}
+
+void ObjectTracker::predict_all(float dt) {
+    if (dt <= 0) {
+        return;
+    }
+    const size_t count = m_ids.size();
+    // 高度最后处理，每个航迹的噪声都按预测前的高度计算
+    const float *height = m_pos[3].data();
+    for (int axis = 0; axis < TRACKER_AXIS_NUM; axis++) {
+        float *pos = m_pos[axis].data();
+        float *vel = m_vel[axis].data();
+        float *p00 = m_p00[axis].data();
+        float *p01 = m_p01[axis].data();
+        float *p11 = m_p11[axis].data();
+        for (size_t i = 0; i < count; i++) {
+            float h = std::max(height[i], 1.0f);
+            float q_pos = TRACKER_STD_POSITION * h * TRACKER_STD_POSITION * h * dt;
+            float q_vel = TRACKER_STD_VELOCITY * h * TRACKER_STD_VELOCITY * h * dt;
+            pos[i] += vel[i] * dt;
+            p00[i] += dt * (2 * p01[i] + dt * p11[i]) + q_pos;
+            p01[i] += dt * p11[i];
+            p11[i] += q_vel;
+        }
+    }
+}
+
+void ObjectTracker::add_track(const TrackBox &box) {
+    float z[TRACKER_AXIS_NUM] = {(box.left + box.right) / 2, (box.top + box.bottom) / 2,
+                                 box.right - box.left, box.bottom - box.top};
+    float h = std::max(z[3], 1.0f);
+    for (int axis = 0; axis < TRACKER_AXIS_NUM; axis++) {
+        m_pos[axis].push_back(z[axis]);
+        m_vel[axis].push_back(0);
+        // 初始速度未知，方差取大
+        m_p00[axis].push_back(4 * TRACKER_STD_POSITION * h * TRACKER_STD_POSITION * h);
+        m_p01[axis].push_back(0);
+        m_p11[axis].push_back(100 * TRACKER_STD_VELOCITY * h * TRACKER_STD_VELOCITY * h);
+    }
+    m_ids.push_back(m_next_id++);
+    m_class_ids.push_back(box.class_id);
+    m_scores.push_back(box.score);
+    m_hits.push_back(1);
+    m_misses.push_back(0);
+    m_stats.created_tracks++;
+}
+
+void ObjectTracker::remove_track(uint32_t index) {
+    // 与最后一个交换后删除，数组保持连续
+    size_t last = m_ids.size() - 1;
+    for (int axis = 0; axis < TRACKER_AXIS_NUM; axis++) {
+        m_pos[axis][index] = m_pos[axis][last];
+        m_vel[axis][index] = m_vel[axis][last];
+        m_p00[axis][index] = m_p00[axis][last];
+        m_p01[axis][index] = m_p01[axis][last];
+        m_p11[axis][index] = m_p11[axis][last];
+        m_pos[axis].pop_back();
+        m_vel[axis].pop_back();
+        m_p00[axis].pop_back();
+        m_p01[axis].pop_back();
+        m_p11[axis].pop_back();
+    }
+    m_ids[index] = m_ids[last];
+    m_class_ids[index] = m_class_ids[last];
+    m_scores[index] = m_scores[last];
+    m_hits[index] = m_hits[last];
+    m_misses[index] = m_misses[last];
+    m_ids.pop_back();
+    m_class_ids.pop_back();
+    m_scores.pop_back();
+    m_hits.pop_back();
+    m_misses.pop_back();
+    m_stats.deleted_tracks++;
+}
+
+TrackBox ObjectTracker::track_box(uint32_t index, float dt) const {
+    float cx = m_pos[0][index] + m_vel[0][index] * dt;
+    float cy = m_pos[1][index] + m_vel[1][index] * dt;
+    float w = std::max(m_pos[2][index] + m_vel[2][index] * dt, 1.0f);
+    float h = std::max(m_pos[3][index] + m_vel[3][index] * dt, 1.0f);
+    return {cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, m_class_ids[index], m_scores[index], m_ids[index]};
+}
+
+int ObjectTracker::update(uint64_t frame, std::vector<TrackBox> &detections) {
+    if (m_updated && frame < m_update_frame) {
+        return -1;
+    }
+    predict_all(m_updated ? (float)(frame - m_update_frame) : 0);
+
+    // 同类别的航迹和检测框按 IoU 从大到小贪心关联
+    struct MatchPair {
+        float iou;
+        uint32_t track;
+        uint32_t detection;
+    };
+    const auto track_num = (uint32_t)m_ids.size();
+    std::vector<MatchPair> pairs;
+    for (uint32_t t = 0; t < track_num; t++) {
+        TrackBox box = track_box(t, 0);
+        for (uint32_t d = 0; d < detections.size(); d++) {
+            if (detections[d].class_id != box.class_id) {
+                continue;
+            }
+            float value = iou(box, detections[d]);
+            if (value >= m_config.iou_threshold) {
+                pairs.push_back({value, t, d});
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const MatchPair &a, const MatchPair &b) { return a.iou > b.iou; });
+
+    std::vector<char> track_matched(track_num, 0);
+    std::vector<char> detection_matched(detections.size(), 0);
+    float activity = 0;
+    for (auto &pair : pairs) {
+        if (track_matched[pair.track] || detection_matched[pair.detection]) {
+            continue;
+        }
+        track_matched[pair.track] = 1;
+        detection_matched[pair.detection] = 1;
+        TrackBox &det = detections[pair.detection];
+        det.track_id = m_ids[pair.track];
+
+        // 各分量独立的卡尔曼更新
+        const uint32_t t = pair.track;
+        float z[TRACKER_AXIS_NUM] = {(det.left + det.right) / 2, (det.top + det.bottom) / 2,
+                                     det.right - det.left, det.bottom - det.top};
+        float h = std::max(m_pos[3][t], 1.0f);
+        float r = TRACKER_STD_POSITION * h * TRACKER_STD_POSITION * h;
+        for (int axis = 0; axis < TRACKER_AXIS_NUM; axis++) {
+            float p00 = m_p00[axis][t];
+            float p01 = m_p01[axis][t];
+            float s = p00 + r;
+            float k0 = p00 / s;
+            float k1 = p01 / s;
+            float y = z[axis] - m_pos[axis][t];
+            m_pos[axis][t] += k0 * y;
+            m_vel[axis][t] += k1 * y;
+            m_p00[axis][t] = (1 - k0) * p00;
+            m_p01[axis][t] = (1 - k0) * p01;
+            m_p11[axis][t] -= k1 * p01;
+        }
+        m_class_ids[t] = det.class_id;
+        m_scores[t] = det.score;
+        m_hits[t]++;
+        m_misses[t] = 0;
+
+        // 运动量：每帧移动的距离相对目标高度，取最快的目标
+        float speed = std::sqrt(m_vel[0][t] * m_vel[0][t] + m_vel[1][t] * m_vel[1][t]) / std::max(m_pos[3][t], 1.0f);
+        activity = std::max(activity, speed);
+    }
+
+    // 没有关联上的航迹多次丢失后删除，从后往前删除不影响未处理的下标
+    bool changed = false;
+    for (uint32_t t = track_num; t > 0; t--) {
+        if (track_matched[t - 1]) {
+            continue;
+        }
+        if (++m_misses[t - 1] >= m_config.max_misses) {
+            remove_track(t - 1);
+            changed = true;
+        }
+    }
+    // 没有关联上的检测框创建新航迹
+    for (uint32_t d = 0; d < detections.size(); d++) {
+        if (!detection_matched[d]) {
+            add_track(detections[d]);
+            detections[d].track_id = m_ids.back();
+            changed = true;
+        }
+    }
+
+    // 按运动量调整检测间隔：两次检测之间目标移动不超过 target_shift，目标出现或消失时按最短间隔检测
+    m_activity = m_updated ? 0.5f * m_activity + 0.5f * activity : activity;
+    float interval = m_activity > 0 ? m_config.target_shift / m_activity : (float)m_config.max_interval;
+    m_interval = (uint32_t)std::min(std::max(interval, (float)m_config.min_interval), (float)m_config.max_interval);
+    if (changed) {
+        m_interval = m_config.min_interval;
+    }
+    m_update_frame = frame;
+    m_updated = true;
+    m_stats.interval = m_interval;
+    m_stats.activity = m_activity;
+    return 0;
+}
+
+void ObjectTracker::predict(uint64_t frame, std::vector<TrackBox> &tracks) const {
+    tracks.clear();
+    // 只输出最近一次检测中关联上的已确认航迹
+    float dt = (float)((int64_t)frame - (int64_t)m_update_frame);
+    for (uint32_t i = 0; i < m_ids.size(); i++) {
+        if (m_misses[i] == 0 && m_hits[i] >= m_config.min_hits) {
+            tracks.push_back(track_box(i, dt));
+        }
+    }
+}
+
+float ObjectTracker::uncertainty(uint64_t frame) const {
+    float dt = frame > m_update_frame ? (float)(frame - m_update_frame) : 0;
+    float max_value = 0;
+    for (uint32_t i = 0; i < m_ids.size(); i++) {
+        if (m_misses[i] != 0 || m_hits[i] < m_config.min_hits) {
+            continue;
+        }
+        // 中心 x、y 外推 dt 帧后的方差
+        float h = std::max(m_pos[3][i], 1.0f);
+        float q_pos = TRACKER_STD_POSITION * h * TRACKER_STD_POSITION * h * dt;
+        float var = 0;
+        for (int axis = 0; axis < 2; axis++) {
+            var += m_p00[axis][i] + dt * (2 * m_p01[axis][i] + dt * m_p11[axis][i]) + q_pos;
+        }
+        max_value = std::max(max_value, std::sqrt(var) / h);
+    }
+    return max_value;
+}
@@ -0,0 +1,146 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.30
+ * @brief: 多目标跟踪（SORT）：每个目标的中心点和宽高各用一个匀速卡尔曼滤波，检测结果按 IoU 贪心关联到预测位置；
+ *         两次检测之间按速度外推目标位置，只每隔 N 帧或外推位置的不确定度过大时检测，N 随场景的运动量调整。
+ *         航迹按成员分开存放（SoA），预测和更新按数组顺序遍历。不依赖 MPP 和检测后处理
+ */
+#ifndef RKNN_INFER_PLUGIN_OBJECT_TRACKER_H
+#define RKNN_INFER_PLUGIN_OBJECT_TRACKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 卡尔曼滤波的观测分量：中心 x、中心 y、宽、高
+#define TRACKER_AXIS_NUM (4)
+
+struct ObjectTrackerConfig {
+    // 是否启用，关闭时每帧都检测
+    bool enable = false;
+    // 检测间隔的范围（帧），按场景运动量在其中调整
+    uint32_t min_interval = 1;
+    uint32_t max_interval = 8;
+    // 两次检测之间允许目标移动的距离（相对目标高度），运动越快检测间隔越短
+    float target_shift = 0.3f;
+    // 关联的最小 IoU
+    float iou_threshold = 0.3f;
+    // 航迹连续多少次检测没有关联上时删除
+    uint32_t max_misses = 2;
+    // 航迹关联上多少次检测后输出
+    uint32_t min_hits = 1;
+    // 任一航迹外推位置的标准差超过目标高度的该比例时（速度估计不准或外推太久）提前检测
+    float max_uncertainty = 0.35f;
+};
+
+// 各流的配置：tracker.xxx 为默认值，tracker.N.xxx 覆盖流 N 的配置
+struct ObjectTrackerConfigSet {
+    ObjectTrackerConfig defaults;
+    std::map<int, ObjectTrackerConfig> streams;
+
+    [[nodiscard]] const ObjectTrackerConfig &get(int stream_id) const {
+        auto it = streams.find(stream_id);
+        return it == streams.end() ? defaults : it->second;
+    }
+};
+
+/**
+ * @brief 从 properties 文件读取 tracker.xxx 和 tracker.N.xxx，忽略其他配置，文件不存在返回 -1
+ */
+int load_object_tracker_config(const std::string &path, ObjectTrackerConfigSet &config_set);
+
+// 检测框或航迹框（原图坐标）
+struct TrackBox {
+    float left;
+    float top;
+    float right;
+    float bottom;
+    int class_id;
+    float score;
+    // 航迹编号，检测框为 -1
+    int track_id;
+};
+
+struct ObjectTrackerStats {
+    // 检测帧和外推帧
+    uint64_t detect_frames = 0;
+    uint64_t track_frames = 0;
+    // 因不确定度过大提前检测的次数
+    uint64_t early_detects = 0;
+    uint64_t created_tracks = 0;
+    uint64_t deleted_tracks = 0;
+    // 当前的检测间隔和运动量
+    uint32_t interval = 1;
+    float activity = 0;
+};
+
+/**
+ * @brief 一路流的跟踪器，非线程安全（输入线程调度、输出线程更新，由调用者加锁）。
+ *        帧序号由调用者按流递增分配，检测结果可以晚于后续帧的调度到达
+ */
+class ObjectTracker {
+public:
+    explicit ObjectTracker(const ObjectTrackerConfig &config);
+
+    [[nodiscard]] const ObjectTrackerConfig &config() const { return m_config; };
+
+    /**
+     * @brief 调度第 frame 帧：距离上次调度检测达到检测间隔，或者没有未返回的检测且航迹不确定度过大时返回 true，
+     *        并记为已调度检测；否则返回 false，该帧用 predict 外推的结果
+     */
+    bool should_detect(uint64_t frame);
+
+    /**
+     * @brief 用第 frame 帧的检测结果更新航迹，detections 的 track_id 填为关联到的航迹
+     * @return 0 成功，-1 结果早于上次更新（乱序到达），被忽略
+     */
+    int update(uint64_t frame, std::vector<TrackBox> &detections);
+
+    // 外推第 frame 帧已确认航迹的位置，不修改状态
+    void predict(uint64_t frame, std::vector<TrackBox> &tracks) const;
+
+    // 第 frame 帧已确认航迹外推位置的最大标准差（相对目标高度），没有航迹时为 0
+    [[nodiscard]] float uncertainty(uint64_t frame) const;
+
+    [[nodiscard]] uint32_t track_count() const { return (uint32_t)m_ids.size(); };
+    [[nodiscard]] ObjectTrackerStats get_stats() const { return m_stats; };
+
+    static float iou(const TrackBox &a, const TrackBox &b);
+
+private:
+    // 所有航迹的卡尔曼状态预测 dt 帧
+    void predict_all(float dt);
+    void add_track(const TrackBox &box);
+    void remove_track(uint32_t index);
+    [[nodiscard]] TrackBox track_box(uint32_t index, float dt) const;
+
+private:
+    ObjectTrackerConfig m_config;
+    int m_next_id = 0;
+    // 最近一次更新和最近一次调度检测的帧序号
+    uint64_t m_update_frame = 0;
+    uint64_t m_detect_frame = 0;
+    bool m_updated = false;
+    bool m_detect_scheduled = false;
+    // 当前的检测间隔和运动量（目标每帧移动的距离相对目标高度，平滑后）
+    uint32_t m_interval;
+    float m_activity = 0;
+
+    // 航迹状态（SoA）：各观测分量的位置、速度和 2x2 协方差
+    std::vector<float> m_pos[TRACKER_AXIS_NUM];
+    std::vector<float> m_vel[TRACKER_AXIS_NUM];
+    std::vector<float> m_p00[TRACKER_AXIS_NUM];
+    std::vector<float> m_p01[TRACKER_AXIS_NUM];
+    std::vector<float> m_p11[TRACKER_AXIS_NUM];
+    std::vector<int> m_ids;
+    std::vector<int> m_class_ids;
+    std::vector<float> m_scores;
+    std::vector<uint32_t> m_hits;
+    std::vector<uint32_t> m_misses;
+
+    ObjectTrackerStats m_stats;
+};
+
+#endif //RKNN_INFER_PLUGIN_OBJECT_TRACKER_H
@@ -7,30 +7,203 @@
 #ifndef RKNN_INFER_PLUGIN_COMMON_H
 #define RKNN_INFER_PLUGIN_COMMON_H
 
+#include <cmath>
 #include <cstring>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
 
-static int rknn_plugin_get_top (
+#include "rknn_api.h"
+#include "utils_log.h"
+
+/**
+ * @brief 半精度浮点（IEEE 754 binary16）转单精度浮点，RKNN 的 FLOAT16 输出以 uint16_t 存放
+ */
+static inline float fp16_to_fp32(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0x1f) {
+        // inf / nan
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else if (exp != 0) {
+        // 规格化数
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if (mant != 0) {
+        // 非规格化数，归一化尾数
+        exp = 113;
+        while ((mant & 0x400) == 0) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    } else {
+        // +-0
+        bits = sign;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief 输出 tensor 元素的读取和反量化，FLOAT16 按 uint16_t 存放
+ *        value_t 为比较用的类型，量化类型直接在整数域比较
+ */
+template<typename T>
+struct PluginTensorTraits;
+
+template<>
+struct PluginTensorTraits<float> {
+    typedef float value_t;
+    static inline value_t load(float v) { return v; }
+    static inline float to_f32(value_t v, int32_t, float) { return v; }
+};
+
+template<>
+struct PluginTensorTraits<uint16_t> {
+    typedef float value_t;
+    static inline value_t load(uint16_t v) { return fp16_to_fp32(v); }
+    static inline float to_f32(value_t v, int32_t, float) { return v; }
+};
+
+template<>
+struct PluginTensorTraits<int8_t> {
+    typedef int32_t value_t;
+    static inline value_t load(int8_t v) { return v; }
+    static inline float to_f32(value_t v, int32_t zp, float scale) { return (float)(v - zp) * scale; }
+};
+
+template<>
+struct PluginTensorTraits<uint8_t> {
+    typedef int32_t value_t;
+    static inline value_t load(uint8_t v) { return v; }
+    static inline float to_f32(value_t v, int32_t zp, float scale) { return (float)(v - zp) * scale; }
+};
+
+/**
+ * @brief 取前 top_num 大的元素（按值从大到小，值相同时下标小的在前）
+ *        使用大小为 top_num 的最小堆，单次遍历 O(N·logK)，只对选出的元素做反量化
+ * @param data 输出 tensor（float / uint16_t(fp16) / int8_t / uint8_t）
+ * @param count 元素个数
+ * @param top_prob 选出元素的值（反量化后，softmax 时为概率），长度至少 top_num
+ * @param top_class 选出元素的下标，长度至少 top_num
+ * @param top_num 选取个数
+ * @param zp, scale 量化参数，仅量化类型使用
+ * @param softmax 是否对整个 tensor 做 softmax 后输出概率（只需额外一次求和遍历）
+ * @return 实际选出的个数 min(count, top_num)
+ */
+template<typename T>
+static uint32_t rknn_plugin_top_k(
+        const T *data,
+        uint32_t count,
+        float *top_prob,
+        uint32_t *top_class,
+        uint32_t top_num,
+        int32_t zp = 0,
+        float scale = 1.0f,
+        bool softmax = false) {
+    typedef PluginTensorTraits<T> Traits;
+    typedef typename Traits::value_t value_t;
+
+    uint32_t k = top_num < count ? top_num : count;
+    if (k == 0) {
+        return 0;
+    }
+
+    // 最小堆，堆顶为当前选出元素中最差的一个
+    thread_local std::vector<std::pair<value_t, uint32_t>> heap;
+    heap.clear();
+    heap.reserve(k);
+    // a 比 b 更优：值更大，或值相同下标更小
+    auto better = [](const std::pair<value_t, uint32_t> &a, const std::pair<value_t, uint32_t> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    for (uint32_t i = 0; i < k; i++) {
+        heap.emplace_back(Traits::load(data[i]), i);
+    }
+    std::make_heap(heap.begin(), heap.end(), better);
+    for (uint32_t i = k; i < count; i++) {
+        value_t v = Traits::load(data[i]);
+        // 下标递增，值相同时新元素一定更差
+        if (v <= heap.front().first) {
+            continue;
+        }
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = std::make_pair(v, i);
+        std::push_heap(heap.begin(), heap.end(), better);
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+
+    for (uint32_t j = 0; j < k; j++) {
+        top_prob[j] = Traits::to_f32(heap[j].first, zp, scale);
+        top_class[j] = heap[j].second;
+    }
+
+    if (softmax) {
+        // 最大值即第一个选出的元素
+        const float max_val = top_prob[0];
+        float exp_sum = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            exp_sum += expf(Traits::to_f32(Traits::load(data[i]), zp, scale) - max_val);
+        }
+        for (uint32_t j = 0; j < k; j++) {
+            top_prob[j] = expf(top_prob[j] - max_val) / exp_sum;
+        }
+    }
+    return k;
+}
+
+/**
+ * @brief 直接在模型输出上取 top-K：want_float 为 false 时按 output_attr 的数据类型在量化域选取，
+ *        只对选出的元素用 zp/scale 反量化，省去运行时整个 tensor 的 float 转换
+ * @return 实际选出的个数，数据类型不支持时返回 0
+ */
+static uint32_t rknn_plugin_output_top_k(
+        const rknn_output &output,
+        const rknn_tensor_attr &attr,
+        float *top_prob,
+        uint32_t *top_class,
+        uint32_t top_num,
+        bool softmax = false) {
+    if (output.want_float) {
+        return rknn_plugin_top_k((const float *)output.buf, output.size / sizeof(float),
+                                 top_prob, top_class, top_num, 0, 1.0f, softmax);
+    }
+    switch (attr.type) {
+        case RKNN_TENSOR_INT8:
+            return rknn_plugin_top_k((const int8_t *)output.buf, output.size / sizeof(int8_t),
+                                     top_prob, top_class, top_num, attr.zp, attr.scale, softmax);
+        case RKNN_TENSOR_UINT8:
+            return rknn_plugin_top_k((const uint8_t *)output.buf, output.size / sizeof(uint8_t),
+                                     top_prob, top_class, top_num, attr.zp, attr.scale, softmax);
+        case RKNN_TENSOR_FLOAT16:
+            return rknn_plugin_top_k((const uint16_t *)output.buf, output.size / sizeof(uint16_t),
+                                     top_prob, top_class, top_num, 0, 1.0f, softmax);
+        case RKNN_TENSOR_FLOAT32:
+            return rknn_plugin_top_k((const float *)output.buf, output.size / sizeof(float),
+                                     top_prob, top_class, top_num, 0, 1.0f, softmax);
+        default:
+            d_rknn_plugin_error("top k do not support output type %s", get_type_string(attr.type))
+            return 0;
+    }
+}
+
+/**
+ * @brief float 输出取前 top_num 大的元素，不足 top_num 的部分概率填 0、下标填 0xffffffff
+ */
+static int rknn_plugin_get_top(
         const float* p_prob,
         float* p_max_prob,
         uint32_t* p_max_class,
         uint32_t output_count,
         uint32_t top_num){
-    uint32_t i, j;
-    memset(p_max_prob, 0, sizeof(float) * top_num);
-    memset(p_max_class, 0xff, sizeof(float) * top_num);
-
-    for (j = 0; j < top_num; j++) {
-        for (i = 0; i < output_count; i++) {
-            if ((i == *(p_max_class + 0)) || (i == *(p_max_class + 1)) || (i == *(p_max_class + 2)) || (i == *(p_max_class + 3)) ||
-                (i == *(p_max_class + 4))) {
-                continue;
-            }
-
-            if (p_prob[i] > *(p_max_prob + j)) {
-                *(p_max_prob + j) = p_prob[i];
-                *(p_max_class + j) = i;
-            }
-        }
+    uint32_t k = rknn_plugin_top_k(p_prob, output_count, p_max_prob, p_max_class, top_num);
+    for (uint32_t j = k; j < top_num; j++) {
+        p_max_prob[j] = 0;
+        p_max_class[j] = 0xffffffff;
     }
     return 1;
 }
@@ -0,0 +1,73 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.30
+ * @brief: properties 配置读取实现
+ */
+#include <fstream>
+#include <cstdlib>
+#include <cctype>
+
+#include "properties_reader.h"
+
+static std::string trim(const std::string &str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+int read_properties(const std::string &path, std::vector<PropertyItem> &items) {
+    std::ifstream config_file(path);
+    if (!config_file.is_open()) {
+        return -1;
+    }
+    items.clear();
+    std::string line;
+    while (std::getline(config_file, line)) {
+        // 跳过注释和空行
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t eq_pos = line.find('=');
+        if (eq_pos == std::string::npos) {
+            continue;
+        }
+        items.push_back({trim(line.substr(0, eq_pos)), trim(line.substr(eq_pos + 1))});
+    }
+    return 0;
+}
+
+int read_stream_properties(const std::string &path, const std::string &prefix, std::vector<StreamPropertyItem> &items) {
+    std::vector<PropertyItem> all_items;
+    if (read_properties(path, all_items) != 0) {
+        return -1;
+    }
+    items.clear();
+    const std::string key_prefix = prefix + ".";
+    for (auto &item : all_items) {
+        if (item.key.compare(0, key_prefix.size(), key_prefix) != 0) {
+            continue;
+        }
+        std::string name = item.key.substr(key_prefix.size());
+        if (name.empty() || !isdigit((unsigned char)name[0])) {
+            items.push_back({-1, name, item.value});
+            continue;
+        }
+        size_t dot_pos = name.find('.');
+        if (dot_pos == std::string::npos) {
+            d_mpp_module_warn("unknown %s config: %s", prefix.c_str(), item.key.c_str())
+            continue;
+        }
+        int stream_id = (int)strtol(name.c_str(), nullptr, 10);
+        items.push_back({stream_id, name.substr(dot_pos + 1), item.value});
+    }
+    return 0;
+}
+
+bool parse_bool_property(const std::string &value) {
+    return value == "true" || value == "1" || value == "on";
+}
@@ -0,0 +1,75 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.30
+ * @brief: key = value 格式的 properties 配置读取：解码、运动检测和跟踪配置共用一个文件，
+ *         各自读取自己前缀的配置项；prefix.xxx 为默认值，prefix.N.xxx 覆盖流 N 的配置
+ */
+#ifndef RKNN_INFER_PLUGIN_PROPERTIES_READER_H
+#define RKNN_INFER_PLUGIN_PROPERTIES_READER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils_log.h"
+
+struct PropertyItem {
+    std::string key;
+    std::string value;
+};
+
+// 带流序号的配置项，stream_id 为 -1 时是默认值，name 不带前缀和流序号
+struct StreamPropertyItem {
+    int stream_id;
+    std::string name;
+    std::string value;
+};
+
+/**
+ * @brief 按文件中的顺序读取所有配置项，跳过空行、# 注释和没有 '=' 的行，key 和 value 去掉首尾空白；文件不存在返回 -1
+ */
+int read_properties(const std::string &path, std::vector<PropertyItem> &items);
+
+/**
+ * @brief 读取 prefix.xxx 和 prefix.N.xxx（prefix 不带 '.'），忽略其他配置，文件不存在返回 -1
+ */
+int read_stream_properties(const std::string &path, const std::string &prefix, std::vector<StreamPropertyItem> &items);
+
+// true / 1 / on 为真
+bool parse_bool_property(const std::string &value);
+
+/**
+ * @brief 读取 prefix.xxx 到 defaults，prefix.N.xxx 在默认值之上覆盖到 streams[N]，与配置项的先后顺序无关
+ * @param set_config bool(const std::string &name, const std::string &value, Config &config)，未知配置返回 false
+ */
+template <typename Config, typename Setter>
+int load_stream_properties(const std::string &path, const std::string &prefix,
+                           Config &defaults, std::map<int, Config> &streams, Setter set_config) {
+    std::vector<StreamPropertyItem> items;
+    if (read_stream_properties(path, prefix, items) != 0) {
+        return -1;
+    }
+    for (auto &item : items) {
+        if (item.stream_id < 0 && !set_config(item.name, item.value, defaults)) {
+            d_mpp_module_warn("unknown %s config: %s.%s", prefix.c_str(), prefix.c_str(), item.name.c_str())
+        }
+    }
+    streams.clear();
+    for (auto &item : items) {
+        if (item.stream_id < 0) {
+            continue;
+        }
+        auto it = streams.find(item.stream_id);
+        if (it == streams.end()) {
+            it = streams.emplace(item.stream_id, defaults).first;
+        }
+        if (!set_config(item.name, item.value, it->second)) {
+            d_mpp_module_warn("unknown %s config: %s.%d.%s", prefix.c_str(), prefix.c_str(), item.stream_id,
+                              item.name.c_str())
+        }
+    }
+    return 0;
+}
+
+#endif //RKNN_INFER_PLUGIN_PROPERTIES_READER_H
@@ -0,0 +1,316 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.25
+ * @brief: 原始文件和合成图案帧来源实现
+ */
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "raw_frame_source.h"
+#include "utils_log.h"
+
+// 限速时落后超过该时间不再追帧，从当前时间重新计时
+#define FRAME_PACE_RESYNC_NS (1000 * 1000 * 1000ULL)
+
+PooledFrameSource::PooledFrameSource(const FrameSourceOptions &options) {
+    m_options = options;
+}
+
+int PooledFrameSource::init_pool(uint32_t width, uint32_t height, MppFrameFormat format, double fps) {
+    CHECK_VAL(width < 2 || height < 2 || width % 2 != 0 || height % 2 != 0,
+              d_mpp_module_error("invalid frame size %dx%d", (int)width, (int)height); return -1;)
+    CHECK_VAL(format != MPP_FMT_YUV420SP && format != MPP_FMT_YUV420P,
+              d_mpp_module_error("unsupported frame format %d, only NV12 / I420", format); return -1;)
+    uint32_t align = std::max<uint32_t>(m_options.stride_align, 2);
+    m_width = width;
+    m_height = height;
+    m_hor_stride = (width + align - 1) / align * align;
+    m_ver_stride = (height + align - 1) / align * align;
+    m_buf_size = m_hor_stride * m_ver_stride * 3 / 2;
+    m_format = format;
+    m_fps = m_options.free_run ? 0 : fps;
+
+    m_buffers.resize(std::max(m_options.max_frames, 1));
+    for (auto &buffer : m_buffers) {
+        // 对齐填充部分清零，缩放时不会读到随机数据
+        buffer.data.reset(new uint8_t[m_buf_size]());
+    }
+    d_mpp_module_info("frame pool %dx%d stride %dx%d format %d, frames: %d, fps: %.2f",
+                      (int)m_width, (int)m_height, (int)m_hor_stride, (int)m_ver_stride, m_format,
+                      (int)m_buffers.size(), m_fps)
+    return 0;
+}
+
+PooledFrameSource::FrameBuffer *PooledFrameSource::acquire_buffer(time_unit deadline_ns) {
+    std::unique_lock<std::mutex> lock(m_pool_mutex);
+    while (true) {
+        for (auto &buffer : m_buffers) {
+            if (!buffer.in_use) {
+                buffer.in_use = true;
+                return &buffer;
+            }
+        }
+        if (deadline_ns == 0) {
+            m_pool_cond.wait(lock);
+            continue;
+        }
+        time_unit now = getTimeOfNs();
+        if (now >= deadline_ns) {
+            return nullptr;
+        }
+        m_pool_cond.wait_for(lock, std::chrono::nanoseconds(deadline_ns - now));
+    }
+}
+
+int PooledFrameSource::get_next_frame(DecoderMppFrame &frame, int timeout_ms) {
+    CHECK_VAL(!m_init_flag, d_mpp_module_error("frame source is not init"); return -1;)
+    std::lock_guard<std::mutex> read_lock(m_read_mutex);
+    if (m_eos) {
+        return -1;
+    }
+    time_unit t_start = getTimeOfNs();
+    time_unit deadline_ns = timeout_ms < 0 ? 0 : t_start + (time_unit)timeout_ms * 1000000 + 1;
+
+    // 按帧率限速：第 N 帧不早于 起点 + N / fps 输出
+    if (m_fps > 0) {
+        if (m_start_ns == 0) {
+            m_start_ns = t_start;
+            m_start_index = m_next_index;
+        }
+        auto due_ns = m_start_ns + (time_unit)((double)(m_next_index - m_start_index) * 1e9 / m_fps);
+        if (t_start > due_ns + FRAME_PACE_RESYNC_NS) {
+            m_start_ns = t_start;
+            m_start_index = m_next_index;
+            due_ns = t_start;
+        }
+        if (due_ns > t_start) {
+            if (deadline_ns != 0 && due_ns > deadline_ns) {
+                // 超时之前不到输出时间
+                if (deadline_ns > t_start + 1) {
+                    sleepUS((deadline_ns - t_start) / 1000);
+                }
+                m_wait_ns += getTimeOfNs() - t_start;
+                return 1;
+            }
+            sleepUS((due_ns - t_start) / 1000);
+        }
+    }
+
+    FrameBuffer *buffer = acquire_buffer(deadline_ns);
+    time_unit t_fill = getTimeOfNs();
+    m_wait_ns += t_fill - t_start;
+    if (buffer == nullptr) {
+        return 1;
+    }
+    if (fill_frame(m_next_index, buffer->data.get()) != 0) {
+        m_eos = true;
+        std::lock_guard<std::mutex> lock(m_pool_mutex);
+        buffer->in_use = false;
+        m_pool_cond.notify_all();
+        return -1;
+    }
+    time_unit fill_ns = getTimeOfNs() - t_fill;
+    m_fill_ns += fill_ns;
+
+    frame.hor_width = m_width;
+    frame.ver_height = m_height;
+    frame.hor_stride = m_hor_stride;
+    frame.ver_stride = m_ver_stride;
+    frame.data_fd = -1;
+    frame.data_buf = buffer->data.get();
+    frame.data_size = m_buf_size;
+    frame.mpp_frame = (MppFrame)buffer;
+    frame.mpp_frame_format = m_format;
+    frame.frame_index = m_next_index;
+    frame.pts_ms = (int64_t)((double)m_next_index * 1000 / (m_options.fps > 0 ? m_options.fps : 25));
+    frame.decode_latency_us = (uint32_t)(fill_ns / 1000);
+    m_next_index++;
+    m_frames++;
+    return 0;
+}
+
+void PooledFrameSource::release_frame(DecoderMppFrame &frame) {
+    auto *buffer = (FrameBuffer *)frame.mpp_frame;
+    if (buffer == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    buffer->in_use = false;
+    frame.mpp_frame = nullptr;
+    m_pool_cond.notify_one();
+}
+
+MppDecoderStats PooledFrameSource::get_stats() const {
+    MppDecoderStats stats;
+    stats.decoded_frames = m_frames;
+    stats.queue_capacity = (int)m_buffers.size();
+    stats.consumer_wait_ms = (double)m_wait_ns / 1e6;
+    if (stats.decoded_frames > 0) {
+        stats.avg_decode_latency_ms = (double)m_fill_ns / 1e6 / (double)stats.decoded_frames;
+    }
+    return stats;
+}
+
+// 复制一个平面的 rows 行，每行 width 字节
+static void copy_plane(uint8_t *dst, uint32_t dst_stride, const uint8_t *src, uint32_t width, uint32_t rows) {
+    for (uint32_t i = 0; i < rows; i++) {
+        memcpy(dst + (size_t)i * dst_stride, src + (size_t)i * width, width);
+    }
+}
+
+RawFrameSource::RawFrameSource(const std::string &path, const FrameSourceOptions &options, bool y4m)
+        : PooledFrameSource(options) {
+    m_map = MappedFile::open_shared(path);
+    CHECK_VAL(m_map == nullptr || !m_map->is_init(), d_mpp_module_error("can not map %s", path.c_str()); return;)
+
+    if (y4m) {
+        CHECK_VAL(parse_y4m() != 0, d_mpp_module_error("invalid y4m file %s", path.c_str()); return;)
+    } else {
+        CHECK_VAL(init_pool(options.width, options.height, options.format, options.fps) != 0, return;)
+        m_frame_size = (size_t)m_width * m_height * 3 / 2;
+        size_t frame_num = m_map->size() / m_frame_size;
+        CHECK_VAL(frame_num == 0, d_mpp_module_error("%s smaller than one frame", path.c_str()); return;)
+        if (m_map->size() % m_frame_size != 0) {
+            d_mpp_module_warn("%s has %d trailing bytes", path.c_str(), (int)(m_map->size() % m_frame_size))
+        }
+        for (size_t i = 0; i < frame_num; i++) {
+            m_frame_offsets.push_back(i * m_frame_size);
+        }
+    }
+    m_init_flag = true;
+    d_mpp_module_info("raw frame source %s, frames: %d", path.c_str(), (int)m_frame_offsets.size())
+}
+
+int RawFrameSource::parse_y4m() {
+    const auto *data = (const char *)m_map->data();
+    size_t size = m_map->size();
+    const char *header_end = (const char *)memchr(data, '\n', std::min<size_t>(size, 1024));
+    CHECK_VAL(header_end == nullptr || strncmp(data, "YUV4MPEG2 ", 10) != 0,
+              d_mpp_module_error("missing YUV4MPEG2 header"); return -1;)
+
+    // 文件头：YUV4MPEG2 W1920 H1080 F25:1 Ip A1:1 C420jpeg
+    uint32_t width = 0;
+    uint32_t height = 0;
+    double fps = m_options.fps;
+    std::string header(data + 10, header_end);
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(' ', pos);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        std::string token = header.substr(pos, end - pos);
+        pos = end + 1;
+        if (token.empty()) {
+            continue;
+        }
+        if (token[0] == 'W') {
+            width = (uint32_t)strtoul(token.c_str() + 1, nullptr, 10);
+        } else if (token[0] == 'H') {
+            height = (uint32_t)strtoul(token.c_str() + 1, nullptr, 10);
+        } else if (token[0] == 'F') {
+            char *den_str = nullptr;
+            double num = strtod(token.c_str() + 1, &den_str);
+            double den = den_str != nullptr && *den_str == ':' ? strtod(den_str + 1, nullptr) : 1;
+            if (num > 0 && den > 0) {
+                fps = num / den;
+            }
+        } else if (token[0] == 'C') {
+            // 只支持 8 位 4:2:0，色度采样位置不影响读取
+            CHECK_VAL(token.compare(0, 4, "C420") != 0 || token == "C420p10" || token == "C420p12",
+                      d_mpp_module_error("unsupported y4m colorspace %s", token.c_str()); return -1;)
+        }
+    }
+    CHECK_VAL(init_pool(width, height, MPP_FMT_YUV420P, fps) != 0, return -1;)
+
+    // 每帧：FRAME[ 参数]\n + 帧数据
+    m_frame_size = (size_t)m_width * m_height * 3 / 2;
+    size_t offset = header_end - data + 1;
+    while (offset + 5 < size && memcmp(data + offset, "FRAME", 5) == 0) {
+        const char *line_end = (const char *)memchr(data + offset, '\n', size - offset);
+        if (line_end == nullptr) {
+            break;
+        }
+        size_t frame_offset = line_end - data + 1;
+        if (frame_offset + m_frame_size > size) {
+            d_mpp_module_warn("y4m last frame truncated")
+            break;
+        }
+        m_frame_offsets.push_back(frame_offset);
+        offset = frame_offset + m_frame_size;
+    }
+    CHECK_VAL(m_frame_offsets.empty(), d_mpp_module_error("y4m has no frame"); return -1;)
+    return 0;
+}
+
+int RawFrameSource::fill_frame(uint64_t index, uint8_t *buf) {
+    uint64_t frame_num = m_frame_offsets.size();
+    if (index >= frame_num && !m_options.loop) {
+        return -1;
+    }
+    uint64_t file_index = index % frame_num;
+    const uint8_t *src = m_map->data() + m_frame_offsets[file_index];
+    // 提示内核预读下一帧
+    m_map->prefetch(m_frame_offsets[(file_index + 1) % frame_num], m_frame_size);
+
+    uint8_t *dst_c = buf + (size_t)m_hor_stride * m_ver_stride;
+    const uint8_t *src_c = src + (size_t)m_width * m_height;
+    copy_plane(buf, m_hor_stride, src, m_width, m_height);
+    if (m_format == MPP_FMT_YUV420SP) {
+        copy_plane(dst_c, m_hor_stride, src_c, m_width, m_height / 2);
+    } else {
+        size_t c_size = (size_t)m_width * m_height / 4;
+        copy_plane(dst_c, m_hor_stride / 2, src_c, m_width / 2, m_height / 2);
+        copy_plane(dst_c + (size_t)m_hor_stride * m_ver_stride / 4, m_hor_stride / 2, src_c + c_size,
+                   m_width / 2, m_height / 2);
+    }
+    return 0;
+}
+
+PatternFrameSource::PatternFrameSource(uint32_t width, uint32_t height, const FrameSourceOptions &options)
+        : PooledFrameSource(options) {
+    CHECK_VAL(init_pool(width, height, options.format, options.fps) != 0, return;)
+    // 64 像素一组的斜坡条纹，色度每组颜色不同
+    m_luma_pattern.resize((size_t)m_hor_stride * 2);
+    m_chroma_pattern.resize((size_t)m_hor_stride * 2);
+    for (size_t x = 0; x < m_luma_pattern.size(); x++) {
+        m_luma_pattern[x] = (uint8_t)(16 + (x % 64) * 3);
+        m_chroma_pattern[x] = (uint8_t)(64 + ((x / 64) * 37) % 128);
+    }
+    m_init_flag = true;
+}
+
+int PatternFrameSource::fill_frame(uint64_t index, uint8_t *buf) {
+    if (m_options.pattern_frames > 0 && index >= m_options.pattern_frames) {
+        return -1;
+    }
+    // 每帧条纹左移 4 像素，每行再错开 1 像素
+    for (uint32_t y = 0; y < m_height; y++) {
+        size_t shift = (index * 4 + y) % m_hor_stride;
+        memcpy(buf + (size_t)y * m_hor_stride, m_luma_pattern.data() + shift, m_width);
+    }
+    uint8_t *dst_c = buf + (size_t)m_hor_stride * m_ver_stride;
+    for (uint32_t y = 0; y < m_height / 2; y++) {
+        // NV12 的 UV 交织和 I420 的 U、V 平面都按偶数对齐移动，保持 UV 成对
+        size_t shift = ((index * 2 + y) % (m_hor_stride / 2)) * 2;
+        if (m_format == MPP_FMT_YUV420SP) {
+            memcpy(dst_c + (size_t)y * m_hor_stride, m_chroma_pattern.data() + shift, m_width);
+        } else {
+            memcpy(dst_c + (size_t)y * m_hor_stride / 2, m_chroma_pattern.data() + shift, m_width / 2);
+            memcpy(dst_c + (size_t)m_hor_stride * m_ver_stride / 4 + (size_t)y * m_hor_stride / 2,
+                   m_chroma_pattern.data() + shift + 1, m_width / 2);
+        }
+    }
+
+    // 边长为高度 1/8 的亮块，每帧右移 8 像素
+    uint32_t box = std::max<uint32_t>(m_height / 8, 2) & ~1u;
+    uint32_t box_x = (uint32_t)((index * 8) % (m_width - box + 1)) & ~1u;
+    uint32_t box_y = (m_height - box) / 2 & ~1u;
+    for (uint32_t y = box_y; y < box_y + box; y++) {
+        memset(buf + (size_t)y * m_hor_stride + box_x, 235, box);
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.25
+ * @brief: 不依赖 MPP 的帧来源：原始 NV12/I420 文件、Y4M 文件（mmap 读取）和合成的运动图案，
+ *         帧写入自己的内存池（插件会在帧上绘制，不能直接指向只读映射），按帧率限速或全速输出
+ */
+#ifndef RKNN_INFER_PLUGIN_RAW_FRAME_SOURCE_H
+#define RKNN_INFER_PLUGIN_RAW_FRAME_SOURCE_H
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <condition_variable>
+
+#include "utils.h"
+#include "frame_source.h"
+#include "mapped_file.h"
+
+// 帧内存池和限速的公共部分，子类只负责把第 N 帧写入内存
+class PooledFrameSource : public FrameSource {
+public:
+    ~PooledFrameSource() override = default;
+
+    [[nodiscard]] bool is_init() const override { return m_init_flag; };
+
+    int get_next_frame(DecoderMppFrame &frame, int timeout_ms = -1) override;
+
+    void release_frame(DecoderMppFrame &frame) override;
+
+    [[nodiscard]] MppDecoderStats get_stats() const override;
+
+protected:
+    explicit PooledFrameSource(const FrameSourceOptions &options);
+
+    // 按尺寸和格式（NV12 / I420）分配内存池，fps <= 0 时全速输出，子类构造时调用
+    int init_pool(uint32_t width, uint32_t height, MppFrameFormat format, double fps);
+
+    // 把第 index 帧按 m_hor_stride / m_ver_stride 写入 buf，返回 0 成功，-1 没有更多帧
+    virtual int fill_frame(uint64_t index, uint8_t *buf) = 0;
+
+protected:
+    FrameSourceOptions m_options;
+    bool m_init_flag = false;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_hor_stride = 0;
+    uint32_t m_ver_stride = 0;
+    uint32_t m_buf_size = 0;
+    MppFrameFormat m_format = MPP_FMT_YUV420SP;
+    double m_fps = 0;
+
+private:
+    struct FrameBuffer {
+        std::unique_ptr<uint8_t[]> data;
+        bool in_use = false;
+    };
+
+    // 取一个空闲帧，最多等到 deadline_ns（0 一直等），超时返回 nullptr
+    FrameBuffer *acquire_buffer(time_unit deadline_ns);
+
+private:
+    // 同一时间只有一个线程取帧，释放帧可以在任意线程
+    std::mutex m_read_mutex;
+    std::mutex m_pool_mutex;
+    std::condition_variable m_pool_cond;
+    std::vector<FrameBuffer> m_buffers;
+
+    uint64_t m_next_index = 0;
+    bool m_eos = false;
+    // 限速的起点，落后太多时重新计时
+    time_unit m_start_ns = 0;
+    uint64_t m_start_index = 0;
+
+    std::atomic<uint64_t> m_frames{0};
+    std::atomic<uint64_t> m_wait_ns{0};
+    std::atomic<uint64_t> m_fill_ns{0};
+};
+
+// 原始 NV12/I420 文件（尺寸和格式见 options）或 Y4M 文件
+class RawFrameSource : public PooledFrameSource {
+public:
+    RawFrameSource(const std::string &path, const FrameSourceOptions &options, bool y4m);
+
+    [[nodiscard]] uint64_t frame_count() const { return m_frame_offsets.size(); };
+
+protected:
+    int fill_frame(uint64_t index, uint8_t *buf) override;
+
+private:
+    // 解析 YUV4MPEG2 文件头和每帧的 FRAME 头，成功返回 0
+    int parse_y4m();
+
+private:
+    std::shared_ptr<MappedFile> m_map;
+    size_t m_frame_size = 0;
+    // 每帧数据在文件中的偏移
+    std::vector<size_t> m_frame_offsets;
+};
+
+// 合成的运动图案：移动的斜条纹背景 + 水平移动的亮块
+class PatternFrameSource : public PooledFrameSource {
+public:
+    PatternFrameSource(uint32_t width, uint32_t height, const FrameSourceOptions &options);
+
+protected:
+    int fill_frame(uint64_t index, uint8_t *buf) override;
+
+private:
+    // 两倍行宽的条纹，按偏移拷贝得到移动效果
+    std::vector<uint8_t> m_luma_pattern;
+    std::vector<uint8_t> m_chroma_pattern;
+};
+
+#endif //RKNN_INFER_PLUGIN_RAW_FRAME_SOURCE_H
@@ -35,8 +35,8 @@ static int get_config(PluginConfigGet *plugin_config){
     plugin_config->input_thread_nums = 2;
     // 输出线程个数
     plugin_config->output_thread_nums = 2;
-    // 是否需要输出float类型的输出结果
-    plugin_config->output_want_float = true;
+    // 是否需要输出float类型的输出结果（top5 直接在量化输出上选取）
+    plugin_config->output_want_float = false;
     return 0;
 }
 
@@ -120,15 +120,15 @@ static int rknn_plugin_output(struct ThreadData *td, struct OutputUnit *output_u
     for (int i = 0; i < output_unit->n_outputs; i++) {
         uint32_t max_class[5];
         float max_prob[5];
-        rknn_plugin_get_top(
-                (float *) output_unit->outputs[i].buf,
+        uint32_t top_num = rknn_plugin_output_top_k(
+                output_unit->outputs[i],
+                g_plugin_config_set.output_attr[i],
                 max_prob,
                 max_class,
-                output_unit->outputs[i].size / 4,
                 5);
 
         d_rknn_plugin_info(" --- Top5 ---");
-        for (int j = 0; j < 5; j++) {
+        for (uint32_t j = 0; j < top_num; j++) {
             d_rknn_plugin_info("%3d: %8.6f", max_class[j], max_prob[j]);
         }
     }
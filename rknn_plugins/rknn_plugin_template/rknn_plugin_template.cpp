@@ -36,7 +36,7 @@ static int get_config(PluginConfigGet *plugin_config){
     // 输出线程个数
     plugin_config->output_thread_nums = 2;
     // 是否需要输出float类型的输出结果
-    plugin_config->output_want_float = true;
+    plugin_config->output_want_float = false;
     return 0;
 }
 
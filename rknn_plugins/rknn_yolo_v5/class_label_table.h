@@ -0,0 +1,64 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.15
+ * @brief: 类别名称表，插件启动时一次性加载，之后只读（多个输出线程可并发查询）
+ *         所有名称存放在一块连续内存中，检测结果只保存类别 id
+ */
+#ifndef RKNN_INFER_PLUGIN_CLASS_LABEL_TABLE_H
+#define RKNN_INFER_PLUGIN_CLASS_LABEL_TABLE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+class ClassLabelTable {
+public:
+    ClassLabelTable() = default;
+
+    /**
+     * @brief 从标签文件加载 class_num 个名称（每行一个），缺失的类别名称为空串
+     * @return 实际读取的行数，文件打开失败返回 -1
+     */
+    int load(const std::string &path, int class_num) {
+        m_names.clear();
+        m_offsets.assign(class_num, 0);
+        // 偏移 0 处固定为空串，供缺失的类别使用
+        m_names.push_back('\0');
+
+        std::ifstream label_file(path);
+        if (!label_file.is_open()) {
+            return -1;
+        }
+        int line_num = 0;
+        std::string line;
+        while (line_num < class_num && std::getline(label_file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            m_offsets[line_num++] = (uint32_t)m_names.size();
+            m_names.insert(m_names.end(), line.begin(), line.end());
+            m_names.push_back('\0');
+        }
+        return line_num;
+    }
+
+    [[nodiscard]] int size() const { return (int)m_offsets.size(); }
+
+    // 类别 id 对应的名称，越界时返回空串
+    [[nodiscard]] const char *name(int class_id) const {
+        if (class_id < 0 || class_id >= (int)m_offsets.size()) {
+            return m_names.empty() ? "" : m_names.data();
+        }
+        return m_names.data() + m_offsets[class_id];
+    }
+
+private:
+    // 所有名称（以 '\0' 分隔）
+    std::vector<char> m_names;
+    // 每个类别名称在 m_names 中的偏移
+    std::vector<uint32_t> m_offsets;
+};
+
+#endif //RKNN_INFER_PLUGIN_CLASS_LABEL_TABLE_H
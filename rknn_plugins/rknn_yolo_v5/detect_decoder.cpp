@@ -0,0 +1,619 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.14
+ * @brief: 通用检测头解码器实现
+ */
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+
+#include "detect_decoder.h"
+#include "plugin_common.h"
+#include "task_pool.h"
+#include "utils_log.h"
+
+// DFL 分布 bin 个数上限
+#define DETECT_REG_MAX_LIMIT 64
+// 最大检测头（步长最小）的网格数达到该值才分块并行解码，640 输入（80 x 80）整帧解码只要几十微秒，
+// 分块后线程池唤醒、等待和合并的开销抵消了并行的收益
+#define DETECT_PARALLEL_MIN_CELLS (160 * 160)
+
+/**
+ * @brief 不同输出数据类型的读取、阈值量化和反量化，阈值比较尽量在原始数据域完成
+ */
+template<typename T>
+struct DetectTensorTraits;
+
+template<>
+struct DetectTensorTraits<int8_t> {
+    typedef int32_t value_t;
+    static inline value_t load(int8_t v) { return v; }
+    static inline value_t threshold(float f, const DetectTensorQuant &q) { return qnt_f32_to_affine(f, q.zp, q.scale); }
+    static inline float to_f32(int8_t v, const DetectTensorQuant &q) { return deqnt_affine_to_f32(v, q.zp, q.scale); }
+};
+
+template<>
+struct DetectTensorTraits<uint8_t> {
+    typedef int32_t value_t;
+    static inline value_t load(uint8_t v) { return v; }
+    static inline value_t threshold(float f, const DetectTensorQuant &q) { return (uint8_t)__clip((f / q.scale) + q.zp, 0, 255); }
+    static inline float to_f32(uint8_t v, const DetectTensorQuant &q) { return ((float)v - (float)q.zp) * q.scale; }
+};
+
+// FLOAT16 按 uint16_t 存放
+template<>
+struct DetectTensorTraits<uint16_t> {
+    typedef float value_t;
+    static inline value_t load(uint16_t v) { return fp16_to_fp32(v); }
+    static inline value_t threshold(float f, const DetectTensorQuant &) { return f; }
+    static inline float to_f32(uint16_t v, const DetectTensorQuant &) { return fp16_to_fp32(v); }
+};
+
+template<>
+struct DetectTensorTraits<float> {
+    typedef float value_t;
+    static inline value_t load(float v) { return v; }
+    static inline value_t threshold(float f, const DetectTensorQuant &) { return f; }
+    static inline float to_f32(float v, const DetectTensorQuant &) { return v; }
+};
+
+// 通道 channel、网格位置 pos 在 tensor 中的偏移
+template<rknn_tensor_format LAYOUT>
+static inline int tensor_offset(int channel, int pos, int grid_len, int channels) {
+    return LAYOUT == RKNN_TENSOR_NHWC ? pos * channels + channel : channel * grid_len + pos;
+}
+
+inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
+
+/**
+ * @brief anchor-based 检测头解码（YOLOv5），CLASS_NUM 为 0 时类别数取运行时配置
+ */
+template<typename T, rknn_tensor_format LAYOUT, int CLASS_NUM>
+static void decode_anchor_head(const DetectHeadArgs &args, const DetectHeadDesc &desc,
+                               float threshold, DetectCandidates &candidates) {
+    typedef DetectTensorTraits<T> Traits;
+    typedef typename Traits::value_t value_t;
+
+    const int class_num = CLASS_NUM > 0 ? CLASS_NUM : desc.class_num;
+    const int prop_size = 5 + class_num;
+    const int grid_w = args.grid_w;
+    const int grid_len = args.grid_h * args.grid_w;
+    const int channels = prop_size * args.anchor_num;
+    // 同一网格位置相邻通道的间隔
+    const int c_step = LAYOUT == RKNN_TENSOR_NHWC ? 1 : grid_len;
+    const T *input = (const T *)args.tensors[0];
+    const DetectTensorQuant &q = args.quant[0];
+    const value_t thres = Traits::threshold(threshold, q);
+    const float stride = (float)args.stride;
+
+    const int pos_begin = args.row_begin * grid_w;
+    const int pos_end = args.row_end * grid_w;
+    for (int a = 0; a < args.anchor_num; a++) {
+        const int base_c = prop_size * a;
+        for (int pos = pos_begin; pos < pos_end; pos++) {
+            const T *in_ptr = input + tensor_offset<LAYOUT>(base_c, pos, grid_len, channels);
+            const value_t box_confidence = Traits::load(in_ptr[4 * c_step]);
+            if (box_confidence < thres) {
+                continue;
+            }
+
+            value_t max_class_probs = Traits::load(in_ptr[5 * c_step]);
+            int max_class_id = 0;
+            for (int k = 1; k < class_num; ++k) {
+                value_t prob = Traits::load(in_ptr[(5 + k) * c_step]);
+                if (prob > max_class_probs) {
+                    max_class_id = k;
+                    max_class_probs = prob;
+                }
+            }
+            if (max_class_probs <= thres) {
+                continue;
+            }
+
+            const int i = pos / grid_w;
+            const int j = pos - i * grid_w;
+            float box_x = Traits::to_f32(in_ptr[0], q);
+            float box_y = Traits::to_f32(in_ptr[c_step], q);
+            float box_w = Traits::to_f32(in_ptr[2 * c_step], q);
+            float box_h = Traits::to_f32(in_ptr[3 * c_step], q);
+            float obj_conf = Traits::to_f32(in_ptr[4 * c_step], q);
+            float cls_conf = Traits::to_f32(in_ptr[(5 + max_class_id) * c_step], q);
+            if (desc.apply_sigmoid) {
+                box_x = sigmoid(box_x);
+                box_y = sigmoid(box_y);
+                box_w = sigmoid(box_w);
+                box_h = sigmoid(box_h);
+                obj_conf = sigmoid(obj_conf);
+                cls_conf = sigmoid(cls_conf);
+            }
+            box_x = box_x * 2.0 - 0.5;
+            box_y = box_y * 2.0 - 0.5;
+            box_w = box_w * 2.0;
+            box_h = box_h * 2.0;
+            box_x = (box_x + j) * stride;
+            box_y = (box_y + i) * stride;
+            box_w = box_w * box_w * args.anchors[a * 2];
+            box_h = box_h * box_h * args.anchors[a * 2 + 1];
+            box_x -= (box_w / 2.0);
+            box_y -= (box_h / 2.0);
+
+            candidates.probs.push_back(cls_conf * obj_conf);
+            candidates.class_ids.push_back(max_class_id);
+            candidates.keys.push_back(args.key_base + a * grid_len + pos);
+            candidates.boxes.push_back(box_x);
+            candidates.boxes.push_back(box_y);
+            candidates.boxes.push_back(box_w);
+            candidates.boxes.push_back(box_h);
+        }
+    }
+}
+
+/**
+ * @brief anchor-free 检测头解码（YOLOv8 DFL），CLASS_NUM 为 0 时类别数取运行时配置
+ */
+template<typename T, rknn_tensor_format LAYOUT, int CLASS_NUM>
+static void decode_dfl_head(const DetectHeadArgs &args, const DetectHeadDesc &desc,
+                            float threshold, DetectCandidates &candidates) {
+    typedef DetectTensorTraits<T> Traits;
+    typedef typename Traits::value_t value_t;
+
+    const int class_num = CLASS_NUM > 0 ? CLASS_NUM : desc.class_num;
+    const int reg_max = desc.reg_max;
+    const int grid_w = args.grid_w;
+    const int grid_len = args.grid_h * args.grid_w;
+    const T *box_tensor = (const T *)args.tensors[0];
+    const T *cls_tensor = (const T *)args.tensors[1];
+    const T *sum_tensor = (const T *)args.tensors[2];
+    const value_t cls_thres = Traits::threshold(threshold, args.quant[1]);
+    // 置信度和为激活之后的分数之和，直接和置信度阈值比较
+    const value_t sum_thres = sum_tensor ? Traits::threshold(desc.conf_threshold, args.quant[2]) : value_t(0);
+    const float stride = (float)args.stride;
+
+    float dfl[DETECT_REG_MAX_LIMIT];
+    const int pos_end = args.row_end * grid_w;
+    for (int pos = args.row_begin * grid_w; pos < pos_end; pos++) {
+        // 置信度和小于阈值时所有类别都不可能通过
+        if (sum_tensor != nullptr && Traits::load(sum_tensor[pos]) < sum_thres) {
+            continue;
+        }
+
+        value_t max_class_probs = Traits::load(cls_tensor[tensor_offset<LAYOUT>(0, pos, grid_len, class_num)]);
+        int max_class_id = 0;
+        for (int k = 1; k < class_num; ++k) {
+            value_t prob = Traits::load(cls_tensor[tensor_offset<LAYOUT>(k, pos, grid_len, class_num)]);
+            if (prob > max_class_probs) {
+                max_class_id = k;
+                max_class_probs = prob;
+            }
+        }
+        if (max_class_probs <= cls_thres) {
+            continue;
+        }
+
+        // 每条边的距离为 reg_max 个 bin 做 softmax 之后的期望
+        float dist[4];
+        for (int side = 0; side < 4; side++) {
+            float max_val = -1e30f;
+            for (int b = 0; b < reg_max; b++) {
+                int offset = tensor_offset<LAYOUT>(side * reg_max + b, pos, grid_len, 4 * reg_max);
+                dfl[b] = Traits::to_f32(box_tensor[offset], args.quant[0]);
+                max_val = dfl[b] > max_val ? dfl[b] : max_val;
+            }
+            float exp_sum = 0;
+            float acc = 0;
+            for (int b = 0; b < reg_max; b++) {
+                float e = expf(dfl[b] - max_val);
+                exp_sum += e;
+                acc += e * (float)b;
+            }
+            dist[side] = acc / exp_sum;
+        }
+
+        const int i = pos / grid_w;
+        const int j = pos - i * grid_w;
+        float x1 = ((float)j + 0.5f - dist[0]) * stride;
+        float y1 = ((float)i + 0.5f - dist[1]) * stride;
+        float x2 = ((float)j + 0.5f + dist[2]) * stride;
+        float y2 = ((float)i + 0.5f + dist[3]) * stride;
+
+        float cls_conf = Traits::to_f32(cls_tensor[tensor_offset<LAYOUT>(max_class_id, pos, grid_len, class_num)],
+                                        args.quant[1]);
+        candidates.probs.push_back(desc.apply_sigmoid ? sigmoid(cls_conf) : cls_conf);
+        candidates.class_ids.push_back(max_class_id);
+        candidates.keys.push_back(args.key_base + pos);
+        candidates.boxes.push_back(x1);
+        candidates.boxes.push_back(y1);
+        candidates.boxes.push_back(x2 - x1);
+        candidates.boxes.push_back(y2 - y1);
+    }
+}
+
+template<typename T, rknn_tensor_format LAYOUT>
+static DetectDecodeHeadFunc select_decode_func_by_class(const DetectHeadDesc &desc) {
+    // 官方 COCO 类别数单独特化，其它类别数使用运行时类别数
+    if (desc.head_type == DETECT_HEAD_ANCHOR) {
+        return desc.class_num == OBJ_CLASS_NUM ? decode_anchor_head<T, LAYOUT, OBJ_CLASS_NUM>
+                                               : decode_anchor_head<T, LAYOUT, 0>;
+    }
+    return desc.class_num == OBJ_CLASS_NUM ? decode_dfl_head<T, LAYOUT, OBJ_CLASS_NUM>
+                                           : decode_dfl_head<T, LAYOUT, 0>;
+}
+
+template<typename T>
+static DetectDecodeHeadFunc select_decode_func_by_layout(const DetectHeadDesc &desc) {
+    if (desc.layout == RKNN_TENSOR_NHWC) {
+        return select_decode_func_by_class<T, RKNN_TENSOR_NHWC>(desc);
+    }
+    return select_decode_func_by_class<T, RKNN_TENSOR_NCHW>(desc);
+}
+
+static DetectDecodeHeadFunc select_decode_func(const DetectHeadDesc &desc) {
+    switch (desc.dtype) {
+        case RKNN_TENSOR_INT8:
+            return select_decode_func_by_layout<int8_t>(desc);
+        case RKNN_TENSOR_UINT8:
+            return select_decode_func_by_layout<uint8_t>(desc);
+        case RKNN_TENSOR_FLOAT16:
+            return select_decode_func_by_layout<uint16_t>(desc);
+        case RKNN_TENSOR_FLOAT32:
+            return select_decode_func_by_layout<float>(desc);
+        default:
+            d_rknn_plugin_error("detect decoder do not support dtype %s", get_type_string(desc.dtype))
+            return nullptr;
+    }
+}
+
+// 检测头的输出 tensor 个数
+static int detect_tensors_per_stride(const DetectHeadDesc &desc) {
+    return desc.head_type == DETECT_HEAD_ANCHOR ? 1 : desc.tensors_per_stride;
+}
+
+static std::string trim_string(const std::string &str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+static std::vector<float> split_float_list(const std::string &str) {
+    std::vector<float> values;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = trim_string(item);
+        if (!item.empty()) {
+            values.push_back(strtof(item.c_str(), nullptr));
+        }
+    }
+    return values;
+}
+
+int load_detect_head_desc(const std::string &path, DetectHeadDesc &desc) {
+    std::ifstream config_file(path);
+    if (!config_file.is_open()) {
+        d_rknn_plugin_warn("detect head config %s not exist, use default yolov5 head", path.c_str())
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(config_file, line)) {
+        // 跳过注释和空行
+        line = trim_string(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t eq_pos = line.find('=');
+        if (eq_pos == std::string::npos) {
+            continue;
+        }
+        std::string key = trim_string(line.substr(0, eq_pos));
+        std::string value = trim_string(line.substr(eq_pos + 1));
+
+        if (key == "detect.head_type") {
+            desc.head_type = value == "dfl" ? DETECT_HEAD_DFL : DETECT_HEAD_ANCHOR;
+        } else if (key == "detect.class_num") {
+            desc.class_num = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "detect.strides") {
+            desc.strides.clear();
+            for (float stride : split_float_list(value)) {
+                desc.strides.push_back((int)stride);
+            }
+        } else if (key == "detect.anchors") {
+            // 不同检测头之间用 ; 分隔
+            desc.anchors.clear();
+            std::stringstream ss(value);
+            std::string group;
+            while (std::getline(ss, group, ';')) {
+                desc.anchors.push_back(split_float_list(group));
+            }
+        } else if (key == "detect.reg_max") {
+            desc.reg_max = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "detect.tensors_per_stride") {
+            desc.tensors_per_stride = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "detect.apply_sigmoid") {
+            desc.apply_sigmoid = value == "true" || value == "1";
+        } else if (key == "detect.dtype") {
+            desc.dtype_auto = value == "auto";
+            if (value == "int8") {
+                desc.dtype = RKNN_TENSOR_INT8;
+            } else if (value == "uint8") {
+                desc.dtype = RKNN_TENSOR_UINT8;
+            } else if (value == "fp16") {
+                desc.dtype = RKNN_TENSOR_FLOAT16;
+            } else if (value == "fp32") {
+                desc.dtype = RKNN_TENSOR_FLOAT32;
+            }
+        } else if (key == "detect.layout") {
+            desc.layout_auto = value == "auto";
+            desc.layout = value == "nhwc" ? RKNN_TENSOR_NHWC : RKNN_TENSOR_NCHW;
+        } else if (key == "detect.max_results") {
+            desc.max_results = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "detect.conf_threshold") {
+            desc.conf_threshold = strtof(value.c_str(), nullptr);
+        } else if (key == "detect.nms_threshold") {
+            desc.nms_threshold = strtof(value.c_str(), nullptr);
+        } else if (key == "detect.decode_threads") {
+            desc.decode_threads = (int)strtol(value.c_str(), nullptr, 10);
+        } else if (key == "detect.label_path") {
+            desc.label_path = value;
+        } else {
+            d_rknn_plugin_warn("detect head config unknown key: %s", key.c_str())
+        }
+    }
+    d_rknn_plugin_info("load detect head config %s, head_type:%d, class_num:%d, head_num:%d",
+                       path.c_str(), desc.head_type, desc.class_num, (int)desc.strides.size())
+    return 0;
+}
+
+/**
+ * @brief 检查检测头第 index 个输出 tensor 的形状：网格为模型输入尺寸除以步长，通道数由检测头类型和类别数决定
+ */
+static int check_detect_tensor_shape(const DetectHeadDesc &desc, const rknn_tensor_attr &attr, uint32_t index,
+                                     int model_in_h, int model_in_w) {
+    const int tensors_per_stride = detect_tensors_per_stride(desc);
+    const int head = (int)index / tensors_per_stride;
+    const int stride = desc.strides[head];
+    CHECK_VAL(stride <= 0, d_rknn_plugin_error("invalid stride %d", stride); return -1;)
+    int channels;
+    if (desc.head_type == DETECT_HEAD_ANCHOR) {
+        CHECK_VAL(head >= (int)desc.anchors.size(),
+                  d_rknn_plugin_error("no anchors for detect head %d", head); return -1;)
+        channels = (int)desc.anchors[head].size() / 2 * (5 + desc.class_num);
+    } else {
+        const int t = (int)index % tensors_per_stride;
+        channels = t == 0 ? 4 * desc.reg_max : (t == 1 ? desc.class_num : 1);
+    }
+    const uint32_t grid_h = model_in_h / stride;
+    const uint32_t grid_w = model_in_w / stride;
+    // 4 维输出按模型的排布检查每一维，其他输出只检查元素个数
+    if (attr.n_dims == 4) {
+        bool nhwc = attr.fmt == RKNN_TENSOR_NHWC;
+        uint32_t h = nhwc ? attr.dims[1] : attr.dims[2];
+        uint32_t w = nhwc ? attr.dims[2] : attr.dims[3];
+        uint32_t c = nhwc ? attr.dims[3] : attr.dims[1];
+        if (h != grid_h || w != grid_w || c != (uint32_t)channels) {
+            d_rknn_plugin_error("output %d shape %dx%dx%d mismatch detect head (grid %dx%d, channels %d)",
+                                index, c, h, w, grid_h, grid_w, channels)
+            return -1;
+        }
+    }
+    if (attr.n_elems < grid_h * grid_w * (uint32_t)channels) {
+        d_rknn_plugin_error("output %d has %d elements, detect head needs %d",
+                            index, attr.n_elems, grid_h * grid_w * channels)
+        return -1;
+    }
+    return 0;
+}
+
+int resolve_detect_head_desc(DetectHeadDesc &desc, const rknn_tensor_attr &input_attr,
+                             const rknn_tensor_attr *output_attr, uint32_t n_output, bool want_float) {
+    uint32_t tensor_num = desc.strides.size() * detect_tensors_per_stride(desc);
+    if (n_output < tensor_num) {
+        d_rknn_plugin_error("detect head need %d outputs, model has %d", tensor_num, n_output)
+        return -1;
+    }
+    CHECK_VAL(desc.class_num <= 0, d_rknn_plugin_error("invalid class_num %d", desc.class_num); return -1;)
+    // 模型输入尺寸，与插件送入的尺寸一致
+    int model_in_h = (int)(input_attr.fmt == RKNN_TENSOR_NCHW ? input_attr.dims[2] : input_attr.dims[1]);
+    int model_in_w = (int)(input_attr.fmt == RKNN_TENSOR_NCHW ? input_attr.dims[3] : input_attr.dims[2]);
+    for (uint32_t idx = 0; idx < tensor_num; idx++) {
+        CHECK_VAL(check_detect_tensor_shape(desc, output_attr[idx], idx, model_in_h, model_in_w) != 0, return -1;)
+    }
+    if (desc.dtype_auto) {
+        desc.dtype = want_float ? RKNN_TENSOR_FLOAT32 : output_attr[0].type;
+    }
+    if (desc.layout_auto) {
+        desc.layout = output_attr[0].fmt == RKNN_TENSOR_NHWC ? RKNN_TENSOR_NHWC : RKNN_TENSOR_NCHW;
+    }
+    if (desc.quant.size() < tensor_num) {
+        // float 输出已由运行时反量化
+        desc.quant.resize(tensor_num);
+        for (uint32_t idx = 0; idx < tensor_num; idx++) {
+            desc.quant[idx].zp = want_float ? 0 : output_attr[idx].zp;
+            desc.quant[idx].scale = want_float ? 1.0f : output_attr[idx].scale;
+        }
+    }
+    d_rknn_plugin_info("detect head resolved, dtype:%s, layout:%s",
+                       get_type_string(desc.dtype), get_format_string(desc.layout))
+    return 0;
+}
+
+DetectDecoder::DetectDecoder(const DetectHeadDesc &desc) : m_desc(desc) {
+    // 检查检测头描述
+    CHECK_VAL(m_desc.class_num <= 0, d_rknn_plugin_error("invalid class_num %d", m_desc.class_num); return;)
+    CHECK_VAL(m_desc.strides.empty(), d_rknn_plugin_error("detect head strides is empty"); return;)
+    if (m_desc.head_type == DETECT_HEAD_ANCHOR) {
+        CHECK_VAL(m_desc.anchors.size() != m_desc.strides.size(),
+                  d_rknn_plugin_error("anchors size %d != strides size %d",
+                                      (int)m_desc.anchors.size(), (int)m_desc.strides.size()); return;)
+        for (auto &anchor : m_desc.anchors) {
+            CHECK_VAL(anchor.empty() || anchor.size() % 2 != 0,
+                      d_rknn_plugin_error("anchors must be (w, h) pairs"); return;)
+        }
+    } else {
+        CHECK_VAL(m_desc.reg_max <= 0 || m_desc.reg_max > DETECT_REG_MAX_LIMIT,
+                  d_rknn_plugin_error("invalid reg_max %d", m_desc.reg_max); return;)
+        CHECK_VAL(m_desc.tensors_per_stride != 2 && m_desc.tensors_per_stride != 3,
+                  d_rknn_plugin_error("invalid tensors_per_stride %d", m_desc.tensors_per_stride); return;)
+    }
+    m_desc.quant.resize(m_desc.strides.size() * detect_tensors_per_stride(m_desc));
+
+    m_decode_func = select_decode_func(m_desc);
+    CHECK_VAL(m_decode_func == nullptr, return;)
+    m_threshold = m_desc.apply_sigmoid ? unsigmoid(m_desc.conf_threshold) : m_desc.conf_threshold;
+
+    // 加载类别名称
+    int label_num = m_labels.load(m_desc.label_path, m_desc.class_num);
+    if (label_num < m_desc.class_num) {
+        d_rknn_plugin_warn("load label %s, got %d of %d names", m_desc.label_path.c_str(), label_num, m_desc.class_num)
+    }
+
+    if (m_desc.decode_threads > 0) {
+        m_task_pool = new TaskPool(m_desc.decode_threads);
+        d_rknn_plugin_info("detect decoder use %d decode threads", m_desc.decode_threads)
+    }
+    m_init_flag = true;
+}
+
+DetectDecoder::~DetectDecoder() {
+    delete m_task_pool;
+    m_task_pool = nullptr;
+}
+
+int DetectDecoder::decode(void **outputs, uint32_t n_outputs,
+                          int model_in_h, int model_in_w,
+                          float scale_w, float scale_h,
+                          DetectResultGroup &group) const {
+    group.count = 0;
+    group.results.clear();
+    CHECK_VAL(!m_init_flag, return -1;)
+
+    const int tensors_per_stride = detect_tensors_per_stride(m_desc);
+    CHECK_VAL(n_outputs < (uint32_t)(m_desc.strides.size() * tensors_per_stride),
+              d_rknn_plugin_error("detect decoder outputs not enough: %d", n_outputs); return -1;)
+
+    // 每个输出线程复用自己的候选缓存，避免每帧重新申请内存
+    thread_local DetectCandidates candidates;
+    thread_local std::vector<DetectCandidates> tile_candidates;
+    thread_local std::vector<DetectHeadArgs> tiles;
+    thread_local std::vector<int> order;
+    thread_local std::vector<char> class_present;
+    candidates.clear();
+    tiles.clear();
+
+    int key_base = 0;
+    int total_len = 0;
+    int max_grid_len = 0;
+    for (int stride : m_desc.strides) {
+        const int grid_len = (model_in_h / stride) * (model_in_w / stride);
+        total_len += grid_len;
+        max_grid_len = std::max(max_grid_len, grid_len);
+    }
+    const bool parallel = m_task_pool != nullptr && max_grid_len >= DETECT_PARALLEL_MIN_CELLS;
+    // 分块大小：让线程池中每个线程（包括输出线程）分到约两块，小检测头不再拆分
+    const int tile_len = parallel ? std::max(total_len / (2 * (m_task_pool->thread_num() + 1)), 1) : total_len;
+    for (size_t head = 0; head < m_desc.strides.size(); head++) {
+        DetectHeadArgs args{};
+        for (int t = 0; t < tensors_per_stride; t++) {
+            args.tensors[t] = outputs[head * tensors_per_stride + t];
+            args.quant[t] = m_desc.quant[head * tensors_per_stride + t];
+        }
+        args.stride = m_desc.strides[head];
+        args.grid_h = model_in_h / args.stride;
+        args.grid_w = model_in_w / args.stride;
+        args.anchor_num = 1;
+        if (m_desc.head_type == DETECT_HEAD_ANCHOR) {
+            args.anchors = m_desc.anchors[head].data();
+            args.anchor_num = (int)m_desc.anchors[head].size() / 2;
+        }
+        args.key_base = key_base;
+        key_base += args.anchor_num * args.grid_h * args.grid_w;
+
+        // 按网格行切分
+        const int tile_rows = std::max(tile_len / std::max(args.grid_w, 1), 1);
+        for (int row = 0; row < args.grid_h; row += tile_rows) {
+            args.row_begin = row;
+            args.row_end = std::min(row + tile_rows, args.grid_h);
+            tiles.push_back(args);
+        }
+    }
+
+    if (!parallel || tiles.size() <= 1) {
+        for (const DetectHeadArgs &args : tiles) {
+            m_decode_func(args, m_desc, m_threshold, candidates);
+        }
+    } else {
+        // 各块解码到独立的候选缓存，全部完成后按块顺序合并
+        if (tile_candidates.size() < tiles.size()) {
+            tile_candidates.resize(tiles.size());
+        }
+        DetectCandidates *tile_results = tile_candidates.data();
+        const DetectHeadArgs *tile_args = tiles.data();
+        m_task_pool->run((int)tiles.size(), [this, tile_results, tile_args](int index) {
+            tile_results[index].clear();
+            m_decode_func(tile_args[index], m_desc, m_threshold, tile_results[index]);
+        });
+        for (size_t t = 0; t < tiles.size(); t++) {
+            const DetectCandidates &tile = tile_candidates[t];
+            candidates.boxes.insert(candidates.boxes.end(), tile.boxes.begin(), tile.boxes.end());
+            candidates.probs.insert(candidates.probs.end(), tile.probs.begin(), tile.probs.end());
+            candidates.class_ids.insert(candidates.class_ids.end(), tile.class_ids.begin(), tile.class_ids.end());
+            candidates.keys.insert(candidates.keys.end(), tile.keys.begin(), tile.keys.end());
+        }
+    }
+
+    int valid_count = (int)candidates.probs.size();
+    if (valid_count <= 0) {
+        return 0;
+    }
+
+    // 按分数从高到低排序，分数相同时按顺序解码的位置排序，与是否分块无关
+    order.resize(valid_count);
+    std::iota(order.begin(), order.end(), 0);
+    const std::vector<float> &probs = candidates.probs;
+    const std::vector<int> &keys = candidates.keys;
+    std::sort(order.begin(), order.end(), [&probs, &keys](int a, int b) {
+        return probs[a] > probs[b] || (probs[a] == probs[b] && keys[a] < keys[b]);
+    });
+
+    class_present.assign(m_desc.class_num, 0);
+    for (int class_id : candidates.class_ids) {
+        class_present[class_id] = 1;
+    }
+    for (int c = 0; c < m_desc.class_num; c++) {
+        if (class_present[c]) {
+            nms(valid_count, candidates.boxes, candidates.class_ids, order, c, m_desc.nms_threshold);
+        }
+    }
+
+    /* box valid detect target */
+    for (int i = 0; i < valid_count; ++i) {
+        if (order[i] == -1) {
+            continue;
+        }
+        if (m_desc.max_results > 0 && group.count >= m_desc.max_results) {
+            break;
+        }
+        int n = order[i];
+        float x1 = candidates.boxes[n * 4 + 0];
+        float y1 = candidates.boxes[n * 4 + 1];
+        float x2 = x1 + candidates.boxes[n * 4 + 2];
+        float y2 = y1 + candidates.boxes[n * 4 + 3];
+        detect_result_t result{};
+        result.box.left   = (int)(clamp(x1, 0, model_in_w) / scale_w);
+        result.box.top    = (int)(clamp(y1, 0, model_in_h) / scale_h);
+        result.box.right  = (int)(clamp(x2, 0, model_in_w) / scale_w);
+        result.box.bottom = (int)(clamp(y2, 0, model_in_h) / scale_h);
+        result.prop       = candidates.probs[n];
+        result.class_id   = candidates.class_ids[n];
+        group.results.push_back(result);
+        group.count++;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.14
+ * @brief: 通用检测头解码器，由检测头描述（步长、anchor 或 DFL、类别数、数据类型和排布）驱动，
+ *         支持 YOLOv5 类 anchor-based 检测头和 YOLOv8 类 anchor-free（DFL）检测头
+ */
+#ifndef RKNN_INFER_PLUGIN_DETECT_DECODER_H
+#define RKNN_INFER_PLUGIN_DETECT_DECODER_H
+
+#include <string>
+#include <vector>
+
+#include "rknn_api.h"
+#include "postprocess.h"
+#include "class_label_table.h"
+
+class TaskPool;
+
+// 检测头类型
+enum DetectHeadType {
+    // anchor-based，每个步长一个输出：anchor_num * (5 + class_num) 个通道（YOLOv5）
+    DETECT_HEAD_ANCHOR,
+    // anchor-free，每个步长两个（或三个）输出：4 * reg_max 个框分布通道、class_num 个类别通道（可选置信度和通道）（YOLOv8）
+    DETECT_HEAD_DFL,
+};
+
+// 每个输出 tensor 的量化参数
+struct DetectTensorQuant {
+    int32_t zp = 0;
+    float scale = 1.0;
+};
+
+// 检测头描述
+struct DetectHeadDesc {
+    DetectHeadType head_type = DETECT_HEAD_ANCHOR;
+    // 类别个数
+    int class_num = OBJ_CLASS_NUM;
+    // 每个检测头的步长
+    std::vector<int> strides = {8, 16, 32};
+    // 每个检测头的 anchor（w, h 成对出现），仅 anchor-based 使用
+    std::vector<std::vector<float>> anchors = {
+            {10, 13, 16, 30, 33, 23},
+            {30, 61, 62, 45, 59, 119},
+            {116, 90, 156, 198, 373, 326}};
+    // DFL 分布的 bin 个数，仅 anchor-free 使用
+    int reg_max = 16;
+    // 每个步长对应的输出 tensor 个数，仅 anchor-free 使用（2 或 3，3 表示带置信度和通道）
+    int tensors_per_stride = 2;
+    // 输出是否为 logits，需要做 sigmoid（anchor-based 作用于全部通道，anchor-free 只作用于类别分数）
+    bool apply_sigmoid = true;
+
+    // 输出数据类型和排布，auto 时使用模型的输出特征
+    bool dtype_auto = true;
+    rknn_tensor_type dtype = RKNN_TENSOR_INT8;
+    bool layout_auto = true;
+    rknn_tensor_format layout = RKNN_TENSOR_NCHW;
+    // 每个输出 tensor 的量化参数，auto 时使用模型的输出特征
+    std::vector<DetectTensorQuant> quant;
+
+    // 最多输出结果个数（0 代表无限制）
+    int max_results = OBJ_NUMB_MAX_SIZE;
+    float conf_threshold = BOX_THRESH;
+    float nms_threshold = NMS_THRESH;
+    // 解码工作线程数（0 代表在输出线程上顺序解码），大于 0 时按检测头和网格行分块并行解码，
+    // 只在最大检测头的网格足够大（1280 及以上输入）时分块，较小的输入仍顺序解码
+    int decode_threads = 0;
+    std::string label_path = "./model/coco_80_labels_list.txt";
+};
+
+// 检测结果（结果个数不再受限于固定数组）
+struct DetectResultGroup {
+    int id = 0;
+    int count = 0;
+    std::vector<detect_result_t> results;
+};
+
+// 解码出的候选框（NMS 之前）
+struct DetectCandidates {
+    // x, y, w, h
+    std::vector<float> boxes;
+    std::vector<float> probs;
+    std::vector<int> class_ids;
+    // 候选框在顺序解码中的位置（检测头、anchor、网格位置），分块并行解码时用于保证排序结果一致
+    std::vector<int> keys;
+
+    void clear() {
+        boxes.clear();
+        probs.clear();
+        class_ids.clear();
+        keys.clear();
+    }
+};
+
+// 单个检测头的解码参数
+struct DetectHeadArgs {
+    // 输出 tensor（anchor-free 时依次为框分布、类别分数、置信度和）
+    const void *tensors[3];
+    DetectTensorQuant quant[3];
+    int grid_h;
+    int grid_w;
+    int stride;
+    const float *anchors;
+    int anchor_num;
+    // 本次解码的网格行范围 [row_begin, row_end)
+    int row_begin;
+    int row_end;
+    // 本检测头第一个候选位置的 key
+    int key_base;
+};
+
+// 单个检测头的解码函数，按数据类型、排布和类别数编译期特化
+typedef void (*DetectDecodeHeadFunc)(const DetectHeadArgs &args, const DetectHeadDesc &desc,
+                                     float threshold, DetectCandidates &candidates);
+
+/**
+ * @brief 从配置文件读取检测头描述，文件不存在时保持默认（官方 YOLOv5 配置）
+ */
+int load_detect_head_desc(const std::string &path, DetectHeadDesc &desc);
+
+/**
+ * @brief 根据模型的输出特征补全 auto 的数据类型、排布和量化参数，并检查每个输出的网格和通道数
+ *        与模型输入尺寸、步长和类别数一致（不一致时解码会越界读取）
+ *        want_float 为 false 时直接解码原始输出（推荐），为 true 时按 float 输出解码
+ */
+int resolve_detect_head_desc(DetectHeadDesc &desc, const rknn_tensor_attr &input_attr,
+                             const rknn_tensor_attr *output_attr, uint32_t n_output, bool want_float = false);
+
+class DetectDecoder {
+public:
+    explicit DetectDecoder(const DetectHeadDesc &desc);
+    ~DetectDecoder();
+
+    DetectDecoder(const DetectDecoder &) = delete;
+    DetectDecoder &operator=(const DetectDecoder &) = delete;
+
+    [[nodiscard]] bool is_init() const { return m_init_flag; };
+    [[nodiscard]] const DetectHeadDesc &desc() const { return m_desc; };
+    // 类别名称，线程安全
+    [[nodiscard]] const char *class_name(int class_id) const { return m_labels.name(class_id); };
+
+    // 解码一帧的输出，scale_w/scale_h 为模型输入相对原图的缩放
+    int decode(void **outputs, uint32_t n_outputs,
+               int model_in_h, int model_in_w,
+               float scale_w, float scale_h,
+               DetectResultGroup &group) const;
+
+private:
+    bool m_init_flag = false;
+    DetectHeadDesc m_desc;
+    DetectDecodeHeadFunc m_decode_func = nullptr;
+    // 阈值（已换算到 sigmoid 之前）
+    float m_threshold = 0;
+    // 类别名称表，构造时加载，之后只读
+    ClassLabelTable m_labels;
+    // 分块并行解码的工作线程池，decode_threads 为 0 时为空
+    TaskPool *m_task_pool = nullptr;
+};
+
+#endif //RKNN_INFER_PLUGIN_DETECT_DECODER_H
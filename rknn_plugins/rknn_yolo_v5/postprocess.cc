@@ -23,9 +23,6 @@
 
 #include <set>
 #include <vector>
-#define LABEL_NALE_TXT_PATH "./model/coco_80_labels_list.txt"
-
-static char* labels[OBJ_CLASS_NUM];
 
 const int anchor0[6] = {10, 13, 16, 30, 33, 23};
 const int anchor1[6] = {30, 61, 62, 45, 59, 119};
@@ -33,68 +30,6 @@ const int anchor2[6] = {116, 90, 156, 198, 373, 326};
 
 inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
 
-char* readLine(FILE* fp, char* buffer, int* len)
-{
-  int    ch;
-  int    i        = 0;
-  size_t buff_len = 0;
-
-  buffer = (char*)malloc(buff_len + 1);
-  if (!buffer)
-    return NULL; // Out of memory
-
-  while ((ch = fgetc(fp)) != '\n' && ch != EOF) {
-    buff_len++;
-    void* tmp = realloc(buffer, buff_len + 1);
-    if (tmp == NULL) {
-      free(buffer);
-      return NULL; // Out of memory
-    }
-    buffer = (char*)tmp;
-
-    buffer[i] = (char)ch;
-    i++;
-  }
-  buffer[i] = '\0';
-
-  *len = buff_len;
-
-  // Detect end
-  if (ch == EOF && (i == 0 || ferror(fp))) {
-    free(buffer);
-    return NULL;
-  }
-  return buffer;
-}
-
-int readLines(const char* fileName, char* lines[], int max_line)
-{
-  FILE* file = fopen(fileName, "r");
-  char* s;
-  int   i = 0;
-  int   n = 0;
-
-  if (file == NULL) {
-    printf("Open %s fail!\n", fileName);
-    return -1;
-  }
-
-  while ((s = readLine(file, s, &n)) != NULL) {
-    lines[i++] = s;
-    if (i >= max_line)
-      break;
-  }
-  fclose(file);
-  return i;
-}
-
-int loadLabelName(const char* locationFilename, char* label[])
-{
-  printf("loadLabelName %s\n", locationFilename);
-  readLines(locationFilename, label, OBJ_CLASS_NUM);
-  return 0;
-}
-
 static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
                               float ymax1)
 {
@@ -105,17 +40,17 @@ static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0
   return u <= 0.f ? 0.f : (i / u);
 }
 
-static int nms(int validCount, std::vector<float>& outputLocations, std::vector<int> classIds, std::vector<int>& order,
-               int filterId, float threshold)
+int nms(int validCount, std::vector<float>& outputLocations, const std::vector<int>& classIds, std::vector<int>& order,
+        int filterId, float threshold)
 {
   for (int i = 0; i < validCount; ++i) {
-    if (order[i] == -1 || classIds[i] != filterId) {
+    if (order[i] == -1 || classIds[order[i]] != filterId) {
       continue;
     }
     int n = order[i];
     for (int j = i + 1; j < validCount; ++j) {
       int m = order[j];
-      if (m == -1 || classIds[i] != filterId) {
+      if (m == -1 || classIds[m] != filterId) {
         continue;
       }
       float xmin0 = outputLocations[n * 4 + 0];
@@ -167,25 +102,6 @@ static int quick_sort_indice_inverse(std::vector<float>& input, int left, int ri
   return low;
 }
 
-static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
-
-static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
-
-inline static int32_t __clip(float val, float min, float max)
-{
-  float f = val <= min ? min : (val >= max ? max : val);
-  return f;
-}
-
-static int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale)
-{
-  float  dst_val = (f32 / scale) + zp;
-  int8_t res     = (int8_t)__clip(dst_val, -128, 127);
-  return res;
-}
-
-static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
-
 static int process(int8_t* input, int* anchor, int grid_h, int grid_w, int height, int width, int stride,
                    std::vector<float>& boxes, std::vector<float>& objProbs, std::vector<int>& classId, float threshold,
                    int32_t zp, float scale)
@@ -241,16 +157,6 @@ int post_process(int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h,
                  float nms_threshold, float scale_w, float scale_h, std::vector<int32_t>& qnt_zps,
                  std::vector<float>& qnt_scales, detect_result_group_t* group)
 {
-  static int init = -1;
-  if (init == -1) {
-    int ret = 0;
-    ret     = loadLabelName(LABEL_NALE_TXT_PATH, labels);
-    if (ret < 0) {
-      return -1;
-    }
-
-    init = 0;
-  }
   memset(group, 0, sizeof(detect_result_group_t));
 
   std::vector<float> filterBoxes;
@@ -321,25 +227,10 @@ int post_process(int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h,
     group->results[last_count].box.right  = (int)(clamp(x2, 0, model_in_w) / scale_w);
     group->results[last_count].box.bottom = (int)(clamp(y2, 0, model_in_h) / scale_h);
     group->results[last_count].prop       = obj_conf;
-    char* label                           = labels[id];
-    strncpy(group->results[last_count].name, label, OBJ_NAME_MAX_SIZE);
-
-    // printf("result %2d: (%4d, %4d, %4d, %4d), %s\n", i, group->results[last_count].box.left,
-    // group->results[last_count].box.top,
-    //        group->results[last_count].box.right, group->results[last_count].box.bottom, label);
+    group->results[last_count].class_id   = id;
     last_count++;
   }
   group->count = last_count;
 
   return 0;
 }
-
-void deinitPostProcess()
-{
-  for (int i = 0; i < OBJ_CLASS_NUM; i++) {
-    if (labels[i] != nullptr) {
-      free(labels[i]);
-      labels[i] = nullptr;
-    }
-  }
-}
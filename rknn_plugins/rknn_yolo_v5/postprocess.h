@@ -1,6 +1,7 @@
 #ifndef _RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
 #define _RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
 
+#include <math.h>
 #include <stdint.h>
 #include <vector>
 
@@ -21,7 +22,8 @@ typedef struct _BOX_RECT
 
 typedef struct __detect_result_t
 {
-    char name[OBJ_NAME_MAX_SIZE];
+    // 类别 id，名称通过类别名称表查询
+    int class_id;
     BOX_RECT box;
     float prop;
 } detect_result_t;
@@ -33,10 +35,30 @@ typedef struct _detect_result_group_t
     detect_result_t results[OBJ_NUMB_MAX_SIZE];
 } detect_result_group_t;
 
+static inline float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
+
+static inline float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
+
+inline static int32_t __clip(float val, float min, float max)
+{
+  float f = val <= min ? min : (val >= max ? max : val);
+  return f;
+}
+
+static inline int8_t qnt_f32_to_affine(float f32, int32_t zp, float scale)
+{
+  float  dst_val = (f32 / scale) + zp;
+  int8_t res     = (int8_t)__clip(dst_val, -128, 127);
+  return res;
+}
+
+static inline float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+
+int nms(int validCount, std::vector<float>& outputLocations, const std::vector<int>& classIds, std::vector<int>& order,
+        int filterId, float threshold);
+
 int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w,
                  float conf_threshold, float nms_threshold, float scale_w, float scale_h,
                  std::vector<int32_t> &qnt_zps, std::vector<float> &qnt_scales,
                  detect_result_group_t *group);
-
-void deinitPostProcess();
 #endif //_RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
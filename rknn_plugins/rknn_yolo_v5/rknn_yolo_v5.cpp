@@ -7,6 +7,7 @@
 
 /* 包含定义插件必须的头文件 */
 #include <string>
+#include <vector>
 #include <cstring>
 
 #include "opencv2/core/core.hpp"
@@ -21,13 +22,17 @@
 #include "utils_log.h"
 
 #include "postprocess.h"
+#include "detect_decoder.h"
 
-const float    nms_threshold      = NMS_THRESH;
-const float    box_conf_threshold = BOX_THRESH;
+// 检测头描述文件
+#define DETECT_HEAD_CONFIG_PATH "./model/yolo_v5_head.properties"
 
 // 插件全局配置信息，由调度程序给插件传来的信息
 PluginConfigSet g_plugin_config_set;
 
+// 检测头解码器，插件启动时根据检测头描述创建
+DetectDecoder *g_detect_decoder = nullptr;
+
 // 输入线程私有数据
 struct PluginInputData {
     // 每个线程定制输入源
@@ -57,14 +62,30 @@ static int get_config(PluginConfigGet *plugin_config){
     plugin_config->output_thread_nums = 2;
     // 是否需要输出float类型的输出结果
     plugin_config->output_want_float = false;
-
-    d_rknn_plugin_info("post process config: box_conf_threshold = %.2f, nms_threshold = %.2f", box_conf_threshold, nms_threshold);
     return 0;
 }
 
 static int set_config(PluginConfigSet *plugin_config){
     // 注意拷贝构造函数
     memcpy(&g_plugin_config_set, plugin_config, sizeof(PluginConfigSet));
+
+    // 读取检测头描述并创建解码器
+    DetectHeadDesc detect_head_desc;
+    load_detect_head_desc(DETECT_HEAD_CONFIG_PATH, detect_head_desc);
+    if (0 != resolve_detect_head_desc(detect_head_desc,
+                                      g_plugin_config_set.input_attr[0],
+                                      g_plugin_config_set.output_attr,
+                                      g_plugin_config_set.io_num.n_output)) {
+        d_rknn_plugin_error("resolve detect head failed")
+        return -1;
+    }
+    g_detect_decoder = new DetectDecoder(detect_head_desc);
+    if (!g_detect_decoder->is_init()) {
+        d_rknn_plugin_error("detect decoder init failed")
+        return -1;
+    }
+    d_rknn_plugin_info("post process config: box_conf_threshold = %.2f, nms_threshold = %.2f",
+                       detect_head_desc.conf_threshold, detect_head_desc.nms_threshold)
     d_rknn_plugin_info("plugin config set success")
     return 0;
 }
@@ -196,28 +217,27 @@ static int rknn_plugin_output(struct ThreadData *td, struct OutputUnit *output_u
     float scale_h = (float)sync_data->input_height / (float)sync_data->orig_img.rows;
     d_rknn_plugin_info("scale_w=%f, scale_h=%f", scale_w, scale_h);
 
-    detect_result_group_t detect_result_group;
-    std::vector<float>    out_scales;
-    std::vector<int32_t>  out_zps;
-    for (int i = 0; i < output_unit->n_outputs; ++i) {
-        out_scales.push_back(g_plugin_config_set.output_attr[i].scale);
-        out_zps.push_back(g_plugin_config_set.output_attr[i].zp);
+    DetectResultGroup detect_result_group;
+    std::vector<void *> output_bufs(output_unit->n_outputs);
+    for (uint32_t i = 0; i < output_unit->n_outputs; ++i) {
+        output_bufs[i] = output_unit->outputs[i].buf;
     }
-    post_process(
-            (int8_t*)output_unit->outputs[0].buf,
-            (int8_t*)output_unit->outputs[1].buf,
-            (int8_t*)output_unit->outputs[2].buf,
+    int decode_ret = g_detect_decoder->decode(
+            output_bufs.data(), output_unit->n_outputs,
             (int)sync_data->input_height, (int)sync_data->input_width,
-            box_conf_threshold, nms_threshold,
             scale_w, scale_h,
-            out_zps, out_scales, &detect_result_group);
+            detect_result_group);
+    if (decode_ret != 0) {
+        d_rknn_plugin_error("decode detect result failed, ret: %d", decode_ret)
+    }
 
     // Draw Objects
     char text[256];
     for (int i = 0; i < detect_result_group.count; i++) {
         detect_result_t* det_result = &(detect_result_group.results[i]);
-        sprintf(text, "%s %.1f%%", det_result->name, det_result->prop * 100);
-        d_rknn_plugin_info("%s @ (%d %d %d %d) %f", det_result->name, det_result->box.left, det_result->box.top,
+        const char *class_name = g_detect_decoder->class_name(det_result->class_id);
+        sprintf(text, "%s %.1f%%", class_name, det_result->prop * 100);
+        d_rknn_plugin_info("%s @ (%d %d %d %d) %f", class_name, det_result->box.left, det_result->box.top,
                det_result->box.right, det_result->box.bottom, det_result->prop);
         int x1 = det_result->box.left;
         int y1 = det_result->box.top;
@@ -258,6 +278,7 @@ static void plugin_init plugin_auto_register(){
 // 插件动态库在关闭时会自动调用该函数
 static void plugin_exit plugin_auto_unregister(){
     d_rknn_plugin_info("auto unregister plugin %p, name: %s", &rknn_yolo_v5, rknn_yolo_v5.plugin_name)
-    deinitPostProcess();
+    delete g_detect_decoder;
+    g_detect_decoder = nullptr;
     plugin_unregister(&rknn_yolo_v5);
 }
@@ -6,7 +6,11 @@
  */
 
 /* 包含定义插件必须的头文件 */
+#include <map>
+#include <mutex>
+#include <memory>
 #include <string>
+#include <vector>
 #include <cstring>
 
 #include "opencv2/core/core.hpp"
@@ -18,26 +22,76 @@
 #include "rga.h"
 
 #include "rknn_infer_api.h"
+#include "utils.h"
 #include "utils_log.h"
 
 #include "postprocess.h"
-#include "mpp_video_decoder.h"
-#include "mpp_video_encoder.h"
-
-const float    nms_threshold      = NMS_THRESH;
-const float    box_conf_threshold = BOX_THRESH;
+#include "detect_decoder.h"
+#include "mpp_decoder_manager.h"
+#include "mpp_encoder_manager.h"
+#include "mpp_video_utils.h"
+#include "image_op_utils.h"
+#include "font_atlas_utils.h"
+#include "motion_detector.h"
+#include "object_tracker.h"
+
+// 检测头描述文件
+#define DETECT_HEAD_CONFIG_PATH "./model/yolo_v5_head.properties"
+// 输入流列表和解码配置
+#define DECODER_CONFIG_PATH "./model/yolo_v5_streams.properties"
+// 推理中的帧超过该时间没有返回（调度程序推理失败丢弃）时不再等待，后续帧继续输出
+#define REORDER_TIMEOUT_MS (2000)
 
 // 插件全局配置信息，由调度程序给插件传来的信息
 PluginConfigSet g_plugin_config_set;
 
-std::vector<MppVideoEncoder *> g_mpp_video_encoders;
+// 检测头解码器，插件启动时根据检测头描述创建
+DetectDecoder *g_detect_decoder = nullptr;
+
+// 多路解码：输入线程轮询所有流取帧，流的个数与输入线程个数无关
+MppDecoderManager *g_mpp_decoder_manager = nullptr;
+
+// 按视频流管理编码器，第一帧到来时按实际尺寸创建
+MppEncoderManager *g_mpp_encoder_manager = nullptr;
+
+// 标签字体，构造后只读，输出线程共享
+const FontAtlas g_label_font(2);
+
+// 等待按流内顺序编码输出的帧
+struct PendingFrame {
+    DecoderMppFrame frame = {};
+    time_unit schedule_ms = 0;
+    // 推理的帧在输出线程解码出结果后就绪，不推理的帧调度时就绪
+    bool ready = false;
+    bool inferred = false;
+    // 推理的帧：运动检测决定的推理区域和检测结果（失败时无效，沿用之前的结果）
+    MotionDecision motion_decision = MOTION_DECISION_FULL;
+    MotionRect roi = {};
+    bool results_valid = false;
+    // 不推理的帧：跟踪器未调度检测时输出外推的航迹，否则沿用之前的结果
+    bool tracked = false;
+    DetectResultGroup results;
+};
 
-// 输入线程私有数据
-struct PluginInputData {
-    // 每个线程定制解码器
-    MppVideoDecoder *mpp_video_decoder;
+// 每路流的运动检测、跟踪和最近一次的检测结果，不送入 NPU 的帧直接复用结果
+struct StreamState {
+    // 保护本结构；按序输出（绘制、编码、释放）也在锁内完成，保证编码顺序
+    std::mutex mutex;
+    // 流的运动检测 / 跟踪关闭时为空
+    std::unique_ptr<MotionDetector> detector;
+    std::unique_ptr<ObjectTracker> tracker;
+    // 最近输出的检测结果（原图坐标）
+    DetectResultGroup last_results;
+    bool has_results = false;
+    // 按流递增的帧序号，跟踪器按序号外推
+    uint64_t next_frame = 0;
+    // 已调度还没有输出的帧，按帧序号输出：不推理的帧要等前面推理中的帧
+    std::map<uint64_t, PendingFrame> pending;
 };
 
+// 按流序号索引，get_config 中创建后不再增删
+std::map<int, std::unique_ptr<StreamState>> g_stream_states;
+
 // 输出线程私有数据
 struct PluginOutputData {
     // 每个线程定制输出
@@ -48,9 +102,14 @@ struct PluginOutputData {
 struct PluginSyncData {
     // 帧缓存
     DecoderMppFrame frame = {};
-    MppVideoDecoder *mpp_video_decoder = nullptr;
+    // 帧所属的流（从 1 开始），释放帧和编码输出使用
+    int stream_id = -1;
 
-    int input_thread = -1;
+    // 运动检测决定的推理方式和送入模型的区域（原图坐标）
+    MotionDecision motion_decision = MOTION_DECISION_FULL;
+    MotionRect roi = {};
+    // 帧在所属流中的序号
+    uint64_t stream_frame = 0;
 
     // 模型出入结构
     uint32_t input_channel = 3;
@@ -58,41 +117,310 @@ struct PluginSyncData {
     uint32_t input_height  = 0;
 };
 
+// 在编码器的帧副本上批量绘制检测框和 "类别 置信度" 标签
+static void draw_detect_results(const DecoderMppFrame &frame, const DetectResultGroup &detect_result_group) {
+    const unsigned int box_color = draw_rgb_to_yuv_color(255, 0, 0);
+    const unsigned int text_color = draw_rgb_to_yuv_color(255, 255, 255);
+    YuvPlaneLayout layout = frame.mpp_frame_format == MPP_FMT_YUV420SP ? YUV_LAYOUT_NV12 : YUV_LAYOUT_I420;
+    auto *frame_buf = (uint8_t *)frame.data_buf;
+    int width = (int)frame.hor_width;
+    int height = (int)frame.ver_height;
+
+    std::vector<DrawRect> rects(detect_result_group.count);
+    for (int i = 0; i < detect_result_group.count; i++) {
+        const BOX_RECT &box = detect_result_group.results[i].box;
+        rects[i] = {box.left, box.top, box.right - box.left + 1, box.bottom - box.top + 1, box_color, 4};
+    }
+    if (layout == YUV_LAYOUT_NV12) {
+        draw_rectangles_nv12(frame_buf, width, height, (int)frame.hor_stride, (int)frame.ver_stride,
+                             rects.data(), (int)rects.size());
+    } else {
+        draw_rectangles_i420(frame_buf, width, height, (int)frame.hor_stride, (int)frame.ver_stride,
+                             rects.data(), (int)rects.size());
+    }
+
+    char text[256];
+    for (int i = 0; i < detect_result_group.count; i++) {
+        const detect_result_t &result = detect_result_group.results[i];
+        snprintf(text, sizeof(text), "%s %.2f", g_detect_decoder->class_name(result.class_id), result.prop);
+        g_label_font.draw_label(frame_buf, width, height, (int)frame.hor_stride, (int)frame.ver_stride, layout,
+                                result.box.left, result.box.top, text, text_color, box_color);
+    }
+}
+
+// 跟踪器的航迹框和检测结果互相转换
+static void tracks_to_results(const std::vector<TrackBox> &tracks, DetectResultGroup &group) {
+    group.results.resize(tracks.size());
+    for (size_t i = 0; i < tracks.size(); i++) {
+        const TrackBox &track = tracks[i];
+        detect_result_t &result = group.results[i];
+        result.class_id = track.class_id;
+        result.prop = track.score;
+        result.box = {(int)track.left, (int)track.right, (int)track.top, (int)track.bottom};
+    }
+    group.count = (int)group.results.size();
+}
+
+static void results_to_tracks(const DetectResultGroup &group, std::vector<TrackBox> &tracks) {
+    tracks.resize(group.results.size());
+    for (size_t i = 0; i < group.results.size(); i++) {
+        const detect_result_t &result = group.results[i];
+        tracks[i] = {(float)result.box.left, (float)result.box.top, (float)result.box.right, (float)result.box.bottom,
+                     result.class_id, result.prop, -1};
+    }
+}
+
+/**
+ * @brief ROI 推理的检测框加上 ROI 的偏移，ROI 外的区域沿用上一次的检测结果
+ */
+static void merge_roi_results(const MotionRect &roi, const DetectResultGroup &last_results,
+                              DetectResultGroup &group) {
+    for (auto &result : group.results) {
+        result.box.left += roi.x;
+        result.box.right += roi.x;
+        result.box.top += roi.y;
+        result.box.bottom += roi.y;
+    }
+    for (const auto &result : last_results.results) {
+        const BOX_RECT &box = result.box;
+        if (box.right < roi.x || box.left >= roi.x + roi.width || box.bottom < roi.y || box.top >= roi.y + roi.height) {
+            group.results.push_back(result);
+        }
+    }
+    group.count = (int)group.results.size();
+}
+
+/**
+ * @brief 按帧序号输出已就绪的帧：推理的帧更新跟踪和保存结果，不推理的帧复用之前的结果，然后绘制、编码并释放。
+ *        队首的帧推理超时（调度程序丢弃）时跳过；force 时不再等待未就绪的帧。调用者持有 state.mutex
+ */
+static void flush_stream(StreamState &state, int stream_id, bool force) {
+    time_unit now_ms = get_time_of_ms();
+    while (!state.pending.empty()) {
+        auto it = state.pending.begin();
+        PendingFrame &pending = it->second;
+        if (!pending.ready) {
+            if (!force && now_ms - pending.schedule_ms < REORDER_TIMEOUT_MS) {
+                break;
+            }
+            // 帧由推理中的同步数据持有，迟到时在 complete_frame 中释放
+            d_rknn_plugin_warn("stream %d frame %llu not returned, skip", stream_id, (unsigned long long)it->first)
+            state.pending.erase(it);
+            continue;
+        }
+
+        DetectResultGroup &results = pending.results;
+        if (pending.inferred && pending.results_valid) {
+            if (pending.motion_decision == MOTION_DECISION_ROI) {
+                // ROI 外沿用之前的结果，有跟踪器时为外推到本帧的航迹
+                DetectResultGroup outside_results = state.last_results;
+                if (state.tracker != nullptr) {
+                    std::vector<TrackBox> tracks;
+                    state.tracker->predict(it->first, tracks);
+                    tracks_to_results(tracks, outside_results);
+                }
+                merge_roi_results(pending.roi, outside_results, results);
+            }
+            if (state.tracker != nullptr) {
+                std::vector<TrackBox> tracks;
+                results_to_tracks(results, tracks);
+                state.tracker->update(it->first, tracks);
+            }
+            state.last_results = results;
+            state.has_results = true;
+        } else if (pending.tracked && state.tracker != nullptr) {
+            // 按序外推，前面的帧刚检测过时用的是最新的航迹；
+            // 之后的静止帧沿用外推结果，不跳回上一次推理的位置
+            std::vector<TrackBox> tracks;
+            state.tracker->predict(it->first, tracks);
+            tracks_to_results(tracks, results);
+            state.last_results = results;
+        } else {
+            // 静止帧和推理失败的帧沿用之前的结果
+            results = state.last_results;
+        }
+
+        // 编码器输出（队列满时丢帧，不阻塞），检测框和标签画在编码器的帧副本上（NV12 / I420），不转换到 RGB；
+        // 解码帧还是解码器的参考帧，也是运动检测和推理的输入，不能修改
+        g_mpp_encoder_manager->encode_frame(stream_id, pending.frame, [&results](const DecoderMppFrame &copy) {
+            draw_detect_results(copy, results);
+        });
+        g_mpp_decoder_manager->release_frame(stream_id, pending.frame);
+        state.pending.erase(it);
+    }
+}
+
+/**
+ * @brief 推理的帧得到结果（results 为空表示预处理或解码失败），按序输出该流已就绪的帧
+ */
+static void complete_frame(PluginSyncData *sync_data, DetectResultGroup *results) {
+    auto it = g_stream_states.find(sync_data->stream_id);
+    if (it == g_stream_states.end()) {
+        g_mpp_decoder_manager->release_frame(sync_data->stream_id, sync_data->frame);
+        return;
+    }
+    StreamState &state = *it->second;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto pending_it = state.pending.find(sync_data->stream_frame);
+    if (pending_it == state.pending.end()) {
+        // 已经超时跳过，后面的帧已输出，不再编码
+        d_rknn_plugin_warn("stream %d frame %llu returned too late, drop", sync_data->stream_id,
+                           (unsigned long long)sync_data->stream_frame)
+        g_mpp_decoder_manager->release_frame(sync_data->stream_id, sync_data->frame);
+        return;
+    }
+    PendingFrame &pending = pending_it->second;
+    pending.ready = true;
+    pending.motion_decision = sync_data->motion_decision;
+    pending.roi = sync_data->roi;
+    if (results != nullptr) {
+        pending.results = std::move(*results);
+        pending.results_valid = true;
+    }
+    flush_stream(state, sync_data->stream_id, false);
+}
+
+// 检查所有流队首的帧是否超时（取帧等待超时时调用，此时不会有新帧触发输出）
+static void flush_all_streams() {
+    for (auto &it : g_stream_states) {
+        std::lock_guard<std::mutex> lock(it.second->mutex);
+        flush_stream(*it.second, it.first, false);
+    }
+}
+
+/**
+ * @brief 决定帧是否推理以及推理方式：运动检测判断画面静止时复用该流之前的检测结果，
+ *        画面有变化但跟踪器未调度检测时用外推的航迹。所有帧按流内序号排队，按序输出；
+ *        不推理的帧返回 false（输入线程继续取下一帧），推理的帧返回 true
+ */
+static bool schedule_frame(PluginSyncData *sync_data) {
+    const DecoderMppFrame &frame = sync_data->frame;
+    sync_data->motion_decision = MOTION_DECISION_FULL;
+    sync_data->roi = {0, 0, (int)frame.hor_width, (int)frame.ver_height};
+    auto it = g_stream_states.find(sync_data->stream_id);
+    if (it == g_stream_states.end()) {
+        return true;
+    }
+
+    // 同一路流的帧可能被多个输入线程取到，按流加锁
+    StreamState &state = *it->second;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    sync_data->stream_frame = state.next_frame++;
+    PendingFrame &pending = state.pending[sync_data->stream_frame];
+    pending.frame = frame;
+    pending.schedule_ms = get_time_of_ms();
+
+    MotionResult result;
+    bool detect = true;
+    if (state.detector != nullptr) {
+        // 还没有可以复用的检测结果时整帧推理
+        if (!state.has_results) {
+            state.detector->request_full();
+        }
+        // 亮度平面在 NV12 / I420 帧的开头
+        if (state.detector->detect((const uint8_t *)frame.data_buf, frame.hor_width, frame.ver_height,
+                                   frame.hor_stride, result) == 0 && result.decision == MOTION_DECISION_SKIP) {
+            detect = false;
+        }
+    }
+    if (detect && state.tracker != nullptr && !state.tracker->should_detect(sync_data->stream_frame)) {
+        // 外推在输出时按序进行，航迹已经用前面推理的帧更新过
+        detect = false;
+        pending.tracked = true;
+    }
+    if (detect) {
+        pending.inferred = true;
+        if (result.decision == MOTION_DECISION_ROI) {
+            sync_data->motion_decision = MOTION_DECISION_ROI;
+            sync_data->roi = result.roi;
+        }
+        return true;
+    }
+
+    // 不推理的帧：输出与推理过的帧一致，只是不经过 NPU；前面的帧还在推理时排队等待
+    pending.ready = true;
+    flush_stream(state, sync_data->stream_id, false);
+    return false;
+}
+
 static int get_config(PluginConfigGet *plugin_config){
+    // 读取输入流列表，没有配置时两路解码 1080p.264
+    MppDecoderManagerConfig decoder_config;
+    if (load_decoder_manager_config(DECODER_CONFIG_PATH, decoder_config) != 0) {
+        decoder_config.streams = {"file:1080p.264", "file:1080p.264"};
+        decoder_config.input_threads = 2;
+        decoder_config.adaptive_skip = true;
+    }
+    g_mpp_decoder_manager = new MppDecoderManager(decoder_config);
+    if (!g_mpp_decoder_manager->is_init()) {
+        d_rknn_plugin_error("no valid input stream")
+        return -1;
+    }
+
+    // 按流创建运动检测和跟踪器（配置在同一个文件中，没有配置时关闭）
+    MotionDetectConfigSet motion_config;
+    ObjectTrackerConfigSet tracker_config;
+    load_motion_detect_config(DECODER_CONFIG_PATH, motion_config);
+    load_object_tracker_config(DECODER_CONFIG_PATH, tracker_config);
+    for (size_t i = 0; i < decoder_config.streams.size(); i++) {
+        int stream_id = (int)i + 1;
+        auto state = std::make_unique<StreamState>();
+        if (motion_config.get(stream_id).mode != MOTION_GATE_OFF) {
+            state->detector = std::make_unique<MotionDetector>(motion_config.get(stream_id));
+        }
+        if (tracker_config.get(stream_id).enable) {
+            state->tracker = std::make_unique<ObjectTracker>(tracker_config.get(stream_id));
+        }
+        g_stream_states[stream_id] = std::move(state);
+    }
+
     // 输入线程个数
-    plugin_config->input_thread_nums = 2;
+    plugin_config->input_thread_nums = decoder_config.input_threads;
     // 输出线程个数
     plugin_config->output_thread_nums = 2;
     // 是否需要输出float类型的输出结果
     plugin_config->output_want_float = false;
 
-    d_rknn_plugin_info("post process config: box_conf_threshold = %.2f, nms_threshold = %.2f", box_conf_threshold, nms_threshold);
-
-    // 模型输出编码器定义
-    auto *mpp_video_encoder_1 = new MppVideoEncoder("out_1.h264");
-    auto *mpp_video_encoder_2 = new MppVideoEncoder("out_2.h264");
-    g_mpp_video_encoders.push_back(mpp_video_encoder_1);
-    g_mpp_video_encoders.push_back(mpp_video_encoder_2);
+    // 模型输出编码器定义：流 1 / 2 ... 分别输出到 out_1.h264 / out_2.h264 ...
+    MppEncoderManagerConfig encoder_config;
+    encoder_config.path_pattern = "out_%d.h264";
+    // 长时间运行时按 10 分钟切分输出文件（out_1_00000.h264 ...），避免单个文件无限增长
+    encoder_config.file_config.segment_ms = 10 * 60 * 1000;
+    // 异步编码：输出线程只拷贝一次帧数据，编码和写文件不阻塞推理
+    encoder_config.async = true;
+    g_mpp_encoder_manager = new MppEncoderManager(encoder_config);
     return 0;
 }
 
 static int set_config(PluginConfigSet *plugin_config){
     // 注意拷贝构造函数
     memcpy(&g_plugin_config_set, plugin_config, sizeof(PluginConfigSet));
+
+    // 读取检测头描述并创建解码器
+    DetectHeadDesc detect_head_desc;
+    load_detect_head_desc(DETECT_HEAD_CONFIG_PATH, detect_head_desc);
+    if (0 != resolve_detect_head_desc(detect_head_desc,
+                                      g_plugin_config_set.input_attr[0],
+                                      g_plugin_config_set.output_attr,
+                                      g_plugin_config_set.io_num.n_output)) {
+        d_rknn_plugin_error("resolve detect head failed")
+        return -1;
+    }
+    g_detect_decoder = new DetectDecoder(detect_head_desc);
+    if (!g_detect_decoder->is_init()) {
+        d_rknn_plugin_error("detect decoder init failed")
+        return -1;
+    }
+    d_rknn_plugin_info("post process config: box_conf_threshold = %.2f, nms_threshold = %.2f",
+                       detect_head_desc.conf_threshold, detect_head_desc.nms_threshold)
     d_rknn_plugin_info("plugin config set success")
     return 0;
 }
 
 static int rknn_plugin_init(struct ThreadData *td) {
-    // 设置输入线程的输入源
+    // 输入线程从解码管理器取帧，没有私有数据
     if(td->thread_type == THREAD_TYPE_INPUT) {
-        td->plugin_private_data = new PluginInputData();
-        auto *pri_data = (PluginInputData *)td->plugin_private_data;
-        if(td->thread_id == 0){
-            pri_data->mpp_video_decoder = new MppVideoDecoder("1080p.264");
-        }else if(td->thread_id == 1) {
-            pri_data->mpp_video_decoder = new MppVideoDecoder("1080p.264");
-        }
+        td->plugin_private_data = nullptr;
     }else{
         // 设置输出线程的输出源
         td->plugin_private_data = new PluginOutputData();
@@ -107,27 +435,37 @@ static int rknn_plugin_init(struct ThreadData *td) {
 }
 
 static int rknn_plugin_uninit(struct ThreadData *td) {
-    // 释放输入线程的输入源
-    if(td->thread_type == THREAD_TYPE_INPUT) {
-        auto *pri_data = (PluginInputData *)td->plugin_private_data;
-        delete pri_data;
+    // 释放输出线程的私有数据
+    if(td->thread_type == THREAD_TYPE_OUTPUT) {
+        delete (PluginOutputData *)td->plugin_private_data;
+        td->plugin_private_data = nullptr;
     }
     return 0;
 }
 
 static int rknn_plugin_input(struct ThreadData *td, struct InputUnit *input_unit) {
     // 根据数据源采集数据，使用 动态 的内存做封装
-    auto *pri_data = (PluginInputData *)td->plugin_private_data;
     td->plugin_sync_data = new PluginSyncData();
     auto *sync_data = (PluginSyncData *)td->plugin_sync_data;
-    sync_data->mpp_video_decoder = pri_data->mpp_video_decoder;
-    sync_data->input_thread = td->thread_id;
 
     // Load frame
-    if (pri_data->mpp_video_decoder->get_next_frame(sync_data->frame) < 0) {
-        d_rknn_plugin_error("get_frame fail!");
-        return -1;
-    }
+    g_mpp_decoder_manager->set_queue_pressure(td->task_queue_size, td->task_queue_limit);
+    do {
+        int get_ret;
+        while ((get_ret = g_mpp_decoder_manager->get_next_frame((int)td->thread_id, sync_data->frame,
+                                                                sync_data->stream_id, 1000)) > 0) {
+            d_rknn_plugin_warn("wait decoded frame timeout, thread: %d", td->thread_id)
+            // 帧都在排队等待推理中的帧时解码没有空闲内存，检查推理中的帧是否已被丢弃
+            flush_all_streams();
+        }
+        if (get_ret < 0) {
+            d_rknn_plugin_error("get_frame fail!");
+            delete sync_data;
+            td->plugin_sync_data = nullptr;
+            return -1;
+        }
+        // 不推理的帧已经排队输出，继续取下一帧
+    } while (!schedule_frame(sync_data));
 
     if (g_plugin_config_set.input_attr[0].fmt == RKNN_TENSOR_NCHW) {
         d_rknn_plugin_info("model is NCHW input fmt");
@@ -172,15 +510,48 @@ static int rknn_plugin_input(struct ThreadData *td, struct InputUnit *input_unit
                                  sync_data->frame.mpp_frame_format,
                                  (int)sync_data->frame.hor_stride, (int)sync_data->frame.ver_stride);
     dst = wrapbuffer_virtualaddr((void*)resize_buf, sync_data->input_width, sync_data->input_height, RK_FORMAT_RGB_888);
+    bool crop = sync_data->motion_decision == MOTION_DECISION_ROI;
+    if (crop) {
+        // 只把变化区域缩放到模型输入
+        src_rect = {sync_data->roi.x, sync_data->roi.y, sync_data->roi.width, sync_data->roi.height};
+        dst_rect = {0, 0, (int)sync_data->input_width, (int)sync_data->input_height};
+    }
     int ret = imcheck(src, dst, src_rect, dst_rect);
+    IM_STATUS STATUS = IM_STATUS_NOERROR;
     if (IM_STATUS_NOERROR != ret) {
         d_rknn_plugin_info("%d, check error! %s", __LINE__, imStrError((IM_STATUS)ret));
-        return -1;
+    } else {
+        rga_buffer_t pat;
+        im_rect pat_rect;
+        memset(&pat, 0, sizeof(pat));
+        memset(&pat_rect, 0, sizeof(pat_rect));
+        // imresize 同样经过 improcess，返回值相同
+        STATUS = crop ? improcess(src, dst, pat, src_rect, dst_rect, pat_rect, IM_SYNC) : imresize(src, dst);
+        if (IM_STATUS_NOERROR != STATUS) {
+            d_rknn_plugin_info("%d, resize error! %s", __LINE__, imStrError(STATUS));
+        }
     }
-    IM_STATUS STATUS = imresize(src, dst);
-    if (IM_STATUS_NOERROR != STATUS) {
-        d_rknn_plugin_info("%d, resize error! %s", __LINE__, imStrError(STATUS));
-        return -1;
+    if (IM_STATUS_NOERROR != ret || IM_STATUS_NOERROR != STATUS) {
+        // RGA 不可用时在 CPU 上一次完成颜色转换和缩放（拉伸，与 RGA 结果的坐标换算一致），CPU 路径不裁剪，按整帧推理
+        d_rknn_plugin_warn("rga failed, resize with cpu")
+        sync_data->motion_decision = MOTION_DECISION_FULL;
+        sync_data->roi = {0, 0, (int)sync_data->frame.hor_width, (int)sync_data->frame.ver_height};
+        if (frame_data_to_model_input(
+                (uint8_t *)sync_data->frame.data_buf,
+                sync_data->frame.hor_width, sync_data->frame.ver_height,
+                sync_data->frame.hor_stride, sync_data->frame.ver_stride,
+                sync_data->frame.mpp_frame_format,
+                (uint8_t *)resize_buf, (int)sync_data->input_width, (int)sync_data->input_height,
+                RKNN_TENSOR_NHWC, false, 0, nullptr) != 0) {
+            // 帧仍按序输出（沿用之前的结果），不送入推理
+            complete_frame(sync_data, nullptr);
+            delete sync_data;
+            td->plugin_sync_data = nullptr;
+            delete[] (uint8_t *)input_unit->inputs[0].buf;
+            free(input_unit->inputs);
+            input_unit->inputs = nullptr;
+            return -1;
+        }
     }
     return 0;
 }
@@ -201,52 +572,27 @@ static int rknn_plugin_output(struct ThreadData *td, struct OutputUnit *output_u
     auto *pri_data = (PluginOutputData *)td->plugin_private_data;
     auto *sync_data = (PluginSyncData *)td->plugin_sync_data;
 
-    // post process
-    float scale_w = (float)sync_data->input_width / (float)sync_data->frame.hor_width;
-    float scale_h = (float)sync_data->input_height / (float)sync_data->frame.ver_height;
+    // post process：ROI 推理时模型输入对应原图中的 ROI
+    float scale_w = (float)sync_data->input_width / (float)sync_data->roi.width;
+    float scale_h = (float)sync_data->input_height / (float)sync_data->roi.height;
     d_rknn_plugin_info("scale_w=%f, scale_h=%f", scale_w, scale_h);
 
-    detect_result_group_t detect_result_group;
-    std::vector<float>    out_scales;
-    std::vector<int32_t>  out_zps;
-    for (int i = 0; i < output_unit->n_outputs; ++i) {
-        out_scales.push_back(g_plugin_config_set.output_attr[i].scale);
-        out_zps.push_back(g_plugin_config_set.output_attr[i].zp);
-    }
-    post_process(
-            (int8_t*)output_unit->outputs[0].buf,
-            (int8_t*)output_unit->outputs[1].buf,
-            (int8_t*)output_unit->outputs[2].buf,
+    DetectResultGroup detect_result_group;
+    std::vector<void *> output_bufs(output_unit->n_outputs);
+    for (uint32_t i = 0; i < output_unit->n_outputs; ++i) {
+        output_bufs[i] = output_unit->outputs[i].buf;
+    }
+    int decode_ret = g_detect_decoder->decode(
+            output_bufs.data(), output_unit->n_outputs,
             (int)sync_data->input_height, (int)sync_data->input_width,
-            box_conf_threshold, nms_threshold,
             scale_w, scale_h,
-            out_zps, out_scales, &detect_result_group);
-
-//    // Copy To another buffer avoid to modify mpp decoder buffer
-//    rga_buffer_t frame_buffer;
-//    rga_buffer_t draw_buffer;
-//    uint8_t out_buf = new uint8_t[sync_data->input_width * sync_data->input_height * sync_data->input_channel];
-//    frame_buffer = wrapbuffer_virtualaddr((void*)sync_data->frame.data_buf, sync_data->orig_img.cols, sync_data->orig_img.rows, RK_FORMAT_RGB_888);
-//    draw_buffer = wrapbuffer_virtualaddr((void*)resize_buf, sync_data->input_width, sync_data->input_height, RK_FORMAT_RGB_888);
-//    imcopy(origin, src);
-//
-//    // Draw objects
-//    for (int i = 0; i < detect_result.count; i++) {
-//        detect_result_t* det_result = &(detect_result.results[i]);
-//        printf("%s @ (%d %d %d %d) %f\n", det_result->name, det_result->box.left, det_result->box.top,
-//               det_result->box.right, det_result->box.bottom, det_result->prop);
-//        int x1 = det_result->box.left;
-//        int y1 = det_result->box.top;
-//        int x2 = det_result->box.right;
-//        int y2 = det_result->box.bottom;
-//        draw_rectangle_yuv420sp((unsigned char*)mpp_frame_addr, width_stride, height_stride, x1, y1, x2-x1+1, y2-y1+1, 0x00FF0000, 4);
-//    }
-    // 编码器输出
-
-    // 释放输出
-
-    sync_data->mpp_video_decoder->release_frame(sync_data->frame);
-    sync_data->mpp_video_decoder = nullptr;
+            detect_result_group);
+    if (decode_ret != 0) {
+        d_rknn_plugin_error("decode detect result failed, ret: %d", decode_ret)
+    }
+
+    // 按流内顺序更新航迹、保存结果并编码输出，该流后续不推理的帧复用结果
+    complete_frame(sync_data, decode_ret == 0 ? &detect_result_group : nullptr);
     delete sync_data;
     td->plugin_sync_data = nullptr;
     return 0;
@@ -275,11 +621,61 @@ static void plugin_init plugin_auto_register(){
 // 插件动态库在关闭时会自动调用该函数
 static void plugin_exit plugin_auto_unregister(){
     d_rknn_plugin_info("auto unregister plugin %p, name: %s", &rknn_yolo_v5, rknn_yolo_v5.plugin_name)
-    deinitPostProcess();
+    // 输出还在排队的帧（推理线程已退出，不再等待未返回的帧）
+    for (auto &it : g_stream_states) {
+        std::lock_guard<std::mutex> lock(it.second->mutex);
+        flush_stream(*it.second, it.first, true);
+    }
+    delete g_detect_decoder;
+    g_detect_decoder = nullptr;
 
     // 清除编码器
-    for(auto &it : g_mpp_video_encoders){
-        delete it;
+    if (g_mpp_encoder_manager != nullptr) {
+        for (auto &stats : g_mpp_encoder_manager->get_stats()) {
+            d_rknn_plugin_info("stream %d %dx%d, reinit: %d, encoded: %llu, dropped: %llu, written: %llu bytes",
+                               stats.stream_id, stats.width, stats.height, stats.reinit_count,
+                               (unsigned long long)stats.encoder.encoded_frames,
+                               (unsigned long long)stats.encoder.dropped_frames,
+                               (unsigned long long)stats.encoder.written_bytes)
+        }
+        delete g_mpp_encoder_manager;
+        g_mpp_encoder_manager = nullptr;
+    }
+
+    // 运动检测和跟踪统计
+    for (auto &it : g_stream_states) {
+        if (it.second->detector != nullptr) {
+            MotionDetectStats stats = it.second->detector->get_stats();
+            d_rknn_plugin_info("stream %d motion, frames: %llu, full: %llu, roi: %llu, skipped: %llu, detect avg: %.3f ms",
+                               it.first, (unsigned long long)stats.frames, (unsigned long long)stats.full_frames,
+                               (unsigned long long)stats.roi_frames, (unsigned long long)stats.skipped_frames,
+                               stats.frames == 0 ? 0.0 : (double)stats.detect_us / (double)stats.frames / 1000.0)
+        }
+        if (it.second->tracker != nullptr) {
+            ObjectTrackerStats stats = it.second->tracker->get_stats();
+            d_rknn_plugin_info("stream %d tracker, detect: %llu, tracked: %llu, early detect: %llu, tracks created: %llu, interval: %u",
+                               it.first, (unsigned long long)stats.detect_frames, (unsigned long long)stats.track_frames,
+                               (unsigned long long)stats.early_detects, (unsigned long long)stats.created_tracks,
+                               stats.interval)
+        }
+    }
+    g_stream_states.clear();
+
+    // 清除解码器（帧已全部释放）
+    if (g_mpp_decoder_manager != nullptr) {
+        for (auto &stats : g_mpp_decoder_manager->get_stats()) {
+            d_rknn_plugin_info("stream %d %s, thread: %d, frames: %llu, stolen: %llu, skipped: %llu, dropped: %llu",
+                               stats.stream_id, stats.uri.c_str(), stats.owner_thread,
+                               (unsigned long long)stats.frames, (unsigned long long)stats.stolen_frames,
+                               (unsigned long long)stats.decoder.skipped_frames,
+                               (unsigned long long)stats.decoder.dropped_frames)
+        }
+        for (auto &stats : g_mpp_decoder_manager->get_pool_stats()) {
+            d_rknn_plugin_info("buffer pool %u bytes, streams: %d, limit: %u",
+                               stats.buf_size, stats.streams, stats.limit_count)
+        }
+        delete g_mpp_decoder_manager;
+        g_mpp_decoder_manager = nullptr;
     }
     plugin_unregister(&rknn_yolo_v5);
 }
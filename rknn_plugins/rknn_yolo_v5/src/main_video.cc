@@ -28,6 +28,7 @@
 
 #include "rknn_api.h"
 #include "postprocess.h"
+#include "class_label_table.h"
 
 #include "utils/mpp_decoder.h"
 #include "utils/mpp_encoder.h"
@@ -37,6 +38,10 @@
 #endif
 
 #define OUT_VIDEO_PATH "out.h264"
+#define LABEL_NAME_TXT_PATH "./model/coco_80_labels_list.txt"
+
+// 类别名称表，加载模型时读取，之后只读
+static ClassLabelTable g_labels;
 
 typedef struct {
   rknn_context rknn_ctx;
@@ -144,6 +149,10 @@ static int init_model(const char* model_path, rknn_app_context_t* app_ctx) {
   int ret;
   rknn_context ctx;
 
+  if (g_labels.load(LABEL_NAME_TXT_PATH, OBJ_CLASS_NUM) < 0) {
+    printf("Open %s fail!\n", LABEL_NAME_TXT_PATH);
+  }
+
   /* Create the neural network */
   printf("Loading mode...\n");
   int model_data_size = 0;
@@ -227,7 +236,6 @@ static int release_model(rknn_app_context_t* app_ctx) {
   }
   free(app_ctx->input_attrs);
   free(app_ctx->output_attrs);
-  deinitPostProcess();
   return 0;
 }
 
@@ -379,7 +387,7 @@ void mpp_decoder_frame_callback(void* userdata, int width_stride, int height_str
   // Draw objects
   for (int i = 0; i < detect_result.count; i++) {
     detect_result_t* det_result = &(detect_result.results[i]);
-    printf("%s @ (%d %d %d %d) %f\n", det_result->name, det_result->box.left, det_result->box.top,
+    printf("%s @ (%d %d %d %d) %f\n", g_labels.name(det_result->class_id), det_result->box.left, det_result->box.top,
            det_result->box.right, det_result->box.bottom, det_result->prop);
     int x1 = det_result->box.left;
     int y1 = det_result->box.top;
@@ -0,0 +1,275 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.26
+ * @brief: 跨进程共享内存帧环实现
+ */
+#include <new>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm_frame_ring.h"
+#include "utils.h"
+#include "utils_log.h"
+
+// 帧数据按页对齐
+#define SHM_FRAME_PAGE_SIZE (4096)
+
+static size_t align_page(size_t size) {
+    return (size + SHM_FRAME_PAGE_SIZE - 1) / SHM_FRAME_PAGE_SIZE * SHM_FRAME_PAGE_SIZE;
+}
+
+ShmFrameRing::ShmFrameRing(const std::string &name, uint32_t slot_num, uint32_t slot_size, uint32_t mode) {
+    m_name = name;
+    CHECK_VAL(slot_num == 0 || slot_num > SHM_FRAME_RING_MAX_SLOTS || slot_size == 0,
+              d_mpp_module_error("invalid shm ring %d slots x %d bytes", (int)slot_num, (int)slot_size); return;)
+    size_t data_offset = align_page(sizeof(ShmFrameRingHeader));
+    slot_size = (uint32_t)align_page(slot_size);
+    size_t size = data_offset + (size_t)slot_num * slot_size;
+
+    // 上次异常退出可能留下同名共享内存，重新创建
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, (mode_t)mode);
+    CHECK_VAL(fd < 0, d_mpp_module_error("shm_open %s failed: %s", name.c_str(), strerror(errno)); return;)
+    if (ftruncate(fd, (off_t)size) != 0 || map(fd, size) != 0) {
+        d_mpp_module_error("create shm %s failed: %s", name.c_str(), strerror(errno))
+        close(fd);
+        shm_unlink(name.c_str());
+        return;
+    }
+    close(fd);
+    m_owner = true;
+    m_slot_num = slot_num;
+    m_slot_size = slot_size;
+    m_data_offset = data_offset;
+
+    // 新建的共享内存全为 0，原子变量就地构造
+    auto *header = new(m_header) ShmFrameRingHeader();
+    header->slot_num = slot_num;
+    header->slot_size = slot_size;
+    header->data_offset = data_offset;
+    header->version = SHM_FRAME_RING_VERSION;
+    // magic 最后写入，连接方据此判断初始化完成
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_FRAME_RING_MAGIC;
+    d_mpp_module_info("create shm frame ring %s: %d slots x %d bytes", name.c_str(), (int)slot_num, (int)slot_size)
+}
+
+ShmFrameRing::ShmFrameRing(const std::string &name) {
+    m_name = name;
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    CHECK_VAL(fd < 0, d_mpp_module_error("shm_open %s failed: %s", name.c_str(), strerror(errno)); return;)
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmFrameRingHeader) || map(fd, st.st_size) != 0) {
+        d_mpp_module_error("map shm %s failed", name.c_str())
+        close(fd);
+        return;
+    }
+    close(fd);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    ShmFrameRingHeader *header = m_header;
+    m_slot_num = header->slot_num;
+    m_slot_size = header->slot_size;
+    m_data_offset = header->data_offset;
+    if (header->magic != SHM_FRAME_RING_MAGIC || header->version != SHM_FRAME_RING_VERSION ||
+        m_slot_num == 0 || m_slot_num > SHM_FRAME_RING_MAX_SLOTS ||
+        m_data_offset + (size_t)m_slot_num * m_slot_size > m_map_size) {
+        d_mpp_module_error("shm %s is not a frame ring (or version mismatch)", name.c_str())
+        munmap(m_header, m_map_size);
+        m_header = nullptr;
+    }
+}
+
+ShmFrameRing::~ShmFrameRing() {
+    if (m_header != nullptr) {
+        munmap(m_header, m_map_size);
+        m_header = nullptr;
+    }
+    if (m_owner) {
+        shm_unlink(m_name.c_str());
+    }
+}
+
+int ShmFrameRing::map(int fd, size_t size) {
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    m_header = (ShmFrameRingHeader *)addr;
+    m_map_size = size;
+    return 0;
+}
+
+bool ShmFrameRing::wait(std::atomic<uint32_t> &addr, uint32_t value, int timeout_ms) {
+    struct timespec ts{};
+    struct timespec *timeout = nullptr;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        timeout = &ts;
+    }
+    // 跨进程，不能用 FUTEX_PRIVATE_FLAG；值已经变化时立即返回
+    long ret = syscall(SYS_futex, (uint32_t *)&addr, FUTEX_WAIT, value, timeout, nullptr, 0);
+    return !(ret != 0 && errno == ETIMEDOUT);
+}
+
+void ShmFrameRing::wake(std::atomic<uint32_t> &addr) {
+    syscall(SYS_futex, (uint32_t *)&addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+ShmFrameProducer::ShmFrameProducer(const std::string &name) : m_ring(name) {
+    if (!m_ring.is_init()) {
+        return;
+    }
+    ShmFrameRingHeader *header = m_ring.header();
+    header->producer_closed.store(0, std::memory_order_release);
+    if (header->producer_attach.fetch_add(1) == 0) {
+        return;
+    }
+    // 上一个采集进程异常退出：回收写了一半和已标记就绪但没有进入就绪环的槽
+    uint32_t tail = header->ready_tail.load(std::memory_order_acquire);
+    uint32_t head = header->ready_head.load(std::memory_order_acquire);
+    bool queued[SHM_FRAME_RING_MAX_SLOTS] = {};
+    for (uint32_t i = tail; i != head; i++) {
+        uint32_t slot = header->ready_ring[i % m_ring.slot_num()];
+        if (slot < m_ring.slot_num()) {
+            queued[slot] = true;
+        }
+    }
+    int reclaimed = 0;
+    for (uint32_t i = 0; i < m_ring.slot_num(); i++) {
+        uint32_t state = header->slots[i].state.load(std::memory_order_acquire);
+        if (state == SHM_SLOT_WRITING || (state == SHM_SLOT_READY && !queued[i])) {
+            reclaimed += header->slots[i].state.compare_exchange_strong(state, SHM_SLOT_FREE) ? 1 : 0;
+        }
+    }
+    d_mpp_module_warn("producer reattach to %s, reclaimed %d slots", name.c_str(), reclaimed)
+}
+
+ShmFrameProducer::~ShmFrameProducer() {
+    close();
+}
+
+int ShmFrameProducer::acquire(ShmFrameSlot &frame, int timeout_ms) {
+    CHECK_VAL(!m_ring.is_init(), return -1;)
+    ShmFrameRingHeader *header = m_ring.header();
+    time_unit t_start = get_time_of_ms();
+    while (true) {
+        if (header->consumer_closed.load(std::memory_order_acquire)) {
+            return -1;
+        }
+        // 先记下归还计数，扫描不到空闲槽时等它变化，扫描之后归还的槽不会漏掉
+        uint32_t free_seq = header->free_seq.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < m_ring.slot_num(); i++) {
+            uint32_t state = SHM_SLOT_FREE;
+            if (header->slots[i].state.compare_exchange_strong(state, SHM_SLOT_WRITING,
+                                                               std::memory_order_acquire)) {
+                frame = ShmFrameSlot();
+                frame.slot = i;
+                frame.data = m_ring.slot_data(i);
+                frame.capacity = m_ring.slot_size();
+                return 0;
+            }
+        }
+        int remain_ms = -1;
+        if (timeout_ms >= 0) {
+            remain_ms = timeout_ms - (int)(get_time_of_ms() - t_start);
+            if (remain_ms <= 0) {
+                return 1;
+            }
+        }
+        header->producer_waiting.store(1, std::memory_order_seq_cst);
+        ShmFrameRing::wait(header->free_seq, free_seq, remain_ms);
+        header->producer_waiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+int ShmFrameProducer::publish(const ShmFrameSlot &frame) {
+    CHECK_VAL(!m_ring.is_init(), return -1;)
+    ShmFrameRingHeader *header = m_ring.header();
+    CHECK_VAL(frame.slot >= m_ring.slot_num(), d_mpp_module_error("invalid slot %d", (int)frame.slot); return -1;)
+    ShmFrameSlotInfo &info = header->slots[frame.slot];
+    size_t frame_size = (size_t)frame.hor_stride * frame.ver_stride * 3 / 2;
+    CHECK_VAL(frame.width == 0 || frame.height == 0 || frame.hor_stride < frame.width ||
+              frame.ver_stride < frame.height || frame_size > m_ring.slot_size(),
+              d_mpp_module_error("invalid frame %dx%d stride %dx%d in slot of %d bytes", (int)frame.width,
+                                 (int)frame.height, (int)frame.hor_stride, (int)frame.ver_stride,
+                                 (int)m_ring.slot_size()); return -1;)
+    info.width = frame.width;
+    info.height = frame.height;
+    info.hor_stride = frame.hor_stride;
+    info.ver_stride = frame.ver_stride;
+    info.format = frame.format;
+    info.frame_index = m_frame_index++;
+    info.pts_ms = frame.pts_ms;
+    info.state.store(SHM_SLOT_READY, std::memory_order_release);
+
+    // 只有一个采集进程写就绪环，槽数不超过环的长度，不会溢出
+    uint32_t head = header->ready_head.load(std::memory_order_relaxed);
+    header->ready_ring[head % m_ring.slot_num()] = frame.slot;
+    header->ready_head.store(head + 1, std::memory_order_release);
+    header->ready_seq.fetch_add(1, std::memory_order_seq_cst);
+    if (header->consumer_waiting.load(std::memory_order_seq_cst)) {
+        ShmFrameRing::wake(header->ready_seq);
+    }
+    return 0;
+}
+
+int ShmFrameProducer::push_frame(const uint8_t *data, uint32_t width, uint32_t height, ShmFrameFormat format,
+                                 int64_t pts_ms, int timeout_ms) {
+    ShmFrameSlot frame;
+    int ret = acquire(frame, timeout_ms);
+    if (ret != 0) {
+        return ret;
+    }
+    frame.width = width;
+    frame.height = height;
+    frame.hor_stride = (width + 15) & ~15u;
+    frame.ver_stride = (height + 15) & ~15u;
+    frame.format = format;
+    frame.pts_ms = pts_ms;
+    if ((size_t)frame.hor_stride * frame.ver_stride * 3 / 2 > frame.capacity) {
+        d_mpp_module_error("frame %dx%d larger than slot %d bytes", (int)width, (int)height, (int)frame.capacity)
+        m_ring.header()->slots[frame.slot].state.store(SHM_SLOT_FREE, std::memory_order_release);
+        return -1;
+    }
+    // 按步长拷贝 Y 平面和色度平面（NV12 一个交织平面，I420 两个半宽平面）
+    const uint8_t *src = data;
+    uint8_t *dst = frame.data;
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(dst + (size_t)y * frame.hor_stride, src + (size_t)y * width, width);
+    }
+    src += (size_t)width * height;
+    dst += (size_t)frame.hor_stride * frame.ver_stride;
+    if (format == SHM_FRAME_NV12) {
+        for (uint32_t y = 0; y < height / 2; y++) {
+            memcpy(dst + (size_t)y * frame.hor_stride, src + (size_t)y * width, width);
+        }
+    } else {
+        for (int plane = 0; plane < 2; plane++) {
+            for (uint32_t y = 0; y < height / 2; y++) {
+                memcpy(dst + (size_t)y * frame.hor_stride / 2, src + (size_t)y * width / 2, width / 2);
+            }
+            src += (size_t)width * height / 4;
+            dst += (size_t)frame.hor_stride * frame.ver_stride / 4;
+        }
+    }
+    return publish(frame);
+}
+
+void ShmFrameProducer::close() {
+    if (!m_ring.is_init()) {
+        return;
+    }
+    ShmFrameRingHeader *header = m_ring.header();
+    header->producer_closed.store(1, std::memory_order_release);
+    header->ready_seq.fetch_add(1, std::memory_order_seq_cst);
+    ShmFrameRing::wake(header->ready_seq);
+}
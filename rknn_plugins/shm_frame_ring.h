@@ -0,0 +1,156 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.26
+ * @brief: 跨进程共享内存帧环：推理进程创建 POSIX 共享内存（N 个帧槽 + 就绪环），
+ *         采集进程直接把帧写进空闲槽后发布，推理侧零拷贝读取，帧释放后槽归还给采集进程；
+ *         槽状态和就绪环都是共享内存中的原子变量，只有对方在等待时才用 futex 唤醒。
+ *         本文件不依赖 MPP / RKNN，可以单独编译进采集进程
+ */
+#ifndef RKNN_INFER_PLUGIN_SHM_FRAME_RING_H
+#define RKNN_INFER_PLUGIN_SHM_FRAME_RING_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#define SHM_FRAME_RING_MAGIC (0x524b4652)   // "RKFR"
+#define SHM_FRAME_RING_VERSION (1)
+#define SHM_FRAME_RING_MAX_SLOTS (64)
+// 共享内存的默认权限：只允许同一用户的采集进程连接
+#define SHM_FRAME_RING_MODE (0600)
+
+// 共享内存中的帧格式（与 MPP 格式无关，采集进程不需要 MPP 头文件）
+enum ShmFrameFormat {
+    SHM_FRAME_NV12 = 0,
+    SHM_FRAME_I420 = 1,
+};
+
+// 帧槽状态：空闲 -> 写入（采集进程） -> 就绪 -> 使用（推理进程） -> 空闲
+enum ShmSlotState {
+    SHM_SLOT_FREE = 0,
+    SHM_SLOT_WRITING = 1,
+    SHM_SLOT_READY = 2,
+    SHM_SLOT_IN_USE = 3,
+};
+
+// 每个槽中帧的描述，由采集进程在发布前填写
+struct ShmFrameSlotInfo {
+    std::atomic<uint32_t> state;
+    uint32_t width;
+    uint32_t height;
+    uint32_t hor_stride;
+    uint32_t ver_stride;
+    uint32_t format;
+    uint64_t frame_index;
+    int64_t pts_ms;
+};
+
+// 共享内存头，帧数据从 data_offset 开始，每槽 slot_size 字节
+struct ShmFrameRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t slot_size;
+    uint64_t data_offset;
+
+    // 就绪环：采集进程写 ready_head，推理进程写 ready_tail，内容为槽序号
+    std::atomic<uint32_t> ready_head;
+    std::atomic<uint32_t> ready_tail;
+    uint32_t ready_ring[SHM_FRAME_RING_MAX_SLOTS];
+    // 每发布一帧或结束输入加一，推理进程没有就绪帧时在此等待
+    std::atomic<uint32_t> ready_seq;
+    // 每归还一个槽或推理进程退出时加一，采集进程没有空闲槽时在此等待
+    std::atomic<uint32_t> free_seq;
+    // 等待标志，对方只在有人等待时才调用 futex 唤醒
+    std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint32_t> producer_waiting;
+    // 采集进程结束输入 / 推理进程退出
+    std::atomic<uint32_t> producer_closed;
+    std::atomic<uint32_t> consumer_closed;
+    // 连接过的采集进程个数（重连时回收写了一半的槽）
+    std::atomic<uint32_t> producer_attach;
+
+    ShmFrameSlotInfo slots[SHM_FRAME_RING_MAX_SLOTS];
+};
+
+// 共享内存段的映射：推理进程创建（退出时删除），采集进程按名字连接。
+// 头中的槽数、槽大小和数据偏移对方可以改写，映射时保存一份，之后只用本地的值
+class ShmFrameRing {
+public:
+    // 创建名为 name 的共享内存（例如 /rknn_frames），已存在时覆盖，mode 为共享内存的访问权限
+    ShmFrameRing(const std::string &name, uint32_t slot_num, uint32_t slot_size, uint32_t mode = SHM_FRAME_RING_MODE);
+    // 连接已经创建的共享内存
+    explicit ShmFrameRing(const std::string &name);
+    ~ShmFrameRing();
+
+    ShmFrameRing(const ShmFrameRing &) = delete;
+    ShmFrameRing &operator=(const ShmFrameRing &) = delete;
+
+    [[nodiscard]] bool is_init() const { return m_header != nullptr; };
+    [[nodiscard]] ShmFrameRingHeader *header() const { return m_header; };
+    [[nodiscard]] uint32_t slot_num() const { return m_slot_num; };
+    [[nodiscard]] uint32_t slot_size() const { return m_slot_size; };
+    [[nodiscard]] uint8_t *slot_data(uint32_t slot) const {
+        return (uint8_t *)m_header + m_data_offset + (size_t)slot * m_slot_size;
+    };
+
+    // futex 等待 *addr 不再等于 value，最多 timeout_ms（< 0 一直等），返回 false 表示超时
+    static bool wait(std::atomic<uint32_t> &addr, uint32_t value, int timeout_ms);
+    static void wake(std::atomic<uint32_t> &addr);
+
+private:
+    int map(int fd, size_t size);
+
+private:
+    std::string m_name;
+    bool m_owner = false;
+    ShmFrameRingHeader *m_header = nullptr;
+    size_t m_map_size = 0;
+    uint32_t m_slot_num = 0;
+    uint32_t m_slot_size = 0;
+    size_t m_data_offset = 0;
+};
+
+// 采集进程写入的一帧
+struct ShmFrameSlot {
+    uint32_t slot = 0;
+    uint8_t *data = nullptr;
+    uint32_t capacity = 0;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t hor_stride = 0;
+    uint32_t ver_stride = 0;
+    ShmFrameFormat format = SHM_FRAME_NV12;
+    int64_t pts_ms = 0;
+};
+
+// 采集进程使用的客户端：acquire 取空闲槽 -> 写入 data -> publish
+class ShmFrameProducer {
+public:
+    explicit ShmFrameProducer(const std::string &name);
+    ~ShmFrameProducer();
+
+    [[nodiscard]] bool is_init() const { return m_ring.is_init(); };
+
+    // 取一个空闲槽，没有空闲槽时最多等待 timeout_ms（< 0 一直等）；返回 0 成功，1 超时，-1 推理进程已退出
+    int acquire(ShmFrameSlot &frame, int timeout_ms = -1);
+
+    // 发布 acquire 得到并写好的帧（需填写尺寸、步长、格式），帧序号按发布顺序递增，返回 0 成功，-1 失败
+    int publish(const ShmFrameSlot &frame);
+
+    // 拷贝一帧紧密排列的 4:2:0 数据（步长按 16 对齐），返回值同 acquire
+    int push_frame(const uint8_t *data, uint32_t width, uint32_t height, ShmFrameFormat format,
+                   int64_t pts_ms, int timeout_ms = -1);
+
+    // 输入结束，推理侧取完已发布的帧后结束
+    void close();
+
+private:
+    ShmFrameRing m_ring;
+    uint64_t m_frame_index = 0;
+};
+
+#endif //RKNN_INFER_PLUGIN_SHM_FRAME_RING_H
@@ -0,0 +1,130 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.26
+ * @brief: 共享内存帧来源实现
+ */
+#include <algorithm>
+
+#include "shm_frame_source.h"
+#include "utils.h"
+#include "utils_log.h"
+
+// 按对齐后的步长计算一个 4:2:0 帧的大小
+static uint32_t shm_slot_size(const FrameSourceOptions &options) {
+    uint32_t align = std::max<uint32_t>(options.stride_align, 2);
+    uint32_t width = options.width > 0 ? options.width : 1920;
+    uint32_t height = options.height > 0 ? options.height : 1080;
+    uint32_t hor_stride = (width + align - 1) / align * align;
+    uint32_t ver_stride = (height + align - 1) / align * align;
+    return hor_stride * ver_stride * 3 / 2;
+}
+
+ShmFrameSource::ShmFrameSource(const std::string &name, const FrameSourceOptions &options)
+        : m_ring(name, (uint32_t)std::min(std::max(options.max_frames, 1), SHM_FRAME_RING_MAX_SLOTS),
+                 shm_slot_size(options), options.shm_mode) {
+}
+
+ShmFrameSource::~ShmFrameSource() {
+    if (!m_ring.is_init()) {
+        return;
+    }
+    ShmFrameRingHeader *header = m_ring.header();
+    header->consumer_closed.store(1, std::memory_order_release);
+    header->free_seq.fetch_add(1, std::memory_order_seq_cst);
+    ShmFrameRing::wake(header->free_seq);
+}
+
+bool ShmFrameSource::check_frame_size(const DecoderMppFrame &frame) const {
+    return frame.hor_width > 0 && frame.ver_height > 0 &&
+           frame.hor_stride >= frame.hor_width && frame.ver_stride >= frame.ver_height &&
+           (uint64_t)frame.hor_stride * frame.ver_stride * 3 / 2 <= m_ring.slot_size();
+}
+
+int ShmFrameSource::get_next_frame(DecoderMppFrame &frame, int timeout_ms) {
+    CHECK_VAL(!m_ring.is_init(), d_mpp_module_error("shm frame ring is not init"); return -1;)
+    std::lock_guard<std::mutex> read_lock(m_read_mutex);
+    ShmFrameRingHeader *header = m_ring.header();
+    time_unit t_start = getTimeOfNs();
+    while (true) {
+        // 先记下发布计数再检查就绪环，检查之后发布的帧会让等待立即返回
+        uint32_t seq = header->ready_seq.load(std::memory_order_acquire);
+        uint32_t tail = header->ready_tail.load(std::memory_order_relaxed);
+        if (tail != header->ready_head.load(std::memory_order_acquire)) {
+            // 就绪环和槽描述由采集进程写入，不可信：槽序号和尺寸先拷贝到本地再检查
+            uint32_t slot = header->ready_ring[tail % m_ring.slot_num()];
+            if (slot >= m_ring.slot_num()) {
+                d_mpp_module_error("shm frame ring got invalid slot %u", slot)
+                header->ready_tail.store(tail + 1, std::memory_order_release);
+                continue;
+            }
+            ShmFrameSlotInfo &info = header->slots[slot];
+            // 先标记使用再移动读位置，采集进程重连时不会回收该槽
+            info.state.store(SHM_SLOT_IN_USE, std::memory_order_relaxed);
+            header->ready_tail.store(tail + 1, std::memory_order_release);
+
+            frame.hor_width = info.width;
+            frame.ver_height = info.height;
+            frame.hor_stride = info.hor_stride;
+            frame.ver_stride = info.ver_stride;
+            frame.mpp_frame = (MppFrame)&info;
+            if (!check_frame_size(frame)) {
+                d_mpp_module_error("shm frame %ux%u stride %ux%u does not fit slot of %u bytes", frame.hor_width,
+                                   frame.ver_height, frame.hor_stride, frame.ver_stride, m_ring.slot_size())
+                release_frame(frame);
+                continue;
+            }
+            frame.data_fd = -1;
+            frame.data_buf = m_ring.slot_data(slot);
+            frame.data_size = m_ring.slot_size();
+            frame.mpp_frame_format = info.format == SHM_FRAME_I420 ? MPP_FMT_YUV420P : MPP_FMT_YUV420SP;
+            frame.frame_index = info.frame_index;
+            frame.pts_ms = info.pts_ms;
+            frame.decode_latency_us = 0;
+            m_frames++;
+            m_wait_ns += getTimeOfNs() - t_start;
+            return 0;
+        }
+        if (header->producer_closed.load(std::memory_order_acquire)) {
+            return -1;
+        }
+        int remain_ms = -1;
+        if (timeout_ms >= 0) {
+            remain_ms = timeout_ms - (int)((getTimeOfNs() - t_start) / 1000000);
+            if (remain_ms <= 0) {
+                m_wait_ns += getTimeOfNs() - t_start;
+                return 1;
+            }
+        }
+        header->consumer_waiting.store(1, std::memory_order_seq_cst);
+        ShmFrameRing::wait(header->ready_seq, seq, remain_ms);
+        header->consumer_waiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ShmFrameSource::release_frame(DecoderMppFrame &frame) {
+    auto *info = (ShmFrameSlotInfo *)frame.mpp_frame;
+    if (info == nullptr || !m_ring.is_init()) {
+        return;
+    }
+    ShmFrameRingHeader *header = m_ring.header();
+    info->state.store(SHM_SLOT_FREE, std::memory_order_release);
+    header->free_seq.fetch_add(1, std::memory_order_seq_cst);
+    if (header->producer_waiting.load(std::memory_order_seq_cst)) {
+        ShmFrameRing::wake(header->free_seq);
+    }
+    frame.mpp_frame = nullptr;
+}
+
+MppDecoderStats ShmFrameSource::get_stats() const {
+    MppDecoderStats stats;
+    if (!m_ring.is_init()) {
+        return stats;
+    }
+    ShmFrameRingHeader *header = m_ring.header();
+    stats.decoded_frames = m_frames;
+    stats.queue_capacity = (int)m_ring.slot_num();
+    stats.queue_size = (int)(header->ready_head.load() - header->ready_tail.load());
+    stats.consumer_wait_ms = (double)m_wait_ns / 1e6;
+    return stats;
+}
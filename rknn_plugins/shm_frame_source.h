@@ -0,0 +1,46 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.26
+ * @brief: 共享内存帧来源：推理侧创建帧环，外部采集进程用 ShmFrameProducer 写入，
+ *         取到的帧直接指向共享内存，release_frame 后槽归还给采集进程
+ */
+#ifndef RKNN_INFER_PLUGIN_SHM_FRAME_SOURCE_H
+#define RKNN_INFER_PLUGIN_SHM_FRAME_SOURCE_H
+
+#include <mutex>
+#include <atomic>
+
+#include "frame_source.h"
+#include "shm_frame_ring.h"
+
+class ShmFrameSource : public FrameSource {
+public:
+    // 创建名为 name 的帧环：options.max_frames 个槽，每槽可放 options.width x options.height 的 4:2:0 帧
+    // （步长按 options.stride_align 对齐，没有设置尺寸时按 1080p）
+    ShmFrameSource(const std::string &name, const FrameSourceOptions &options);
+    // 通知采集进程推理侧已退出
+    ~ShmFrameSource() override;
+
+    [[nodiscard]] bool is_init() const override { return m_ring.is_init(); };
+
+    // 采集进程结束输入且已取完时返回 -1
+    int get_next_frame(DecoderMppFrame &frame, int timeout_ms = -1) override;
+
+    void release_frame(DecoderMppFrame &frame) override;
+
+    [[nodiscard]] MppDecoderStats get_stats() const override;
+
+private:
+    // 采集进程填写的尺寸和步长放得进槽
+    [[nodiscard]] bool check_frame_size(const DecoderMppFrame &frame) const;
+
+private:
+    ShmFrameRing m_ring;
+    // 同一时间只有一个线程取帧（就绪环只有一个读者），释放帧可以在任意线程
+    std::mutex m_read_mutex;
+    std::atomic<uint64_t> m_frames{0};
+    std::atomic<uint64_t> m_wait_ns{0};
+};
+
+#endif //RKNN_INFER_PLUGIN_SHM_FRAME_SOURCE_H
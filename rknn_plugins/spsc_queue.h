@@ -0,0 +1,142 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.22
+ * @brief: 单生产者单消费者无锁环形队列，入队出队只用原子下标；
+ *         队列空/满时可以带超时等待，只有等待方存在时才会加锁唤醒
+ */
+#ifndef RKNN_INFER_PLUGIN_SPSC_QUEUE_H
+#define RKNN_INFER_PLUGIN_SPSC_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <cstddef>
+#include <condition_variable>
+
+template<typename T>
+class SpscQueue {
+public:
+    // 容量向上取整到 2 的幂
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    [[nodiscard]] size_t capacity() const { return m_slots.size(); }
+
+    // 当前元素个数（并发时为近似值）
+    [[nodiscard]] size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool is_closed() const { return m_closed.load(std::memory_order_acquire); }
+
+    // 生产者调用，队列满时返回 false
+    bool try_push(const T &value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= m_slots.size()) {
+            return false;
+        }
+        m_slots[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        notify(m_pop_waiting);
+        return true;
+    }
+
+    // 消费者调用，队列空时返回 false
+    bool try_pop(T &value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_slots[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        notify(m_push_waiting);
+        return true;
+    }
+
+    // 队列满时最多等待 timeout_ms（< 0 一直等），关闭或超时返回 false
+    bool push(const T &value, int timeout_ms) {
+        while (!try_push(value)) {
+            if (!wait(m_push_waiting, timeout_ms, [this] {
+                return size() < m_slots.size();
+            })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 队列空时最多等待 timeout_ms（< 0 一直等），超时或关闭且已取空返回 false
+    bool pop(T &value, int timeout_ms) {
+        while (!try_pop(value)) {
+            if (!wait(m_pop_waiting, timeout_ms, [this] {
+                return size() > 0;
+            })) {
+                // 关闭前入队的元素仍然可以取出
+                return try_pop(value);
+            }
+        }
+        return true;
+    }
+
+    // 关闭后等待方全部返回，push 不再等待
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            m_closed.store(true, std::memory_order_release);
+        }
+        m_wait_cond.notify_all();
+    }
+
+private:
+    template<typename Pred>
+    bool wait(std::atomic<bool> &waiting, int timeout_ms, Pred ready) {
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        // 先声明等待再检查条件，和 notify 中先修改下标再检查等待标志配对，不会丢失唤醒
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto pred = [this, &ready] { return ready() || is_closed(); };
+        bool ok;
+        if (timeout_ms < 0) {
+            m_wait_cond.wait(lock, pred);
+            ok = true;
+        } else {
+            ok = m_wait_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), pred);
+        }
+        waiting.store(false, std::memory_order_relaxed);
+        return ok && !is_closed();
+    }
+
+    void notify(std::atomic<bool> &waiting) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            // 加锁保证等待方要么还没检查条件，要么已经进入等待
+            { std::lock_guard<std::mutex> lock(m_wait_mutex); }
+            m_wait_cond.notify_all();
+        }
+    }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_mask = 0;
+    // 读写下标分开缓存行，避免生产者和消费者互相失效
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) std::atomic<bool> m_pop_waiting{false};
+    std::atomic<bool> m_push_waiting{false};
+    std::atomic<bool> m_closed{false};
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cond;
+};
+
+#endif //RKNN_INFER_PLUGIN_SPSC_QUEUE_H
@@ -0,0 +1,115 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.15
+ * @brief: 插件内部使用的小型工作线程池，一次提交一批任务，调用线程也参与执行并等待整批完成
+ */
+#ifndef RKNN_INFER_PLUGIN_TASK_POOL_H
+#define RKNN_INFER_PLUGIN_TASK_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+class TaskPool {
+public:
+    explicit TaskPool(int thread_num) {
+        for (int i = 0; i < thread_num; i++) {
+            m_workers.emplace_back(&TaskPool::worker_loop, this);
+        }
+    }
+
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_stop_flag = true;
+        }
+        m_queue_cond.notify_all();
+        for (auto &worker : m_workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    [[nodiscard]] int thread_num() const { return (int)m_workers.size(); }
+
+    /**
+     * @brief 执行一批任务 task(0) ... task(task_num - 1)，返回时全部执行完成，多个线程可同时提交
+     */
+    void run(int task_num, const std::function<void(int)> &task) {
+        if (task_num <= 0) {
+            return;
+        }
+        auto batch = std::make_shared<TaskBatch>();
+        batch->task = &task;
+        batch->task_num = task_num;
+        if (!m_workers.empty() && task_num > 1) {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_batches.push_back(batch);
+        }
+        m_queue_cond.notify_all();
+
+        // 调用线程同样领取任务，保证线程池繁忙时也能推进
+        run_batch(*batch);
+        std::unique_lock<std::mutex> lock(batch->done_mutex);
+        batch->done_cond.wait(lock, [&batch] { return batch->done_num.load() == batch->task_num; });
+    }
+
+private:
+    struct TaskBatch {
+        const std::function<void(int)> *task = nullptr;
+        int task_num = 0;
+        std::atomic<int> next_index{0};
+        std::atomic<int> done_num{0};
+        std::mutex done_mutex;
+        std::condition_variable done_cond;
+    };
+
+    static void run_batch(TaskBatch &batch) {
+        int index;
+        while ((index = batch.next_index.fetch_add(1)) < batch.task_num) {
+            (*batch.task)(index);
+            if (batch.done_num.fetch_add(1) + 1 == batch.task_num) {
+                std::lock_guard<std::mutex> lock(batch.done_mutex);
+                batch.done_cond.notify_all();
+            }
+        }
+    }
+
+    void worker_loop() {
+        while (true) {
+            std::shared_ptr<TaskBatch> batch;
+            {
+                std::unique_lock<std::mutex> lock(m_queue_mutex);
+                m_queue_cond.wait(lock, [this] { return m_stop_flag || !m_batches.empty(); });
+                if (m_stop_flag) {
+                    return;
+                }
+                batch = m_batches.front();
+                // 任务已被领完的批次出队
+                if (batch->next_index.load() >= batch->task_num) {
+                    m_batches.pop_front();
+                    continue;
+                }
+            }
+            run_batch(*batch);
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::shared_ptr<TaskBatch>> m_batches;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cond;
+    bool m_stop_flag = false;
+};
+
+#endif //RKNN_INFER_PLUGIN_TASK_POOL_H
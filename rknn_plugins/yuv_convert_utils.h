@@ -0,0 +1,331 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.16
+ * @brief: CPU 上的 YUV420（NV12 / I420）转 RGB，颜色转换、双线性缩放和 letterbox 填充在一次遍历中完成，
+ *         直接读取带步长的解码帧，直接写入模型输入（NHWC / NCHW），RGA 不可用或繁忙时作为兜底
+ */
+#ifndef RKNN_INFER_PLUGIN_YUV_CONVERT_UTILS_H
+#define RKNN_INFER_PLUGIN_YUV_CONVERT_UTILS_H
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "rknn_api.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_CONVERT_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUV_CONVERT_USE_SSE2
+#endif
+
+// 双线性插值权重的小数位数
+#define YUV_RESIZE_WEIGHT_BITS 7
+#define YUV_RESIZE_WEIGHT_ONE (1 << YUV_RESIZE_WEIGHT_BITS)
+
+// YUV 平面排布
+enum YuvPlaneLayout {
+    // Y 平面 + UV 交织平面，行步长都为 hor_stride
+    YUV_LAYOUT_NV12,
+    // Y、U、V 三个平面，U、V 行步长为 hor_stride / 2
+    YUV_LAYOUT_I420,
+};
+
+// 带步长的 YUV420 帧
+struct YuvFrameView {
+    const uint8_t *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t hor_stride;
+    uint32_t ver_stride;
+    YuvPlaneLayout layout;
+};
+
+// 缩放结果在模型输入中的位置，用于把检测框映射回原图：x_src = (x_dst - pad_left) / scale_w
+struct LetterboxInfo {
+    float scale_w;
+    float scale_h;
+    int pad_left;
+    int pad_top;
+    int resized_w;
+    int resized_h;
+};
+
+/**
+ * @brief 一行 YUV 转 RGB（BT.601 limited range，6 位定点，标量实现）
+ *        R = (74 * (Y - 16) + 102 * (V - 128) + 32) >> 6
+ *        G = (74 * (Y - 16) - 52 * (V - 128) - 25 * (U - 128) + 32) >> 6
+ *        B = (74 * (Y - 16) + 129 * (U - 128) + 32) >> 6
+ */
+static inline void yuv_to_rgb_row_c(const uint8_t *y_row, const uint8_t *u_row, const uint8_t *v_row,
+                                    uint8_t *r_row, uint8_t *g_row, uint8_t *b_row, int count) {
+    for (int i = 0; i < count; i++) {
+        int y = 74 * ((int)y_row[i] - 16) + 32;
+        int u = (int)u_row[i] - 128;
+        int v = (int)v_row[i] - 128;
+        int r = (y + 102 * v) >> 6;
+        int g = (y - 52 * v - 25 * u) >> 6;
+        int b = (y + 129 * u) >> 6;
+        r_row[i] = (uint8_t)(r < 0 ? 0 : (r > 255 ? 255 : r));
+        g_row[i] = (uint8_t)(g < 0 ? 0 : (g > 255 ? 255 : g));
+        b_row[i] = (uint8_t)(b < 0 ? 0 : (b > 255 ? 255 : b));
+    }
+}
+
+/**
+ * @brief 一行 YUV 转 RGB，NEON / SSE2 每次处理 8 个像素，结果与标量实现逐位一致
+ */
+static inline void yuv_to_rgb_row(const uint8_t *y_row, const uint8_t *u_row, const uint8_t *v_row,
+                                  uint8_t *r_row, uint8_t *g_row, uint8_t *b_row, int count) {
+    int i = 0;
+#if defined(YUV_CONVERT_USE_NEON)
+    const int16x8_t c16 = vdupq_n_s16(16);
+    const int16x8_t c128 = vdupq_n_s16(128);
+    const int32x4_t c32 = vdupq_n_s32(32);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y_row + i))), c16);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u_row + i))), c128);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v_row + i))), c128);
+        int32x4_t y_lo = vmlal_n_s16(c32, vget_low_s16(y), 74);
+        int32x4_t y_hi = vmlal_n_s16(c32, vget_high_s16(y), 74);
+
+        int32x4_t r_lo = vmlal_n_s16(y_lo, vget_low_s16(v), 102);
+        int32x4_t r_hi = vmlal_n_s16(y_hi, vget_high_s16(v), 102);
+        int32x4_t g_lo = vmlal_n_s16(vmlal_n_s16(y_lo, vget_low_s16(v), -52), vget_low_s16(u), -25);
+        int32x4_t g_hi = vmlal_n_s16(vmlal_n_s16(y_hi, vget_high_s16(v), -52), vget_high_s16(u), -25);
+        int32x4_t b_lo = vmlal_n_s16(y_lo, vget_low_s16(u), 129);
+        int32x4_t b_hi = vmlal_n_s16(y_hi, vget_high_s16(u), 129);
+
+        vst1_u8(r_row + i, vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(r_lo, 6)), vqmovn_s32(vshrq_n_s32(r_hi, 6)))));
+        vst1_u8(g_row + i, vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(g_lo, 6)), vqmovn_s32(vshrq_n_s32(g_hi, 6)))));
+        vst1_u8(b_row + i, vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(b_lo, 6)), vqmovn_s32(vshrq_n_s32(b_hi, 6)))));
+    }
+#elif defined(YUV_CONVERT_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c16 = _mm_set1_epi16(16);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i c32 = _mm_set1_epi32(32);
+    // 成对系数，配合 _mm_madd_epi16 一次完成两项乘加
+    const __m128i coef_r = _mm_set_epi16(102, 74, 102, 74, 102, 74, 102, 74);
+    const __m128i coef_b = _mm_set_epi16(129, 74, 129, 74, 129, 74, 129, 74);
+    const __m128i coef_g_yv = _mm_set_epi16(-52, 74, -52, 74, -52, 74, -52, 74);
+    const __m128i coef_g_u = _mm_set_epi16(0, -25, 0, -25, 0, -25, 0, -25);
+    for (; i + 8 <= count; i += 8) {
+        __m128i y = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y_row + i)), zero), c16);
+        __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u_row + i)), zero), c128);
+        __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v_row + i)), zero), c128);
+        __m128i yv_lo = _mm_unpacklo_epi16(y, v);
+        __m128i yv_hi = _mm_unpackhi_epi16(y, v);
+        __m128i yu_lo = _mm_unpacklo_epi16(y, u);
+        __m128i yu_hi = _mm_unpackhi_epi16(y, u);
+        __m128i u0_lo = _mm_unpacklo_epi16(u, zero);
+        __m128i u0_hi = _mm_unpackhi_epi16(u, zero);
+
+        __m128i r_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_lo, coef_r), c32), 6);
+        __m128i r_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_hi, coef_r), c32), 6);
+        __m128i g_lo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yv_lo, coef_g_yv),
+                                                                  _mm_madd_epi16(u0_lo, coef_g_u)), c32), 6);
+        __m128i g_hi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yv_hi, coef_g_yv),
+                                                                  _mm_madd_epi16(u0_hi, coef_g_u)), c32), 6);
+        __m128i b_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu_lo, coef_b), c32), 6);
+        __m128i b_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu_hi, coef_b), c32), 6);
+
+        __m128i r = _mm_packs_epi32(r_lo, r_hi);
+        __m128i g = _mm_packs_epi32(g_lo, g_hi);
+        __m128i b = _mm_packs_epi32(b_lo, b_hi);
+        _mm_storel_epi64((__m128i *)(r_row + i), _mm_packus_epi16(r, r));
+        _mm_storel_epi64((__m128i *)(g_row + i), _mm_packus_epi16(g, g));
+        _mm_storel_epi64((__m128i *)(b_row + i), _mm_packus_epi16(b, b));
+    }
+#endif
+    yuv_to_rgb_row_c(y_row + i, u_row + i, v_row + i, r_row + i, g_row + i, b_row + i, count - i);
+}
+
+// 双线性插值的源坐标：整数位置和小数权重（与 cv::INTER_LINEAR 相同的像素中心对齐）
+struct YuvResizeCoord {
+    int p0;
+    int p1;
+    int w1;
+};
+
+static inline void yuv_resize_coords(int dst_len, int src_len, float scale, std::vector<YuvResizeCoord> &coords) {
+    coords.resize(dst_len);
+    for (int d = 0; d < dst_len; d++) {
+        float s = ((float)d + 0.5f) / scale - 0.5f;
+        s = s < 0 ? 0 : s;
+        int p0 = (int)s;
+        if (p0 >= src_len - 1) {
+            coords[d] = {src_len - 1, src_len - 1, 0};
+            continue;
+        }
+        coords[d].p0 = p0;
+        coords[d].p1 = p0 + 1;
+        coords[d].w1 = (int)lroundf((s - (float)p0) * YUV_RESIZE_WEIGHT_ONE);
+    }
+}
+
+// 插值结果的舍入：两次权重相乘共 2 * YUV_RESIZE_WEIGHT_BITS 位小数
+static inline uint8_t yuv_bilinear(int a, int b, int c, int d, int wx, int wy) {
+    int top = a * (YUV_RESIZE_WEIGHT_ONE - wx) + b * wx;
+    int bottom = c * (YUV_RESIZE_WEIGHT_ONE - wx) + d * wx;
+    return (uint8_t)((top * (YUV_RESIZE_WEIGHT_ONE - wy) + bottom * wy +
+                      (1 << (2 * YUV_RESIZE_WEIGHT_BITS - 1))) >> (2 * YUV_RESIZE_WEIGHT_BITS));
+}
+
+/**
+ * @brief 带步长的 YUV420 帧转换、缩放到模型输入（RGB888，NHWC 或 NCHW）
+ * @param frame 解码帧（宽高需为偶数）
+ * @param dst 模型输入，大小 dst_w * dst_h * 3
+ * @param dst_layout RKNN_TENSOR_NHWC 或 RKNN_TENSOR_NCHW
+ * @param keep_ratio true 时等比例缩放并居中填充 pad_value（letterbox），false 时拉伸到整个输入
+ * @param info 缩放结果的位置，可为空
+ */
+static int yuv_to_rgb_resize(
+        const YuvFrameView &frame,
+        uint8_t *dst, int dst_w, int dst_h,
+        rknn_tensor_format dst_layout,
+        bool keep_ratio,
+        uint8_t pad_value,
+        LetterboxInfo *info) {
+    if (frame.data == nullptr || dst == nullptr || frame.width < 2 || frame.height < 2 || dst_w <= 0 || dst_h <= 0) {
+        return -1;
+    }
+    if (dst_layout != RKNN_TENSOR_NHWC && dst_layout != RKNN_TENSOR_NCHW) {
+        return -1;
+    }
+
+    // 缩放比例和 letterbox 位置
+    float scale_w = (float)dst_w / (float)frame.width;
+    float scale_h = (float)dst_h / (float)frame.height;
+    int resized_w = dst_w;
+    int resized_h = dst_h;
+    if (keep_ratio) {
+        scale_w = scale_h = std::min(scale_w, scale_h);
+        resized_w = std::min(std::max((int)lroundf((float)frame.width * scale_w), 1), dst_w);
+        resized_h = std::min(std::max((int)lroundf((float)frame.height * scale_h), 1), dst_h);
+    }
+    const int pad_left = (dst_w - resized_w) / 2;
+    const int pad_top = (dst_h - resized_h) / 2;
+    if (info != nullptr) {
+        *info = {scale_w, scale_h, pad_left, pad_top, resized_w, resized_h};
+    }
+
+    // 各平面位置，色度坐标相对亮度坐标减半
+    const uint8_t *y_plane = frame.data;
+    const uint8_t *c_plane = frame.data + frame.hor_stride * frame.ver_stride;
+    const uint8_t *v_plane = c_plane + frame.hor_stride * frame.ver_stride / 4;
+    const int c_stride = frame.layout == YUV_LAYOUT_NV12 ? (int)frame.hor_stride : (int)frame.hor_stride / 2;
+    const int c_width = (int)frame.width / 2;
+    const int c_height = (int)frame.height / 2;
+
+    // 每个线程复用坐标表和行缓存
+    thread_local std::vector<YuvResizeCoord> x_coords, y_coords, cx_coords, cy_coords;
+    thread_local std::vector<uint8_t> row_buf;
+    yuv_resize_coords(resized_w, (int)frame.width, scale_w, x_coords);
+    yuv_resize_coords(resized_h, (int)frame.height, scale_h, y_coords);
+    // 色度平面相对输出的缩放比例是亮度的两倍：源坐标 (d + 0.5) / (2 * scale) - 0.5
+    yuv_resize_coords(resized_w, c_width, scale_w * 2, cx_coords);
+    yuv_resize_coords(resized_h, c_height, scale_h * 2, cy_coords);
+    row_buf.resize(resized_w * 6);
+    uint8_t *y_row = row_buf.data();
+    uint8_t *u_row = y_row + resized_w;
+    uint8_t *v_row = u_row + resized_w;
+    uint8_t *r_row = v_row + resized_w;
+    uint8_t *g_row = r_row + resized_w;
+    uint8_t *b_row = g_row + resized_w;
+
+    // letterbox 填充区域
+    const size_t plane_size = (size_t)dst_w * dst_h;
+    if (resized_w != dst_w || resized_h != dst_h) {
+        if (dst_layout == RKNN_TENSOR_NHWC) {
+            memset(dst, pad_value, pad_top * dst_w * 3);
+            memset(dst + (size_t)(pad_top + resized_h) * dst_w * 3, pad_value,
+                   (size_t)(dst_h - pad_top - resized_h) * dst_w * 3);
+        } else {
+            for (int c = 0; c < 3; c++) {
+                uint8_t *plane = dst + c * plane_size;
+                memset(plane, pad_value, pad_top * dst_w);
+                memset(plane + (size_t)(pad_top + resized_h) * dst_w, pad_value,
+                       (size_t)(dst_h - pad_top - resized_h) * dst_w);
+            }
+        }
+    }
+
+    for (int dy = 0; dy < resized_h; dy++) {
+        // 只读取源图中需要的两行亮度和两行色度
+        const YuvResizeCoord &yc = y_coords[dy];
+        const YuvResizeCoord &cyc = cy_coords[dy];
+        const uint8_t *y0 = y_plane + yc.p0 * frame.hor_stride;
+        const uint8_t *y1 = y_plane + yc.p1 * frame.hor_stride;
+        for (int dx = 0; dx < resized_w; dx++) {
+            const YuvResizeCoord &xc = x_coords[dx];
+            y_row[dx] = yuv_bilinear(y0[xc.p0], y0[xc.p1], y1[xc.p0], y1[xc.p1], xc.w1, yc.w1);
+        }
+        if (frame.layout == YUV_LAYOUT_NV12) {
+            const uint8_t *c0 = c_plane + cyc.p0 * c_stride;
+            const uint8_t *c1 = c_plane + cyc.p1 * c_stride;
+            for (int dx = 0; dx < resized_w; dx++) {
+                const YuvResizeCoord &xc = cx_coords[dx];
+                const int a = xc.p0 * 2;
+                const int b = xc.p1 * 2;
+                u_row[dx] = yuv_bilinear(c0[a], c0[b], c1[a], c1[b], xc.w1, cyc.w1);
+                v_row[dx] = yuv_bilinear(c0[a + 1], c0[b + 1], c1[a + 1], c1[b + 1], xc.w1, cyc.w1);
+            }
+        } else {
+            const uint8_t *u0 = c_plane + cyc.p0 * c_stride;
+            const uint8_t *u1 = c_plane + cyc.p1 * c_stride;
+            const uint8_t *v0 = v_plane + cyc.p0 * c_stride;
+            const uint8_t *v1 = v_plane + cyc.p1 * c_stride;
+            for (int dx = 0; dx < resized_w; dx++) {
+                const YuvResizeCoord &xc = cx_coords[dx];
+                u_row[dx] = yuv_bilinear(u0[xc.p0], u0[xc.p1], u1[xc.p0], u1[xc.p1], xc.w1, cyc.w1);
+                v_row[dx] = yuv_bilinear(v0[xc.p0], v0[xc.p1], v1[xc.p0], v1[xc.p1], xc.w1, cyc.w1);
+            }
+        }
+
+        const int out_y = pad_top + dy;
+        if (dst_layout == RKNN_TENSOR_NCHW) {
+            // 直接写入三个通道平面
+            uint8_t *r_out = dst + (size_t)out_y * dst_w;
+            uint8_t *g_out = r_out + plane_size;
+            uint8_t *b_out = g_out + plane_size;
+            memset(r_out, pad_value, pad_left);
+            memset(g_out, pad_value, pad_left);
+            memset(b_out, pad_value, pad_left);
+            yuv_to_rgb_row(y_row, u_row, v_row, r_out + pad_left, g_out + pad_left, b_out + pad_left, resized_w);
+            int right = dst_w - pad_left - resized_w;
+            memset(r_out + pad_left + resized_w, pad_value, right);
+            memset(g_out + pad_left + resized_w, pad_value, right);
+            memset(b_out + pad_left + resized_w, pad_value, right);
+        } else {
+            yuv_to_rgb_row(y_row, u_row, v_row, r_row, g_row, b_row, resized_w);
+            uint8_t *out = dst + (size_t)out_y * dst_w * 3;
+            memset(out, pad_value, pad_left * 3);
+            uint8_t *pixel = out + pad_left * 3;
+            int dx = 0;
+#if defined(YUV_CONVERT_USE_NEON)
+            for (; dx + 16 <= resized_w; dx += 16) {
+                uint8x16x3_t rgb;
+                rgb.val[0] = vld1q_u8(r_row + dx);
+                rgb.val[1] = vld1q_u8(g_row + dx);
+                rgb.val[2] = vld1q_u8(b_row + dx);
+                vst3q_u8(pixel + dx * 3, rgb);
+            }
+#endif
+            for (; dx < resized_w; dx++) {
+                pixel[dx * 3 + 0] = r_row[dx];
+                pixel[dx * 3 + 1] = g_row[dx];
+                pixel[dx * 3 + 2] = b_row[dx];
+            }
+            memset(pixel + resized_w * 3, pad_value, (dst_w - pad_left - resized_w) * 3);
+        }
+    }
+    return 0;
+}
+
+#endif //RKNN_INFER_PLUGIN_YUV_CONVERT_UTILS_H
@@ -0,0 +1,136 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.18
+ * @brief: 后台写文件测试，写入内容和读回内容一致（普通写入 / O_DIRECT / 只按块写出），
+ *         以及模拟编码码流时调用线程上 fwrite 和异步写入的耗时对比
+ */
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "async_file_writer.h"
+
+#define TEST_FILE_PATH "test_async_file_writer.bin"
+#define TEST_PACKET_NUM 3000
+#define TEST_PACKET_INTERVAL_US 1000
+
+static int read_file(const char *path, std::vector<uint8_t> &data) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    data.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return n == data.size() ? 0 : -1;
+}
+
+// 模拟编码器输出的包大小：每 60 帧一个大的关键帧
+static void gen_packets(std::vector<std::vector<uint8_t>> &packets, uint32_t seed) {
+    std::mt19937 rng(seed);
+    packets.resize(TEST_PACKET_NUM);
+    for (int i = 0; i < TEST_PACKET_NUM; i++) {
+        size_t size = i % 60 == 0 ? 150000 + rng() % 50000 : 1000 + rng() % 30000;
+        packets[i].resize(size);
+        for (auto &v : packets[i]) {
+            v = (uint8_t)rng();
+        }
+    }
+}
+
+int test_write_content() {
+    std::vector<std::vector<uint8_t>> packets;
+    gen_packets(packets, 37);
+    std::vector<uint8_t> expect;
+    for (const auto &packet : packets) {
+        expect.insert(expect.end(), packet.begin(), packet.end());
+    }
+
+    AsyncFileWriterConfig configs[3];
+    // 缓冲区很小，调用方会频繁等待
+    configs[0].buffer_size = 512 << 10;
+    configs[0].chunk_size = 128 << 10;
+    configs[1] = configs[0];
+    configs[1].direct_io = true;
+    configs[2].flush_interval_ms = 0;
+    const char *config_names[3] = {"small ring", "direct io", "chunk only"};
+    for (int c = 0; c < 3; c++) {
+        uint64_t stall_count;
+        {
+            AsyncFileWriter writer(TEST_FILE_PATH, configs[c]);
+            if (!writer.is_init()) {
+                d_unit_test_error("async writer init failed")
+                return -1;
+            }
+            for (size_t i = 0; i < packets.size(); i++) {
+                writer.write(packets[i].data(), packets[i].size());
+                if (i % 500 == 0) {
+                    writer.flush();
+                }
+            }
+            stall_count = writer.stall_count();
+        }
+        std::vector<uint8_t> result;
+        if (read_file(TEST_FILE_PATH, result) != 0 || result != expect) {
+            d_unit_test_error("%s: file content mismatch, size %d vs %d",
+                              config_names[c], (int)result.size(), (int)expect.size())
+            return -1;
+        }
+        d_unit_test_info("%s: content pass, %.1f MB, stall count: %llu",
+                         config_names[c], (double)expect.size() / 1e6, (unsigned long long)stall_count)
+    }
+    remove(TEST_FILE_PATH);
+    return 0;
+}
+
+int test_caller_latency() {
+    std::vector<std::vector<uint8_t>> packets;
+    gen_packets(packets, 38);
+
+    // 原有方式：调用线程上 fwrite
+    time_unit max_sync = 0;
+    time_unit t_sync = 0;
+    FILE *fp = fopen(TEST_FILE_PATH, "wb+");
+    for (const auto &packet : packets) {
+        time_unit t0 = getTimeOfNs();
+        fwrite(packet.data(), 1, packet.size(), fp);
+        time_unit t = getTimeOfNs() - t0;
+        max_sync = std::max(max_sync, t);
+        t_sync += t;
+        // 按固定间隔产生码流，和编码器输出节奏一致
+        sleepUS(TEST_PACKET_INTERVAL_US);
+    }
+    fclose(fp);
+
+    time_unit max_async = 0;
+    time_unit t_async = 0;
+    {
+        AsyncFileWriter writer(TEST_FILE_PATH);
+        for (const auto &packet : packets) {
+            time_unit t0 = getTimeOfNs();
+            writer.write(packet.data(), packet.size());
+            time_unit t = getTimeOfNs() - t0;
+            max_async = std::max(max_async, t);
+            t_async += t;
+            sleepUS(TEST_PACKET_INTERVAL_US);
+        }
+    }
+    remove(TEST_FILE_PATH);
+    d_unit_test_warn("%d packets caller time: fwrite avg %.2f us max %.2f us, async avg %.2f us max %.2f us",
+                     TEST_PACKET_NUM,
+                     (double)t_sync / TEST_PACKET_NUM / 1e3, (double)max_sync / 1e3,
+                     (double)t_async / TEST_PACKET_NUM / 1e3, (double)max_async / 1e3)
+    return 0;
+}
+
+int main() {
+    int ret = test_write_content();
+    ret |= test_caller_latency();
+    return ret;
+}
@@ -0,0 +1,401 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.19
+ * @brief: 编码码流输出测试：分段文件（同步 / 后台写线程）、内存环形缓冲导出片段、
+ *         命名管道和 Unix socket（包括读取过慢时丢包后从关键帧重新同步）
+ */
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "encoder_sink.h"
+
+#define TEST_PACKET_NUM 300
+#define TEST_GOP 30
+#define TEST_FRAME_MS 33
+#define TEST_SEGMENT_PATH "test_encoder_sink.h264"
+#define TEST_FIFO_PATH "test_encoder_sink.fifo"
+#define TEST_SOCKET_PATH "test_encoder_sink.sock"
+
+// 码流头以 0 开头，包以 0xA5 开头，解析时可以区分
+static const uint8_t g_header[8] = {0x00, 0x00, 0x00, 0x01, 'H', 'D', 'R', 0x00};
+
+static size_t packet_size(int index) {
+    return index % TEST_GOP == 0 ? 60000 : 200 + (index * 7919) % 5000;
+}
+
+// 包内容：0xA5 + 24 位序号，其余字节由序号决定
+static void make_packet(int index, std::vector<uint8_t> &data) {
+    data.resize(packet_size(index));
+    data[0] = 0xA5;
+    data[1] = (uint8_t)(index >> 16);
+    data[2] = (uint8_t)(index >> 8);
+    data[3] = (uint8_t)index;
+    for (size_t i = 4; i < data.size(); i++) {
+        data[i] = (uint8_t)(index + i);
+    }
+}
+
+static EncoderPacket to_packet(int index, const std::vector<uint8_t> &data) {
+    EncoderPacket packet;
+    packet.data = data.data();
+    packet.size = data.size();
+    packet.pts_ms = (int64_t)index * TEST_FRAME_MS;
+    packet.key_frame = index % TEST_GOP == 0;
+    return packet;
+}
+
+// 检查码流：码流头之后必须是关键帧，其余位置的包序号必须连续；返回包个数，格式错误返回 -1
+static int parse_stream(const std::vector<uint8_t> &stream, int &first_index) {
+    size_t pos = 0;
+    int count = 0;
+    int last = -1;
+    bool after_header = false;
+    std::vector<uint8_t> expect;
+    first_index = -1;
+    while (pos < stream.size()) {
+        if (stream[pos] == 0x00) {
+            if (stream.size() - pos < sizeof(g_header) || memcmp(&stream[pos], g_header, sizeof(g_header)) != 0) {
+                return -1;
+            }
+            pos += sizeof(g_header);
+            after_header = true;
+            continue;
+        }
+        if (stream[pos] != 0xA5 || stream.size() - pos < 4) {
+            return -1;
+        }
+        int index = (stream[pos + 1] << 16) | (stream[pos + 2] << 8) | stream[pos + 3];
+        if (after_header ? index % TEST_GOP != 0 : index != last + 1) {
+            d_unit_test_error("packet %d after %d, after header: %d", index, last, after_header)
+            return -1;
+        }
+        make_packet(index, expect);
+        if (stream.size() - pos < expect.size() || memcmp(&stream[pos], expect.data(), expect.size()) != 0) {
+            return -1;
+        }
+        if (first_index < 0) {
+            first_index = index;
+        }
+        pos += expect.size();
+        last = index;
+        after_header = false;
+        count++;
+    }
+    return count;
+}
+
+static int read_file(const std::string &path, std::vector<uint8_t> &data) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    data.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return n == data.size() ? 0 : -1;
+}
+
+int test_file_segment(bool async_writer) {
+    FileSegmentConfig config;
+    config.segment_ms = 2000;
+    config.max_segments = 3;
+    config.batch_bytes = 32 << 10;
+    config.async_writer = async_writer;
+    uint32_t segment_count;
+    {
+        FileSegmentSink sink(TEST_SEGMENT_PATH, config);
+        sink.write_header(g_header, sizeof(g_header));
+        std::vector<uint8_t> data;
+        for (int i = 0; i < TEST_PACKET_NUM; i++) {
+            make_packet(i, data);
+            sink.write_packet(to_packet(i, data));
+        }
+        segment_count = sink.segment_count();
+    }
+    // 只在关键帧处切分：分段从不早于上一段起点 2 秒后的第一个关键帧开始
+    uint32_t expect_count = 1;
+    int64_t start_ms = 0;
+    for (int i = TEST_GOP; i < TEST_PACKET_NUM; i += TEST_GOP) {
+        if ((int64_t)i * TEST_FRAME_MS - start_ms >= config.segment_ms) {
+            start_ms = (int64_t)i * TEST_FRAME_MS;
+            expect_count++;
+        }
+    }
+    if (segment_count != expect_count) {
+        d_unit_test_error("segment count %d", segment_count)
+        return -1;
+    }
+    // 最早的分段已被删除，保留的分段各自以码流头和关键帧开始，首尾相接
+    int next_index = -1;
+    for (uint32_t i = 0; i < segment_count; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "test_encoder_sink_%05u.h264", i);
+        std::vector<uint8_t> data;
+        bool exist = read_file(path, data) == 0;
+        if (i + config.max_segments < segment_count) {
+            if (exist) {
+                d_unit_test_error("segment %s should be removed", path)
+                return -1;
+            }
+            continue;
+        }
+        int first_index;
+        int count = exist && memcmp(data.data(), g_header, sizeof(g_header)) == 0 ? parse_stream(data, first_index) : -1;
+        if (count <= 0 || (next_index >= 0 && first_index != next_index)) {
+            d_unit_test_error("segment %s invalid", path)
+            return -1;
+        }
+        next_index = first_index + count;
+        remove(path);
+    }
+    if (next_index != TEST_PACKET_NUM) {
+        d_unit_test_error("last packet %d", next_index)
+        return -1;
+    }
+    d_unit_test_info("file segment pass, async writer: %d, segments: %d", async_writer, segment_count)
+    return 0;
+}
+
+int test_memory_ring() {
+    MemoryRingConfig config;
+    config.duration_ms = 3000;
+    MemoryRingSink sink(config);
+    sink.write_header(g_header, sizeof(g_header));
+    std::vector<uint8_t> data;
+    // 从非关键帧开始写入，缓冲区等待第一个关键帧
+    for (int i = TEST_GOP / 2; i < TEST_PACKET_NUM; i++) {
+        make_packet(i, data);
+        sink.write_packet(to_packet(i, data));
+    }
+    // 保留时长覆盖 3 秒，且不超过 3 秒加一个 GOP
+    int64_t gop_ms = TEST_GOP * TEST_FRAME_MS;
+    if (sink.buffered_ms() < config.duration_ms || sink.buffered_ms() >= config.duration_ms + gop_ms ||
+        sink.dropped_packets() != TEST_GOP / 2) {
+        d_unit_test_error("ring buffered %d ms, dropped %d", (int)sink.buffered_ms(), (int)sink.dropped_packets())
+        return -1;
+    }
+    std::vector<uint8_t> clip;
+    int first_index;
+    int64_t newest_ms = (TEST_PACKET_NUM - 1) * TEST_FRAME_MS;
+    if (sink.get_clip(clip, 1000) != 0 || memcmp(clip.data(), g_header, sizeof(g_header)) != 0 ||
+        parse_stream(clip, first_index) != TEST_PACKET_NUM - first_index ||
+        first_index * TEST_FRAME_MS > newest_ms - 1000 || first_index * TEST_FRAME_MS <= newest_ms - 1000 - gop_ms) {
+        d_unit_test_error("clip invalid")
+        return -1;
+    }
+    // 导出的文件和内存中的片段一致
+    std::vector<uint8_t> file;
+    if (sink.save_clip(TEST_SEGMENT_PATH, 1000) != 0 || read_file(TEST_SEGMENT_PATH, file) != 0 || file != clip) {
+        d_unit_test_error("save clip failed")
+        return -1;
+    }
+    remove(TEST_SEGMENT_PATH);
+
+    // 内存上限小于一个 GOP 时清空缓冲区等待下一个关键帧
+    config.max_bytes = 50000;
+    MemoryRingSink small_sink(config);
+    for (int i = 0; i < TEST_PACKET_NUM; i++) {
+        make_packet(i, data);
+        small_sink.write_packet(to_packet(i, data));
+        if (small_sink.buffered_bytes() > config.max_bytes) {
+            d_unit_test_error("ring exceeds max bytes")
+            return -1;
+        }
+    }
+    d_unit_test_info("memory ring pass, buffered %d ms, clip from packet %d", (int)sink.buffered_ms(), first_index)
+    return 0;
+}
+
+// 编码器重建后码流头变化：不切分的文件中直接写入新的码流头，切分时开始新的分段，内存环形缓冲被清空
+int test_header_change() {
+    static const uint8_t new_header[8] = {0x00, 0x00, 0x00, 0x01, 'N', 'E', 'W', 0x00};
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> expect;
+    {
+        FileSegmentSink sink(TEST_SEGMENT_PATH);
+        MemoryRingSink ring_sink;
+        for (auto *header : {g_header, new_header}) {
+            sink.write_header(header, sizeof(g_header));
+            ring_sink.write_header(header, sizeof(g_header));
+            expect.insert(expect.end(), header, header + sizeof(g_header));
+            for (int i = 0; i < TEST_GOP; i++) {
+                make_packet(i, data);
+                sink.write_packet(to_packet(i, data));
+                if (header == g_header) {
+                    ring_sink.write_packet(to_packet(i, data));
+                }
+                expect.insert(expect.end(), data.begin(), data.end());
+            }
+        }
+        if (ring_sink.packet_count() != 0) {
+            d_unit_test_error("ring not cleared after header change")
+            return -1;
+        }
+    }
+    std::vector<uint8_t> file;
+    if (read_file(TEST_SEGMENT_PATH, file) != 0 || file != expect) {
+        d_unit_test_error("header change in single file mismatch")
+        return -1;
+    }
+    remove(TEST_SEGMENT_PATH);
+
+    FileSegmentConfig config;
+    config.segment_ms = 60000;
+    uint32_t segment_count;
+    {
+        FileSegmentSink sink(TEST_SEGMENT_PATH, config);
+        for (auto *header : {g_header, new_header}) {
+            sink.write_header(header, sizeof(g_header));
+            make_packet(0, data);
+            sink.write_packet(to_packet(0, data));
+        }
+        segment_count = sink.segment_count();
+    }
+    std::vector<uint8_t> second;
+    if (segment_count != 2 || read_file("test_encoder_sink_00001.h264", second) != 0 ||
+        memcmp(second.data(), new_header, sizeof(new_header)) != 0) {
+        d_unit_test_error("header change should start a new segment")
+        return -1;
+    }
+    remove("test_encoder_sink_00000.h264");
+    remove("test_encoder_sink_00001.h264");
+    d_unit_test_info("header change pass")
+    return 0;
+}
+
+// 读取管道 / socket 的数据直到对端关闭，slow 时每次少量读取并等待
+static void read_stream(int fd, bool slow, std::vector<uint8_t> &stream) {
+    uint8_t buffer[4096];
+    while (true) {
+        ssize_t n = read(fd, buffer, slow ? 1024 : sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        stream.insert(stream.end(), buffer, buffer + n);
+        if (slow) {
+            sleepUS(1000);
+        }
+    }
+    close(fd);
+}
+
+static int write_stream(StreamSink &sink) {
+    std::vector<uint8_t> data;
+    for (int i = 0; i < TEST_PACKET_NUM; i++) {
+        make_packet(i, data);
+        sink.write_packet(to_packet(i, data));
+        sleepUS(1000);
+    }
+    // 等待剩余数据写出
+    for (int i = 0; i < 500; i++) {
+        sink.flush();
+        sleepUS(1000);
+    }
+    return 0;
+}
+
+static int check_stream(const char *name, const std::vector<uint8_t> &stream, uint64_t dropped, bool slow) {
+    int first_index;
+    int count = parse_stream(stream, first_index);
+    if (count <= 0 || memcmp(stream.data(), g_header, sizeof(g_header)) != 0 || (slow && dropped == 0)) {
+        d_unit_test_error("%s stream invalid, count %d dropped %d", name, count, (int)dropped)
+        return -1;
+    }
+    d_unit_test_info("%s pass, slow reader: %d, received %d packets, dropped %d",
+                     name, slow, count, (int)dropped)
+    return 0;
+}
+
+int test_fifo(bool slow) {
+    StreamSinkConfig config;
+    config.type = STREAM_SINK_FIFO;
+    config.reconnect_interval_ms = 0;
+    config.max_pending_bytes = 128 << 10;
+    std::vector<uint8_t> stream;
+    std::thread reader;
+    uint64_t dropped;
+    {
+        StreamSink sink(TEST_FIFO_PATH, config);
+        // 没有读端时丢包
+        std::vector<uint8_t> data;
+        make_packet(0, data);
+        sink.write_packet(to_packet(0, data));
+        sink.write_header(g_header, sizeof(g_header));
+        if (sink.is_connected() || sink.dropped_packets() != 1) {
+            d_unit_test_error("fifo without reader should drop")
+            return -1;
+        }
+        int fd = open(TEST_FIFO_PATH, O_RDONLY | O_NONBLOCK);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        reader = std::thread(read_stream, fd, slow, std::ref(stream));
+        write_stream(sink);
+        dropped = sink.dropped_packets() - 1;
+    }
+    // 写端关闭后读线程结束
+    reader.join();
+    unlink(TEST_FIFO_PATH);
+    return check_stream("fifo", stream, dropped, slow);
+}
+
+int test_unix_socket(bool slow) {
+    unlink(TEST_SOCKET_PATH);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, TEST_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0) {
+        d_unit_test_error("bind socket failed")
+        return -1;
+    }
+    std::vector<uint8_t> stream;
+    std::thread reader([&] {
+        int fd = accept(server, nullptr, nullptr);
+        // 缩小接收缓冲区，读取过慢时更快触发丢包
+        int size = 16 << 10;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        read_stream(fd, slow, stream);
+    });
+    uint64_t dropped;
+    {
+        StreamSinkConfig config;
+        config.type = STREAM_SINK_UNIX_SOCKET;
+        config.reconnect_interval_ms = 0;
+        config.max_pending_bytes = 128 << 10;
+        StreamSink sink(TEST_SOCKET_PATH, config);
+        sink.write_header(g_header, sizeof(g_header));
+        write_stream(sink);
+        dropped = sink.dropped_packets();
+    }
+    reader.join();
+    close(server);
+    unlink(TEST_SOCKET_PATH);
+    return check_stream("unix socket", stream, dropped, slow);
+}
+
+int main() {
+    int ret = test_file_segment(false);
+    ret |= test_file_segment(true);
+    ret |= test_memory_ring();
+    ret |= test_header_change();
+    ret |= test_fifo(false);
+    ret |= test_fifo(true);
+    ret |= test_unix_socket(false);
+    ret |= test_unix_socket(true);
+    return ret;
+}
@@ -0,0 +1,292 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.25
+ * @brief: 不依赖 MPP 的帧来源测试：原始 NV12 / Y4M 文件的步长、内容、循环和结束，帧池用尽时超时，
+ *         按帧率限速，以及用合成图案跑 取帧 -> 预处理 -> 推理（模拟）-> 后处理 的多线程压测
+ */
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "frame_source.h"
+#include "yuv_convert_utils.h"
+#include "image_op_utils.h"
+
+// 第 index 帧、平面 plane 中 (x, y) 的像素值
+static uint8_t test_pixel(int index, int plane, int x, int y) {
+    return (uint8_t)(index * 31 + plane * 67 + x * 3 + y * 5);
+}
+
+// 写 frame_num 帧紧密排列的 4:2:0 帧（NV12 的 UV 交织看作一个平面）
+static void write_frames(FILE *fp, int width, int height, int frame_num, bool nv12) {
+    std::vector<uint8_t> plane;
+    for (int i = 0; i < frame_num; i++) {
+        if (!nv12) {
+            fprintf(fp, i % 2 == 0 ? "FRAME\n" : "FRAME Ixyz\n");
+        }
+        int planes = nv12 ? 2 : 3;
+        for (int p = 0; p < planes; p++) {
+            int w = p == 0 || nv12 ? width : width / 2;
+            int h = p == 0 ? height : height / 2;
+            plane.resize(w * h);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    plane[y * w + x] = test_pixel(i, p, x, y);
+                }
+            }
+            fwrite(plane.data(), 1, plane.size(), fp);
+        }
+    }
+}
+
+// 检查帧内容与写入的一致（步长之外的部分不检查）
+static int check_frame(const DecoderMppFrame &frame, int index, bool nv12) {
+    const auto *buf = (const uint8_t *)frame.data_buf;
+    int width = (int)frame.hor_width;
+    int height = (int)frame.ver_height;
+    const uint8_t *planes[3] = {
+            buf,
+            buf + frame.hor_stride * frame.ver_stride,
+            buf + frame.hor_stride * frame.ver_stride * 5 / 4,
+    };
+    int plane_num = nv12 ? 2 : 3;
+    for (int p = 0; p < plane_num; p++) {
+        int w = p == 0 || nv12 ? width : width / 2;
+        int h = p == 0 ? height : height / 2;
+        int stride = p == 0 || nv12 ? (int)frame.hor_stride : (int)frame.hor_stride / 2;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                if (planes[p][y * stride + x] != test_pixel(index, p, x, y)) {
+                    d_unit_test_error("frame %d plane %d (%d, %d) mismatch", index, p, x, y)
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int test_raw_nv12() {
+    const char *path = "/tmp/test_frame_source.yuv";
+    FILE *fp = fopen(path, "wb");
+    CHECK_VAL(fp == nullptr, d_unit_test_error("create %s failed", path); return -1;)
+    write_frames(fp, 100, 50, 5, true);
+    fclose(fp);
+
+    FrameSourceOptions options;
+    options.width = 100;
+    options.height = 50;
+    options.format = MPP_FMT_YUV420SP;
+    options.free_run = true;
+    options.max_frames = 2;
+    std::unique_ptr<FrameSource> source = create_frame_source(std::string("yuv:") + path, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create yuv source failed"); return -1;)
+
+    // 步长按 16 对齐，帧池 2 帧：第 3 帧在释放前超时
+    DecoderMppFrame frames[3] = {};
+    if (source->get_next_frame(frames[0]) != 0 || source->get_next_frame(frames[1]) != 0 ||
+        source->get_next_frame(frames[2], 10) != 1) {
+        d_unit_test_error("frame pool limit failed")
+        return -1;
+    }
+    if (frames[0].hor_stride != 112 || frames[0].ver_stride != 64 || frames[0].data_fd != -1 ||
+        frames[1].frame_index != 1 || check_frame(frames[0], 0, true) != 0 || check_frame(frames[1], 1, true) != 0) {
+        d_unit_test_error("nv12 frame mismatch, stride %dx%d", frames[0].hor_stride, frames[0].ver_stride)
+        return -1;
+    }
+    source->release_frame(frames[0]);
+    source->release_frame(frames[1]);
+
+    // 不循环时读完 5 帧结束
+    int count = 2;
+    DecoderMppFrame frame = {};
+    while (source->get_next_frame(frame) == 0) {
+        if (check_frame(frame, count, true) != 0) {
+            return -1;
+        }
+        source->release_frame(frame);
+        count++;
+    }
+    if (count != 5) {
+        d_unit_test_error("nv12 frame count: %d", count)
+        return -1;
+    }
+    source.reset();
+
+    // 循环读取时帧序号继续递增，内容回到第一帧
+    options.loop = true;
+    source = create_frame_source(std::string("yuv:") + path, options);
+    for (int i = 0; i < 12; i++) {
+        if (source->get_next_frame(frame) != 0 || frame.frame_index != (uint64_t)i ||
+            check_frame(frame, i % 5, true) != 0) {
+            d_unit_test_error("nv12 loop failed at %d", i)
+            return -1;
+        }
+        source->release_frame(frame);
+    }
+    remove(path);
+    d_unit_test_info("raw nv12 pass")
+    return 0;
+}
+
+int test_y4m() {
+    const char *path = "/tmp/test_frame_source.y4m";
+    FILE *fp = fopen(path, "wb");
+    CHECK_VAL(fp == nullptr, d_unit_test_error("create %s failed", path); return -1;)
+    fprintf(fp, "YUV4MPEG2 W64 H36 F50:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n");
+    write_frames(fp, 64, 36, 6, false);
+    fclose(fp);
+
+    // 使用文件头的 50 fps 限速，6 帧至少 100 ms
+    FrameSourceOptions options;
+    std::unique_ptr<FrameSource> source = create_frame_source(std::string("y4m:") + path, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create y4m source failed"); return -1;)
+    time_unit t_start = get_time_of_ms();
+    DecoderMppFrame frame = {};
+    int count = 0;
+    while (source->get_next_frame(frame) == 0) {
+        if (frame.mpp_frame_format != MPP_FMT_YUV420P || frame.hor_stride != 64 || frame.ver_stride != 48 ||
+            check_frame(frame, count, false) != 0) {
+            d_unit_test_error("y4m frame %d mismatch", count)
+            return -1;
+        }
+        source->release_frame(frame);
+        count++;
+    }
+    time_unit cost = get_time_of_ms() - t_start;
+    if (count != 6 || cost < 95) {
+        d_unit_test_error("y4m frames: %d, cost %d ms", count, (int)cost)
+        return -1;
+    }
+
+    // 还没到输出时间时不等待
+    source = create_frame_source(std::string("y4m:") + path, options);
+    if (source->poll_frame(frame) != 0) {
+        return -1;
+    }
+    source->release_frame(frame);
+    if (source->poll_frame(frame) != 1) {
+        d_unit_test_error("poll before due time should return 1")
+        return -1;
+    }
+    remove(path);
+    d_unit_test_info("y4m pass, 6 frames at 50 fps: %d ms", (int)cost)
+    return 0;
+}
+
+int test_pattern() {
+    FrameSourceOptions options;
+    options.free_run = true;
+    options.pattern_frames = 3;
+    std::unique_ptr<FrameSource> source = create_frame_source("pattern:320x240", options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create pattern source failed"); return -1;)
+    // 相邻帧的亮度不同（运动），帧数到达后结束
+    DecoderMppFrame frames[3] = {};
+    for (auto &frame : frames) {
+        if (source->get_next_frame(frame) != 0) {
+            d_unit_test_error("pattern get frame failed")
+            return -1;
+        }
+    }
+    DecoderMppFrame eos_frame = {};
+    if (memcmp(frames[0].data_buf, frames[1].data_buf, 320 * 240) == 0 || source->get_next_frame(eos_frame) != -1) {
+        d_unit_test_error("pattern frames failed")
+        return -1;
+    }
+    for (auto &frame : frames) {
+        source->release_frame(frame);
+    }
+    if (create_frame_source("pattern:320", options) != nullptr || create_frame_source("file:none.h264", options) != nullptr) {
+        d_unit_test_error("invalid uri should fail")
+        return -1;
+    }
+    d_unit_test_info("pattern pass")
+    return 0;
+}
+
+/**
+ * @brief 多线程流水线压测：input_threads 个线程取帧并预处理（缩放到 640x640 RGB），
+ *        推理用 sleep 模拟，后处理在帧上画框后释放
+ */
+int test_pipeline(const char *uri, double fps, int thread_num, int frame_num, time_unit infer_us) {
+    FrameSourceOptions options;
+    options.fps = fps;
+    options.free_run = fps <= 0;
+    options.pattern_frames = frame_num;
+    std::unique_ptr<FrameSource> source = create_frame_source(uri, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create source %s failed", uri); return -1;)
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> get_ns{0};
+    std::atomic<uint64_t> pre_ns{0};
+    std::atomic<uint64_t> post_ns{0};
+    std::vector<std::thread> threads;
+    time_unit t_start = getTimeOfNs();
+    for (int t = 0; t < thread_num; t++) {
+        threads.emplace_back([&]() {
+            std::vector<uint8_t> model_input(640 * 640 * 3);
+            DecoderMppFrame frame = {};
+            while (true) {
+                time_unit t0 = getTimeOfNs();
+                if (source->get_next_frame(frame, 1000) != 0) {
+                    break;
+                }
+                time_unit t1 = getTimeOfNs();
+                YuvFrameView view = {(const uint8_t *)frame.data_buf, frame.hor_width, frame.ver_height,
+                                     frame.hor_stride, frame.ver_stride,
+                                     frame.mpp_frame_format == MPP_FMT_YUV420SP ? YUV_LAYOUT_NV12 : YUV_LAYOUT_I420};
+                yuv_to_rgb_resize(view, model_input.data(), 640, 640, RKNN_TENSOR_NHWC, true, 114, nullptr);
+                time_unit t2 = getTimeOfNs();
+                sleepUS(infer_us);
+                time_unit t3 = getTimeOfNs();
+                DrawRect rects[4];
+                for (int i = 0; i < 4; i++) {
+                    rects[i] = {100 + i * 200, 100 + i * 100, 150, 120, draw_rgb_to_yuv_color(255, 0, 0), 4};
+                }
+                draw_rectangles_nv12((uint8_t *)frame.data_buf, (int)frame.hor_width, (int)frame.ver_height,
+                                     (int)frame.hor_stride, (int)frame.ver_stride, rects, 4);
+                source->release_frame(frame);
+                get_ns += t1 - t0;
+                pre_ns += t2 - t1;
+                post_ns += getTimeOfNs() - t3;
+                frames++;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = (double)(getTimeOfNs() - t_start) / 1e9;
+    double n = (double)std::max<uint64_t>(frames, 1);
+    MppDecoderStats stats = source->get_stats();
+    d_unit_test_warn("%s fps %.0f threads %d infer %d us: %d frames %.1f fps, get %.2f ms (fill %.2f ms), preprocess %.2f ms, postprocess %.2f ms",
+                     uri, fps, thread_num, (int)infer_us, (int)frames.load(), (double)frames / cost_s,
+                     (double)get_ns / 1e6 / n, stats.avg_decode_latency_ms, (double)pre_ns / 1e6 / n,
+                     (double)post_ns / 1e6 / n)
+    if (frames != (uint64_t)frame_num) {
+        d_unit_test_error("pipeline frames: %d, expect: %d", (int)frames.load(), frame_num)
+        return -1;
+    }
+    // 限速时不超过设定帧率
+    if (fps > 0 && (double)frames / cost_s > fps * 1.05) {
+        d_unit_test_error("pipeline faster than %.0f fps", fps)
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int ret = test_raw_nv12();
+    ret |= test_y4m();
+    ret |= test_pattern();
+    // 1080p 全速和 30 fps 限速，3 个线程模拟 3 个 NPU 核
+    ret |= test_pipeline("pattern:1920x1080", 0, 3, 120, 10000);
+    ret |= test_pipeline("pattern:1920x1080", 30, 3, 60, 10000);
+    return ret;
+}
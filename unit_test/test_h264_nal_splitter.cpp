@@ -0,0 +1,275 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.23
+ * @brief: H.264 访问单元切分测试：构造带 SPS/PPS/AUD/SEI、多 slice、3/4 字节起始码的码流，
+ *         检查帧边界、关键帧/参考帧标记、时间戳、循环和定位，各跳帧模式的处理结果，
+ *         以及起始码查找与逐字节查找的耗时对比
+ */
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "h264_nal_splitter.h"
+
+// 生成的测试帧
+struct TestFrame {
+    size_t offset;
+    size_t size;
+    bool key_frame;
+    bool reference;
+};
+
+static std::mt19937 g_rng(42);
+
+// 写入一个 NAL：起始码 + 头 + 不含 00 00 的负载（与防竞争字节处理后的码流一致）
+static void append_nal(std::vector<uint8_t> &stream, int nal_type, int ref_idc, bool first_slice, bool long_sc,
+                       size_t payload_size) {
+    if (long_sc) {
+        stream.push_back(0);
+    }
+    stream.insert(stream.end(), {0, 0, 1});
+    stream.push_back((uint8_t)((ref_idc << 5) | nal_type));
+    if (nal_type == H264_NAL_SLICE || nal_type == H264_NAL_IDR) {
+        // first_mb_in_slice 的 ue(v)：0 编码为比特 1，非 0 时首比特为 0
+        stream.push_back(first_slice ? 0x88 : 0x24);
+    }
+    for (size_t i = 0; i < payload_size; i++) {
+        stream.push_back((uint8_t)(g_rng() % 255 + 1));
+    }
+}
+
+// gop 帧一个 IDR（带 SPS/PPS），其余 P 帧和不参考的 B 帧交替，部分帧分两个 slice
+static std::vector<uint8_t> build_stream(int frame_num, int gop, std::vector<TestFrame> &frames) {
+    std::vector<uint8_t> stream;
+    // 起始码之前的无效数据会被跳过
+    stream.insert(stream.end(), {0x12, 0x34});
+    size_t first_offset = stream.size();
+    for (int i = 0; i < frame_num; i++) {
+        TestFrame frame{};
+        frame.offset = stream.size();
+        frame.key_frame = i % gop == 0;
+        frame.reference = frame.key_frame || i % 2 == 1;
+        bool long_sc = g_rng() % 2 == 0;
+        if (i % 7 == 3) {
+            append_nal(stream, H264_NAL_AUD, 0, false, long_sc, 1);
+        }
+        if (frame.key_frame) {
+            append_nal(stream, H264_NAL_SPS, 3, false, true, 12);
+            append_nal(stream, H264_NAL_PPS, 3, false, true, 4);
+            append_nal(stream, H264_NAL_SEI, 0, false, long_sc, 20);
+        }
+        int nal_type = frame.key_frame ? H264_NAL_IDR : H264_NAL_SLICE;
+        int ref_idc = frame.reference ? 2 : 0;
+        size_t slice_size = 200 + g_rng() % 5000;
+        append_nal(stream, nal_type, ref_idc, true, long_sc, slice_size);
+        if (i % 3 == 0) {
+            append_nal(stream, nal_type, ref_idc, false, g_rng() % 2 == 0, slice_size / 2);
+        }
+        frames.push_back(frame);
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        size_t end = i + 1 < frames.size() ? frames[i + 1].offset : stream.size();
+        frames[i].size = end - frames[i].offset;
+    }
+    frames[0].offset = first_offset;
+    return stream;
+}
+
+int test_split() {
+    std::vector<TestFrame> frames;
+    std::vector<uint8_t> stream = build_stream(300, 30, frames);
+    H264NalSplitter splitter(stream.data(), stream.size(), 30);
+    H264AccessUnit au;
+    size_t count = 0;
+    while (splitter.next(au)) {
+        if (count >= frames.size()) {
+            d_unit_test_error("too many access units")
+            return -1;
+        }
+        const TestFrame &frame = frames[count];
+        if ((size_t)(au.data - stream.data()) != frame.offset || au.size != frame.size ||
+            au.key_frame != frame.key_frame || au.reference != frame.reference ||
+            au.index != count || au.pts_ms != (int64_t)(count * 1000 / 30)) {
+            d_unit_test_error("access unit %d mismatch: offset %d/%d size %d/%d key %d/%d ref %d/%d",
+                              (int)count, (int)(au.data - stream.data()), (int)frame.offset,
+                              (int)au.size, (int)frame.size, au.key_frame, frame.key_frame,
+                              au.reference, frame.reference)
+            return -1;
+        }
+        count++;
+    }
+    if (count != frames.size() || !splitter.at_end()) {
+        d_unit_test_error("access unit count: %d, expect: %d", (int)count, (int)frames.size())
+        return -1;
+    }
+
+    // 循环读取时帧序号继续递增
+    splitter.reset();
+    if (!splitter.next(au) || au.index != frames.size() || au.data - stream.data() != (long)frames[0].offset) {
+        d_unit_test_error("reset failed")
+        return -1;
+    }
+
+    // 定位到最近的关键帧
+    H264NalSplitter seeker(stream.data(), stream.size(), 30);
+    if (seeker.seek_key_frame(75) != 60 || !seeker.next(au) || !au.key_frame || au.index != 60 ||
+        (size_t)(au.data - stream.data()) != frames[60].offset) {
+        d_unit_test_error("seek failed")
+        return -1;
+    }
+    d_unit_test_info("split pass, access units: %d", (int)count)
+    return 0;
+}
+
+int test_no_start_code() {
+    std::vector<uint8_t> data(1000, 0x55);
+    H264NalSplitter splitter(data.data(), data.size());
+    H264AccessUnit au;
+    if (splitter.next(au) || !splitter.at_end()) {
+        d_unit_test_error("data without start code should be empty")
+        return -1;
+    }
+    d_unit_test_info("no start code pass")
+    return 0;
+}
+
+// 统计一种跳帧模式下的处理结果，并检查送解码的帧不依赖被跳过的参考帧
+static int count_actions(const std::vector<uint8_t> &stream, H264SkipMode mode, int counts[3]) {
+    H264NalSplitter splitter(stream.data(), stream.size());
+    H264SkipFilter filter;
+    H264AccessUnit au;
+    bool ref_missing = false;
+    counts[0] = counts[1] = counts[2] = 0;
+    while (splitter.next(au)) {
+        H264SkipAction action = filter.filter(au, mode, 3, splitter.at_end());
+        counts[action]++;
+        if (au.key_frame) {
+            ref_missing = false;
+        }
+        if (action != H264_ACTION_SKIP && ref_missing && !splitter.at_end()) {
+            d_unit_test_error("mode %d: frame %d decoded after reference skipped", mode, (int)au.index)
+            return -1;
+        }
+        if (action == H264_ACTION_DECODE && mode == H264_SKIP_EVERY_NTH && au.index % 3 != 0 && !au.key_frame) {
+            d_unit_test_error("every nth output frame %d", (int)au.index)
+            return -1;
+        }
+        ref_missing |= action == H264_ACTION_SKIP && au.reference;
+    }
+    return 0;
+}
+
+int test_skip_filter() {
+    // 300 帧，每 30 帧一个 IDR，奇数帧为参考 P 帧，其余偶数帧为非参考 B 帧
+    std::vector<TestFrame> frames;
+    std::vector<uint8_t> stream = build_stream(300, 30, frames);
+    int counts[3];
+    // 全部解码
+    if (count_actions(stream, H264_SKIP_NONE, counts) != 0 || counts[H264_ACTION_DECODE] != 300) {
+        d_unit_test_error("skip none failed")
+        return -1;
+    }
+    // 跳过 140 个非参考帧（最后一帧为参考帧）
+    if (count_actions(stream, H264_SKIP_NON_REFERENCE, counts) != 0 ||
+        counts[H264_ACTION_DECODE] != 160 || counts[H264_ACTION_SKIP] != 140) {
+        d_unit_test_error("skip non reference failed: %d %d %d", counts[0], counts[1], counts[2])
+        return -1;
+    }
+    // 每 3 帧输出一帧：输出 100 帧，其余参考帧解码不输出
+    if (count_actions(stream, H264_SKIP_EVERY_NTH, counts) != 0 || counts[H264_ACTION_DECODE] != 100 ||
+        counts[H264_ACTION_DECODE] + counts[H264_ACTION_DECODE_DROP] != 100 + 100) {
+        d_unit_test_error("skip every nth failed: %d %d %d", counts[0], counts[1], counts[2])
+        return -1;
+    }
+    // 只解码 10 个关键帧，最后一帧带结束标志解码不输出
+    if (count_actions(stream, H264_SKIP_KEY_FRAME_ONLY, counts) != 0 ||
+        counts[H264_ACTION_DECODE] != 10 || counts[H264_ACTION_DECODE_DROP] != 1) {
+        d_unit_test_error("key frame only failed: %d %d %d", counts[0], counts[1], counts[2])
+        return -1;
+    }
+
+    // 只解码关键帧的过程中恢复，需要等到下一个关键帧
+    H264NalSplitter splitter(stream.data(), stream.size());
+    H264SkipFilter filter;
+    H264AccessUnit au;
+    int decoded_before_key = 0;
+    while (splitter.next(au)) {
+        H264SkipMode mode = au.index >= 5 && au.index < 40 ? H264_SKIP_KEY_FRAME_ONLY : H264_SKIP_NONE;
+        H264SkipAction action = filter.filter(au, mode, 3, splitter.at_end());
+        if (au.index >= 40 && au.index < 60 && action != H264_ACTION_SKIP) {
+            decoded_before_key++;
+        }
+        if (au.index == 60 && (action != H264_ACTION_DECODE || filter.waiting_key_frame())) {
+            d_unit_test_error("not resumed at key frame")
+            return -1;
+        }
+    }
+    if (decoded_before_key != 0) {
+        d_unit_test_error("decoded %d frames before key frame", decoded_before_key)
+        return -1;
+    }
+
+    // 压力对应的模式
+    H264SkipConfig config;
+    if (H264SkipFilter::mode_for_pressure(0.1f, config) != H264_SKIP_NONE ||
+        H264SkipFilter::mode_for_pressure(0.3f, config) != H264_SKIP_NON_REFERENCE ||
+        H264SkipFilter::mode_for_pressure(0.5f, config) != H264_SKIP_EVERY_NTH ||
+        H264SkipFilter::mode_for_pressure(0.9f, config) != H264_SKIP_KEY_FRAME_ONLY) {
+        d_unit_test_error("mode for pressure failed")
+        return -1;
+    }
+    d_unit_test_info("skip filter pass")
+    return 0;
+}
+
+// 逐字节查找起始码，作为对比
+static size_t count_start_code_bytewise(const std::vector<uint8_t> &stream) {
+    size_t count = 0;
+    for (size_t i = 2; i < stream.size(); i++) {
+        if (stream[i] == 1 && stream[i - 1] == 0 && stream[i - 2] == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static size_t count_start_code(const std::vector<uint8_t> &stream) {
+    size_t count = 0;
+    const uint8_t *end = stream.data() + stream.size();
+    const uint8_t *p = stream.data();
+    int sc_len = 0;
+    while ((p = H264NalSplitter::find_start_code(p, end, sc_len)) < end) {
+        count++;
+        p += sc_len;
+    }
+    return count;
+}
+
+int test_scan_cost() {
+    std::vector<TestFrame> frames;
+    std::vector<uint8_t> stream = build_stream(20000, 50, frames);
+    time_unit t_start = getTimeOfNs();
+    size_t bytewise = count_start_code_bytewise(stream);
+    time_unit t_bytewise = getTimeOfNs() - t_start;
+    t_start = getTimeOfNs();
+    size_t fast = count_start_code(stream);
+    time_unit t_fast = getTimeOfNs() - t_start;
+    if (bytewise != fast) {
+        d_unit_test_error("start code count mismatch: %d != %d", (int)bytewise, (int)fast)
+        return -1;
+    }
+    d_unit_test_warn("%.1f MB, %d start codes: bytewise %.2f ms, memchr %.2f ms",
+                     (double)stream.size() / 1e6, (int)fast, (double)t_bytewise / 1e6, (double)t_fast / 1e6)
+    return 0;
+}
+
+int main() {
+    int ret = test_split();
+    ret |= test_no_start_code();
+    ret |= test_skip_filter();
+    ret |= test_scan_cost();
+    return ret;
+}
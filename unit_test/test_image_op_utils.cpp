@@ -0,0 +1,391 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.16
+ * @brief: 图像绘制函数测试，和逐像素边界判断的原有实现对比结果，并对比 4K NV12 上批量画框的耗时；
+ *         点阵文字绘制和逐像素参考实现对比，以及 1080p 上 64 个带标签检测框的标注耗时；
+ *         YUVA 叠加图混合和逐像素参考实现对比，以及 1080p 全帧分割掩码混合的耗时
+ */
+#include <string>
+#include <vector>
+#include <random>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "image_op_utils.h"
+#include "font_atlas_utils.h"
+
+#define TEST_LOOP_COUNT 100
+#define TEST_BOX_NUM 60
+#define TEST_LABEL_NUM 64
+
+// 原有实现：逐像素写入，内层循环判断边界
+static void legacy_fill(unsigned char* pixels, int w, int h, int stride, int channels,
+                        int x0, int y0, int x1, int y1, unsigned int color) {
+    const unsigned char* pen_color = (const unsigned char*)&color;
+    for (int y = y0; y < y1; y++) {
+        if (y < 0) {
+            continue;
+        }
+        if (y >= h) {
+            break;
+        }
+        unsigned char* p = pixels + stride * y;
+        for (int x = x0; x < x1; x++) {
+            if (x < 0) {
+                continue;
+            }
+            if (x >= w) {
+                break;
+            }
+            for (int c = 0; c < channels; c++) {
+                p[x * channels + c] = pen_color[c];
+            }
+        }
+    }
+}
+
+static void legacy_draw_rectangle(unsigned char* pixels, int w, int h, int stride, int channels,
+                                  int rx, int ry, int rw, int rh, unsigned int color, int thickness) {
+    if (thickness == -1) {
+        legacy_fill(pixels, w, h, stride, channels, rx, ry, rx + rw, ry + rh, color);
+        return;
+    }
+    const int t0 = thickness / 2;
+    const int t1 = thickness - t0;
+    legacy_fill(pixels, w, h, stride, channels, rx - t0, ry - t0, rx + rw + t1, ry + t1, color);
+    legacy_fill(pixels, w, h, stride, channels, rx - t0, ry + rh - t0, rx + rw + t1, ry + rh + t1, color);
+    legacy_fill(pixels, w, h, stride, channels, rx - t0, ry + t1, rx + t1, ry + rh - t0, color);
+    legacy_fill(pixels, w, h, stride, channels, rx + rw - t0, ry + t1, rx + rw + t1, ry + rh - t0, color);
+}
+
+static void legacy_draw_rectangle_nv12(unsigned char* nv12, int w, int h, int hor_stride, int ver_stride,
+                                       const DrawRect &rect) {
+    const unsigned char* pen_color = (const unsigned char*)&rect.color;
+    unsigned int color_uv = (unsigned int)pen_color[1] | ((unsigned int)pen_color[2] << 8);
+    int thickness_uv = rect.thickness == -1 ? rect.thickness : std::max(rect.thickness / 2, 1);
+    legacy_draw_rectangle(nv12, w, h, hor_stride, 1, rect.x, rect.y, rect.w, rect.h, pen_color[0], rect.thickness);
+    legacy_draw_rectangle(nv12 + hor_stride * ver_stride, w / 2, h / 2, hor_stride, 2,
+                          rect.x / 2, rect.y / 2, rect.w / 2, rect.h / 2, color_uv, thickness_uv);
+}
+
+static void gen_rects(std::vector<DrawRect> &rects, int w, int h, int num, uint32_t seed) {
+    std::mt19937 rng(seed);
+    rects.resize(num);
+    for (auto &rect : rects) {
+        // 部分矩形超出图像范围
+        rect.x = (int)(rng() % (w + 200)) - 100;
+        rect.y = (int)(rng() % (h + 200)) - 100;
+        rect.w = (int)(rng() % (w / 4)) + 2;
+        rect.h = (int)(rng() % (h / 4)) + 2;
+        rect.color = rng() & 0xffffff;
+        rect.thickness = rng() % 8 == 0 ? -1 : (int)(rng() % 6) + 1;
+    }
+}
+
+int test_draw_rectangle() {
+    // 各通道数和原有实现逐字节一致
+    const int w = 333;
+    const int h = 211;
+    for (int channels = 1; channels <= 4; channels++) {
+        const int stride = w * channels + 7;
+        std::vector<uint8_t> expect(stride * h, 0);
+        std::vector<uint8_t> result(stride * h, 0);
+        std::vector<DrawRect> rects;
+        gen_rects(rects, w, h, 200, 1037 + channels);
+        for (const auto &rect : rects) {
+            legacy_draw_rectangle(expect.data(), w, h, stride, channels,
+                                  rect.x, rect.y, rect.w, rect.h, rect.color, rect.thickness);
+            draw_rectangle_cn(result.data(), w, h, stride, channels,
+                              rect.x, rect.y, rect.w, rect.h, rect.color, rect.thickness);
+        }
+        if (expect != result) {
+            d_unit_test_error("draw rectangle c%d mismatch", channels)
+            return -1;
+        }
+    }
+    d_unit_test_info("draw rectangle c1 ~ c4 pass")
+    return 0;
+}
+
+int test_draw_rectangles_nv12() {
+    // 4K NV12，带 padding
+    const int w = 3840;
+    const int h = 2160;
+    const int hor_stride = 3840;
+    const int ver_stride = 2176;
+    std::vector<uint8_t> expect(hor_stride * ver_stride * 3 / 2, 0);
+    std::vector<uint8_t> result(hor_stride * ver_stride * 3 / 2, 0);
+    std::vector<DrawRect> rects;
+    gen_rects(rects, w, h, TEST_BOX_NUM, 2023);
+    for (auto &rect : rects) {
+        // 原有 NV12 接口要求偶数坐标和线宽
+        rect.x &= ~1;
+        rect.y &= ~1;
+        rect.w &= ~1;
+        rect.h &= ~1;
+        rect.thickness = rect.thickness == -1 ? 4 : (rect.thickness + 1) & ~1;
+        rect.color = draw_rgb_to_yuv_color(rect.color & 0xff, (rect.color >> 8) & 0xff, (rect.color >> 16) & 0xff);
+    }
+
+    for (const auto &rect : rects) {
+        legacy_draw_rectangle_nv12(expect.data(), w, h, hor_stride, ver_stride, rect);
+    }
+    draw_rectangles_nv12(result.data(), w, h, hor_stride, ver_stride, rects.data(), (int)rects.size());
+    if (expect != result) {
+        d_unit_test_error("draw rectangles nv12 mismatch")
+        return -1;
+    }
+
+    time_unit t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        for (const auto &rect : rects) {
+            legacy_draw_rectangle_nv12(expect.data(), w, h, hor_stride, ver_stride, rect);
+        }
+    }
+    time_unit t_legacy = getTimeOfNs() - t_start;
+    t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        draw_rectangles_nv12(result.data(), w, h, hor_stride, ver_stride, rects.data(), (int)rects.size());
+    }
+    time_unit t_batch = getTimeOfNs() - t_start;
+    d_unit_test_warn("4K nv12 %d boxes avg: per pixel %.3f ms, span batch %.3f ms", TEST_BOX_NUM,
+                     (double)t_legacy / TEST_LOOP_COUNT / 1e6,
+                     (double)t_batch / TEST_LOOP_COUNT / 1e6)
+    return 0;
+}
+
+// 参考实现：逐像素读取字形位，色度取 2x2 内任一像素
+static void reference_draw_text(uint8_t *yuv, int w, int h, int hor_stride, int ver_stride, YuvPlaneLayout layout,
+                                int x, int y, const char *text, unsigned int color, int scale) {
+    x &= ~1;
+    y &= ~1;
+    const uint8_t *pen_color = (const uint8_t *)&color;
+    const int glyph_size = FONT_GLYPH_SIZE * scale;
+    const int text_w = (int)strlen(text) * glyph_size;
+    auto pixel_on = [&](int px, int py) {
+        if (px < 0 || py < 0 || px >= text_w || py >= glyph_size) {
+            return false;
+        }
+        int c = (uint8_t)text[px / glyph_size];
+        c = (c < FONT_GLYPH_FIRST || c > FONT_GLYPH_LAST) ? '?' : c;
+        return ((g_font8x8_basic[c - FONT_GLYPH_FIRST][py / scale] >> ((px % glyph_size) / scale)) & 1) != 0;
+    };
+    for (int py = 0; py < h; py++) {
+        for (int px = 0; px < w; px++) {
+            if (pixel_on(px - x, py - y)) {
+                yuv[py * hor_stride + px] = pen_color[0];
+            }
+        }
+    }
+    uint8_t *u_plane = yuv + hor_stride * ver_stride;
+    for (int py = 0; py < h / 2; py++) {
+        for (int px = 0; px < w / 2; px++) {
+            int lx = px * 2 - x;
+            int ly = py * 2 - y;
+            if (!pixel_on(lx, ly) && !pixel_on(lx + 1, ly) && !pixel_on(lx, ly + 1) && !pixel_on(lx + 1, ly + 1)) {
+                continue;
+            }
+            if (layout == YUV_LAYOUT_NV12) {
+                u_plane[py * hor_stride + px * 2] = pen_color[1];
+                u_plane[py * hor_stride + px * 2 + 1] = pen_color[2];
+            } else {
+                u_plane[py * hor_stride / 2 + px] = pen_color[1];
+                u_plane[hor_stride * ver_stride / 4 + py * hor_stride / 2 + px] = pen_color[2];
+            }
+        }
+    }
+}
+
+int test_draw_text() {
+    const int w = 320;
+    const int h = 96;
+    const int hor_stride = 336;
+    const int ver_stride = 112;
+    const char *texts[3] = {"person 0.87", "~!@#$%^&*()_+{}|:<>?", "\x7f\t bus"};
+    const int positions[4][2] = {{10, 20}, {-13, -5}, {250, 80}, {0, 0}};
+    const YuvPlaneLayout layouts[2] = {YUV_LAYOUT_NV12, YUV_LAYOUT_I420};
+    for (int scale = 1; scale <= 3; scale++) {
+        FontAtlas font(scale);
+        for (auto layout : layouts) {
+            std::vector<uint8_t> expect(hor_stride * ver_stride * 3 / 2, 16);
+            std::vector<uint8_t> result(hor_stride * ver_stride * 3 / 2, 16);
+            for (const char *text : texts) {
+                for (const auto &pos : positions) {
+                    unsigned int color = draw_rgb_to_yuv_color(pos[0] & 0xff, 200, 50);
+                    reference_draw_text(expect.data(), w, h, hor_stride, ver_stride, layout,
+                                        pos[0], pos[1], text, color, scale);
+                    font.draw_text(result.data(), w, h, hor_stride, ver_stride, layout,
+                                   pos[0], pos[1], text, color);
+                }
+            }
+            if (expect != result) {
+                d_unit_test_error("draw text mismatch, scale: %d, layout: %d", scale, layout)
+                return -1;
+            }
+        }
+    }
+    d_unit_test_info("draw text pass")
+    return 0;
+}
+
+int test_annotate_frame() {
+    // 1080p 解码帧上绘制 64 个检测框和标签
+    const int w = 1920;
+    const int h = 1080;
+    const int hor_stride = 1920;
+    const int ver_stride = 1088;
+    std::vector<uint8_t> frame(hor_stride * ver_stride * 3 / 2, 128);
+    std::vector<DrawRect> rects;
+    gen_rects(rects, w, h, TEST_LABEL_NUM, 1080);
+    const unsigned int box_color = draw_rgb_to_yuv_color(255, 0, 0);
+    const unsigned int text_color = draw_rgb_to_yuv_color(255, 255, 255);
+    std::vector<std::string> labels(rects.size());
+    for (size_t i = 0; i < rects.size(); i++) {
+        rects[i].color = box_color;
+        rects[i].thickness = 4;
+        char text[64];
+        snprintf(text, sizeof(text), "person %.2f", 0.5 + (double)i / 200);
+        labels[i] = text;
+    }
+    FontAtlas font(2);
+
+    time_unit t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        draw_rectangles_nv12(frame.data(), w, h, hor_stride, ver_stride, rects.data(), (int)rects.size());
+        for (size_t i = 0; i < rects.size(); i++) {
+            font.draw_label(frame.data(), w, h, hor_stride, ver_stride, YUV_LAYOUT_NV12,
+                            rects[i].x, rects[i].y, labels[i].c_str(), text_color, box_color);
+        }
+    }
+    time_unit t_annotate = getTimeOfNs() - t_start;
+    d_unit_test_warn("1080p nv12 %d labelled boxes avg: %.3f ms", TEST_LABEL_NUM,
+                     (double)t_annotate / TEST_LOOP_COUNT / 1e6)
+    return 0;
+}
+
+// 参考实现：逐像素判断是否在帧内
+static void reference_draw_overlay(uint8_t *nv12, int w, int h, int hor_stride, int ver_stride,
+                                   const YuvaOverlay &overlay, int x, int y,
+                                   int crop_x, int crop_y, int crop_w, int crop_h) {
+    x &= ~1;
+    y &= ~1;
+    crop_x &= ~1;
+    crop_y &= ~1;
+    int crop_x1 = std::min(crop_x + crop_w, overlay.width) & ~1;
+    int crop_y1 = std::min(crop_y + crop_h, overlay.height) & ~1;
+    auto blend = [](uint8_t &d, uint8_t s, uint8_t a) {
+        d = (uint8_t)((s * a + d * (255 - a) + 127) / 255);
+    };
+    for (int sy = crop_y; sy < crop_y1; sy++) {
+        for (int sx = crop_x; sx < crop_x1; sx++) {
+            int dx = x + sx - crop_x;
+            int dy = y + sy - crop_y;
+            if (dx < 0 || dy < 0 || dx >= (w & ~1) || dy >= (h & ~1)) {
+                continue;
+            }
+            int i = sy * overlay.width + sx;
+            blend(nv12[dy * hor_stride + dx], overlay.y[i], overlay.y_alpha[i]);
+            if (sy % 2 == 0) {
+                int ci = sy / 2 * overlay.width + sx;
+                blend(nv12[hor_stride * ver_stride + dy / 2 * hor_stride + dx], overlay.uv[ci], overlay.uv_alpha[ci]);
+            }
+        }
+    }
+}
+
+static void gen_rgba(std::vector<uint8_t> &rgba, int w, int h, uint32_t seed) {
+    std::mt19937 rng(seed);
+    rgba.resize(w * h * 4);
+    for (auto &v : rgba) {
+        v = (uint8_t)(rng() & 0xff);
+    }
+}
+
+int test_draw_overlay() {
+    // SIMD 行混合和标量实现逐位一致
+    std::mt19937 rng(35);
+    std::vector<uint8_t> src(1023), alpha(1023), simd_dst(1023), c_dst(1023);
+    for (int loop = 0; loop < 100; loop++) {
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = rng() & 0xff;
+            alpha[i] = loop % 2 == 0 ? rng() & 0xff : (rng() % 2) * 255;
+            simd_dst[i] = c_dst[i] = rng() & 0xff;
+        }
+        overlay_blend_row(simd_dst.data(), src.data(), alpha.data(), (int)src.size());
+        overlay_blend_row_c(c_dst.data(), src.data(), alpha.data(), (int)src.size());
+        if (simd_dst != c_dst) {
+            d_unit_test_error("simd overlay blend mismatch")
+            return -1;
+        }
+    }
+
+    // 裁剪和越界
+    const int w = 320;
+    const int h = 180;
+    const int hor_stride = 336;
+    const int ver_stride = 192;
+    std::vector<uint8_t> rgba;
+    gen_rgba(rgba, 101, 67, 7);
+    YuvaOverlay overlay;
+    yuva_overlay_from_rgba(rgba.data(), 101, 67, 101 * 4, overlay);
+    const int cases[][6] = {
+            // x, y, crop_x, crop_y, crop_w, crop_h
+            {10, 20, 0, 0, 100, 66},
+            {-30, -15, 0, 0, 100, 66},
+            {260, 150, 0, 0, 100, 66},
+            {33, 41, 12, 8, 40, 30},
+            {-7, 170, 20, 4, 51, 33},
+    };
+    std::vector<uint8_t> frame(hor_stride * ver_stride * 3 / 2);
+    gen_rgba(frame, hor_stride, ver_stride * 3 / 8, 8);
+    std::vector<uint8_t> expect = frame;
+    for (const auto &c : cases) {
+        reference_draw_overlay(expect.data(), w, h, hor_stride, ver_stride, overlay, c[0], c[1], c[2], c[3], c[4], c[5]);
+        draw_overlay_nv12(frame.data(), w, h, hor_stride, ver_stride, overlay, c[0], c[1], c[2], c[3], c[4], c[5]);
+        if (expect != frame) {
+            d_unit_test_error("draw overlay mismatch, pos: %d %d, crop: %d %d %d %d", c[0], c[1], c[2], c[3], c[4], c[5])
+            return -1;
+        }
+    }
+    d_unit_test_info("draw overlay pass")
+
+    // 1080p 全帧分割掩码：背景透明，前景半透明类别颜色
+    const int frame_w = 1920;
+    const int frame_h = 1080;
+    std::vector<uint8_t> mask_rgba(frame_w * frame_h * 4, 0);
+    for (int row = 0; row < frame_h; row++) {
+        for (int col = 0; col < frame_w; col++) {
+            uint8_t *p = mask_rgba.data() + (row * frame_w + col) * 4;
+            int cls = ((row / 120) + (col / 160)) % 4;
+            if (cls != 0) {
+                p[0] = cls == 1 ? 255 : 0;
+                p[1] = cls == 2 ? 255 : 0;
+                p[2] = cls == 3 ? 255 : 0;
+                p[3] = 128;
+            }
+        }
+    }
+    std::vector<uint8_t> nv12(frame_w * 1088 * 3 / 2, 100);
+    time_unit t_start = getTimeOfNs();
+    YuvaOverlay mask_overlay;
+    yuva_overlay_from_rgba(mask_rgba.data(), frame_w, frame_h, frame_w * 4, mask_overlay);
+    time_unit t_convert = getTimeOfNs() - t_start;
+    t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        draw_overlay_nv12(nv12.data(), frame_w, frame_h, frame_w, 1088, mask_overlay, 0, 0);
+    }
+    time_unit t_blend = getTimeOfNs() - t_start;
+    d_unit_test_warn("1080p nv12 full frame mask: rgba to yuva once %.3f ms, blend avg %.3f ms (30 fps budget 33.3 ms)",
+                     (double)t_convert / 1e6, (double)t_blend / TEST_LOOP_COUNT / 1e6)
+    return 0;
+}
+
+int main() {
+    int ret = test_draw_rectangle();
+    ret |= test_draw_rectangles_nv12();
+    ret |= test_draw_text();
+    ret |= test_annotate_frame();
+    ret |= test_draw_overlay();
+    return ret;
+}
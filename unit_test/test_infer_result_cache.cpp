@@ -0,0 +1,198 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.28
+ * @brief: 推理结果缓存测试：静止画面和传感器噪声命中，局部目标移动不命中，过期重新推理，
+ *         回放的输出与推理输出一致，以及 640x640 输入的哈希耗时
+ */
+#include <vector>
+#include <random>
+#include <cstring>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "infer_result_cache.h"
+
+#define TEST_SIZE (640)
+
+// 640x640x3 输入：背景渐变，(box_x, box_y) 处有一个 40x40 的亮块
+static void draw_frame(std::vector<uint8_t> &data, int box_x, int box_y, int noise, uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (int y = 0; y < TEST_SIZE; y++) {
+        for (int x = 0; x < TEST_SIZE; x++) {
+            uint8_t *pixel = data.data() + ((size_t)y * TEST_SIZE + x) * 3;
+            int value = (x + y) / 8 + 40;
+            if (x >= box_x && x < box_x + 40 && y >= box_y && y < box_y + 40) {
+                value = 230;
+            }
+            if (noise > 0) {
+                value += (int)(rng() % (2 * noise + 1)) - noise;
+            }
+            value = value < 0 ? 0 : (value > 255 ? 255 : value);
+            pixel[0] = pixel[1] = pixel[2] = (uint8_t)value;
+        }
+    }
+}
+
+struct TestModel {
+    rknn_tensor_attr input_attr{};
+    rknn_tensor_attr output_attr{};
+    PluginConfigSet config{};
+
+    TestModel() {
+        input_attr.n_dims = 4;
+        input_attr.dims[0] = 1;
+        input_attr.dims[1] = TEST_SIZE;
+        input_attr.dims[2] = TEST_SIZE;
+        input_attr.dims[3] = 3;
+        input_attr.fmt = RKNN_TENSOR_NHWC;
+        input_attr.type = RKNN_TENSOR_UINT8;
+        config.io_num.n_input = 1;
+        config.io_num.n_output = 1;
+        config.input_attr = &input_attr;
+        config.output_attr = &output_attr;
+    }
+};
+
+static InputUnit make_input(rknn_input &in, std::vector<uint8_t> &data) {
+    memset(&in, 0, sizeof(in));
+    in.buf = data.data();
+    in.size = data.size();
+    in.type = RKNN_TENSOR_UINT8;
+    in.fmt = RKNN_TENSOR_NHWC;
+    return {&in, 1};
+}
+
+int test_cache() {
+    TestModel model;
+    InferCacheConfig config;
+    config.enable = true;
+    config.max_distance = 3;
+    config.max_age_ms = 200;
+    InferResultCache cache(config, model.config);
+    CHECK_VAL(!cache.enable(), d_unit_test_error("cache not enabled"); return -1;)
+
+    std::vector<uint8_t> data((size_t)TEST_SIZE * TEST_SIZE * 3);
+    rknn_input in{};
+    InputUnit input = make_input(in, data);
+    InferCacheHash hash;
+
+    // 第一帧未命中，推理后保存
+    draw_frame(data, 100, 100, 0, 0);
+    cache.compute_hash(input, hash);
+    if (!hash.valid || cache.lookup(hash) != nullptr) {
+        d_unit_test_error("first frame should miss")
+        return -1;
+    }
+    std::vector<uint8_t> output_data(1000);
+    for (size_t i = 0; i < output_data.size(); i++) {
+        output_data[i] = (uint8_t)(i * 13);
+    }
+    rknn_output out{};
+    out.buf = output_data.data();
+    out.size = output_data.size();
+    out.want_float = 0;
+    OutputUnit output = {&out, 1};
+    cache.insert(hash, output);
+
+    // 相同画面加传感器噪声仍然命中，回放的输出与推理输出一致
+    draw_frame(data, 100, 100, 4, 1);
+    cache.compute_hash(input, hash);
+    std::shared_ptr<const InferCacheEntry> entry = cache.lookup(hash);
+    if (entry == nullptr) {
+        d_unit_test_error("noisy static frame should hit")
+        return -1;
+    }
+    rknn_output replay{};
+    OutputUnit replay_unit = {&replay, 1};
+    std::vector<std::vector<uint8_t>> buffers;
+    InferResultCache::fill_output(*entry, replay_unit, buffers);
+    if (replay.size != out.size || memcmp(replay.buf, output_data.data(), out.size) != 0 ||
+        replay.buf == output_data.data()) {
+        d_unit_test_error("replayed output mismatch")
+        return -1;
+    }
+
+    // 目标移动 8 像素不命中
+    draw_frame(data, 108, 100, 0, 0);
+    cache.compute_hash(input, hash);
+    if (cache.lookup(hash) != nullptr) {
+        d_unit_test_error("moved box should miss")
+        return -1;
+    }
+
+    // 过期后重新推理
+    draw_frame(data, 100, 100, 0, 0);
+    cache.compute_hash(input, hash);
+    sleepUS(250000);
+    if (cache.lookup(hash) != nullptr) {
+        d_unit_test_error("expired entry should miss")
+        return -1;
+    }
+
+    // 非 uint8 输入不缓存
+    in.type = RKNN_TENSOR_FLOAT32;
+    cache.compute_hash(input, hash);
+    if (hash.valid || cache.lookup(hash) != nullptr) {
+        d_unit_test_error("float input should be uncacheable")
+        return -1;
+    }
+    InferCacheStats stats = cache.get_stats();
+    if (stats.hits != 1 || stats.misses != 3 || stats.uncacheable != 1 || stats.expired != 1) {
+        d_unit_test_error("stats mismatch: hits %d misses %d", (int)stats.hits, (int)stats.misses)
+        return -1;
+    }
+    cache.print_stats();
+    d_unit_test_info("cache pass")
+    return 0;
+}
+
+/**
+ * @brief 静止画面中偶尔有目标经过：统计命中率和哈希耗时
+ */
+int test_static_scene() {
+    TestModel model;
+    InferCacheConfig config;
+    config.enable = true;
+    // 只看画面变化，不受运行速度影响
+    config.max_age_ms = 60000;
+    InferResultCache cache(config, model.config);
+    std::vector<uint8_t> data((size_t)TEST_SIZE * TEST_SIZE * 3);
+    rknn_input in{};
+    InputUnit input = make_input(in, data);
+    std::vector<uint8_t> output_data(1000);
+    rknn_output out{};
+    out.buf = output_data.data();
+    out.size = output_data.size();
+    OutputUnit output = {&out, 1};
+
+    // 300 帧，第 100 ~ 130 帧目标从左向右移动
+    int infer_count = 0;
+    time_unit hash_ns = 0;
+    for (int frame = 0; frame < 300; frame++) {
+        int box_x = frame >= 100 && frame < 130 ? (frame - 100) * 20 : -100;
+        draw_frame(data, box_x, 300, 2, frame);
+        InferCacheHash hash;
+        time_unit t_start = getTimeOfNs();
+        cache.compute_hash(input, hash);
+        hash_ns += getTimeOfNs() - t_start;
+        if (cache.lookup(hash) == nullptr) {
+            infer_count++;
+            cache.insert(hash, output);
+        }
+    }
+    d_unit_test_warn("static scene: %d / 300 frames inferred, hash %.3f ms per frame", infer_count,
+                     (double)hash_ns / 300 / 1e6)
+    // 目标移动的 30 帧都要推理，静止部分基本命中
+    if (infer_count < 30 || infer_count > 35) {
+        d_unit_test_error("unexpected infer count %d", infer_count)
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int ret = test_cache();
+    ret |= test_static_scene();
+    return ret;
+}
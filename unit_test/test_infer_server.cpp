@@ -0,0 +1,376 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.27
+ * @brief: 本地推理服务测试和压测：协议正确性（内联 / fd 传递 / 错误请求 / 不读取响应的客户端 / batch 拆分），
+ *         以及不同并发下对模拟后端的吞吐和 p50/p99 延时。
+ *         带参数运行时作为压测客户端连接已经启动的服务：./test_infer_server <socket_path> <input_size>
+ */
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <future>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "infer_backend.h"
+#include "infer_server.h"
+#include "infer_client.h"
+
+#define TEST_SOCKET_PATH "/tmp/test_rknn_infer.sock"
+
+// 输入内容按请求序号填充，输出校验和可以由客户端算出
+static void fill_input(std::vector<uint8_t> &data, uint64_t seed) {
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)((seed * 131 + i * 7) & 0xff);
+    }
+}
+
+static bool check_output(const InferResult &result, const std::vector<uint8_t> &input) {
+    if (result.status != INFER_STATUS_OK || result.outputs.size() != 1 || result.outputs[0].size() < sizeof(uint64_t)) {
+        return false;
+    }
+    uint64_t sum = 0;
+    memcpy(&sum, result.outputs[0].data(), sizeof(sum));
+    return sum == MockInferBackend::checksum(input.data(), (uint32_t)input.size());
+}
+
+// 把 input 写入 memfd（大小 fd_size，seals 为要加的封印）后用 submit_fd 提交，返回结果状态
+static int submit_memfd(InferClient &client, const std::vector<uint8_t> &input, size_t fd_size, int seals) {
+    int fd = memfd_create("test_input", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    CHECK_VAL(fd < 0, return -1;)
+    if (ftruncate(fd, (off_t)fd_size) != 0 || write(fd, input.data(), std::min(fd_size, input.size())) < 0 ||
+        (seals != 0 && fcntl(fd, F_ADD_SEALS, seals) != 0)) {
+        close(fd);
+        return -1;
+    }
+    std::promise<int> status;
+    auto input_size = (uint32_t)input.size();
+    int ret = client.submit_fd(fd, &input_size, 1, [&status](InferResult &r) { status.set_value(r.status); });
+    close(fd);
+    return ret != 0 ? -1 : status.get_future().get();
+}
+
+int test_protocol() {
+    MockInferBackend backend(2, 1, 1024, 64, 100, 0);
+    InferServerConfig config;
+    config.socket_path = TEST_SOCKET_PATH;
+    InferServer server(config, &backend);
+    CHECK_VAL(!server.is_init(), d_unit_test_error("start server failed"); return -1;)
+
+    // 阈值为 0 的客户端全部走 fd 传递
+    InferClient inline_client(TEST_SOCKET_PATH);
+    InferClient fd_client(TEST_SOCKET_PATH, 0);
+    CHECK_VAL(!inline_client.is_init() || !fd_client.is_init(), d_unit_test_error("connect failed"); return -1;)
+    std::vector<uint8_t> input(1024);
+    for (uint64_t i = 0; i < 20; i++) {
+        fill_input(input, i);
+        InferClientInput in = {input.data(), (uint32_t)input.size()};
+        InferResult result;
+        InferClient &client = i % 2 == 0 ? inline_client : fd_client;
+        if (client.infer(&in, 1, result, 1000) != 0 || !check_output(result, input) ||
+            result.outputs[0].size() != 64 || result.infer_us < 100) {
+            d_unit_test_error("request %d failed, status %d", (int)i, result.status)
+            return -1;
+        }
+    }
+
+    // 输入大小不符返回错误，连接仍然可用
+    std::vector<uint8_t> bad(100);
+    InferClientInput in = {bad.data(), (uint32_t)bad.size()};
+    InferResult result;
+    if (inline_client.infer(&in, 1, result, 1000) != 0 || result.status != INFER_STATUS_BAD_REQUEST) {
+        d_unit_test_error("bad request not rejected, status %d", result.status)
+        return -1;
+    }
+    in = {input.data(), (uint32_t)input.size()};
+    if (inline_client.infer(&in, 1, result, 1000) != 0 || !check_output(result, input)) {
+        d_unit_test_error("connection unusable after bad request")
+        return -1;
+    }
+
+    // fd 比声明的输入小或者可以被缩小时拒绝（否则截断后服务端访问映射会 SIGBUS）
+    if (submit_memfd(inline_client, input, input.size() / 2, F_SEAL_SHRINK) != INFER_STATUS_BAD_REQUEST ||
+        submit_memfd(inline_client, input, input.size(), 0) != INFER_STATUS_BAD_REQUEST ||
+        submit_memfd(inline_client, input, input.size(), F_SEAL_SHRINK) != INFER_STATUS_OK) {
+        d_unit_test_error("unsafe data fd not rejected")
+        return -1;
+    }
+
+    // 服务停止后未返回的请求以断开回调
+    std::atomic<int> disconnected{0};
+    MockInferBackend slow_backend(1, 1, 1024, 64, 200000, 0);
+    config.socket_path = TEST_SOCKET_PATH "2";
+    auto *slow_server = new InferServer(config, &slow_backend);
+    InferClient slow_client(config.socket_path);
+    for (int i = 0; i < 4; i++) {
+        slow_client.submit(&in, 1, [&disconnected](InferResult &r) {
+            disconnected += r.status == INFER_STATUS_DISCONNECTED ? 1 : 0;
+        });
+    }
+    sleepUS(20000);
+    delete slow_server;
+    slow_client.close();
+    if (disconnected < 3 || slow_client.pending() != 0) {
+        d_unit_test_error("pending requests not failed on disconnect: %d", disconnected.load())
+        return -1;
+    }
+    d_unit_test_info("protocol pass")
+    return 0;
+}
+
+int test_float_model() {
+    // 非量化模型的输入 tensor size 是 float16 字节数，请求仍按 uint8 元素个数发送
+    const uint32_t input_size = 1024;
+    for (uint32_t model_batch : {1u, 4u}) {
+        MockInferBackend backend(1, model_batch, input_size, 64, 100, 0, RKNN_TENSOR_FLOAT16);
+        InferServerConfig config;
+        config.socket_path = TEST_SOCKET_PATH;
+        InferServer server(config, &backend);
+        CHECK_VAL(!server.is_init(), d_unit_test_error("start server failed"); return -1;)
+        InferClient client(TEST_SOCKET_PATH);
+        std::vector<uint8_t> input(input_size);
+        fill_input(input, model_batch);
+        InferClientInput in = {input.data(), input_size};
+        InferResult result;
+        if (client.infer(&in, 1, result, 1000) != 0 || !check_output(result, input)) {
+            d_unit_test_error("float16 model batch %d request failed, status %d", (int)model_batch, result.status)
+            return -1;
+        }
+    }
+    d_unit_test_info("float model pass")
+    return 0;
+}
+
+int test_stalled_client() {
+    // 不读取响应的客户端超时后被断开，同一上下文上其他客户端的请求不被阻塞
+    const uint32_t input_size = 1024;
+    MockInferBackend backend(1, 1, input_size, 4 * 1024 * 1024, 100, 0);
+    InferServerConfig config;
+    config.socket_path = TEST_SOCKET_PATH;
+    config.send_timeout_ms = 200;
+    InferServer server(config, &backend);
+    CHECK_VAL(!server.is_init(), d_unit_test_error("start server failed"); return -1;)
+
+    // 直接按协议发送请求，从不读取响应，4MB 的响应会填满套接字缓冲
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, TEST_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    CHECK_VAL(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0,
+              d_unit_test_error("connect failed"); CHECK_VAL(fd >= 0, close(fd);) return -1;)
+    std::vector<uint8_t> input(input_size);
+    fill_input(input, 7);
+    for (uint64_t i = 0; i < 4; i++) {
+        InferRequestHeader header{};
+        header.magic = INFER_SERVER_MAGIC;
+        header.version = INFER_SERVER_VERSION;
+        header.request_id = i;
+        header.n_inputs = 1;
+        header.input_size[0] = input_size;
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+            write(fd, input.data(), input_size) != (ssize_t)input_size) {
+            d_unit_test_error("send request failed")
+            close(fd);
+            return -1;
+        }
+    }
+    sleepUS(20000);
+
+    InferClient client(TEST_SOCKET_PATH);
+    InferClientInput in = {input.data(), input_size};
+    InferResult result;
+    int ret = client.infer(&in, 1, result, 2000) != 0 || !check_output(result, input) ? -1 : 0;
+    close(fd);
+    if (ret != 0) {
+        d_unit_test_error("request blocked by stalled client, status %d", result.status)
+        return -1;
+    }
+    d_unit_test_info("stalled client pass")
+    return 0;
+}
+
+int test_batch_split() {
+    // 模型 batch 为 4：同时到达的请求拼成一批，输出按 batch 项拆回各自请求
+    MockInferBackend backend(1, 4, 512, 32, 2000, 0);
+    InferServerConfig config;
+    config.socket_path = TEST_SOCKET_PATH;
+    config.batch_wait_us = 5000;
+    InferServer server(config, &backend);
+    CHECK_VAL(!server.is_init(), d_unit_test_error("start server failed"); return -1;)
+    InferClient client(TEST_SOCKET_PATH);
+
+    const int request_num = 64;
+    std::vector<std::vector<uint8_t>> inputs(request_num, std::vector<uint8_t>(512));
+    std::atomic<int> done{0};
+    std::atomic<int> errors{0};
+    std::atomic<uint32_t> max_batch{0};
+    for (int i = 0; i < request_num; i++) {
+        fill_input(inputs[i], i);
+        InferClientInput in = {inputs[i].data(), 512};
+        client.submit(&in, 1, [&, i](InferResult &r) {
+            errors += check_output(r, inputs[i]) ? 0 : 1;
+            uint32_t batch = max_batch;
+            while (r.batch_size > batch && !max_batch.compare_exchange_weak(batch, r.batch_size)) {}
+            done++;
+        });
+    }
+    for (int i = 0; i < 1000 && done < request_num; i++) {
+        sleepUS(1000);
+    }
+    InferServerStats stats = server.get_stats();
+    if (done != request_num || errors != 0 || max_batch != 4 || stats.batches >= (uint64_t)request_num) {
+        d_unit_test_error("batch split failed: done %d errors %d max batch %d batches %d", done.load(),
+                          errors.load(), (int)max_batch.load(), (int)stats.batches)
+        return -1;
+    }
+    d_unit_test_info("batch split pass: %d requests in %d batches", request_num, (int)stats.batches)
+    return 0;
+}
+
+struct LoadResult {
+    double throughput;
+    double p50_ms;
+    double p99_ms;
+    double avg_batch;
+    int errors;
+};
+
+/**
+ * @brief 压测：client_num 个连接，每个连接保持 window 个未返回的请求，持续 duration_ms
+ */
+LoadResult run_load(const std::string &socket_path, uint32_t input_size, int client_num, int window,
+                    int duration_ms, bool verify) {
+    std::vector<uint8_t> input(input_size);
+    fill_input(input, 1);
+    std::mutex latency_mutex;
+    std::vector<uint32_t> latency;
+    std::atomic<int> errors{0};
+    std::atomic<uint64_t> batch_sum{0};
+
+    std::vector<std::thread> threads;
+    time_unit t_start = getTimeOfNs();
+    time_unit t_end = t_start + (time_unit)duration_ms * 1000000;
+    for (int c = 0; c < client_num; c++) {
+        threads.emplace_back([&]() {
+            InferClient client(socket_path);
+            if (!client.is_init()) {
+                errors++;
+                return;
+            }
+            std::mutex mutex;
+            std::condition_variable cond;
+            int in_flight = 0;
+            std::vector<uint32_t> local;
+            auto callback = [&](InferResult &r) {
+                if (r.status != INFER_STATUS_OK || (verify && !check_output(r, input))) {
+                    errors++;
+                } else {
+                    local.push_back(r.rtt_us);
+                    batch_sum += r.batch_size;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                in_flight--;
+                cond.notify_one();
+            };
+            InferClientInput in = {input.data(), input_size};
+            while (getTimeOfNs() < t_end) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&] { return in_flight < window; });
+                    in_flight++;
+                }
+                if (client.submit(&in, 1, callback) != 0) {
+                    errors++;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    in_flight--;
+                    break;
+                }
+            }
+            // 等待剩余请求返回
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait_for(lock, std::chrono::seconds(5), [&] { return in_flight == 0; });
+            lock.unlock();
+            client.close();
+            std::lock_guard<std::mutex> latency_lock(latency_mutex);
+            latency.insert(latency.end(), local.begin(), local.end());
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = (double)(getTimeOfNs() - t_start) / 1e9;
+
+    LoadResult result{};
+    result.errors = errors;
+    if (!latency.empty()) {
+        std::sort(latency.begin(), latency.end());
+        result.throughput = (double)latency.size() / cost_s;
+        result.p50_ms = latency[latency.size() / 2] / 1000.0;
+        result.p99_ms = latency[std::min(latency.size() - 1, latency.size() * 99 / 100)] / 1000.0;
+        result.avg_batch = (double)batch_sum / (double)latency.size();
+    }
+    return result;
+}
+
+/**
+ * @brief 模拟 3 个 NPU 核心上的 640x640 模型（约 1.2MB 输入，走 fd 传递），
+ *        比较不攒批和 batch 模型在不同并发下的吞吐和延时
+ */
+int test_load(uint32_t model_batch, uint32_t base_us, uint32_t item_us) {
+    const uint32_t input_size = 640 * 640 * 3;
+    MockInferBackend backend(3, model_batch, input_size, 25200 * 85 / 16, base_us, item_us);
+    InferServerConfig config;
+    config.socket_path = TEST_SOCKET_PATH;
+    config.max_batch = 1;
+    config.batch_wait_us = 2000;
+    InferServer server(config, &backend);
+    CHECK_VAL(!server.is_init(), d_unit_test_error("start server failed"); return -1;)
+
+    int ret = 0;
+    const int concurrency[][2] = {{1, 1}, {2, 1}, {4, 1}, {4, 2}, {8, 2}, {8, 4}};
+    for (auto &level : concurrency) {
+        LoadResult result = run_load(TEST_SOCKET_PATH, input_size, level[0], level[1], 1000, false);
+        d_unit_test_warn("model batch %d, %2d clients x %d in flight: %7.1f req/s, p50 %6.2f ms, p99 %6.2f ms, avg batch %.2f",
+                         (int)model_batch, level[0], level[1], result.throughput, result.p50_ms,
+                         result.p99_ms, result.avg_batch)
+        ret |= result.errors != 0 || result.throughput <= 0 ? -1 : 0;
+    }
+    server.print_stats();
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3) {
+        // 压测外部服务
+        auto input_size = (uint32_t)strtoul(argv[2], nullptr, 10);
+        int ret = 0;
+        for (int clients : {1, 2, 4, 8, 16}) {
+            LoadResult result = run_load(argv[1], input_size, clients, 2, 3000, false);
+            d_unit_test_warn("%2d clients x 2 in flight: %7.1f req/s, p50 %6.2f ms, p99 %6.2f ms, avg batch %.2f, errors %d",
+                             clients, result.throughput, result.p50_ms, result.p99_ms,
+                             result.avg_batch, result.errors)
+            ret |= result.errors != 0 ? -1 : 0;
+        }
+        return ret;
+    }
+    int ret = test_protocol();
+    ret |= test_float_model();
+    ret |= test_stalled_client();
+    ret |= test_batch_split();
+    // 单 batch 模型：每次推理约 10ms
+    ret |= test_load(1, 8000, 2000);
+    // batch 4 模型：固定开销摊到 4 个请求上
+    ret |= test_load(4, 8000, 2000);
+    return ret;
+}
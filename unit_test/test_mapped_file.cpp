@@ -0,0 +1,156 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.21
+ * @brief: 内存映射文件测试：同一路径共享映射、内容一致、不能映射的输入返回空，
+ *         以及多个解码器循环读取同一文件时 fread 和 mmap 输入的耗时对比
+ */
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "mapped_file.h"
+
+#define TEST_FILE_PATH "test_mapped_file.bin"
+#define TEST_FILE_SIZE (64 << 20)
+#define TEST_DECODER_NUM 4
+#define TEST_LOOP_NUM 4
+// 与解码器一致：fread 每次读 5 MB，mmap 每次交出 512 KB
+#define TEST_READ_SIZE (5 << 20)
+#define TEST_MMAP_PACKET_SIZE (512 << 10)
+
+static int create_test_file(std::vector<uint8_t> &content) {
+    std::mt19937 rng(40);
+    content.resize(TEST_FILE_SIZE);
+    for (auto &v : content) {
+        v = (uint8_t)rng();
+    }
+    FILE *fp = fopen(TEST_FILE_PATH, "wb");
+    if (fp == nullptr) {
+        return -1;
+    }
+    size_t n = fwrite(content.data(), 1, content.size(), fp);
+    fclose(fp);
+    return n == content.size() ? 0 : -1;
+}
+
+// 模拟解码器读取输入：对交出的每段数据求和
+static uint64_t consume(const uint8_t *data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static uint64_t read_with_fread() {
+    std::vector<uint8_t> buffer(TEST_READ_SIZE);
+    uint64_t sum = 0;
+    FILE *fp = fopen(TEST_FILE_PATH, "rb");
+    for (int loop = 0; loop < TEST_LOOP_NUM; loop++) {
+        fseek(fp, 0, SEEK_SET);
+        size_t len;
+        while ((len = fread(buffer.data(), 1, buffer.size(), fp)) > 0) {
+            sum += consume(buffer.data(), len);
+        }
+    }
+    fclose(fp);
+    return sum;
+}
+
+static uint64_t read_with_mmap() {
+    std::shared_ptr<MappedFile> file = MappedFile::open_shared(TEST_FILE_PATH);
+    uint64_t sum = 0;
+    for (int loop = 0; loop < TEST_LOOP_NUM; loop++) {
+        for (size_t offset = 0; offset < file->size(); offset += TEST_MMAP_PACKET_SIZE) {
+            size_t len = std::min((size_t)TEST_MMAP_PACKET_SIZE, file->size() - offset);
+            file->prefetch(offset + len, TEST_MMAP_PACKET_SIZE);
+            sum += consume(file->data() + offset, len);
+        }
+    }
+    return sum;
+}
+
+int test_mapped_file() {
+    std::vector<uint8_t> content;
+    if (create_test_file(content) != 0) {
+        d_unit_test_error("create test file failed")
+        return -1;
+    }
+    std::shared_ptr<MappedFile> file_1 = MappedFile::open_shared(TEST_FILE_PATH);
+    std::shared_ptr<MappedFile> file_2 = MappedFile::open_shared(TEST_FILE_PATH);
+    if (file_1 == nullptr || file_1 != file_2 || file_1->size() != content.size() ||
+        memcmp(file_1->data(), content.data(), content.size()) != 0) {
+        d_unit_test_error("shared mapping mismatch")
+        return -1;
+    }
+    // 所有使用者释放后重新映射
+    file_1.reset();
+    file_2.reset();
+    std::shared_ptr<MappedFile> file_3 = MappedFile::open_shared(TEST_FILE_PATH);
+    if (file_3 == nullptr || file_3.use_count() != 1) {
+        d_unit_test_error("mapping not released")
+        return -1;
+    }
+    file_3.reset();
+
+    // 空文件、管道和不存在的文件不能映射
+    FILE *fp = fopen("test_mapped_file_empty.bin", "wb");
+    fclose(fp);
+    mkfifo("test_mapped_file.fifo", 0666);
+    if (MappedFile::open_shared("test_mapped_file_empty.bin") != nullptr ||
+        MappedFile::open_shared("test_mapped_file.fifo") != nullptr ||
+        MappedFile::open_shared("test_mapped_file_not_exist.bin") != nullptr) {
+        d_unit_test_error("invalid input should not be mapped")
+        return -1;
+    }
+    remove("test_mapped_file_empty.bin");
+    unlink("test_mapped_file.fifo");
+    d_unit_test_info("mapped file pass")
+    return 0;
+}
+
+int test_read_cost() {
+    // 多个解码器同时循环读取同一文件（文件已在页缓存中）
+    uint64_t sums[2][TEST_DECODER_NUM] = {};
+    time_unit costs[2];
+    for (int mode = 0; mode < 2; mode++) {
+        time_unit t_start = getTimeOfNs();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < TEST_DECODER_NUM; i++) {
+            threads.emplace_back([mode, i, &sums] {
+                sums[mode][i] = mode == 0 ? read_with_fread() : read_with_mmap();
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        costs[mode] = getTimeOfNs() - t_start;
+    }
+    for (int i = 0; i < TEST_DECODER_NUM; i++) {
+        if (sums[0][i] != sums[1][i]) {
+            d_unit_test_error("read content mismatch")
+            return -1;
+        }
+    }
+    double total_mb = (double)TEST_FILE_SIZE * TEST_LOOP_NUM * TEST_DECODER_NUM / 1e6;
+    d_unit_test_warn("%d decoders x %d loops, %.0f MB: fread %.1f ms, mmap %.1f ms",
+                     TEST_DECODER_NUM, TEST_LOOP_NUM, total_mb,
+                     (double)costs[0] / 1e6, (double)costs[1] / 1e6)
+    remove(TEST_FILE_PATH);
+    return 0;
+}
+
+int main() {
+    int ret = test_mapped_file();
+    ret |= test_read_cost();
+    return ret;
+}
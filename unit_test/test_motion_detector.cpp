@@ -0,0 +1,213 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.29
+ * @brief: 运动检测测试：比较内核和逐像素参考实现一致，静止画面加噪声跳过推理并按间隔刷新，
+ *         局部目标移动时 ROI 包含目标，整体光照变化整帧推理后背景重新适应，按流读取配置，
+ *         以及 1080p 亮度平面的检测耗时和监控场景下的跳帧比例
+ */
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "motion_detector.h"
+
+#define TEST_WIDTH (1920)
+#define TEST_HEIGHT (1080)
+// 行步长大于宽度，与解码帧一致
+#define TEST_STRIDE (1984)
+
+// 逐像素参考实现
+static void diff_row_ref(const uint8_t *cur, uint8_t *bg, uint32_t count, uint8_t threshold, uint32_t learn_shift,
+                         uint16_t *tile_counts) {
+    for (uint32_t i = 0; i < count; i++) {
+        int diff = cur[i] > bg[i] ? cur[i] - bg[i] : bg[i] - cur[i];
+        tile_counts[i / MOTION_TILE_SIZE] += diff > threshold ? 1 : 0;
+        // 向下取整，与算术右移一致
+        int delta = (int)cur[i] - (int)bg[i];
+        int step = delta >= 0 ? delta / (1 << learn_shift) : -((-delta + (1 << learn_shift) - 1) / (1 << learn_shift));
+        bg[i] = (uint8_t)(bg[i] + step);
+    }
+}
+
+// 亮度平面：背景渐变加噪声，(box_x, box_y) 处有一个 box_size 的亮块，brightness 为整体亮度偏移
+static void draw_luma(std::vector<uint8_t> &luma, int box_x, int box_y, int box_size, int brightness, int noise,
+                      uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        uint8_t *row = luma.data() + (size_t)y * TEST_STRIDE;
+        for (int x = 0; x < TEST_WIDTH; x++) {
+            int value = (x + y) / 16 + 40 + brightness;
+            if (x >= box_x && x < box_x + box_size && y >= box_y && y < box_y + box_size) {
+                value = 230;
+            }
+            if (noise > 0) {
+                value += (int)(rng() % (2 * noise + 1)) - noise;
+            }
+            row[x] = (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+    }
+}
+
+int test_diff_row() {
+    std::mt19937 rng(7);
+    for (uint32_t count : {1u, 15u, 16u, 17u, 100u, 480u}) {
+        for (uint32_t shift : {0u, 1u, 3u, 7u}) {
+            std::vector<uint8_t> cur(count), bg(count);
+            for (uint32_t i = 0; i < count; i++) {
+                cur[i] = (uint8_t)rng();
+                // 一半像素接近背景
+                bg[i] = i % 2 == 0 ? (uint8_t)rng() : (uint8_t)std::min(255, cur[i] + (int)(rng() % 8));
+            }
+            std::vector<uint8_t> bg_ref = bg;
+            std::vector<uint16_t> counts(count / MOTION_TILE_SIZE + 1, 0), counts_ref(counts.size(), 0);
+            MotionDetector::diff_row(cur.data(), bg.data(), count, 25, shift, counts.data());
+            diff_row_ref(cur.data(), bg_ref.data(), count, 25, shift, counts_ref.data());
+            if (bg != bg_ref || counts != counts_ref) {
+                d_unit_test_error("diff row mismatch, count %d, shift %d", (int)count, (int)shift)
+                return -1;
+            }
+        }
+    }
+    d_unit_test_info("diff row pass")
+    return 0;
+}
+
+int test_decision() {
+    std::vector<uint8_t> luma((size_t)TEST_STRIDE * TEST_HEIGHT);
+    MotionDetectConfig config;
+    config.mode = MOTION_GATE_ROI;
+    config.refresh_frames = 10;
+    MotionDetector detector(config);
+    MotionResult result;
+
+    // 第一帧整帧推理，之后静止画面加噪声跳过
+    draw_luma(luma, -200, 0, 120, 0, 4, 0);
+    detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    CHECK_VAL(result.decision != MOTION_DECISION_FULL, d_unit_test_error("first frame should be full"); return -1;)
+    for (int i = 1; i < 10; i++) {
+        draw_luma(luma, -200, 0, 120, 0, 4, i);
+        detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+        if (result.decision != MOTION_DECISION_SKIP || result.dirty_tiles != 0) {
+            d_unit_test_error("static frame %d not skipped, dirty tiles %d", i, (int)result.dirty_tiles)
+            return -1;
+        }
+    }
+    // 距离上次整帧推理达到 refresh_frames 时刷新
+    draw_luma(luma, -200, 0, 120, 0, 4, 10);
+    detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    CHECK_VAL(result.decision != MOTION_DECISION_FULL, d_unit_test_error("refresh frame should be full"); return -1;)
+
+    // 局部目标：ROI 包含目标，宽高比与整帧一致
+    draw_luma(luma, 1500, 700, 120, 0, 4, 10);
+    detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    const MotionRect &roi = result.roi;
+    if (result.decision != MOTION_DECISION_ROI || roi.x > 1500 || roi.y > 700 || roi.x + roi.width < 1620 ||
+        roi.y + roi.height < 820 || roi.x + roi.width > TEST_WIDTH || roi.y + roi.height > TEST_HEIGHT ||
+        roi.x % 2 != 0 || roi.width % 2 != 0 || std::abs(roi.width * 9 - roi.height * 16) > 32) {
+        d_unit_test_error("bad roi: decision %d, %d %d %d %d", result.decision, roi.x, roi.y, roi.width, roi.height)
+        return -1;
+    }
+
+    // 请求整帧推理
+    detector.request_full();
+    draw_luma(luma, 1500, 700, 120, 0, 4, 11);
+    detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    CHECK_VAL(result.decision != MOTION_DECISION_FULL, d_unit_test_error("requested full frame"); return -1;)
+
+    // 整体光照变化：整帧推理，背景适应后重新跳过
+    int frame = 0;
+    for (; frame < 30; frame++) {
+        draw_luma(luma, 1500, 700, 120, 40, 4, 100 + frame);
+        detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+        if (frame == 0 && result.decision != MOTION_DECISION_FULL) {
+            d_unit_test_error("lighting change should be full, dirty tiles %d / %d", (int)result.dirty_tiles,
+                              (int)result.total_tiles)
+            return -1;
+        }
+        if (result.decision == MOTION_DECISION_SKIP) {
+            break;
+        }
+    }
+    CHECK_VAL(frame == 30, d_unit_test_error("background not adapted to lighting change"); return -1;)
+    d_unit_test_info("decision pass, background adapted after %d frames", frame)
+
+    // skip 模式不裁剪
+    config.mode = MOTION_GATE_SKIP;
+    MotionDetector skip_detector(config);
+    draw_luma(luma, 1500, 700, 120, 0, 4, 0);
+    skip_detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    draw_luma(luma, 1400, 700, 120, 0, 4, 1);
+    skip_detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+    CHECK_VAL(result.decision != MOTION_DECISION_FULL, d_unit_test_error("skip mode should not crop"); return -1;)
+    return 0;
+}
+
+int test_config() {
+    const char *path = "/tmp/test_motion_streams.properties";
+    std::ofstream file(path);
+    file << "stream.1 = file:1080p.264\n"
+         << "motion.2.pixel_threshold = 40\n"
+         << "motion.mode = roi\n"
+         << "motion.downsample = 8\n"
+         << "motion.3.mode = off\n";
+    file.close();
+    MotionDetectConfigSet config_set;
+    CHECK_VAL(load_motion_detect_config(path, config_set) != 0, d_unit_test_error("load config failed"); return -1;)
+    // 流的配置继承默认值，与顺序无关
+    const MotionDetectConfig &c1 = config_set.get(1);
+    const MotionDetectConfig &c2 = config_set.get(2);
+    const MotionDetectConfig &c3 = config_set.get(3);
+    if (c1.mode != MOTION_GATE_ROI || c1.pixel_threshold != 25 || c2.mode != MOTION_GATE_ROI ||
+        c2.downsample != 8 || c2.pixel_threshold != 40 || c3.mode != MOTION_GATE_OFF || c3.downsample != 8) {
+        d_unit_test_error("config mismatch")
+        return -1;
+    }
+    remove(path);
+    d_unit_test_info("config pass")
+    return 0;
+}
+
+/**
+ * @brief 监控场景：300 帧中第 100 ~ 160 帧有目标经过，统计推理方式和检测耗时
+ */
+int test_surveillance() {
+    std::vector<uint8_t> luma((size_t)TEST_STRIDE * TEST_HEIGHT);
+    MotionDetectConfig config;
+    config.mode = MOTION_GATE_ROI;
+    MotionDetector detector(config);
+    MotionResult result;
+    for (int frame = 0; frame < 300; frame++) {
+        int box_x = frame >= 100 && frame < 160 ? 200 + (frame - 100) * 24 : -500;
+        draw_luma(luma, box_x, 500, 160, 0, 3, frame);
+        detector.detect(luma.data(), TEST_WIDTH, TEST_HEIGHT, TEST_STRIDE, result);
+        if (frame >= 101 && frame < 160 && result.decision == MOTION_DECISION_SKIP) {
+            d_unit_test_error("moving object skipped at frame %d", frame)
+            return -1;
+        }
+    }
+    MotionDetectStats stats = detector.get_stats();
+    d_unit_test_warn("surveillance: %d frames, full %d, roi %d, skipped %d, detect %.3f ms per frame",
+                     (int)stats.frames, (int)stats.full_frames, (int)stats.roi_frames, (int)stats.skipped_frames,
+                     (double)stats.detect_us / (double)stats.frames / 1000.0)
+    // 静止部分除按间隔刷新外都跳过
+    if (stats.skipped_frames < 220 || stats.roi_frames < 50) {
+        d_unit_test_error("unexpected decisions")
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int ret = test_diff_row();
+    ret |= test_decision();
+    ret |= test_config();
+    ret |= test_surveillance();
+    return ret;
+}
@@ -2,13 +2,20 @@
  * @author: bo.liu
  * @mail: geniusrabbit@qq.com
  * @date: 2023.08.09
- * @brief: Rockchip MPP 视频解码测试
+ * @brief: Rockchip MPP 视频解码测试，以及解码后重新编码时不同输入方式（两次拷贝 / 一次拷贝 / 零拷贝）的耗时对比，
+ *         按流管理编码器（按帧尺寸创建、尺寸变化重建、空闲销毁），同步解码和预解码的取帧耗时对比，
+ *         多路流由少量线程轮询解码（共享内存池、线程间窃取）
  */
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include "mpp_video_decoder.h"
 #include "utils_log.h"
 #include "utils.h"
 #include "mpp_video_encoder.h"
+#include "mpp_encoder_manager.h"
+#include "mpp_decoder_manager.h"
 
 #include "mpp_video_utils.h"
 
@@ -47,7 +54,110 @@ int test_decoder(){
     return 0;
 }
 
-int test_encoder(){
+// 每帧模拟 process_us 的处理耗时，统计取帧（等待解码）的总耗时
+int test_decode_ahead(int queue_size, time_unit process_us){
+    std::string path = "1080p_ffmpeg.h264";
+    MppVideoDecoder video_decoder = MppVideoDecoder(path);
+    if(!video_decoder.is_init()){
+        d_unit_test_error("MppVideoDecoder init failed!")
+        return -1;
+    }
+    if (queue_size > 0 && video_decoder.start_decode_ahead(queue_size) != 0) {
+        d_unit_test_error("start decode ahead failed!")
+        return -1;
+    }
+
+    uint32_t frame_count = 0;
+    time_unit get_ns = 0;
+    time_unit time_start = getTimeOfNs();
+    DecoderMppFrame frame{};
+    while (true) {
+        time_unit t_get = getTimeOfNs();
+        int ret = video_decoder.get_next_frame(frame, 1000);
+        get_ns += getTimeOfNs() - t_get;
+        if (ret != 0) {
+            break;
+        }
+        frame_count++;
+        sleepUS(process_us);
+        video_decoder.release_frame(frame);
+    }
+    time_unit time_cost = getTimeOfNs() - time_start;
+    MppDecoderStats stats = video_decoder.get_stats();
+    d_unit_test_warn("queue %d, process %d us, frames: %d, total %.1f ms, get frame %.3f ms/frame, "
+                     "avg ready: %.2f, decoder stall: %.1f ms, consumer wait: %.1f ms, decode latency: %.2f ms",
+                     queue_size, (int)process_us, frame_count, (double)time_cost / 1e6,
+                     frame_count > 0 ? (double)get_ns / 1e6 / frame_count : 0,
+                     stats.avg_queue_size, stats.decoder_stall_ms, stats.consumer_wait_ms,
+                     stats.avg_decode_latency_ms)
+    return 0;
+}
+
+// stream_num 路流由 thread_num 个线程取帧，线程 0 每帧多处理 process_us，其余线程窃取它的流
+int test_decoder_manager(int stream_num, int thread_num, time_unit process_us){
+    MppDecoderManagerConfig config;
+    for (int i = 0; i < stream_num; i++) {
+        config.streams.emplace_back("file:1080p_ffmpeg.h264");
+    }
+    config.input_threads = thread_num;
+    config.max_frame_memory_mb = 256;
+    MppDecoderManager manager(config);
+    if (!manager.is_init() || (int)manager.stream_count() != stream_num) {
+        d_unit_test_error("MppDecoderManager init failed!")
+        return -1;
+    }
+
+    std::atomic<uint64_t> total_frames{0};
+    time_unit time_start = getTimeOfNs();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; t++) {
+        threads.emplace_back([&manager, &total_frames, t, process_us] {
+            DecoderMppFrame frame{};
+            int stream_id = 0;
+            while (manager.get_next_frame(t, frame, stream_id) == 0) {
+                total_frames++;
+                if (t == 0) {
+                    sleepUS(process_us);
+                }
+                manager.release_frame(stream_id, frame);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double time_ms = (double)(getTimeOfNs() - time_start) / 1e6;
+
+    uint64_t stolen = 0;
+    auto stats_list = manager.get_stats();
+    for (auto &stats : stats_list) {
+        stolen += stats.stolen_frames;
+        if (!stats.finished || stats.frames != stats_list[0].frames) {
+            d_unit_test_error("stream %d frames: %llu, expect: %llu", stats.stream_id,
+                              (unsigned long long)stats.frames, (unsigned long long)stats_list[0].frames)
+            return -1;
+        }
+    }
+    for (auto &stats : manager.get_pool_stats()) {
+        d_unit_test_info("buffer pool %u bytes, streams: %d, limit: %u", stats.buf_size, stats.streams, stats.limit_count)
+    }
+    d_unit_test_warn("%d streams on %d threads: %llu frames in %.1f ms (%.1f fps), stolen: %llu",
+                     stream_num, thread_num, (unsigned long long)total_frames.load(), time_ms,
+                     (double)total_frames.load() * 1000 / time_ms, (unsigned long long)stolen)
+    return 0;
+}
+
+// 解码后重新编码的输入方式
+enum TranscodeMode {
+    // 原有方式：先去掉 padding，编码器再补上 padding（两次整帧拷贝）
+    TRANSCODE_DEL_ADD_STRIDE,
+    // 带步长的内存直接拷贝到编码器内存（一次拷贝）
+    TRANSCODE_SINGLE_COPY,
+    // 解码帧的 MppBuffer 直接作为编码器输入（零拷贝）
+    TRANSCODE_ZERO_COPY,
+};
+
+int test_encoder(TranscodeMode mode, const std::string &output_path){
     // 初始化解码器
     std::string path = "1080p_ffmpeg.h264";
     MppVideoDecoder video_decoder = MppVideoDecoder(path);
@@ -55,7 +165,6 @@ int test_encoder(){
         d_unit_test_error("MppVideoDecoder init failed!")
         return -1;
     }
-    std::string output_path = "1080p_ffmpeg_encoder.h264";
     MppVideoEncoder video_encoder = MppVideoEncoder(output_path);
     if(!video_encoder.is_init()){
         d_unit_test_error("MppVideoEncoder init failed!")
@@ -65,31 +174,103 @@ int test_encoder(){
     // 获取视频的下一帧数据
     uint64_t time_start = get_time_of_ms();
     uint32_t frame_count = 0;
+    uint64_t copy_bytes = 0;
+    std::vector<uint8_t> image_data;
     DecoderMppFrame frame{};
     while(video_decoder.get_next_frame(frame) == 0){
         frame_count++;
         d_unit_test_info("frame count: %d", frame_count)
 
-        uint8_t image_data[frame.data_size];
-        yuv_del_stride(
-                (uint8_t *) frame.data_buf,
-                frame.hor_width, frame.ver_height,
-                frame.hor_stride, frame.ver_stride,
-                frame.mpp_frame_format,
-                image_data);
-        video_encoder.process_image(image_data, frame.hor_width, frame.ver_height, frame.mpp_frame_format);
+        if (mode == TRANSCODE_DEL_ADD_STRIDE) {
+            image_data.resize(frame.data_size);
+            yuv_del_stride(
+                    (uint8_t *) frame.data_buf,
+                    frame.hor_width, frame.ver_height,
+                    frame.hor_stride, frame.ver_stride,
+                    frame.mpp_frame_format,
+                    image_data.data());
+            video_encoder.process_image(image_data.data(), frame.hor_width, frame.ver_height, frame.mpp_frame_format);
+            copy_bytes += frame.hor_width * frame.ver_height * 3;
+        } else if (mode == TRANSCODE_SINGLE_COPY) {
+            video_encoder.process_buffer((const uint8_t *) frame.data_buf,
+                                         (int32_t)frame.hor_width, (int32_t)frame.ver_height,
+                                         (int32_t)frame.hor_stride, (int32_t)frame.ver_stride,
+                                         frame.mpp_frame_format);
+            copy_bytes += frame.hor_stride * frame.ver_stride * 3 / 2;
+        } else {
+            video_encoder.process_frame(frame);
+        }
 
         video_decoder.release_frame(frame);
     }
     uint64_t time_end = get_time_of_ms();
-    d_unit_test_warn("frame count: %d", frame_count)
+    d_unit_test_warn("mode: %d, frame count: %d, cpu copy: %.1f MB", mode, frame_count, (double)copy_bytes / 1e6)
     d_unit_test_warn("time cost: %d ms", time_end - time_start)
     return 0;
 }
 
+int test_encoder_manager(){
+    std::string path = "1080p_ffmpeg.h264";
+    MppVideoDecoder video_decoder = MppVideoDecoder(path);
+    if(!video_decoder.is_init()){
+        d_unit_test_error("MppVideoDecoder init failed!")
+        return -1;
+    }
+    MppEncoderManagerConfig config;
+    config.path_pattern = "1080p_ffmpeg_stream_%d.h264";
+    config.idle_timeout_ms = 200;
+    MppEncoderManager manager(config);
+
+    // 流 0 编码所有帧；流 1 编码前一半帧后停止，随后因空闲被销毁；流 2 中途把宽高裁小一半，触发重建
+    uint32_t frame_count = 0;
+    DecoderMppFrame frame{};
+    while(video_decoder.get_next_frame(frame) == 0){
+        frame_count++;
+        manager.encode_frame(0, frame);
+        if (frame_count < 100) {
+            manager.encode_frame(1, frame);
+        }
+        DecoderMppFrame crop_frame = frame;
+        if (frame_count >= 50) {
+            crop_frame.hor_width = frame.hor_width / 2;
+            crop_frame.ver_height = frame.ver_height / 2;
+        }
+        manager.encode_frame(2, crop_frame);
+        video_decoder.release_frame(frame);
+        // 放慢 300 ms，流 1 空闲超时
+        if (frame_count > 100 && frame_count <= 160) {
+            sleepUS(5 * 1000);
+        }
+    }
+    for (auto &stats : manager.get_stats()) {
+        d_unit_test_warn("stream %d %dx%d, reinit: %d, pushed: %llu, encoded: %llu, dropped: %llu, written: %llu",
+                         stats.stream_id, stats.width, stats.height, stats.reinit_count,
+                         (unsigned long long)stats.encoder.pushed_frames,
+                         (unsigned long long)stats.encoder.encoded_frames,
+                         (unsigned long long)stats.encoder.dropped_frames,
+                         (unsigned long long)stats.encoder.written_bytes)
+    }
+    if (frame_count > 160 && manager.stream_count() != 2) {
+        d_unit_test_error("idle stream not removed, stream count: %d", (int)manager.stream_count())
+        return -1;
+    }
+    return 0;
+}
+
 int main(){
 //    test_decoder();
 
-    test_encoder();
+    test_encoder(TRANSCODE_DEL_ADD_STRIDE, "1080p_ffmpeg_encoder_del_add.h264");
+    test_encoder(TRANSCODE_SINGLE_COPY, "1080p_ffmpeg_encoder_single_copy.h264");
+    test_encoder(TRANSCODE_ZERO_COPY, "1080p_ffmpeg_encoder_zero_copy.h264");
+    test_encoder_manager();
+
+    // 同步解码 / 预解码 4 帧，每帧处理 10 ms
+    test_decode_ahead(0, 10 * 1000);
+    test_decode_ahead(4, 10 * 1000);
+
+    // 2 / 8 路流由 2 个线程解码
+    test_decoder_manager(2, 2, 5 * 1000);
+    test_decoder_manager(8, 2, 5 * 1000);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,390 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.16
+ * @brief: MPP 帧数据转换测试，对比原有先去 padding 再转换的方式和直接引用带步长帧数据的方式，
+ *         以及 OpenCV 转换 + 缩放 + 填充流程和融合转换缩放的耗时；
+ *         编码输入先去 padding 再补 padding 和一次按步长拷贝的耗时
+ */
+#include <vector>
+#include <random>
+#include <cstring>
+#include <algorithm>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "mpp_video_utils.h"
+
+#define TEST_LOOP_COUNT 50
+#define TEST_MODEL_IN_SIZE 640
+
+// 参考实现：先拷贝去掉 padding，再按 NV12 / I420 转换
+// （原有实现使用的 COLOR_YUV420sp2RGB / COLOR_YUV420p2RGB 是 NV21 / YV12，U、V 颠倒）
+static int legacy_frame_data_to_mat(
+        const uint8_t *data_buf,
+        uint32_t width, uint32_t height,
+        uint32_t hor_stride, uint32_t ver_stride,
+        MppFrameFormat fmt,
+        cv::Mat &rgb_img) {
+    cv::Mat yuv_img;
+    yuv_img.create((int)height * 3 / 2, (int)width, CV_8UC1);
+    if (yuv_del_stride(data_buf, width, height, hor_stride, ver_stride, fmt, yuv_img.data) != 0) {
+        return -1;
+    }
+    cv::cvtColor(yuv_img, rgb_img, fmt == MPP_FMT_YUV420SP ? cv::COLOR_YUV2RGB_NV12 : cv::COLOR_YUV2RGB_I420);
+    return 0;
+}
+
+// 生成带 padding 的随机帧数据
+static void gen_frame(std::vector<uint8_t> &frame, uint32_t hor_stride, uint32_t ver_stride, uint32_t seed) {
+    std::mt19937 rng(seed);
+    frame.resize(hor_stride * ver_stride * 3 / 2);
+    for (auto &v : frame) {
+        v = (uint8_t)(rng() & 0xff);
+    }
+}
+
+static int test_frame_size(uint32_t width, uint32_t height, uint32_t hor_stride, uint32_t ver_stride) {
+    std::vector<uint8_t> frame;
+    gen_frame(frame, hor_stride, ver_stride, width);
+
+    const MppFrameFormat fmts[2] = {MPP_FMT_YUV420SP, MPP_FMT_YUV420P};
+    const char *fmt_names[2] = {"nv12", "i420"};
+    for (int f = 0; f < 2; f++) {
+        cv::Mat legacy_img;
+        cv::Mat rgb_img;
+        legacy_frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmts[f], legacy_img);
+        frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmts[f], rgb_img);
+        if (legacy_img.size() != rgb_img.size() || cv::norm(legacy_img, rgb_img, cv::NORM_INF) > 0) {
+            d_unit_test_error("%s %dx%d result mismatch", fmt_names[f], width, height)
+            return -1;
+        }
+
+        time_unit t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            legacy_frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmts[f], legacy_img);
+        }
+        time_unit t_legacy = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmts[f], rgb_img);
+        }
+        time_unit t_stride = getTimeOfNs() - t_start;
+        d_unit_test_warn("%s %dx%d (stride %dx%d) avg: copy then convert %.3f ms, strided convert %.3f ms",
+                         fmt_names[f], width, height, hor_stride, ver_stride,
+                         (double)t_legacy / TEST_LOOP_COUNT / 1e6,
+                         (double)t_stride / TEST_LOOP_COUNT / 1e6)
+    }
+    return 0;
+}
+
+// U、V 顺序：U 偏低、V 偏高的帧转换后 R 明显大于 B，有无 padding 结果一致
+static int test_chroma_order(uint32_t width, uint32_t height, uint32_t hor_stride, uint32_t ver_stride) {
+    const MppFrameFormat fmts[2] = {MPP_FMT_YUV420SP, MPP_FMT_YUV420P};
+    const char *fmt_names[2] = {"nv12", "i420"};
+    for (int f = 0; f < 2; f++) {
+        std::vector<uint8_t> frame(hor_stride * ver_stride * 3 / 2, 128);
+        uint8_t *base_c = frame.data() + hor_stride * ver_stride;
+        for (uint32_t row = 0; row < height / 2; row++) {
+            for (uint32_t col = 0; col < width / 2; col++) {
+                if (fmts[f] == MPP_FMT_YUV420SP) {
+                    base_c[row * hor_stride + col * 2] = 80;
+                    base_c[row * hor_stride + col * 2 + 1] = 200;
+                } else {
+                    base_c[row * hor_stride / 2 + col] = 80;
+                    base_c[hor_stride * ver_stride / 4 + row * hor_stride / 2 + col] = 200;
+                }
+            }
+        }
+        cv::Mat rgb_img;
+        if (frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmts[f], rgb_img) != 0 ||
+            rgb_img.empty()) {
+            d_unit_test_error("%s %dx%d convert failed", fmt_names[f], width, height)
+            return -1;
+        }
+        const uint8_t *pixel = rgb_img.data + (height / 2) * (size_t)rgb_img.step + (width / 2) * 3;
+        if (pixel[0] < pixel[2] + 100) {
+            d_unit_test_error("%s %dx%d stride %dx%d chroma swapped", fmt_names[f], width, height, hor_stride, ver_stride)
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 生成平滑渐变的帧数据（用于和 OpenCV 流程对比，两者的色度插值方式不同，随机数据没有可比性）
+static void gen_gradient_frame(std::vector<uint8_t> &frame, uint32_t width, uint32_t height,
+                               uint32_t hor_stride, uint32_t ver_stride, MppFrameFormat fmt) {
+    frame.assign(hor_stride * ver_stride * 3 / 2, 0);
+    for (uint32_t row = 0; row < height; row++) {
+        for (uint32_t col = 0; col < width; col++) {
+            frame[row * hor_stride + col] = (uint8_t)(16 + col * 219 / width);
+        }
+    }
+    uint8_t *base_c = frame.data() + hor_stride * ver_stride;
+    for (uint32_t row = 0; row < height / 2; row++) {
+        for (uint32_t col = 0; col < width / 2; col++) {
+            auto u = (uint8_t)(64 + row * 128 / (height / 2));
+            auto v = (uint8_t)(192 - col * 128 / (width / 2));
+            if (fmt == MPP_FMT_YUV420SP) {
+                base_c[row * hor_stride + col * 2] = u;
+                base_c[row * hor_stride + col * 2 + 1] = v;
+            } else {
+                base_c[row * hor_stride / 2 + col] = u;
+                base_c[hor_stride * ver_stride / 4 + row * hor_stride / 2 + col] = v;
+            }
+        }
+    }
+}
+
+// OpenCV 流程：转换、缩放、填充三次遍历
+static void opencv_letterbox(const std::vector<uint8_t> &frame, uint32_t width, uint32_t height,
+                             uint32_t hor_stride, uint32_t ver_stride, MppFrameFormat fmt,
+                             const LetterboxInfo &info, cv::Mat &rgb_img, cv::Mat &resized_img, cv::Mat &model_in) {
+    frame_data_to_mat(frame.data(), width, height, hor_stride, ver_stride, fmt, rgb_img);
+    cv::resize(rgb_img, resized_img, cv::Size(info.resized_w, info.resized_h), 0, 0, cv::INTER_LINEAR);
+    cv::copyMakeBorder(resized_img, model_in,
+                       info.pad_top, TEST_MODEL_IN_SIZE - info.pad_top - info.resized_h,
+                       info.pad_left, TEST_MODEL_IN_SIZE - info.pad_left - info.resized_w,
+                       cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
+}
+
+static int test_fused_resize(uint32_t width, uint32_t height, uint32_t hor_stride, uint32_t ver_stride) {
+    const MppFrameFormat fmts[2] = {MPP_FMT_YUV420SP, MPP_FMT_YUV420P};
+    const char *fmt_names[2] = {"nv12", "i420"};
+    std::vector<uint8_t> model_in_buf(TEST_MODEL_IN_SIZE * TEST_MODEL_IN_SIZE * 3);
+    cv::Mat fused_img(TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE, CV_8UC3, model_in_buf.data());
+    for (int f = 0; f < 2; f++) {
+        std::vector<uint8_t> frame;
+        gen_gradient_frame(frame, width, height, hor_stride, ver_stride, fmts[f]);
+
+        LetterboxInfo info{};
+        frame_data_to_model_input(frame.data(), width, height, hor_stride, ver_stride, fmts[f],
+                                  model_in_buf.data(), TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE,
+                                  RKNN_TENSOR_NHWC, true, 114, &info);
+        cv::Mat rgb_img, resized_img, model_in;
+        opencv_letterbox(frame, width, height, hor_stride, ver_stride, fmts[f], info, rgb_img, resized_img, model_in);
+        // 系数精度和色度插值不同，只要求平均误差很小
+        cv::Mat diff_img;
+        cv::absdiff(model_in, fused_img, diff_img);
+        cv::Scalar diff = cv::mean(diff_img);
+        if (diff[0] > 3 || diff[1] > 3 || diff[2] > 3) {
+            d_unit_test_error("%s %dx%d fused resize diff too large: %.2f %.2f %.2f",
+                              fmt_names[f], width, height, diff[0], diff[1], diff[2])
+            return -1;
+        }
+
+        time_unit t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            opencv_letterbox(frame, width, height, hor_stride, ver_stride, fmts[f], info, rgb_img, resized_img, model_in);
+        }
+        time_unit t_opencv = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            frame_data_to_model_input(frame.data(), width, height, hor_stride, ver_stride, fmts[f],
+                                      model_in_buf.data(), TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE,
+                                      RKNN_TENSOR_NHWC, true, 114, &info);
+        }
+        time_unit t_fused = getTimeOfNs() - t_start;
+        d_unit_test_warn("%s %dx%d -> %d letterbox avg: opencv %.3f ms, fused %.3f ms (mean diff %.2f)",
+                         fmt_names[f], width, height, TEST_MODEL_IN_SIZE,
+                         (double)t_opencv / TEST_LOOP_COUNT / 1e6,
+                         (double)t_fused / TEST_LOOP_COUNT / 1e6, diff[0])
+    }
+    return 0;
+}
+
+// 逐像素参考实现的双线性源坐标（与 cv::INTER_LINEAR 相同的像素中心对齐）
+static void reference_coord(int d, float scale, int src_len, int &p0, int &p1, int &w1) {
+    float s = std::max(((float)d + 0.5f) / scale - 0.5f, 0.0f);
+    p0 = std::min((int)s, src_len - 1);
+    p1 = std::min(p0 + 1, src_len - 1);
+    w1 = p1 == p0 ? 0 : (int)lroundf((s - (float)p0) * YUV_RESIZE_WEIGHT_ONE);
+}
+
+// 逐像素参考实现：每个输出像素单独计算亮度和色度的源坐标，色度平面的缩放比例是亮度的两倍
+static void reference_model_input(const std::vector<uint8_t> &frame, uint32_t width, uint32_t height,
+                                  uint32_t hor_stride, uint32_t ver_stride, MppFrameFormat fmt,
+                                  const LetterboxInfo &info, int dst_w, int dst_h, rknn_tensor_format layout,
+                                  uint8_t pad_value, std::vector<uint8_t> &dst) {
+    dst.assign((size_t)dst_w * dst_h * 3, pad_value);
+    const uint8_t *y_plane = frame.data();
+    const uint8_t *c_plane = y_plane + hor_stride * ver_stride;
+    const uint8_t *v_plane = c_plane + hor_stride * ver_stride / 4;
+    for (int dy = 0; dy < info.resized_h; dy++) {
+        int y0, y1, wy, cy0, cy1, cwy;
+        reference_coord(dy, info.scale_h, (int)height, y0, y1, wy);
+        reference_coord(dy, info.scale_h * 2, (int)height / 2, cy0, cy1, cwy);
+        for (int dx = 0; dx < info.resized_w; dx++) {
+            int x0, x1, wx, cx0, cx1, cwx;
+            reference_coord(dx, info.scale_w, (int)width, x0, x1, wx);
+            reference_coord(dx, info.scale_w * 2, (int)width / 2, cx0, cx1, cwx);
+            auto luma = [&](int x, int y) { return (int)y_plane[y * hor_stride + x]; };
+            auto chroma = [&](int x, int y, int c) {
+                if (fmt == MPP_FMT_YUV420SP) {
+                    return (int)c_plane[y * hor_stride + x * 2 + c];
+                }
+                const uint8_t *plane = c == 0 ? c_plane : v_plane;
+                return (int)plane[y * hor_stride / 2 + x];
+            };
+            uint8_t yuv[3];
+            yuv[0] = yuv_bilinear(luma(x0, y0), luma(x1, y0), luma(x0, y1), luma(x1, y1), wx, wy);
+            for (int c = 0; c < 2; c++) {
+                yuv[c + 1] = yuv_bilinear(chroma(cx0, cy0, c), chroma(cx1, cy0, c),
+                                          chroma(cx0, cy1, c), chroma(cx1, cy1, c), cwx, cwy);
+            }
+            uint8_t rgb[3];
+            yuv_to_rgb_row_c(&yuv[0], &yuv[1], &yuv[2], &rgb[0], &rgb[1], &rgb[2], 1);
+            int out_x = info.pad_left + dx;
+            int out_y = info.pad_top + dy;
+            for (int c = 0; c < 3; c++) {
+                if (layout == RKNN_TENSOR_NHWC) {
+                    dst[((size_t)out_y * dst_w + out_x) * 3 + c] = rgb[c];
+                } else {
+                    dst[(size_t)c * dst_w * dst_h + (size_t)out_y * dst_w + out_x] = rgb[c];
+                }
+            }
+        }
+    }
+}
+
+// 融合转换缩放和逐像素参考实现逐位一致（随机帧，色度不平坦）
+static int test_fused_resize_exact(uint32_t width, uint32_t height, uint32_t hor_stride, uint32_t ver_stride,
+                                   int dst_w, int dst_h, rknn_tensor_format layout, bool keep_ratio) {
+    const MppFrameFormat fmts[2] = {MPP_FMT_YUV420SP, MPP_FMT_YUV420P};
+    const char *fmt_names[2] = {"nv12", "i420"};
+    std::vector<uint8_t> frame;
+    gen_frame(frame, hor_stride, ver_stride, width * 31 + height);
+    std::vector<uint8_t> fused((size_t)dst_w * dst_h * 3), reference;
+    for (int f = 0; f < 2; f++) {
+        LetterboxInfo info{};
+        frame_data_to_model_input(frame.data(), width, height, hor_stride, ver_stride, fmts[f],
+                                  fused.data(), dst_w, dst_h, layout, keep_ratio, 114, &info);
+        reference_model_input(frame, width, height, hor_stride, ver_stride, fmts[f], info,
+                              dst_w, dst_h, layout, 114, reference);
+        if (fused != reference) {
+            d_unit_test_error("%s %dx%d -> %dx%d fused resize mismatch reference",
+                              fmt_names[f], width, height, dst_w, dst_h)
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 原尺寸输出时色度边缘留在原位置：亮度平坦，色度在亮度 x = 32 处变化
+static int test_fused_chroma_edge() {
+    const uint32_t width = 64, height = 16;
+    std::vector<uint8_t> frame(width * height * 3 / 2, 128);
+    uint8_t *c_plane = frame.data() + width * height;
+    for (uint32_t row = 0; row < height / 2; row++) {
+        for (uint32_t col = width / 4; col < width / 2; col++) {
+            c_plane[row * width + col * 2] = 200;
+            c_plane[row * width + col * 2 + 1] = 60;
+        }
+    }
+    std::vector<uint8_t> rgb(width * height * 3);
+    frame_data_to_model_input(frame.data(), width, height, width, height, MPP_FMT_YUV420SP,
+                              rgb.data(), (int)width, (int)height, RKNN_TENSOR_NHWC, false, 114, nullptr);
+    // 边缘两侧各留两个像素的插值过渡
+    for (uint32_t x = 0; x < width; x++) {
+        if (x >= 30 && x < 34) {
+            continue;
+        }
+        uint32_t ref_x = x < 32 ? 0 : width - 1;
+        if (memcmp(&rgb[x * 3], &rgb[ref_x * 3], 3) != 0) {
+            d_unit_test_error("chroma edge moved, x %d differs from x %d", x, ref_x)
+            return -1;
+        }
+    }
+    if (memcmp(&rgb[0], &rgb[(width - 1) * 3], 3) == 0) {
+        d_unit_test_error("chroma edge lost")
+        return -1;
+    }
+    return 0;
+}
+
+// SIMD 行转换和标量实现逐位一致
+static int test_yuv_to_rgb_row() {
+    std::mt19937 rng(1037);
+    const int count = 1023;
+    std::vector<uint8_t> yuv(count * 3), simd_rgb(count * 3), c_rgb(count * 3);
+    for (int loop = 0; loop < 100; loop++) {
+        for (auto &v : yuv) {
+            v = (uint8_t)(rng() & 0xff);
+        }
+        yuv_to_rgb_row(yuv.data(), yuv.data() + count, yuv.data() + count * 2,
+                       simd_rgb.data(), simd_rgb.data() + count, simd_rgb.data() + count * 2, count);
+        yuv_to_rgb_row_c(yuv.data(), yuv.data() + count, yuv.data() + count * 2,
+                         c_rgb.data(), c_rgb.data() + count, c_rgb.data() + count * 2, count);
+        if (simd_rgb != c_rgb) {
+            d_unit_test_error("simd yuv to rgb mismatch")
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int test_copy_stride(uint32_t width, uint32_t height, uint32_t hor_stride, uint32_t ver_stride,
+                            uint32_t enc_hor_stride, uint32_t enc_ver_stride) {
+    std::vector<uint8_t> frame;
+    gen_frame(frame, hor_stride, ver_stride, width + 1);
+    std::vector<uint8_t> image(width * height * 3 / 2);
+    std::vector<uint8_t> legacy_buf(enc_hor_stride * enc_ver_stride * 3 / 2, 0);
+    std::vector<uint8_t> copy_buf(enc_hor_stride * enc_ver_stride * 3 / 2, 0);
+    const MppFrameFormat fmts[2] = {MPP_FMT_YUV420SP, MPP_FMT_YUV420P};
+    const char *fmt_names[2] = {"nv12", "i420"};
+    for (int f = 0; f < 2; f++) {
+        yuv_del_stride(frame.data(), width, height, hor_stride, ver_stride, fmts[f], image.data());
+        yuv_add_stride(image.data(), width, height, enc_hor_stride, enc_ver_stride, fmts[f], legacy_buf.data());
+        yuv_copy_stride(frame.data(), width, height, hor_stride, ver_stride, fmts[f],
+                        copy_buf.data(), enc_hor_stride, enc_ver_stride);
+        // 只比较有效像素（步长一致时整帧拷贝，padding 内容不同）
+        std::vector<uint8_t> legacy_image(image.size()), copy_image(image.size());
+        yuv_del_stride(legacy_buf.data(), width, height, enc_hor_stride, enc_ver_stride, fmts[f], legacy_image.data());
+        yuv_del_stride(copy_buf.data(), width, height, enc_hor_stride, enc_ver_stride, fmts[f], copy_image.data());
+        if (legacy_image != copy_image) {
+            d_unit_test_error("%s copy stride mismatch", fmt_names[f])
+            return -1;
+        }
+
+        time_unit t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            yuv_del_stride(frame.data(), width, height, hor_stride, ver_stride, fmts[f], image.data());
+            yuv_add_stride(image.data(), width, height, enc_hor_stride, enc_ver_stride, fmts[f], legacy_buf.data());
+        }
+        time_unit t_legacy = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            yuv_copy_stride(frame.data(), width, height, hor_stride, ver_stride, fmts[f],
+                            copy_buf.data(), enc_hor_stride, enc_ver_stride);
+        }
+        time_unit t_copy = getTimeOfNs() - t_start;
+        d_unit_test_warn("%s %dx%d stride [%d:%d] -> [%d:%d] avg: del + add stride %.3f ms, single copy %.3f ms",
+                         fmt_names[f], width, height, hor_stride, ver_stride, enc_hor_stride, enc_ver_stride,
+                         (double)t_legacy / TEST_LOOP_COUNT / 1e6,
+                         (double)t_copy / TEST_LOOP_COUNT / 1e6)
+    }
+    return 0;
+}
+
+int main() {
+    int ret = 0;
+    ret |= test_yuv_to_rgb_row();
+    ret |= test_chroma_order(64, 32, 64, 32);
+    ret |= test_chroma_order(64, 32, 128, 48);
+    // MPP 解码 1080p 时 ver_stride 按 16 对齐为 1088
+    ret |= test_frame_size(1920, 1080, 1920, 1088);
+    // 行有 padding 的情况
+    ret |= test_frame_size(1920, 1080, 2048, 1088);
+    ret |= test_frame_size(3840, 2160, 3840, 2160);
+    ret |= test_fused_resize(1920, 1080, 1920, 1088);
+    ret |= test_fused_resize(3840, 2160, 3840, 2160);
+    ret |= test_fused_chroma_edge();
+    ret |= test_fused_resize_exact(64, 48, 64, 48, 64, 48, RKNN_TENSOR_NHWC, false);
+    ret |= test_fused_resize_exact(1920, 1080, 2048, 1088, TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE,
+                                   RKNN_TENSOR_NHWC, true);
+    ret |= test_fused_resize_exact(100, 60, 128, 64, 160, 160, RKNN_TENSOR_NCHW, false);
+    // 编码器按解码帧步长初始化（整帧拷贝）和按 16 对齐初始化（逐行拷贝）
+    ret |= test_copy_stride(1920, 1080, 1920, 1088, 1920, 1088);
+    ret |= test_copy_stride(1920, 1080, 2048, 1088, 1920, 1088);
+    return ret;
+}
@@ -0,0 +1,283 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.30
+ * @brief: 多目标跟踪测试：匀速目标的外推误差，航迹关联（编号保持、类别隔离、丢失删除），
+ *         检测间隔随运动量调整，按流读取配置，以及模拟视频中检测帧比例和外推帧的 IoU
+ */
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <cstdio>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "object_tracker.h"
+
+// 模拟目标：匀速运动，碰到画面边缘反弹
+struct TestObject {
+    float x;
+    float y;
+    float w;
+    float h;
+    float vx;
+    float vy;
+    int class_id;
+
+    [[nodiscard]] TrackBox box() const { return {x, y, x + w, y + h, class_id, 0.8f, -1}; }
+
+    void step() {
+        x += vx;
+        y += vy;
+        if (x < 0 || x + w > 1920) {
+            vx = -vx;
+        }
+        if (y < 0 || y + h > 1080) {
+            vy = -vy;
+        }
+    }
+};
+
+int test_predict() {
+    ObjectTrackerConfig config;
+    config.enable = true;
+    ObjectTracker tracker(config);
+    TestObject object = {100, 200, 80, 160, 6, 2, 0};
+    int track_id = -1;
+    for (uint64_t frame = 0; frame < 15; frame++) {
+        std::vector<TrackBox> detections = {object.box()};
+        tracker.update(frame, detections);
+        if (frame > 0 && detections[0].track_id != track_id) {
+            d_unit_test_error("track id changed at frame %d", (int)frame)
+            return -1;
+        }
+        track_id = detections[0].track_id;
+        object.step();
+    }
+    // 外推 5 帧
+    for (int i = 0; i < 4; i++) {
+        object.step();
+    }
+    std::vector<TrackBox> tracks;
+    tracker.predict(19, tracks);
+    TrackBox truth = object.box();
+    if (tracks.size() != 1 || std::fabs(tracks[0].left - truth.left) > 3 || std::fabs(tracks[0].top - truth.top) > 3 ||
+        std::fabs(tracks[0].right - truth.right) > 3 || tracks[0].track_id != track_id) {
+        d_unit_test_error("predict error: %.1f %.1f, truth %.1f %.1f", tracks.empty() ? 0 : tracks[0].left,
+                          tracks.empty() ? 0 : tracks[0].top, truth.left, truth.top)
+        return -1;
+    }
+    // 乱序到达的旧结果被忽略
+    std::vector<TrackBox> stale = {object.box()};
+    CHECK_VAL(tracker.update(10, stale) != -1, d_unit_test_error("stale update accepted"); return -1;)
+    d_unit_test_info("predict pass")
+    return 0;
+}
+
+int test_association() {
+    ObjectTrackerConfig config;
+    config.enable = true;
+    config.max_misses = 2;
+    ObjectTracker tracker(config);
+    // 两个相向运动的目标，以及与第一个目标重叠的另一类别目标
+    TestObject a = {100, 300, 100, 200, 20, 0, 0};
+    TestObject b = {1700, 600, 100, 200, -20, 0, 0};
+    TestObject c = {100, 300, 100, 200, 20, 0, 1};
+    int ids[3] = {-1, -1, -1};
+    for (uint64_t frame = 0; frame < 40; frame++) {
+        std::vector<TrackBox> detections = {a.box(), b.box(), c.box()};
+        tracker.update(frame, detections);
+        for (int i = 0; i < 3; i++) {
+            if (frame > 0 && detections[i].track_id != ids[i]) {
+                d_unit_test_error("object %d switched track at frame %d", i, (int)frame)
+                return -1;
+            }
+            ids[i] = detections[i].track_id;
+        }
+        a.step();
+        b.step();
+        c.step();
+    }
+    CHECK_VAL(ids[0] == ids[1] || ids[0] == ids[2], d_unit_test_error("objects share a track"); return -1;)
+
+    // 目标 b 消失，连续 max_misses 次检测没有关联上后删除
+    for (uint64_t frame = 40; frame < 42; frame++) {
+        std::vector<TrackBox> detections = {a.box(), c.box()};
+        tracker.update(frame, detections);
+        a.step();
+        c.step();
+    }
+    CHECK_VAL(tracker.track_count() != 2, d_unit_test_error("lost track not deleted: %d", tracker.track_count()); return -1;)
+    // 新目标创建新航迹
+    std::vector<TrackBox> detections = {a.box(), c.box(), b.box()};
+    tracker.update(42, detections);
+    if (detections[2].track_id == ids[1] || tracker.track_count() != 3) {
+        d_unit_test_error("new object not tracked")
+        return -1;
+    }
+    d_unit_test_info("association pass")
+    return 0;
+}
+
+int test_interval() {
+    ObjectTrackerConfig config;
+    config.enable = true;
+    config.max_interval = 8;
+
+    // 静止目标：检测间隔增加到最大值
+    ObjectTracker still(config);
+    TestObject object = {500, 500, 100, 200, 0, 0, 0};
+    for (uint64_t frame = 0; frame < 100; frame++) {
+        if (still.should_detect(frame)) {
+            std::vector<TrackBox> detections = {object.box()};
+            still.update(frame, detections);
+        }
+    }
+    ObjectTrackerStats stats = still.get_stats();
+    if (stats.interval != 8 || stats.detect_frames > 20) {
+        d_unit_test_error("still scene interval %d, detect frames %d", (int)stats.interval, (int)stats.detect_frames)
+        return -1;
+    }
+
+    // 快速目标：每帧移动目标高度的 0.3 倍，每帧检测
+    ObjectTracker fast(config);
+    object = {100, 100, 25, 50, 15, 0, 0};
+    for (uint64_t frame = 0; frame < 100; frame++) {
+        if (fast.should_detect(frame)) {
+            std::vector<TrackBox> detections = {object.box()};
+            fast.update(frame, detections);
+        }
+        object.step();
+    }
+    stats = fast.get_stats();
+    if (stats.interval != 1 || stats.detect_frames < 90) {
+        d_unit_test_error("fast scene interval %d, detect frames %d", (int)stats.interval, (int)stats.detect_frames)
+        return -1;
+    }
+
+    // 目标出现：下一帧就检测
+    std::vector<TrackBox> detections = {TestObject{500, 500, 100, 200, 0, 0, 0}.box(),
+                                        TestObject{900, 500, 100, 200, 0, 0, 0}.box()};
+    uint64_t frame = 200;
+    while (!still.should_detect(frame)) {
+        frame++;
+    }
+    still.update(frame, detections);
+    CHECK_VAL(!still.should_detect(frame + 1), d_unit_test_error("new object should shorten interval"); return -1;)
+    d_unit_test_info("interval pass")
+    return 0;
+}
+
+int test_config() {
+    const char *path = "/tmp/test_tracker_streams.properties";
+    std::ofstream file(path);
+    file << "motion.mode = roi\n"
+         << "tracker.1.enable = false\n"
+         << "tracker.enable = true\n"
+         << "tracker.max_interval = 12\n"
+         << "tracker.2.iou_threshold = 0.5\n";
+    file.close();
+    ObjectTrackerConfigSet config_set;
+    CHECK_VAL(load_object_tracker_config(path, config_set) != 0, d_unit_test_error("load config failed"); return -1;)
+    const ObjectTrackerConfig &c1 = config_set.get(1);
+    const ObjectTrackerConfig &c2 = config_set.get(2);
+    const ObjectTrackerConfig &c3 = config_set.get(3);
+    if (c1.enable || c1.max_interval != 12 || !c2.enable || std::fabs(c2.iou_threshold - 0.5f) > 1e-6 ||
+        !c3.enable || std::fabs(c3.iou_threshold - 0.3f) > 1e-6) {
+        d_unit_test_error("config mismatch")
+        return -1;
+    }
+    remove(path);
+    d_unit_test_info("config pass")
+    return 0;
+}
+
+/**
+ * @brief 模拟视频：8 个不同速度的目标，检测框带噪声，检测结果晚 2 帧返回（流水线延迟），
+ *        统计检测帧比例、外推帧与真值的平均 IoU 以及跟踪耗时
+ */
+int test_sequence() {
+    ObjectTrackerConfig config;
+    config.enable = true;
+    ObjectTracker tracker(config);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-2, 2);
+    std::vector<TestObject> objects;
+    for (int i = 0; i < 8; i++) {
+        float speed = i < 4 ? 0.5f : 4.0f;
+        objects.push_back({(float)(100 + i * 200), (float)(100 + (i % 4) * 200), 80, 160,
+                           speed * (i % 2 == 0 ? 1 : -1), speed / 2, i % 3});
+    }
+
+    const int frame_num = 300;
+    const int latency = 2;
+    std::vector<std::pair<uint64_t, std::vector<TrackBox>>> pending;
+    double iou_sum = 0;
+    int iou_count = 0;
+    time_unit track_ns = 0;
+    for (uint64_t frame = 0; frame < frame_num; frame++) {
+        std::vector<TrackBox> truth;
+        for (auto &object : objects) {
+            truth.push_back(object.box());
+        }
+        time_unit t_start = getTimeOfNs();
+        // 返回 latency 帧之前调度的检测
+        while (!pending.empty() && pending.front().first + latency <= frame) {
+            tracker.update(pending.front().first, pending.front().second);
+            pending.erase(pending.begin());
+        }
+        bool detect = tracker.should_detect(frame);
+        std::vector<TrackBox> tracks;
+        if (!detect) {
+            tracker.predict(frame, tracks);
+        }
+        track_ns += getTimeOfNs() - t_start;
+
+        if (detect) {
+            std::vector<TrackBox> detections = truth;
+            for (auto &box : detections) {
+                float dx = noise(rng), dy = noise(rng);
+                box.left += dx;
+                box.right += dx;
+                box.top += dy;
+                box.bottom += dy;
+            }
+            pending.emplace_back(frame, detections);
+        } else if (frame > 10) {
+            // 每个真值取 IoU 最大的外推框
+            for (auto &t : truth) {
+                float best = 0;
+                for (auto &box : tracks) {
+                    best = std::max(best, box.class_id == t.class_id ? ObjectTracker::iou(t, box) : 0.0f);
+                }
+                iou_sum += best;
+                iou_count++;
+            }
+        }
+        for (auto &object : objects) {
+            object.step();
+        }
+    }
+    ObjectTrackerStats stats = tracker.get_stats();
+    double mean_iou = iou_count == 0 ? 0 : iou_sum / iou_count;
+    d_unit_test_warn("sequence: detect %d / %d frames (early %d), tracked frame iou %.3f, interval %d, tracker %.3f us per frame",
+                     (int)stats.detect_frames, frame_num, (int)stats.early_detects, mean_iou, (int)stats.interval,
+                     (double)track_ns / frame_num / 1000.0)
+    // 目标在画面边缘反弹时外推方向错误，可能丢失后重新创建航迹
+    if (stats.detect_frames > frame_num / 2 || mean_iou < 0.7 || stats.created_tracks > objects.size() + 4) {
+        d_unit_test_error("sequence failed, created tracks %d", (int)stats.created_tracks)
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int ret = test_predict();
+    ret |= test_association();
+    ret |= test_interval();
+    ret |= test_config();
+    ret |= test_sequence();
+    return ret;
+}
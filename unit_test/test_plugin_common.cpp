@@ -0,0 +1,166 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.15
+ * @brief: 插件公用函数测试，top-K 结果正确性以及和原有多次遍历实现的耗时对比
+ */
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "plugin_common.h"
+
+#define TEST_TOP_NUM 5
+#define TEST_LOOP_COUNT 200
+
+// 原有实现：top_num 次全量遍历（只对 top_num = 5 正确）
+static void legacy_get_top(const float *p_prob, float *p_max_prob, uint32_t *p_max_class,
+                           uint32_t output_count, uint32_t top_num) {
+    uint32_t i, j;
+    memset(p_max_prob, 0, sizeof(float) * top_num);
+    memset(p_max_class, 0xff, sizeof(uint32_t) * top_num);
+    for (j = 0; j < top_num; j++) {
+        for (i = 0; i < output_count; i++) {
+            if ((i == *(p_max_class + 0)) || (i == *(p_max_class + 1)) || (i == *(p_max_class + 2)) ||
+                (i == *(p_max_class + 3)) || (i == *(p_max_class + 4))) {
+                continue;
+            }
+            if (p_prob[i] > *(p_max_prob + j)) {
+                *(p_max_prob + j) = p_prob[i];
+                *(p_max_class + j) = i;
+            }
+        }
+    }
+}
+
+// 参考结果：按值从大到小（相同值下标小的在前）完整排序
+template<typename T>
+static std::vector<uint32_t> reference_top_k(const std::vector<T> &data, uint32_t top_num) {
+    std::vector<uint32_t> index(data.size());
+    for (uint32_t i = 0; i < index.size(); i++) {
+        index[i] = i;
+    }
+    std::stable_sort(index.begin(), index.end(), [&data](uint32_t a, uint32_t b) {
+        return PluginTensorTraits<T>::load(data[a]) > PluginTensorTraits<T>::load(data[b]);
+    });
+    index.resize(std::min<size_t>(top_num, index.size()));
+    return index;
+}
+
+template<typename T>
+static int check_top_k(const char *type_name, const std::vector<T> &data, uint32_t top_num) {
+    std::vector<float> top_prob(top_num);
+    std::vector<uint32_t> top_class(top_num);
+    uint32_t k = rknn_plugin_top_k(data.data(), (uint32_t)data.size(), top_prob.data(), top_class.data(), top_num);
+    std::vector<uint32_t> expect = reference_top_k(data, top_num);
+    if (k != expect.size() || !std::equal(expect.begin(), expect.end(), top_class.begin())) {
+        d_unit_test_error("%s top %d mismatch, n: %d", type_name, top_num, (int)data.size())
+        return -1;
+    }
+    return 0;
+}
+
+// fp32 转 fp16（只用于生成测试数据，截断尾数）
+static uint16_t fp32_to_fp16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    if (exp <= 0) {
+        return sign;
+    }
+    return sign | (exp << 10) | ((bits >> 13) & 0x3ff);
+}
+
+int test_top_k() {
+    std::mt19937 rng(1037);
+    std::uniform_real_distribution<float> prob_dist(0.0, 1.0);
+    std::uniform_int_distribution<int> int8_dist(-128, 127);
+
+    const uint32_t sizes[3] = {1000, 10000, 100000};
+    for (uint32_t n : sizes) {
+        std::vector<float> f32_data(n);
+        std::vector<uint16_t> f16_data(n);
+        std::vector<int8_t> i8_data(n);
+        for (uint32_t i = 0; i < n; i++) {
+            f32_data[i] = prob_dist(rng);
+            f16_data[i] = fp32_to_fp16(f32_data[i]);
+            i8_data[i] = (int8_t)int8_dist(rng);
+        }
+
+        // 正确性：不同 K（int8 和 fp16 有大量相同值）
+        const uint32_t top_nums[4] = {1, TEST_TOP_NUM, 20, 100};
+        for (uint32_t top_num : top_nums) {
+            if (check_top_k("float", f32_data, top_num) != 0 ||
+                check_top_k("fp16", f16_data, top_num) != 0 ||
+                check_top_k("int8", i8_data, top_num) != 0) {
+                return -1;
+            }
+        }
+
+        // 耗时对比
+        float top_prob[TEST_TOP_NUM];
+        uint32_t top_class[TEST_TOP_NUM];
+        time_unit t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            legacy_get_top(f32_data.data(), top_prob, top_class, n, TEST_TOP_NUM);
+        }
+        time_unit t_legacy = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            rknn_plugin_top_k(f32_data.data(), n, top_prob, top_class, TEST_TOP_NUM);
+        }
+        time_unit t_float = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            rknn_plugin_top_k(i8_data.data(), n, top_prob, top_class, TEST_TOP_NUM, 0, 0.1f);
+        }
+        time_unit t_int8 = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            rknn_plugin_top_k(f32_data.data(), n, top_prob, top_class, TEST_TOP_NUM, 0, 1.0f, true);
+        }
+        time_unit t_softmax = getTimeOfNs() - t_start;
+        d_unit_test_warn("n: %d, top%d avg(us) legacy: %.2f, float: %.2f, int8: %.2f, float+softmax: %.2f",
+                         n, TEST_TOP_NUM,
+                         (double)t_legacy / TEST_LOOP_COUNT / 1e3,
+                         (double)t_float / TEST_LOOP_COUNT / 1e3,
+                         (double)t_int8 / TEST_LOOP_COUNT / 1e3,
+                         (double)t_softmax / TEST_LOOP_COUNT / 1e3)
+    }
+
+    // softmax 概率和直接计算一致
+    std::vector<float> logits = {1.0f, 3.0f, 2.0f, 0.5f};
+    float top_prob[2];
+    uint32_t top_class[2];
+    rknn_plugin_top_k(logits.data(), (uint32_t)logits.size(), top_prob, top_class, 2, 0, 1.0f, true);
+    float exp_sum = expf(1.0f) + expf(3.0f) + expf(2.0f) + expf(0.5f);
+    if (top_class[0] != 1 || top_class[1] != 2 || fabsf(top_prob[0] - expf(3.0f) / exp_sum) > 1e-6) {
+        d_unit_test_error("softmax top k mismatch, class %d %d prob %f", top_class[0], top_class[1], top_prob[0])
+        return -1;
+    }
+    // 量化输出直接选取，只对选出的元素反量化
+    std::vector<int8_t> qnt_output = {-10, 20, 5, 20, -128, 127, 0};
+    rknn_output output{};
+    output.want_float = 0;
+    output.buf = qnt_output.data();
+    output.size = qnt_output.size();
+    rknn_tensor_attr attr{};
+    attr.type = RKNN_TENSOR_INT8;
+    attr.zp = -128;
+    attr.scale = 0.5f;
+    uint32_t k = rknn_plugin_output_top_k(output, attr, top_prob, top_class, 2);
+    if (k != 2 || top_class[0] != 5 || top_class[1] != 1 || top_prob[0] != 127.5f || top_prob[1] != 74.0f) {
+        d_unit_test_error("quantized output top k mismatch, class %d %d prob %f %f",
+                          top_class[0], top_class[1], top_prob[0], top_prob[1])
+        return -1;
+    }
+    d_unit_test_info("top k test pass")
+    return 0;
+}
+
+int main() {
+    return test_top_k();
+}
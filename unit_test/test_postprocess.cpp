@@ -0,0 +1,329 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.14
+ * @brief: 检测后处理测试，对比通用检测头解码器和原有 post_process 的结果和耗时
+ */
+#include <string>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "postprocess.h"
+#include "detect_decoder.h"
+
+#define TEST_MODEL_IN_SIZE 640
+#define TEST_LOOP_COUNT 200
+#define TEST_LABEL_PATH "./model/coco_80_labels_list.txt"
+
+// 检测解码器的类别名称文件，不存在时生成一份
+static void prepare_label_file() {
+    FILE *fp = fopen(TEST_LABEL_PATH, "r");
+    if (fp != nullptr) {
+        fclose(fp);
+        return;
+    }
+    mkdir("./model", 0755);
+    fp = fopen(TEST_LABEL_PATH, "w");
+    if (fp == nullptr) {
+        return;
+    }
+    for (int i = 0; i < OBJ_CLASS_NUM; i++) {
+        fprintf(fp, "class_%d\n", i);
+    }
+    fclose(fp);
+}
+
+// 生成 YOLOv5 三个检测头的 int8 输出，绝大部分位置低于阈值，随机放置少量目标
+// same_conf 为 false 时目标置信度互不相同，为 true 时全部相同（用于检查同分排序）
+static void gen_yolo_v5_outputs(std::vector<std::vector<int8_t>> &outputs, int object_num, uint32_t seed,
+                                bool same_conf = false, int model_in_size = TEST_MODEL_IN_SIZE) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> noise(-128, -60);
+    std::uniform_int_distribution<int> value(-40, 40);
+    const int strides[3] = {8, 16, 32};
+    outputs.resize(3);
+    for (int head = 0; head < 3; head++) {
+        int grid = model_in_size / strides[head];
+        int grid_len = grid * grid;
+        outputs[head].resize(3 * PROP_BOX_SIZE * grid_len);
+        for (auto &v : outputs[head]) {
+            v = (int8_t)noise(rng);
+        }
+        for (int obj = 0; obj < object_num; obj++) {
+            int a = (int)(rng() % 3);
+            int pos = (int)(rng() % grid_len);
+            int cls = (int)(rng() % OBJ_CLASS_NUM);
+            int8_t *base = outputs[head].data() + PROP_BOX_SIZE * a * grid_len + pos;
+            for (int c = 0; c < 4; c++) {
+                base[c * grid_len] = (int8_t)value(rng);
+            }
+            base[4 * grid_len] = (int8_t)(same_conf ? 100 : -20 + head * object_num + obj);
+            base[(5 + cls) * grid_len] = 100;
+        }
+    }
+}
+
+int test_yolo_v5_decoder() {
+    prepare_label_file();
+    std::vector<std::vector<int8_t>> outputs;
+    gen_yolo_v5_outputs(outputs, 40, 1037);
+
+    std::vector<int32_t> qnt_zps = {0, 0, 0};
+    std::vector<float> qnt_scales = {0.05, 0.05, 0.05};
+
+    DetectHeadDesc desc;
+    desc.dtype_auto = false;
+    desc.layout_auto = false;
+    desc.quant.resize(3);
+    for (int i = 0; i < 3; i++) {
+        desc.quant[i].zp = qnt_zps[i];
+        desc.quant[i].scale = qnt_scales[i];
+    }
+    desc.label_path = TEST_LABEL_PATH;
+    DetectDecoder decoder(desc);
+    if (!decoder.is_init()) {
+        d_unit_test_error("DetectDecoder init failed!")
+        return -1;
+    }
+
+    // 结果对比
+    detect_result_group_t legacy_group;
+    post_process(outputs[0].data(), outputs[1].data(), outputs[2].data(),
+                 TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE, BOX_THRESH, NMS_THRESH, 1.0, 1.0,
+                 qnt_zps, qnt_scales, &legacy_group);
+    void *output_bufs[3] = {outputs[0].data(), outputs[1].data(), outputs[2].data()};
+    DetectResultGroup group;
+    decoder.decode(output_bufs, 3, TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE, 1.0, 1.0, group);
+    d_unit_test_info("legacy result count: %d, decoder result count: %d", legacy_group.count, group.count)
+    if (legacy_group.count != group.count) {
+        d_unit_test_error("result count mismatch!")
+        return -1;
+    }
+    for (int i = 0; i < group.count; i++) {
+        const detect_result_t &a = legacy_group.results[i];
+        const detect_result_t &b = group.results[i];
+        if (a.box.left != b.box.left || a.box.top != b.box.top ||
+            a.box.right != b.box.right || a.box.bottom != b.box.bottom ||
+            a.prop != b.prop || a.class_id != b.class_id) {
+            d_unit_test_error("result %d mismatch! legacy %d (%d %d %d %d) %f, decoder %d (%d %d %d %d) %f", i,
+                              a.class_id, a.box.left, a.box.top, a.box.right, a.box.bottom, a.prop,
+                              b.class_id, b.box.left, b.box.top, b.box.right, b.box.bottom, b.prop)
+            return -1;
+        }
+    }
+    // 类别名称查表
+    if (strcmp(decoder.class_name(7), "class_7") != 0 || strcmp(decoder.class_name(OBJ_CLASS_NUM), "") != 0) {
+        d_unit_test_error("class name lookup mismatch: %s", decoder.class_name(7))
+        return -1;
+    }
+
+    // 耗时对比
+    time_unit t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        post_process(outputs[0].data(), outputs[1].data(), outputs[2].data(),
+                     TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE, BOX_THRESH, NMS_THRESH, 1.0, 1.0,
+                     qnt_zps, qnt_scales, &legacy_group);
+    }
+    time_unit t_legacy = getTimeOfNs() - t_start;
+
+    t_start = getTimeOfNs();
+    for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+        decoder.decode(output_bufs, 3, TEST_MODEL_IN_SIZE, TEST_MODEL_IN_SIZE, 1.0, 1.0, group);
+    }
+    time_unit t_decoder = getTimeOfNs() - t_start;
+    d_unit_test_warn("post_process avg: %.3f ms, detect decoder avg: %.3f ms",
+                     (double)t_legacy / TEST_LOOP_COUNT / 1e6,
+                     (double)t_decoder / TEST_LOOP_COUNT / 1e6)
+    return 0;
+}
+
+static bool same_result_group(const DetectResultGroup &a, const DetectResultGroup &b) {
+    if (a.count != b.count) {
+        return false;
+    }
+    for (int i = 0; i < a.count; i++) {
+        const detect_result_t &ra = a.results[i];
+        const detect_result_t &rb = b.results[i];
+        if (memcmp(&ra.box, &rb.box, sizeof(BOX_RECT)) != 0 || ra.prop != rb.prop || ra.class_id != rb.class_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int test_parallel_decoder() {
+    DetectHeadDesc desc;
+    desc.dtype_auto = false;
+    desc.layout_auto = false;
+    desc.quant.resize(3);
+    for (auto &quant : desc.quant) {
+        quant.zp = 0;
+        quant.scale = 0.05;
+    }
+    desc.label_path = TEST_LABEL_PATH;
+    DetectDecoder sequential_decoder(desc);
+    desc.decode_threads = 3;
+    DetectDecoder parallel_decoder(desc);
+    if (!sequential_decoder.is_init() || !parallel_decoder.is_init()) {
+        d_unit_test_error("DetectDecoder init failed!")
+        return -1;
+    }
+
+    // 640 输入不分块，1280 输入分块；分数互不相同、大量同分两种情况下，结果都要和顺序解码完全一致
+    const int model_in_sizes[2] = {TEST_MODEL_IN_SIZE, 2 * TEST_MODEL_IN_SIZE};
+    for (int model_in_size : model_in_sizes) {
+        for (int same_conf = 0; same_conf < 2; same_conf++) {
+            std::vector<std::vector<int8_t>> outputs;
+            gen_yolo_v5_outputs(outputs, 40, 2023, same_conf, model_in_size);
+            void *output_bufs[3] = {outputs[0].data(), outputs[1].data(), outputs[2].data()};
+            DetectResultGroup sequential_group;
+            DetectResultGroup parallel_group;
+            sequential_decoder.decode(output_bufs, 3, model_in_size, model_in_size, 1.0, 1.0, sequential_group);
+            parallel_decoder.decode(output_bufs, 3, model_in_size, model_in_size, 1.0, 1.0, parallel_group);
+            if (!same_result_group(sequential_group, parallel_group)) {
+                d_unit_test_error("parallel decode result mismatch, model_in_size: %d, same_conf: %d",
+                                  model_in_size, same_conf)
+                return -1;
+            }
+        }
+    }
+
+    for (int model_in_size : model_in_sizes) {
+        std::vector<std::vector<int8_t>> outputs;
+        gen_yolo_v5_outputs(outputs, 40, 1037, false, model_in_size);
+        void *output_bufs[3] = {outputs[0].data(), outputs[1].data(), outputs[2].data()};
+        DetectResultGroup group;
+        time_unit t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            sequential_decoder.decode(output_bufs, 3, model_in_size, model_in_size, 1.0, 1.0, group);
+        }
+        time_unit t_sequential = getTimeOfNs() - t_start;
+        t_start = getTimeOfNs();
+        for (int loop = 0; loop < TEST_LOOP_COUNT; loop++) {
+            parallel_decoder.decode(output_bufs, 3, model_in_size, model_in_size, 1.0, 1.0, group);
+        }
+        time_unit t_parallel = getTimeOfNs() - t_start;
+        d_unit_test_warn("model in %d, sequential decode avg: %.3f ms, parallel decode(3 threads) avg: %.3f ms",
+                         model_in_size,
+                         (double)t_sequential / TEST_LOOP_COUNT / 1e6,
+                         (double)t_parallel / TEST_LOOP_COUNT / 1e6)
+    }
+    return 0;
+}
+
+int test_dfl_decoder() {
+    // 单个 fp32 检测头，在 (row 3, col 5) 放置一个类别 2 的目标
+    const int class_num = 3;
+    const int reg_max = 4;
+    const int stride = 8;
+    const int grid = 8;
+    const int grid_len = grid * grid;
+    std::vector<float> box_tensor(4 * reg_max * grid_len, 0.0);
+    std::vector<float> cls_tensor(class_num * grid_len, 0.0);
+    const int pos = 3 * grid + 5;
+    cls_tensor[2 * grid_len + pos] = 0.9;
+    // 四条边的分布都集中在 bin 1（距离为 1）
+    for (int side = 0; side < 4; side++) {
+        box_tensor[(side * reg_max + 1) * grid_len + pos] = 20.0;
+    }
+
+    DetectHeadDesc desc;
+    desc.head_type = DETECT_HEAD_DFL;
+    desc.class_num = class_num;
+    desc.strides = {stride};
+    desc.reg_max = reg_max;
+    desc.tensors_per_stride = 2;
+    desc.apply_sigmoid = false;
+    desc.dtype_auto = false;
+    desc.dtype = RKNN_TENSOR_FLOAT32;
+    desc.layout_auto = false;
+    desc.label_path = "";
+    DetectDecoder decoder(desc);
+    if (!decoder.is_init()) {
+        d_unit_test_error("DetectDecoder init failed!")
+        return -1;
+    }
+
+    void *output_bufs[2] = {box_tensor.data(), cls_tensor.data()};
+    DetectResultGroup group;
+    decoder.decode(output_bufs, 2, grid * stride, grid * stride, 1.0, 1.0, group);
+    if (group.count != 1) {
+        d_unit_test_error("dfl result count %d != 1", group.count)
+        return -1;
+    }
+    // 中心 (5.5, 3.5) * 8，左上右下各 1 * 8
+    const BOX_RECT &box = group.results[0].box;
+    if (box.left != 36 || box.top != 20 || box.right != 52 || box.bottom != 36) {
+        d_unit_test_error("dfl box mismatch (%d %d %d %d)", box.left, box.top, box.right, box.bottom)
+        return -1;
+    }
+    d_unit_test_info("dfl decoder pass, prop: %f", group.results[0].prop)
+    return 0;
+}
+
+// 模型输出特征：NCHW，c x h x w
+static rknn_tensor_attr make_tensor_attr(uint32_t c, uint32_t h, uint32_t w) {
+    rknn_tensor_attr attr{};
+    attr.n_dims = 4;
+    attr.fmt = RKNN_TENSOR_NCHW;
+    attr.type = RKNN_TENSOR_INT8;
+    attr.dims[0] = 1;
+    attr.dims[1] = c;
+    attr.dims[2] = h;
+    attr.dims[3] = w;
+    attr.n_elems = c * h * w;
+    attr.scale = 1.0;
+    return attr;
+}
+
+int test_resolve_desc() {
+    rknn_tensor_attr input_attr{};
+    input_attr.n_dims = 4;
+    input_attr.fmt = RKNN_TENSOR_NHWC;
+    input_attr.dims[0] = 1;
+    input_attr.dims[1] = TEST_MODEL_IN_SIZE;
+    input_attr.dims[2] = TEST_MODEL_IN_SIZE;
+    input_attr.dims[3] = 3;
+    // 官方 YOLOv5：3 个 anchor * (5 + 80) 个通道
+    rknn_tensor_attr output_attr[3] = {make_tensor_attr(255, 80, 80), make_tensor_attr(255, 40, 40),
+                                       make_tensor_attr(255, 20, 20)};
+    DetectHeadDesc desc;
+    CHECK_VAL(resolve_detect_head_desc(desc, input_attr, output_attr, 3) != 0,
+              d_unit_test_error("resolve yolov5 head failed"); return -1;)
+
+    // 类别数与模型不一致
+    desc = DetectHeadDesc();
+    desc.class_num = 20;
+    CHECK_VAL(resolve_detect_head_desc(desc, input_attr, output_attr, 3) == 0,
+              d_unit_test_error("class num mismatch accepted"); return -1;)
+    // 步长与模型不一致
+    desc = DetectHeadDesc();
+    desc.strides = {8, 16, 16};
+    CHECK_VAL(resolve_detect_head_desc(desc, input_attr, output_attr, 3) == 0,
+              d_unit_test_error("stride mismatch accepted"); return -1;)
+
+    // DFL：框分布、类别分数两个输出
+    rknn_tensor_attr dfl_attr[2] = {make_tensor_attr(64, 80, 80), make_tensor_attr(80, 80, 80)};
+    desc = DetectHeadDesc();
+    desc.head_type = DETECT_HEAD_DFL;
+    desc.strides = {8};
+    CHECK_VAL(resolve_detect_head_desc(desc, input_attr, dfl_attr, 2) != 0,
+              d_unit_test_error("resolve dfl head failed"); return -1;)
+    desc.reg_max = 8;
+    CHECK_VAL(resolve_detect_head_desc(desc, input_attr, dfl_attr, 2) == 0,
+              d_unit_test_error("reg_max mismatch accepted"); return -1;)
+    d_unit_test_info("resolve detect head pass")
+    return 0;
+}
+
+int main() {
+    int ret = test_yolo_v5_decoder();
+    ret |= test_parallel_decoder();
+    ret |= test_dfl_decoder();
+    ret |= test_resolve_desc();
+    return ret;
+}
@@ -8,6 +8,7 @@
 #include "rknn_model.h"
 #include "utils_log.h"
 #include "rknn_infer_api.h"
+#include "plugin_common.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgcodecs.hpp"
@@ -48,32 +49,6 @@ static void dump_tensor_attr(rknn_tensor_attr* attr){
            get_qnt_type_string(attr->qnt_type), attr->zp, attr->scale);
 }
 
-static int rknn_plugin_GetTop(const float* pfProb, float* pfMaxProb, uint32_t* pMaxClass, uint32_t outputCount, uint32_t topNum){
-    uint32_t i, j;
-
-#define MAX_TOP_NUM 20
-    if (topNum > MAX_TOP_NUM)
-        return 0;
-
-    memset(pfMaxProb, 0, sizeof(float) * topNum);
-    memset(pMaxClass, 0xff, sizeof(float) * topNum);
-
-    for (j = 0; j < topNum; j++) {
-        for (i = 0; i < outputCount; i++) {
-            if ((i == *(pMaxClass + 0)) || (i == *(pMaxClass + 1)) || (i == *(pMaxClass + 2)) || (i == *(pMaxClass + 3)) ||
-                (i == *(pMaxClass + 4))) {
-                continue;
-            }
-
-            if (pfProb[i] > *(pfMaxProb + j)) {
-                *(pfMaxProb + j) = pfProb[i];
-                *(pMaxClass + j) = i;
-            }
-        }
-    }
-    return 1;
-}
-
 int test_rknn_model(){
     std::string model_path = "model/RK3566_RK3568/mobilenet_v1.rknn";
     std::string image_path   = "model/dog_224x224.jpg";
@@ -113,20 +88,18 @@ int test_rknn_model(){
     output_unit->n_outputs = 1;
     output_unit->outputs = (rknn_output*)malloc(output_unit->n_outputs * sizeof(rknn_output));
     memset(output_unit->outputs, 0, output_unit->n_outputs * sizeof(rknn_output));
-    output_unit->outputs[0].want_float = 1;
+    output_unit->outputs[0].want_float = 0;
 
     model.model_infer_sync(input_unit->n_inputs, input_unit->inputs, output_unit->n_outputs, output_unit->outputs);
 
     for (int i = 0; i < 1; i++) {
         uint32_t MaxClass[5];
         float    fMaxProb[5];
-        auto*   buffer = (float*)output_unit->outputs[i].buf;
-        uint32_t sz     = output_unit->outputs[i].size / 4;
-
-        rknn_plugin_GetTop(buffer, fMaxProb, MaxClass, sz, 5);
+        uint32_t top_num = rknn_plugin_output_top_k(
+                output_unit->outputs[i], m_plugin_set_config.output_attr[i], fMaxProb, MaxClass, 5);
 
         printf(" --- Top5 ---\n");
-        for (int j = 0; j < 5; j++) {
+        for (uint32_t j = 0; j < top_num; j++) {
             printf("%3d: %8.6f\n", MaxClass[j], fMaxProb[j]);
         }
     }
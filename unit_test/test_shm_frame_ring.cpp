@@ -0,0 +1,298 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.26
+ * @brief: 共享内存帧环测试：同进程的取帧/超时/槽归还，采集进程异常退出后重连回收槽，出错的采集进程写入越界的槽和尺寸，
+ *         以及 fork 出的采集进程持续写入、多个推理线程乱序释放的压测
+ */
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "frame_source.h"
+#include "shm_frame_ring.h"
+
+#define TEST_SHM_NAME "/test_rknn_frames"
+
+// 帧内容：Y 平面开头写帧序号，其余按序号填充，抽查几个位置
+static void fill_test_frame(uint8_t *data, uint32_t width, uint32_t height, uint64_t index) {
+    size_t size = (size_t)width * height * 3 / 2;
+    memset(data, (int)(index & 0xff), size);
+    memcpy(data, &index, sizeof(index));
+}
+
+static int check_test_frame(const DecoderMppFrame &frame, uint64_t index) {
+    const auto *data = (const uint8_t *)frame.data_buf;
+    uint64_t head = 0;
+    memcpy(&head, data, sizeof(head));
+    auto value = (uint8_t)(index & 0xff);
+    size_t y_last = (size_t)(frame.ver_height - 1) * frame.hor_stride + frame.hor_width - 1;
+    size_t c_last = (size_t)frame.hor_stride * frame.ver_stride + (size_t)(frame.ver_height / 2 - 1) * frame.hor_stride +
+                    frame.hor_width - 1;
+    if (head != index || data[y_last] != value || data[c_last] != value) {
+        d_unit_test_error("frame %d content mismatch, head %d", (int)index, (int)head)
+        return -1;
+    }
+    return 0;
+}
+
+int test_local() {
+    FrameSourceOptions options;
+    options.width = 64;
+    options.height = 36;
+    options.max_frames = 2;
+    std::unique_ptr<FrameSource> source = create_frame_source("shm:" TEST_SHM_NAME, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create shm source failed"); return -1;)
+    ShmFrameProducer producer(TEST_SHM_NAME);
+    CHECK_VAL(!producer.is_init(), d_unit_test_error("attach producer failed"); return -1;)
+
+    // 没有帧时超时
+    DecoderMppFrame frames[2] = {};
+    if (source->get_next_frame(frames[0], 10) != 1) {
+        d_unit_test_error("empty ring should time out")
+        return -1;
+    }
+    std::vector<uint8_t> data(64 * 36 * 3 / 2);
+    for (uint64_t i = 0; i < 2; i++) {
+        fill_test_frame(data.data(), 64, 36, i);
+        if (producer.push_frame(data.data(), 64, 36, SHM_FRAME_NV12, (int64_t)i * 40, 0) != 0) {
+            d_unit_test_error("push frame %d failed", (int)i)
+            return -1;
+        }
+    }
+    // 两个槽都已发布，采集进程取不到空闲槽
+    ShmFrameSlot slot;
+    if (producer.acquire(slot, 10) != 1) {
+        d_unit_test_error("acquire should time out when all slots used")
+        return -1;
+    }
+    for (uint64_t i = 0; i < 2; i++) {
+        if (source->get_next_frame(frames[i], 0) != 0 || frames[i].frame_index != i || frames[i].pts_ms != (int64_t)i * 40 ||
+            frames[i].hor_stride != 64 || frames[i].ver_stride != 48 || check_test_frame(frames[i], i) != 0) {
+            d_unit_test_error("get frame %d failed", (int)i)
+            return -1;
+        }
+    }
+    // 释放第二帧后采集进程可以重用它的槽（两边映射地址不同，按槽序号比较）
+    source->release_frame(frames[1]);
+    if (producer.acquire(slot, 10) != 0 || slot.slot != 1) {
+        d_unit_test_error("released slot not reused")
+        return -1;
+    }
+    source->release_frame(frames[0]);
+
+    // 采集进程结束后取完剩余帧再返回结束
+    slot.width = 64;
+    slot.height = 36;
+    slot.hor_stride = 64;
+    slot.ver_stride = 36;
+    producer.publish(slot);
+    producer.close();
+    if (source->get_next_frame(frames[0], 10) != 0 || source->get_next_frame(frames[1], 10) != -1) {
+        d_unit_test_error("close failed")
+        return -1;
+    }
+    source->release_frame(frames[0]);
+    d_unit_test_info("local pass")
+    return 0;
+}
+
+int test_reattach() {
+    FrameSourceOptions options;
+    options.width = 64;
+    options.height = 36;
+    options.max_frames = 4;
+    std::unique_ptr<FrameSource> source = create_frame_source("shm:" TEST_SHM_NAME, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create shm source failed"); return -1;)
+
+    // 子进程占住所有槽后直接退出（不关闭）
+    pid_t pid = fork();
+    if (pid == 0) {
+        ShmFrameProducer producer(TEST_SHM_NAME);
+        ShmFrameSlot slot;
+        for (int i = 0; i < 4; i++) {
+            producer.acquire(slot, 0);
+        }
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    ShmFrameProducer producer(TEST_SHM_NAME);
+    ShmFrameSlot slot;
+    for (int i = 0; i < 4; i++) {
+        if (producer.acquire(slot, 0) != 0) {
+            d_unit_test_error("slot %d not reclaimed after reattach", i)
+            return -1;
+        }
+    }
+    // 推理侧退出后采集进程立即返回
+    source.reset();
+    if (producer.acquire(slot, -1) != -1) {
+        d_unit_test_error("acquire should fail after consumer closed")
+        return -1;
+    }
+    d_unit_test_info("reattach pass")
+    return 0;
+}
+
+// 出错的采集进程：直接改写就绪环和槽描述，推理侧跳过越界的槽和放不下的帧，共享内存只允许同一用户访问
+int test_bad_producer() {
+    FrameSourceOptions options;
+    options.width = 64;
+    options.height = 36;
+    options.max_frames = 4;
+    std::unique_ptr<FrameSource> source = create_frame_source("shm:" TEST_SHM_NAME, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create shm source failed"); return -1;)
+    struct stat st{};
+    if (stat("/dev/shm" TEST_SHM_NAME, &st) == 0 && (st.st_mode & 0077) != 0) {
+        d_unit_test_error("shm mode %o allows other users", (unsigned)(st.st_mode & 0777))
+        return -1;
+    }
+
+    ShmFrameRing ring(TEST_SHM_NAME);
+    CHECK_VAL(!ring.is_init(), d_unit_test_error("attach ring failed"); return -1;)
+    ShmFrameRingHeader *header = ring.header();
+    // 槽描述：0 越界的步长，1 宽度大于步长，2 正常
+    const uint32_t strides[3][4] = {{64, 36, 4096, 4096}, {128, 36, 64, 48}, {64, 36, 64, 48}};
+    for (uint32_t i = 0; i < 3; i++) {
+        ShmFrameSlotInfo &info = header->slots[i];
+        info.width = strides[i][0];
+        info.height = strides[i][1];
+        info.hor_stride = strides[i][2];
+        info.ver_stride = strides[i][3];
+        info.format = SHM_FRAME_NV12;
+        info.frame_index = i;
+        info.state.store(SHM_SLOT_READY);
+    }
+    // 就绪环中还有一个越界的槽序号
+    const uint32_t ready[4] = {1000, 0, 1, 2};
+    for (uint32_t i = 0; i < 4; i++) {
+        header->ready_ring[i] = ready[i];
+    }
+    header->ready_head.store(4);
+
+    DecoderMppFrame frame = {};
+    if (source->get_next_frame(frame, 10) != 0 || frame.frame_index != 2 || frame.hor_stride != 64) {
+        d_unit_test_error("bad frames not skipped")
+        return -1;
+    }
+    source->release_frame(frame);
+    // 被跳过的槽归还给采集进程
+    for (uint32_t i = 0; i < 3; i++) {
+        if (header->slots[i].state.load() != SHM_SLOT_FREE) {
+            d_unit_test_error("slot %d not freed", (int)i)
+            return -1;
+        }
+    }
+    d_unit_test_info("bad producer pass")
+    return 0;
+}
+
+/**
+ * @brief 子进程按最快速度写 frame_num 帧，thread_num 个线程取帧，每个线程攒几帧后乱序释放
+ */
+int test_producer_process(uint32_t width, uint32_t height, int frame_num, int slot_num, int thread_num) {
+    FrameSourceOptions options;
+    options.width = width;
+    options.height = height;
+    options.max_frames = slot_num;
+    std::unique_ptr<FrameSource> source = create_frame_source("shm:" TEST_SHM_NAME, options);
+    CHECK_VAL(source == nullptr, d_unit_test_error("create shm source failed"); return -1;)
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        ShmFrameProducer producer(TEST_SHM_NAME);
+        std::vector<uint8_t> data((size_t)width * height * 3 / 2);
+        for (int i = 0; i < frame_num; i++) {
+            // 直接写入槽（零拷贝），步长与宽高相同
+            ShmFrameSlot slot;
+            if (producer.acquire(slot, 5000) != 0) {
+                _exit(1);
+            }
+            fill_test_frame(slot.data, width, height, i);
+            slot.width = slot.hor_stride = width;
+            slot.height = slot.ver_stride = height;
+            slot.pts_ms = i;
+            if (producer.publish(slot) != 0) {
+                _exit(2);
+            }
+        }
+        producer.close();
+        _exit(0);
+    }
+
+    std::vector<std::atomic<int>> seen(frame_num);
+    std::atomic<int> errors{0};
+    std::vector<std::thread> threads;
+    time_unit t_start = getTimeOfNs();
+    for (int t = 0; t < thread_num; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            std::vector<DecoderMppFrame> held;
+            uint64_t last_index = 0;
+            while (true) {
+                DecoderMppFrame frame = {};
+                int ret = source->get_next_frame(frame, 5000);
+                if (ret != 0) {
+                    errors += ret > 0 ? 1 : 0;
+                    break;
+                }
+                // 同一线程取到的帧序号递增，每帧只出现一次
+                if (frame.frame_index >= (uint64_t)frame_num || (!held.empty() && frame.frame_index <= last_index) ||
+                    seen[frame.frame_index]++ != 0 || check_test_frame(frame, frame.frame_index) != 0) {
+                    errors++;
+                }
+                last_index = frame.frame_index;
+                held.push_back(frame);
+                if (held.size() >= 2 || rng() % 2 == 0) {
+                    std::shuffle(held.begin(), held.end(), rng);
+                    for (auto &h : held) {
+                        source->release_frame(h);
+                    }
+                    held.clear();
+                }
+            }
+            for (auto &h : held) {
+                source->release_frame(h);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = (double)(getTimeOfNs() - t_start) / 1e9;
+    int status = 0;
+    waitpid(pid, &status, 0);
+    int missing = 0;
+    for (auto &s : seen) {
+        missing += s == 1 ? 0 : 1;
+    }
+    MppDecoderStats stats = source->get_stats();
+    d_unit_test_warn("%dx%d %d slots %d threads: %d frames %.0f fps (%.0f MB/s), consumer wait %.1f ms",
+                     (int)width, (int)height, slot_num, thread_num, frame_num, frame_num / cost_s,
+                     frame_num / cost_s * width * height * 1.5 / 1e6, stats.consumer_wait_ms)
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || errors != 0 || missing != 0 ||
+        stats.decoded_frames != (uint64_t)frame_num) {
+        d_unit_test_error("producer exit %d, errors %d, missing %d", WEXITSTATUS(status), errors.load(), missing)
+        return -1;
+    }
+    return 0;
+}
+
+int main() {
+    int ret = test_local();
+    ret |= test_reattach();
+    ret |= test_bad_producer();
+    ret |= test_producer_process(640, 360, 5000, 8, 3);
+    ret |= test_producer_process(1920, 1080, 600, 4, 2);
+    return ret;
+}
@@ -0,0 +1,131 @@
+/**
+ * @author: bo.liu
+ * @mail: geniusrabbit@qq.com
+ * @date: 2023.08.22
+ * @brief: 单生产者单消费者队列测试：顺序与完整性、超时、关闭后取空，以及生产快/消费快两种节奏下的等待
+ */
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include "utils.h"
+#include "utils_log.h"
+#include "spsc_queue.h"
+
+#define TEST_ITEM_NUM 200000
+
+int test_order() {
+    SpscQueue<uint64_t> queue(5);
+    if (queue.capacity() != 8) {
+        d_unit_test_error("capacity not rounded: %d", (int)queue.capacity())
+        return -1;
+    }
+    std::thread producer([&queue] {
+        for (uint64_t i = 0; i < TEST_ITEM_NUM; i++) {
+            queue.push(i, -1);
+        }
+        queue.close();
+    });
+    uint64_t expect = 0;
+    uint64_t value = 0;
+    while (queue.pop(value, -1)) {
+        if (value != expect) {
+            d_unit_test_error("order mismatch: %llu != %llu", (unsigned long long)value, (unsigned long long)expect)
+            producer.join();
+            return -1;
+        }
+        expect++;
+    }
+    producer.join();
+    if (expect != TEST_ITEM_NUM) {
+        d_unit_test_error("item lost: %llu", (unsigned long long)expect)
+        return -1;
+    }
+    d_unit_test_info("order pass")
+    return 0;
+}
+
+int test_timeout_and_close() {
+    SpscQueue<int> queue(2);
+    int value = 0;
+    time_unit t_start = getTimeOfNs();
+    if (queue.pop(value, 50)) {
+        d_unit_test_error("pop from empty queue")
+        return -1;
+    }
+    double wait_ms = (double)(getTimeOfNs() - t_start) / 1e6;
+    if (wait_ms < 45 || wait_ms > 500) {
+        d_unit_test_error("pop timeout wrong: %.1f ms", wait_ms)
+        return -1;
+    }
+    if (!queue.try_push(1) || !queue.try_push(2) || queue.try_push(3) || queue.push(3, 10)) {
+        d_unit_test_error("full queue push")
+        return -1;
+    }
+    // 关闭前入队的元素仍然可以取出
+    queue.close();
+    if (!queue.pop(value, -1) || value != 1 || !queue.pop(value, -1) || value != 2 || queue.pop(value, -1)) {
+        d_unit_test_error("pop after close")
+        return -1;
+    }
+    // 关闭唤醒等待中的消费者
+    SpscQueue<int> wait_queue(2);
+    std::thread closer([&wait_queue] {
+        sleepUS(20 * 1000);
+        wait_queue.close();
+    });
+    bool popped = wait_queue.pop(value, -1);
+    closer.join();
+    if (popped) {
+        d_unit_test_error("pop from closed queue")
+        return -1;
+    }
+    d_unit_test_info("timeout and close pass")
+    return 0;
+}
+
+// 生产者每 produce_us 产生一个，消费者每个处理 consume_us
+int test_pacing(time_unit produce_us, time_unit consume_us) {
+    const int item_num = 200;
+    SpscQueue<int> queue(4);
+    time_unit producer_wait_ns = 0;
+    std::thread producer([&] {
+        for (int i = 0; i < item_num; i++) {
+            sleepUS(produce_us);
+            time_unit t_start = getTimeOfNs();
+            queue.push(i, -1);
+            producer_wait_ns += getTimeOfNs() - t_start;
+        }
+        queue.close();
+    });
+    time_unit consumer_wait_ns = 0;
+    int count = 0;
+    int value = 0;
+    while (true) {
+        time_unit t_start = getTimeOfNs();
+        bool popped = queue.pop(value, -1);
+        consumer_wait_ns += getTimeOfNs() - t_start;
+        if (!popped) {
+            break;
+        }
+        if (value != count++) {
+            d_unit_test_error("order mismatch")
+            producer.join();
+            return -1;
+        }
+        sleepUS(consume_us);
+    }
+    producer.join();
+    d_unit_test_warn("produce %d us, consume %d us: producer wait %.1f ms, consumer wait %.1f ms",
+                     (int)produce_us, (int)consume_us,
+                     (double)producer_wait_ns / 1e6, (double)consumer_wait_ns / 1e6)
+    return count == item_num ? 0 : -1;
+}
+
+int main() {
+    int ret = test_order();
+    ret |= test_timeout_and_close();
+    ret |= test_pacing(500, 1000);
+    ret |= test_pacing(1000, 500);
+    return ret;
+}